@@ -0,0 +1,699 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <functional>
+#include <optional>
+#include <print>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "BPE.h"
+#include "CompiledEncoder.h"
+#include "Core.h"
+#include "PairCountTable.h"
+#include "ParallelApply.h"
+#include "TokenCache.h"
+
+namespace
+{
+    const size_t PAIR_COUNT_TOKEN_COUNT{1 << 20};
+    const uint64_t SEED{42};
+
+    // Tokens expanded one by one by DecodeToken and generated by GenerateTokenString, both are far slower per token
+    const size_t DECODE_TOKEN_COUNT{1 << 16};
+    const uint GENERATE_TOKEN_COUNT{1 << 14};
+    const uint64_t GENERATE_STREAM_TOKEN_COUNT{1 << 22};
+
+    struct BenchOptions
+    {
+        std::vector<size_t> Sizes{256 * 1024, 1024 * 1024};
+        std::vector<std::string> InputFiles{};
+        int Warmup{1};
+        int Repetitions{3};
+        bool Json{false};
+        std::string Filter{};
+    };
+
+    struct Corpus
+    {
+        std::string Name;
+        std::string Text;
+    };
+
+    /*
+     * One line of the report. Throughputs use the fastest repetition, the median is there to judge the noise. Work that
+     * has no tokens or iterations reports zero for them.
+     */
+    struct Result
+    {
+        std::string Benchmark;
+        std::string Corpus;
+        uint64_t Bytes;
+        double BestSeconds;
+        double MedianSeconds;
+        double MegabytesPerSecond;
+        double TokensPerSecond;
+        double IterationsPerSecond;
+        // Peak resident set of the whole process so far, so it only grows from one line to the next
+        long PeakRssKib;
+    };
+
+    struct Work
+    {
+        uint64_t Bytes;
+        uint64_t Tokens;
+        uint64_t Iterations;
+    };
+
+    long PeakRssKib()
+    {
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+
+        return usage.ru_maxrss;
+    }
+
+    // Sends stdout to /dev/null while alive, for the functions that print as they go
+    class MutedStdout
+    {
+    public:
+        MutedStdout()
+        {
+            std::fflush(stdout);
+            m_SavedDescriptor = dup(STDOUT_FILENO);
+            int nullDescriptor{open("/dev/null", O_WRONLY)};
+            dup2(nullDescriptor, STDOUT_FILENO);
+            close(nullDescriptor);
+        }
+
+        ~MutedStdout()
+        {
+            std::fflush(stdout);
+            dup2(m_SavedDescriptor, STDOUT_FILENO);
+            close(m_SavedDescriptor);
+        }
+
+        MutedStdout(const MutedStdout&) = delete;
+        MutedStdout& operator=(const MutedStdout&) = delete;
+
+    private:
+        int m_SavedDescriptor;
+    };
+
+    std::string MakeRandomCorpus(size_t size)
+    {
+        std::mt19937_64 random{SEED};
+        std::uniform_int_distribution<int> byte{0, 255};
+
+        std::string text(size, '\0');
+        std::generate(text.begin(), text.end(), [&]() { return char(byte(random)); });
+
+        return text;
+    }
+
+    // A handful of lines repeated with a changing number, the kind of input logs and generated files consist of
+    std::string MakeRepetitiveCorpus(size_t size)
+    {
+        const std::pair<std::string_view, std::string_view> lines[]{
+            {"INFO  request handled in ", " ms by worker thread\n"},
+            {"DEBUG cache lookup for key ", " returned a hit\n"},
+            {"WARN  retrying connection attempt number ", "\n"},
+        };
+
+        std::string text{};
+        text.reserve(size + 64);
+
+        for (size_t i{0}; text.size() < size; ++i)
+        {
+            auto [prefix, suffix]{lines[i % std::size(lines)]};
+            text += prefix;
+            text += std::to_string(i % 1000);
+            text += suffix;
+        }
+
+        text.resize(size);
+        return text;
+    }
+
+    // Words drawn from a Zipf-like distribution over a made-up vocabulary, with sentences, punctuation and paragraphs
+    std::string MakeNaturalCorpus(size_t size)
+    {
+        std::mt19937_64 random{SEED};
+        std::geometric_distribution<size_t> wordLength{0.3};
+        std::uniform_int_distribution<int> letter{'a', 'z'};
+
+        std::vector<std::string> vocabulary(5000);
+
+        for (std::string& word : vocabulary)
+        {
+            size_t length{1 + std::min<size_t>(wordLength(random), 11)};
+
+            for (size_t i{0}; i < length; ++i)
+            {
+                word.push_back(char(letter(random)));
+            }
+        }
+
+        std::vector<double> weights(vocabulary.size());
+
+        for (size_t rank{0}; rank < weights.size(); ++rank)
+        {
+            weights[rank] = 1.0 / double(rank + 1);
+        }
+
+        std::discrete_distribution<size_t> pickWord{weights.begin(), weights.end()};
+        std::uniform_int_distribution<int> sentenceLength{4, 20};
+        std::uniform_int_distribution<int> paragraphLength{2, 8};
+
+        std::string text{};
+        text.reserve(size + 256);
+
+        while (text.size() < size)
+        {
+            int sentences{paragraphLength(random)};
+
+            for (int sentence{0}; sentence < sentences; ++sentence)
+            {
+                int words{sentenceLength(random)};
+
+                for (int i{0}; i < words; ++i)
+                {
+                    std::string word{vocabulary[pickWord(random)]};
+
+                    if (i == 0)
+                    {
+                        word[0] = char(word[0] - 'a' + 'A');
+                    }
+
+                    text += word;
+                    text += (i + 1 == words) ? ". " : (random() % 9 == 0 ? ", " : " ");
+                }
+            }
+
+            text += "\n\n";
+        }
+
+        text.resize(size);
+        return text;
+    }
+
+    // Corpus names can be file paths, which may contain quotes and backslashes
+    std::string EscapeJson(std::string_view text)
+    {
+        std::string escaped{};
+
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                escaped.push_back('\\');
+                escaped.push_back(c);
+            }
+            else if (uint8_t(c) < 0x20)
+            {
+                escaped += std::format("\\u{:04x}", int(c));
+            }
+            else
+            {
+                escaped.push_back(c);
+            }
+        }
+
+        return escaped;
+    }
+
+    template <typename Function>
+    std::pair<double, double> Time(const BenchOptions& options, Function&& function)
+    {
+        for (int i{0}; i < options.Warmup; ++i)
+        {
+            function();
+        }
+
+        std::vector<double> seconds{};
+
+        for (int i{0}; i < std::max(options.Repetitions, 1); ++i)
+        {
+            auto start{std::chrono::steady_clock::now()};
+            function();
+            std::chrono::duration<double> elapsed{std::chrono::steady_clock::now() - start};
+            seconds.push_back(elapsed.count());
+        }
+
+        std::sort(seconds.begin(), seconds.end());
+
+        return {seconds.front(), seconds[seconds.size() / 2]};
+    }
+
+    void Report(const BenchOptions& options, const Result& result)
+    {
+        if (options.Json)
+        {
+            std::println("{{\"benchmark\":\"{}\",\"corpus\":\"{}\",\"bytes\":{},\"best_seconds\":{:.6f},\"median_seconds\":{:.6f},\"mb_per_s\":{:.3f},\"tokens_per_s\":{:.1f},\"iterations_per_s\":{:.1f},\"peak_rss_kib\":{}}}",
+                result.Benchmark, EscapeJson(result.Corpus), result.Bytes, result.BestSeconds, result.MedianSeconds, result.MegabytesPerSecond, result.TokensPerSecond, result.IterationsPerSecond, result.PeakRssKib);
+        }
+        else
+        {
+            std::println("{:<18} {:<22} {:>10} {:>12.6f} {:>10.2f} {:>14.0f} {:>12.0f} {:>12}",
+                result.Benchmark, result.Corpus, result.Bytes, result.BestSeconds, result.MegabytesPerSecond, result.TokensPerSecond, result.IterationsPerSecond, result.PeakRssKib);
+        }
+
+        std::fflush(stdout);
+    }
+
+    // Times function (which returns the work it did) and reports it, unless the filter skips the benchmark
+    void Run(const BenchOptions& options, std::string_view benchmark, std::string_view corpus, const std::function<Work()>& function)
+    {
+        if (!options.Filter.empty() && benchmark.find(options.Filter) == std::string_view::npos)
+        {
+            return;
+        }
+
+        Work work{};
+        auto [best, median]{Time(options, [&]() { work = function(); })};
+
+        Report(options, {std::string{benchmark}, std::string{corpus}, work.Bytes, best, median, double(work.Bytes) / best / 1e6, double(work.Tokens) / best, double(work.Iterations) / best, PeakRssKib()});
+    }
+
+    void BenchCorpus(const BenchOptions& options, const Corpus& corpus)
+    {
+        typedef char16_t TokenType;
+
+        BPE::BpeEncodingOptions encodingOptions{};
+        auto [bpeTable, encodedString, info]{BPE::EncodeText<TokenType>(corpus.Text, encodingOptions)};
+        std::span<const std::pair<TokenType, TokenType>> pairs{reinterpret_cast<const std::pair<TokenType, TokenType>*>(bpeTable.data()), bpeTable.size() / 2};
+
+        Run(options, "encode", corpus.Name, [&]()
+        {
+            auto [table, tokens, encodeInfo]{BPE::EncodeText<TokenType>(corpus.Text, encodingOptions)};
+            return Work{corpus.Text.size(), encodeInfo.EncodedStringLength, encodeInfo.EncodingIterationCount};
+        });
+
+        BPE::BpeEncodingOptions wordOptions{};
+        wordOptions.PreTokenize = true;
+
+        Run(options, "encode-words", corpus.Name, [&]()
+        {
+            auto [table, tokens, encodeInfo]{BPE::EncodeText<TokenType>(corpus.Text, wordOptions)};
+            return Work{corpus.Text.size(), encodeInfo.EncodedStringLength, encodeInfo.EncodingIterationCount};
+        });
+
+        std::expected<BPE::DecodeTable, std::string> decodeTable{BPE::TryBuildDecodeTable(pairs)};
+
+        if (!decodeTable.has_value())
+        {
+            std::println(stderr, "{}", decodeTable.error());
+            return;
+        }
+
+        Run(options, "decode", corpus.Name, [&]()
+        {
+            auto [text, decodeInfo]{BPE::DecodeString<TokenType>(std::span<const TokenType>{encodedString}, decodeTable.value())};
+            return Work{decodeInfo.DecodedStringLength, decodeInfo.EncodedStringLength, 0};
+        });
+
+        // The owning calls against the caller-buffer ones of Core.h, whose buffers are only allocated once here
+        std::vector<char> decodeBuffer(corpus.Text.size());
+
+        Run(options, "decode-into", corpus.Name, [&]()
+        {
+            std::expected<size_t, std::string> decodedSize{BPE::TryDecodeInto<TokenType>(encodedString, decodeTable.value(), std::as_writable_bytes(std::span{decodeBuffer}))};
+            return Work{decodedSize.value_or(0), encodedString.size(), 0};
+        });
+
+        Run(options, "apply", corpus.Name, [&]()
+        {
+            auto [tokens, applyInfo]{BPE::ApplyBpeTable<TokenType>(corpus.Text, pairs)};
+            return Work{corpus.Text.size(), applyInfo.EncodedStringLength, applyInfo.EncodingIterationCount};
+        });
+
+        BPE::PairRanks<TokenType> ranks{BPE::BuildPairRanks(pairs)};
+        BPE::ApplyScratch<TokenType> scratch{};
+        std::vector<TokenType> tokenBuffer(corpus.Text.size());
+
+        Run(options, "apply-into", corpus.Name, [&]()
+        {
+            std::expected<size_t, std::string> tokenCount{BPE::TryApplyBpeTableInto<TokenType>(std::as_bytes(std::span{corpus.Text}), ranks, scratch, tokenBuffer)};
+            return Work{corpus.Text.size(), tokenCount.value_or(0), corpus.Text.size() - tokenCount.value_or(0)};
+        });
+
+        Run(options, "compile", corpus.Name, [&]()
+        {
+            std::expected<BPE::CompiledEncoder<TokenType>, std::string> compiled{BPE::CompiledEncoder<TokenType>::TryCompile(pairs)};
+            return Work{compiled.has_value() ? compiled.value().Bytes().size() : 0, pairs.size(), 0};
+        });
+
+        std::expected<BPE::CompiledEncoder<TokenType>, std::string> compiledEncoder{BPE::CompiledEncoder<TokenType>::TryCompile(pairs)};
+        BPE::CompiledScratch compiledScratch{};
+
+        if (compiledEncoder.has_value())
+        {
+            // Against apply-into: the same input, output buffer and result, one pass instead of merge by merge
+            Run(options, "apply-compiled", corpus.Name, [&]()
+            {
+                std::expected<size_t, std::string> tokenCount{compiledEncoder.value().TryEncodeInto(std::as_bytes(std::span{corpus.Text}), compiledScratch, tokenBuffer)};
+                return Work{corpus.Text.size(), tokenCount.value_or(0), corpus.Text.size() - tokenCount.value_or(0)};
+            });
+        }
+
+        // Against apply-into: the same encoder on chunks split where no token can cross, on every core
+        unsigned parallelThreadCount{std::max(std::thread::hardware_concurrency(), 1u)};
+        std::vector<BPE::ApplyScratch<TokenType>> workerScratches(parallelThreadCount);
+
+        Run(options, "apply-parallel", corpus.Name, [&]()
+        {
+            size_t tokenCount{0};
+            std::expected<BPE::BpeEncodingResultInfo, std::string> info{BPE::TryApplyBpeTableParallel<TokenType>(
+                pairs,
+                corpus.Text,
+                false,
+                [&](std::span<const std::byte> chunk, std::span<TokenType> output, unsigned worker)
+                {
+                    return BPE::TryApplyBpeTableInto<TokenType>(chunk, ranks, workerScratches[worker], output);
+                },
+                [&](std::span<const TokenType> tokens) -> std::expected<void, std::string>
+                {
+                    tokenCount += tokens.size();
+                    return {};
+                },
+                parallelThreadCount)};
+            return Work{corpus.Text.size(), tokenCount, info.has_value() ? info.value().EncodingIterationCount : 0};
+        });
+
+        // A fresh cache every run, so its misses are part of the measurement
+        Run(options, "apply-words", corpus.Name, [&]()
+        {
+            BPE::TokenCache<TokenType> cache{};
+            std::expected<size_t, std::string> tokenCount{BPE::TryApplyBpeTableWordsInto<TokenType>(std::as_bytes(std::span{corpus.Text}), ranks, scratch, cache, tokenBuffer)};
+            return Work{corpus.Text.size(), tokenCount.value_or(0), corpus.Text.size() - tokenCount.value_or(0)};
+        });
+
+        Run(options, "decode-token", corpus.Name, [&]()
+        {
+            std::string text{};
+            size_t tokenCount{std::min(encodedString.size(), DECODE_TOKEN_COUNT)};
+
+            for (size_t i{0}; i < tokenCount; ++i)
+            {
+                BPE::DecodeToken(encodedString[i], text, pairs);
+            }
+
+            return Work{text.size(), tokenCount, 0};
+        });
+
+        Run(options, "print-table", corpus.Name, [&]()
+        {
+            MutedStdout muted{};
+            BPE::PrintBpeTable(pairs);
+            return Work{0, pairs.size(), 0};
+        });
+
+        // Generating needs at least one merge to walk from
+        if (pairs.empty())
+        {
+            return;
+        }
+
+        Run(options, "generate", corpus.Name, [&]()
+        {
+            MutedStdout muted{};
+            std::basic_string<TokenType> tokens{BPE::GenerateTokenString(pairs, GENERATE_TOKEN_COUNT, SEED)};
+            return Work{0, tokens.size(), 0};
+        });
+
+        Run(options, "generate-stream", corpus.Name, [&]()
+        {
+            std::ostringstream output{};
+            std::expected<uint64_t, std::string> tokenCount{BPE::TryGenerateToStream(pairs, GENERATE_STREAM_TOKEN_COUNT, SEED, output)};
+            return Work{uint64_t(output.tellp()), tokenCount.value_or(0), 0};
+        });
+    }
+
+    // The pair hash used before PairCountTable: symmetric, and zero for every (x, x)
+    struct XorPairHash
+    {
+        size_t operator()(const std::pair<char16_t, char16_t>& p) const
+        {
+            return std::hash<char16_t>{}(p.first) ^ std::hash<char16_t>{}(p.second);
+        }
+    };
+
+    // Tokens drawn from a skewed distribution over `alphabetSize` symbols, about `byteShare` of them raw bytes
+    std::basic_string<char16_t> MakeTokens(size_t alphabetSize, double byteShare, uint64_t seed)
+    {
+        std::mt19937_64 random{seed};
+        std::geometric_distribution<size_t> rank{8.0 / double(alphabetSize)};
+        std::bernoulli_distribution isByte{byteShare};
+
+        std::basic_string<char16_t> tokens{};
+        tokens.reserve(PAIR_COUNT_TOKEN_COUNT);
+
+        for (size_t i{0}; i < PAIR_COUNT_TOKEN_COUNT; ++i)
+        {
+            size_t r{rank(random) % alphabetSize};
+            tokens.push_back(char16_t(isByte(random) ? r % BPE::FIRST_TOKEN<char16_t> : BPE::FIRST_TOKEN<char16_t> + r));
+        }
+
+        return tokens;
+    }
+
+    template <typename Hash>
+    uint64_t CountWithMap(const std::basic_string<char16_t>& tokens)
+    {
+        std::unordered_map<std::pair<char16_t, char16_t>, int, Hash> pairCounts{};
+
+        for (size_t i{0}; i + 1 < tokens.size(); ++i)
+        {
+            pairCounts[{tokens[i], tokens[i + 1]}] += 1;
+        }
+
+        return pairCounts.size();
+    }
+
+    uint64_t CountWithTable(const std::basic_string<char16_t>& tokens)
+    {
+        BPE::PairCountTable<char16_t, int> pairCounts{};
+
+        for (size_t i{0}; i + 1 < tokens.size(); ++i)
+        {
+            pairCounts.Add(tokens[i], tokens[i + 1]);
+        }
+
+        uint64_t distinctPairs{0};
+        pairCounts.ForEach([&](const std::pair<char16_t, char16_t>&, int) { ++distinctPairs; });
+
+        return distinctPairs;
+    }
+
+    /*
+     * A single-threaded pair count pass over synthetic token sequences, from raw bytes only (the start of training) to
+     * mostly merged tokens (late in training), with the previous unordered_map setup next to PairCountTable.
+     */
+    bool BenchPairCounting(const BenchOptions& options)
+    {
+        struct Scenario
+        {
+            std::string_view Name;
+            size_t AlphabetSize;
+            double ByteShare;
+        };
+
+        const Scenario scenarios[]{
+            {"raw-bytes", 96, 1.0},
+            {"early-training", 1024, 0.7},
+            {"late-training", 16384, 0.1},
+        };
+
+        for (const Scenario& scenario : scenarios)
+        {
+            std::basic_string<char16_t> tokens{MakeTokens(scenario.AlphabetSize, scenario.ByteShare, SEED)};
+            std::optional<uint64_t> distinctPairs{};
+            bool agree{true};
+
+            auto count = [&](uint64_t (*countPass)(const std::basic_string<char16_t>&))
+            {
+                return [&, countPass]()
+                {
+                    uint64_t pairs{countPass(tokens)};
+                    agree = agree && (!distinctPairs.has_value() || distinctPairs.value() == pairs);
+                    distinctPairs = pairs;
+                    return Work{tokens.size() * sizeof(char16_t), tokens.size(), 0};
+                };
+            };
+
+            Run(options, "pair-count-xor", scenario.Name, count(CountWithMap<XorPairHash>));
+            Run(options, "pair-count-mix", scenario.Name, count(CountWithMap<BPE::PairHash>));
+            Run(options, "pair-count-table", scenario.Name, count(CountWithTable));
+
+            if (!agree)
+            {
+                std::println(stderr, "ERROR: Pair counts disagree in scenario \"{}\"", scenario.Name);
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void PrintUsage(std::string_view programName)
+    {
+        std::println();
+        std::println("Usage: {} [--size <KiB>] [-i <file>] [--warmup <count>] [--repetitions <count>] [--filter <text>] [--json]", programName);
+        std::println();
+        std::println("Options:");
+        std::println("\t--size <KiB>\t Size of the synthetic corpora, repeat for several sizes (optional, default: 256 and 1024)");
+        std::println("\t-i <file>\t Also benchmark this file as a corpus, repeat for several files (optional)");
+        std::println("\t--warmup <count>\t Untimed runs before the timed ones (optional, default: 1)");
+        std::println("\t--repetitions <count>\t Timed runs, the fastest one is reported (optional, default: 3)");
+        std::println("\t--filter <text>\t Only run benchmarks whose name contains the text (optional)");
+        std::println("\t--json\t\t Print one JSON object per result instead of a table (optional)");
+        std::println("\t-h, --help\t Print this help message");
+        std::println();
+    }
+
+    std::optional<long long> ParseCount(std::string_view arg, long long minimum)
+    {
+        try
+        {
+            long long count{std::stoll(std::string{arg}, nullptr, 0)};
+
+            if (count < minimum)
+            {
+                std::println(stderr, "ERROR: {} should be at least {}", arg, minimum);
+                return std::nullopt;
+            }
+
+            return count;
+        }
+        catch (std::exception const& ex)
+        {
+            std::println(stderr, "ERROR: Unable to parse {} to int", arg);
+            return std::nullopt;
+        }
+    }
+} //namespace
+
+/*
+ * Times training, decoding and generation on synthetic corpora of several sizes and entropies (random bytes, repetitive
+ * log lines, natural-language-like text) and on user-supplied files, plus the pair count pass on its own. Results are a
+ * table by default, or JSON lines with --json so runs can be collected and compared over time.
+ */
+int main(int argc, char* argv[])
+{
+    std::string_view programName{argv[0]};
+    std::queue<std::string_view> args{argv + 1, argv + argc};
+
+    BenchOptions options{};
+    bool sizesGiven{false};
+
+    while (args.size() > 0)
+    {
+        std::string_view arg{args.front()};
+        args.pop();
+
+        if (arg == "-h" || arg == "--help")
+        {
+            PrintUsage(programName);
+            return 0;
+        }
+
+        if (arg == "--json")
+        {
+            options.Json = true;
+            continue;
+        }
+
+        if (args.empty())
+        {
+            std::println(stderr, "ERROR: Missing value for option '{}'", arg);
+            PrintUsage(programName);
+            return 1;
+        }
+
+        std::string_view value{args.front()};
+        args.pop();
+
+        if (arg == "--size" || arg == "--warmup" || arg == "--repetitions")
+        {
+            std::optional<long long> count{ParseCount(value, arg == "--warmup" ? 0 : 1)};
+            if (!count.has_value())
+            {
+                return 1;
+            }
+
+            if (arg == "--size")
+            {
+                if (!sizesGiven)
+                {
+                    options.Sizes.clear();
+                    sizesGiven = true;
+                }
+
+                options.Sizes.push_back(size_t(count.value()) * 1024);
+            }
+            else if (arg == "--warmup")
+            {
+                options.Warmup = int(count.value());
+            }
+            else
+            {
+                options.Repetitions = int(count.value());
+            }
+        }
+        else if (arg == "-i")
+        {
+            options.InputFiles.emplace_back(value);
+        }
+        else if (arg == "--filter")
+        {
+            options.Filter = value;
+        }
+        else
+        {
+            std::println(stderr, "ERROR: Unknown option '{}'", arg);
+            PrintUsage(programName);
+            return 1;
+        }
+    }
+
+    if (!options.Json)
+    {
+        std::println("{:<18} {:<22} {:>10} {:>12} {:>10} {:>14} {:>12} {:>12}", "benchmark", "corpus", "bytes", "best (s)", "MB/s", "tokens/s", "iter/s", "rss (KiB)");
+    }
+
+    if (!BenchPairCounting(options))
+    {
+        return 1;
+    }
+
+    for (size_t size : options.Sizes)
+    {
+        BenchCorpus(options, {std::format("random-{}k", size / 1024), MakeRandomCorpus(size)});
+        BenchCorpus(options, {std::format("repetitive-{}k", size / 1024), MakeRepetitiveCorpus(size)});
+        BenchCorpus(options, {std::format("natural-{}k", size / 1024), MakeNaturalCorpus(size)});
+    }
+
+    for (const std::string& inputFile : options.InputFiles)
+    {
+        std::expected<std::string, std::string> text{BPE::TryReadFileIntoContainer<std::string>(inputFile)};
+        if (!text.has_value())
+        {
+            std::println(stderr, "{}", text.error());
+            return 1;
+        }
+
+        BenchCorpus(options, {inputFile, std::move(text.value())});
+    }
+
+    return 0;
+}
@@ -0,0 +1,300 @@
+#include "BPE.h"
+#include "Core.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <format>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+    const uint32_t END_INDEX{UINT32_MAX};
+    const uint32_t REMOVED_INDEX{UINT32_MAX - 1};
+
+    // Heap entries pack the rank above the position so the smallest entry is the lowest rank at its leftmost position
+    uint64_t MakeHeapEntry(uint32_t rank, uint32_t position)
+    {
+        return (uint64_t(rank) << 32) | position;
+    }
+} //namespace
+
+template BPE::PairRanks<char8_t> BPE::BuildPairRanks<char8_t>(std::span<const std::pair<char8_t, char8_t>> bpeTable);
+template BPE::PairRanks<char16_t> BPE::BuildPairRanks<char16_t>(std::span<const std::pair<char16_t, char16_t>> bpeTable);
+template BPE::PairRanks<char32_t> BPE::BuildPairRanks<char32_t>(std::span<const std::pair<char32_t, char32_t>> bpeTable);
+template <typename TokenType>
+BPE::PairRanks<TokenType> BPE::BuildPairRanks(std::span<const std::pair<TokenType, TokenType>> bpeTable)
+{
+    BPE::PairRanks<TokenType> ranks{};
+
+    for (uint32_t rank{0}; rank < bpeTable.size(); ++rank)
+    {
+        ranks.Add(bpeTable[rank].first, bpeTable[rank].second, rank);
+    }
+
+    return ranks;
+}
+
+template std::tuple<std::basic_string<char8_t>, BPE::BpeEncodingResultInfo> BPE::ApplyBpeTable<char8_t>(const std::string& input, std::span<const std::pair<char8_t, char8_t>> bpeTable);
+template std::tuple<std::basic_string<char16_t>, BPE::BpeEncodingResultInfo> BPE::ApplyBpeTable<char16_t>(const std::string& input, std::span<const std::pair<char16_t, char16_t>> bpeTable);
+template std::tuple<std::basic_string<char32_t>, BPE::BpeEncodingResultInfo> BPE::ApplyBpeTable<char32_t>(const std::string& input, std::span<const std::pair<char32_t, char32_t>> bpeTable);
+template <typename TokenType>
+std::tuple<std::basic_string<TokenType>, BPE::BpeEncodingResultInfo> BPE::ApplyBpeTable(const std::string& input, std::span<const std::pair<TokenType, TokenType>> bpeTable)
+{
+    return BPE::ApplyBpeTable<TokenType>(std::string_view{input}, BPE::BuildPairRanks<TokenType>(bpeTable));
+}
+
+template std::tuple<std::basic_string<char8_t>, BPE::BpeEncodingResultInfo> BPE::ApplyBpeTable<char8_t>(std::string_view input, const BPE::PairRanks<char8_t>& ranks);
+template std::tuple<std::basic_string<char16_t>, BPE::BpeEncodingResultInfo> BPE::ApplyBpeTable<char16_t>(std::string_view input, const BPE::PairRanks<char16_t>& ranks);
+template std::tuple<std::basic_string<char32_t>, BPE::BpeEncodingResultInfo> BPE::ApplyBpeTable<char32_t>(std::string_view input, const BPE::PairRanks<char32_t>& ranks);
+template <typename TokenType>
+std::tuple<std::basic_string<TokenType>, BPE::BpeEncodingResultInfo> BPE::ApplyBpeTable(std::string_view input, const BPE::PairRanks<TokenType>& ranks)
+{
+    BPE::ApplyScratch<TokenType> scratch{};
+    std::basic_string<TokenType> encodedString(input.size(), TokenType{0});
+
+    std::expected<size_t, std::string> tokenCount{BPE::TryApplyBpeTableInto<TokenType>(std::as_bytes(std::span{input}), ranks, scratch, encodedString)};
+    if (!tokenCount.has_value())
+    {
+        throw std::invalid_argument(tokenCount.error());
+    }
+
+    encodedString.resize(tokenCount.value());
+
+    BPE::BpeEncodingResultInfo encodingInfo{};
+    encodingInfo.EncodedStringInitialLength = input.size();
+    encodingInfo.EncodingIterationCount = input.size() - encodedString.size();
+    encodingInfo.EncodedStringLength = encodedString.size();
+
+    return {encodedString, encodingInfo};
+}
+
+template std::expected<size_t, std::string> BPE::TryApplyBpeTableInto<char8_t>(std::span<const std::byte> input, const BPE::PairRanks<char8_t>& ranks, BPE::ApplyScratch<char8_t>& scratch, std::span<char8_t> output);
+template std::expected<size_t, std::string> BPE::TryApplyBpeTableInto<char16_t>(std::span<const std::byte> input, const BPE::PairRanks<char16_t>& ranks, BPE::ApplyScratch<char16_t>& scratch, std::span<char16_t> output);
+template std::expected<size_t, std::string> BPE::TryApplyBpeTableInto<char32_t>(std::span<const std::byte> input, const BPE::PairRanks<char32_t>& ranks, BPE::ApplyScratch<char32_t>& scratch, std::span<char32_t> output);
+/*
+ * Encodes the input with an existing table instead of training a new one. Training merges every occurrence of a pair
+ * before the next pair is chosen, and a merge can only create pairs with a higher rank than its own, so always merging
+ * the lowest ranked (and then leftmost) pair left in the sequence yields exactly the tokens training would have produced.
+ * Each merge costs a few heap operations, which keeps this close to linear in the input size.
+ */
+template <typename TokenType>
+std::expected<size_t, std::string> BPE::TryApplyBpeTableInto(std::span<const std::byte> input, const BPE::PairRanks<TokenType>& ranks, BPE::ApplyScratch<TokenType>& scratch, std::span<TokenType> output)
+{
+    if (input.size() > BPE::MAX_APPLY_INPUT_SIZE)
+    {
+        return std::unexpected{std::format("ERROR: Input of {} bytes is larger than the {} bytes that can be encoded at once", input.size(), BPE::MAX_APPLY_INPUT_SIZE)};
+    }
+
+    if (output.size() < input.size())
+    {
+        return std::unexpected{std::format("ERROR: Output of {} tokens is too small for an input of {} bytes", output.size(), input.size())};
+    }
+
+    std::expected<void, std::string> validation{BPE::TryValidateInput<TokenType>({reinterpret_cast<const char*>(input.data()), input.size()})};
+    if (!validation.has_value())
+    {
+        return std::unexpected{validation.error()};
+    }
+
+    uint32_t tokenCount{uint32_t(input.size())};
+
+    // Resizing within the capacity the scratch already has does not allocate
+    std::vector<TokenType>& symbols{scratch.Symbols};
+    std::vector<uint32_t>& previous{scratch.Previous};
+    std::vector<uint32_t>& next{scratch.Next};
+    std::vector<uint64_t>& heap{scratch.Heap};
+    symbols.resize(tokenCount);
+    previous.resize(tokenCount);
+    next.resize(tokenCount);
+    heap.clear();
+
+    for (uint32_t i{0}; i < tokenCount; ++i)
+    {
+        symbols[i] = TokenType(input[i]);
+        previous[i] = i == 0 ? END_INDEX : i - 1;
+        next[i] = i + 1 == tokenCount ? END_INDEX : i + 1;
+    }
+
+    for (uint32_t i{0}; i + 1 < tokenCount; ++i)
+    {
+        uint32_t rank{ranks.Find(symbols[i], symbols[i + 1])};
+
+        if (rank != BPE::NO_PAIR_RANK)
+        {
+            heap.push_back(MakeHeapEntry(rank, i));
+        }
+    }
+
+    std::make_heap(heap.begin(), heap.end(), std::greater<uint64_t>{});
+
+    auto pushEntry{[&](uint64_t entry)
+    {
+        heap.push_back(entry);
+        std::push_heap(heap.begin(), heap.end(), std::greater<uint64_t>{});
+    }};
+
+    while (heap.empty() == false)
+    {
+        std::pop_heap(heap.begin(), heap.end(), std::greater<uint64_t>{});
+        uint64_t entry{heap.back()};
+        heap.pop_back();
+
+        uint32_t rank{uint32_t(entry >> 32)};
+        uint32_t position{uint32_t(entry)};
+
+        // Entries go stale when one of their nodes was merged into another pair in the meantime
+        if (next[position] == REMOVED_INDEX || next[position] == END_INDEX)
+        {
+            continue;
+        }
+
+        uint32_t right{next[position]};
+
+        if (ranks.Find(symbols[position], symbols[right]) != rank)
+        {
+            continue;
+        }
+
+        uint32_t left{previous[position]};
+        uint32_t afterRight{next[right]};
+
+        symbols[position] = TokenType(BPE::FIRST_TOKEN<TokenType> + rank);
+        next[position] = afterRight;
+        next[right] = REMOVED_INDEX;
+
+        if (afterRight != END_INDEX)
+        {
+            previous[afterRight] = position;
+
+            uint32_t rightRank{ranks.Find(symbols[position], symbols[afterRight])};
+
+            if (rightRank != BPE::NO_PAIR_RANK)
+            {
+                pushEntry(MakeHeapEntry(rightRank, position));
+            }
+        }
+
+        if (left != END_INDEX)
+        {
+            uint32_t leftRank{ranks.Find(symbols[left], symbols[position])};
+
+            if (leftRank != BPE::NO_PAIR_RANK)
+            {
+                pushEntry(MakeHeapEntry(leftRank, left));
+            }
+        }
+    }
+
+    size_t outputSize{0};
+
+    for (uint32_t i{tokenCount == 0 ? END_INDEX : 0}; i != END_INDEX; i = next[i])
+    {
+        output[outputSize++] = symbols[i];
+    }
+
+    return outputSize;
+}
+
+template bool BPE::CanFollow<char8_t>(std::span<const std::pair<char8_t, char8_t>> bpeTable, const BPE::PairRanks<char8_t>& ranks, char8_t left, char8_t right);
+template bool BPE::CanFollow<char16_t>(std::span<const std::pair<char16_t, char16_t>> bpeTable, const BPE::PairRanks<char16_t>& ranks, char16_t left, char16_t right);
+template bool BPE::CanFollow<char32_t>(std::span<const std::pair<char32_t, char32_t>> bpeTable, const BPE::PairRanks<char32_t>& ranks, char32_t left, char32_t right);
+/*
+ * Only the right halves of the left token and the left halves of the right token ever meet at the boundary. Walking
+ * down both from the top, always taking apart the token created last, every pair that meets is checked against the
+ * limit of when it would have had to merge: before the token just taken apart was created (or, for the right token,
+ * no later than it, as the leftmost pair wins a tie).
+ */
+template <typename TokenType>
+bool BPE::CanFollow(std::span<const std::pair<TokenType, TokenType>> bpeTable, const BPE::PairRanks<TokenType>& ranks, TokenType left, TokenType right)
+{
+    // Tokens are numbered in the order they are created, raw bytes split into themselves
+    auto split{[&](TokenType token)
+    {
+        return token < BPE::FIRST_TOKEN<TokenType> ? std::pair<TokenType, TokenType>{token, token} : bpeTable[token - BPE::FIRST_TOKEN<TokenType>];
+    }};
+
+    uint64_t limit{UINT64_MAX};
+
+    while (true)
+    {
+        uint32_t rank{ranks.Find(left, right)};
+
+        if (rank != BPE::NO_PAIR_RANK && BPE::FIRST_TOKEN<TokenType> + uint64_t(rank) < limit)
+        {
+            return false;
+        }
+
+        if (left > right)
+        {
+            limit = left;
+            left = split(left).second;
+
+            if (left == limit)
+            {
+                limit = uint64_t(right) + 1;
+                right = split(right).first;
+
+                if (uint64_t(right) + 1 == limit)
+                {
+                    return true;
+                }
+            }
+        }
+        else
+        {
+            limit = uint64_t(right) + 1;
+            right = split(right).first;
+
+            if (uint64_t(right) + 1 == limit)
+            {
+                limit = left;
+                left = split(left).second;
+
+                if (left == limit)
+                {
+                    return true;
+                }
+            }
+        }
+    }
+}
+
+template std::expected<std::vector<bool>, std::string> BPE::TryFindPairsInsideTokens<char8_t>(std::span<const std::pair<char8_t, char8_t>> bpeTable);
+template std::expected<std::vector<bool>, std::string> BPE::TryFindPairsInsideTokens<char16_t>(std::span<const std::pair<char16_t, char16_t>> bpeTable);
+template std::expected<std::vector<bool>, std::string> BPE::TryFindPairsInsideTokens<char32_t>(std::span<const std::pair<char32_t, char32_t>> bpeTable);
+/*
+ * Inside a token, any two neighbouring bytes are the last byte of the left half and the first byte of the right half of
+ * one of the merges it is built from.
+ */
+template <typename TokenType>
+std::expected<std::vector<bool>, std::string> BPE::TryFindPairsInsideTokens(std::span<const std::pair<TokenType, TokenType>> bpeTable)
+{
+    std::vector<uint8_t> firstBytes(BPE::FIRST_TOKEN<TokenType> + bpeTable.size());
+    std::vector<uint8_t> lastBytes(firstBytes.size());
+    std::vector<bool> inside(256 * 256, false);
+
+    for (size_t token{0}; token < BPE::FIRST_TOKEN<TokenType>; ++token)
+    {
+        firstBytes[token] = uint8_t(token);
+        lastBytes[token] = uint8_t(token);
+    }
+
+    for (size_t i{0}; i < bpeTable.size(); ++i)
+    {
+        auto [left, right]{bpeTable[i]};
+        size_t token{BPE::FIRST_TOKEN<TokenType> + i};
+
+        if (left >= token || right >= token)
+        {
+            return std::unexpected{std::format("ERROR: Merge {} of the BPE table uses a token that does not exist yet", i)};
+        }
+
+        inside[lastBytes[left] * 256 + firstBytes[right]] = true;
+        firstBytes[token] = firstBytes[left];
+        lastBytes[token] = lastBytes[right];
+    }
+
+    return inside;
+}
@@ -1,6 +1,13 @@
 #include "BPE.h"
+#include "Container.h"
+#include "MappedFile.h"
+#include "PairCountTable.h"
+#include "ThreadPool.h"
+#include "TrainingMonitor.h"
 
+#include <algorithm>
 #include <cassert>
+#include <climits>
 #include <cstdint>
 #include <cstdlib>
 #include <expected>
@@ -9,10 +16,12 @@
 #include <iomanip>
 #include <iostream>
 #include <print>
-#include <unordered_map>
+#include <stdexcept>
 
 template std::expected<void, std::string> BPE::TryWriteBasicStringToFile<std::string::value_type>(const std::basic_string<std::string::value_type>& textToWrite, const std::filesystem::path& outputFilePath);
-template std::expected<void, std::string> BPE::TryWriteBasicStringToFile<BPE::TOKEN>(const std::basic_string<BPE::TOKEN>& textToWrite, const std::filesystem::path& outputFilePath);
+template std::expected<void, std::string> BPE::TryWriteBasicStringToFile<char8_t>(const std::basic_string<char8_t>& textToWrite, const std::filesystem::path& outputFilePath);
+template std::expected<void, std::string> BPE::TryWriteBasicStringToFile<char16_t>(const std::basic_string<char16_t>& textToWrite, const std::filesystem::path& outputFilePath);
+template std::expected<void, std::string> BPE::TryWriteBasicStringToFile<char32_t>(const std::basic_string<char32_t>& textToWrite, const std::filesystem::path& outputFilePath);
 template <typename charType>
 std::expected<void, std::string> BPE::TryWriteBasicStringToFile(const std::basic_string<charType>& dataToWrite, const std::filesystem::path& outputFilePath)
 {
@@ -30,8 +39,12 @@ std::expected<void, std::string> BPE::TryWriteBasicStringToFile(const std::basic
 }
 
 template std::expected<std::string, std::string> BPE::TryReadFileIntoContainer(const std::filesystem::path& inputFilePath);
-template std::expected<std::basic_string<BPE::TOKEN>, std::string> BPE::TryReadFileIntoContainer(const std::filesystem::path& inputFilePath);
-template std::expected<std::vector<std::pair<BPE::TOKEN, BPE::TOKEN>>, std::string> BPE::TryReadFileIntoContainer(const std::filesystem::path& inputFilePath);
+template std::expected<std::basic_string<char8_t>, std::string> BPE::TryReadFileIntoContainer(const std::filesystem::path& inputFilePath);
+template std::expected<std::basic_string<char16_t>, std::string> BPE::TryReadFileIntoContainer(const std::filesystem::path& inputFilePath);
+template std::expected<std::basic_string<char32_t>, std::string> BPE::TryReadFileIntoContainer(const std::filesystem::path& inputFilePath);
+template std::expected<std::vector<std::pair<char8_t, char8_t>>, std::string> BPE::TryReadFileIntoContainer(const std::filesystem::path& inputFilePath);
+template std::expected<std::vector<std::pair<char16_t, char16_t>>, std::string> BPE::TryReadFileIntoContainer(const std::filesystem::path& inputFilePath);
+template std::expected<std::vector<std::pair<char32_t, char32_t>>, std::string> BPE::TryReadFileIntoContainer(const std::filesystem::path& inputFilePath);
 template <typename ContainerType>
 std::expected<ContainerType, std::string> BPE::TryReadFileIntoContainer(const std::filesystem::path& inputFilePath)
 {
@@ -56,148 +69,375 @@ std::expected<ContainerType, std::string> BPE::TryReadFileIntoContainer(const st
     return content;
 }
 
-std::expected<void, std::string> BPE::TryWriteEncodedTextToFile(const std::basic_string<TOKEN>& encodedString, const std::string& outputFilePath)
+template std::expected<void, std::string> BPE::TryValidateInput<char8_t>(std::string_view input);
+template std::expected<void, std::string> BPE::TryValidateInput<char16_t>(std::string_view input);
+template std::expected<void, std::string> BPE::TryValidateInput<char32_t>(std::string_view input);
+template <typename TokenType>
+std::expected<void, std::string> BPE::TryValidateInput(std::string_view input)
+{
+    if constexpr (BPE::FIRST_TOKEN<TokenType> <= UCHAR_MAX)
+    {
+        auto it{std::find_if(input.begin(), input.end(), [](char byte) { return size_t(byte) >= BPE::FIRST_TOKEN<TokenType>; })};
+
+        if (it != input.end())
+        {
+            return std::unexpected{std::format("ERROR: Byte 0x{:02X} at offset {} does not fit in {}-bit tokens, use wider tokens for this input", size_t(*it), it - input.begin(), sizeof(TokenType) * 8)};
+        }
+    }
+
+    return {};
+}
+
+template std::expected<void, std::string> BPE::TryWriteBpeTableToFile<char8_t>(const std::basic_string<char8_t>& bpeTable, const std::filesystem::path& outputFilePath);
+template std::expected<void, std::string> BPE::TryWriteBpeTableToFile<char16_t>(const std::basic_string<char16_t>& bpeTable, const std::filesystem::path& outputFilePath);
+template std::expected<void, std::string> BPE::TryWriteBpeTableToFile<char32_t>(const std::basic_string<char32_t>& bpeTable, const std::filesystem::path& outputFilePath);
+template <typename TokenType>
+std::expected<void, std::string> BPE::TryWriteBpeTableToFile(const std::basic_string<TokenType>& bpeTable, const std::filesystem::path& outputFilePath)
 {
     std::ofstream outputFile{outputFilePath, std::ios::binary};
 
     if (outputFile.is_open() == false)
     {
-        return std::unexpected{std::format("ERROR: Unable to open or create output file at path \"{}\"", outputFilePath)};
+        return std::unexpected(std::format("ERROR: Unable to open or create output file at path \"{}\"", outputFilePath.c_str()));
     }
 
-    outputFile.write(reinterpret_cast<const char*>(encodedString.data()), encodedString.size() * sizeof(BPE::TOKEN));
+    BPE::BpeTableHeader header{};
+    std::copy(std::begin(BPE::BPE_TABLE_MAGIC), std::end(BPE::BPE_TABLE_MAGIC), header.Magic);
+    header.Width = BPE::TOKEN_WIDTH<TokenType>;
+
+    outputFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    outputFile.write(reinterpret_cast<const char*>(bpeTable.data()), bpeTable.size() * sizeof(TokenType));
     outputFile.close();
 
     return {};
 }
 
-bool BPE::TryReadEncodedTextFromFile(const std::string& inputFilePath, std::basic_string<BPE::TOKEN>& encodedString, std::vector<std::pair<BPE::TOKEN, BPE::TOKEN>>& tokens)
+std::expected<BPE::TokenWidth, std::string> BPE::TryReadTokenWidth(const std::filesystem::path& bpeFilePath)
 {
-    std::ifstream file(inputFilePath, std::ios::binary);
+    std::ifstream file{bpeFilePath, std::ios::binary};
 
     if (file.is_open() == false)
     {
-        std::cout << "ERROR: Unable to open file at path " << inputFilePath << std::endl;
-        return false;
+        return std::unexpected{std::format("ERROR: Unable to open file at path \"{}\"", bpeFilePath.c_str())};
     }
 
-    file.seekg(0, file.end);
-    std::streamsize fileLength = file.tellg();
-    file.seekg(0, file.beg);
+    char magic[sizeof(BPE::CONTAINER_MAGIC)]{};
 
-    if (fileLength % (sizeof(BPE::TOKEN) / sizeof(char)) != 0)
+    if (file.read(magic, sizeof(magic)) && std::equal(std::begin(BPE::CONTAINER_MAGIC), std::end(BPE::CONTAINER_MAGIC), magic))
     {
-        std::cout << "ERROR: Bad UTF-16 format (odd number of bytes)" << std::endl;
+        std::expected<BPE::FileMapping, std::string> mapping{BPE::FileMapping::TryMap(bpeFilePath)};
+        if (!mapping.has_value())
+        {
+            return std::unexpected{mapping.error()};
+        }
+
+        std::expected<BPE::ContainerHeader, std::string> header{BPE::TryReadContainerHeader(mapping.value().Bytes())};
+        if (!header.has_value())
+        {
+            return std::unexpected{header.error()};
+        }
+
+        return header.value().Width;
     }
 
-    BPE::TOKEN token;
-    while (file.read(reinterpret_cast<char*>(&token), sizeof(BPE::TOKEN)) && token > 0)
+    file.clear();
+    file.seekg(0);
+
+    BPE::BpeTableHeader header{};
+
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::equal(std::begin(BPE::BPE_TABLE_MAGIC), std::end(BPE::BPE_TABLE_MAGIC), header.Magic) == false)
     {
-        encodedString.push_back(token);
+        // The first merge of a table always joins two raw bytes, so a table without header never starts with the magic
+        return BPE::TokenWidth::Bits16;
     }
 
-    std::pair<BPE::TOKEN, BPE::TOKEN> tokenPair;
-    while (file.read(reinterpret_cast<char*>(&tokenPair.first), sizeof(BPE::TOKEN)) && file.read(reinterpret_cast<char*>(&tokenPair.second), sizeof(BPE::TOKEN)))
+    switch (header.Width)
     {
-        tokens.push_back(tokenPair);
+        case BPE::TokenWidth::Bits8:
+        case BPE::TokenWidth::Bits16:
+        case BPE::TokenWidth::Bits32:
+            return header.Width;
     }
 
-    file.close();
-
-    return true;
+    return std::unexpected{std::format("ERROR: BPE table \"{}\" has an unsupported token width of {} bytes", bpeFilePath.c_str(), uint8_t(header.Width))};
 }
 
-std::tuple<std::basic_string<BPE::TOKEN>, std::basic_string<BPE::TOKEN>, BPE::BpeEncodingResultInfo> BPE::EncodeText(const std::string& input)
+namespace
 {
-    std::basic_string<BPE::TOKEN> encodedString{};
-    encodedString.reserve(input.size());
+    // Bounds checked table access, a corrupt table or token file should not read past the end of the table
+    template <typename TokenType>
+    const std::pair<TokenType, TokenType>& TableEntryAt(std::span<const std::pair<TokenType, TokenType>> bpeTable, size_t index)
+    {
+        if (index >= bpeTable.size())
+        {
+            throw std::out_of_range(std::format("Token {} is not part of the BPE table", index + BPE::FIRST_TOKEN<TokenType>));
+        }
+
+        return bpeTable[index];
+    }
 
-    for (const char& i : input)
+    template <typename TokenType>
+    bool IsMoreFrequent(int count, const std::pair<TokenType, TokenType>& pair, int bestCount, const std::pair<TokenType, TokenType>& bestPair)
     {
-        encodedString.push_back(i);
+        // Ties are broken on the smallest pair so the result does not depend on map iteration order or thread count
+        return count > bestCount || (count == bestCount && pair < bestPair);
     }
 
-    std::basic_string<BPE::TOKEN> encodedStringCopy{};
-    encodedStringCopy.reserve(input.size());
+    /*
+     * Every chunk counts the pairs starting inside of it (so the pair straddling a chunk boundary belongs to the left
+     * chunk) into its own table. The tables are partitioned the same way, so each partition is then reduced over all
+     * chunks by its own thread, which yields exactly the counts of a single-threaded pass.
+     */
+    template <typename TokenType>
+    std::pair<std::pair<TokenType, TokenType>, int> FindMostFrequentPair(const std::basic_string<TokenType>& encodedString, BPE::ThreadPool& threadPool, std::vector<BPE::PairCountTable<TokenType, int>>& localCounts)
+    {
+        size_t chunkCount{BPE::ChunkCount(encodedString.size(), threadPool.ThreadCount(), BPE::MINIMUM_TOKEN_CHUNK_SIZE)};
+        size_t partitionCount{threadPool.ThreadCount()};
 
-    std::unordered_map<std::pair<BPE::TOKEN, BPE::TOKEN>, int, BPE::PairHash> pairCounts;
-    std::basic_string<BPE::TOKEN> bpeTable;
+        while (localCounts.size() < chunkCount)
+        {
+            localCounts.emplace_back(partitionCount);
+        }
 
-    BPE::TOKEN nextEncodedToken{FIRST_TOKEN};
+        threadPool.ParallelFor(chunkCount, [&](size_t chunk)
+        {
+            auto [begin, end]{BPE::SplitRange(encodedString.size(), chunkCount, chunk)};
+            BPE::PairCountTable<TokenType, int>& pairCounts{localCounts[chunk]};
 
-    BPE::BpeEncodingResultInfo encodingInfo{};
-    encodingInfo.EncodedStringInitialLength = input.size();
+            pairCounts.Clear();
 
-    for (;; encodingInfo.EncodingIterationCount++)
-    {
-        pairCounts.clear();
+            for (size_t i{begin}; i < end && i + 1 < encodedString.size(); ++i)
+            {
+                pairCounts.Add(encodedString[i], encodedString[i + 1]);
+            }
+        });
 
-        for (size_t i{0}; i < encodedString.size() - 1; ++i)
+        std::vector<std::pair<std::pair<TokenType, TokenType>, int>> partitionBest(partitionCount);
+
+        threadPool.ParallelFor(partitionCount, [&](size_t partition)
         {
-            std::pair<BPE::TOKEN, BPE::TOKEN> pair{encodedString[i], encodedString[i + 1]};
-            pairCounts[pair] += 1;
-        }
+            BPE::PairCountTable<TokenType, int>& pairCounts{localCounts[0]};
 
-        std::pair<BPE::TOKEN, BPE::TOKEN> mostFrequentPair{};
-        int mostFrequentCount{0};
+            for (size_t chunk{1}; chunk < chunkCount; ++chunk)
+            {
+                pairCounts.AddPartition(localCounts[chunk], partition);
+            }
+
+            std::pair<TokenType, TokenType> mostFrequentPair{};
+            int mostFrequentCount{0};
+
+            pairCounts.ForEachInPartition(partition, [&](const std::pair<TokenType, TokenType>& pair, int count)
+            {
+                if (IsMoreFrequent(count, pair, mostFrequentCount, mostFrequentPair))
+                {
+                    mostFrequentPair = pair;
+                    mostFrequentCount = count;
+                }
+            });
+
+            partitionBest[partition] = {mostFrequentPair, mostFrequentCount};
+        });
 
-        for (std::pair<std::pair<BPE::TOKEN, BPE::TOKEN>, int> kvp : pairCounts)
+        std::pair<std::pair<TokenType, TokenType>, int> best{};
+
+        for (const auto& [pair, count] : partitionBest)
         {
-            if (kvp.second > mostFrequentCount)
+            if (IsMoreFrequent(count, pair, best.second, best.first))
             {
-                mostFrequentPair = kvp.first;
-                mostFrequentCount = kvp.second;
+                best = {pair, count};
             }
         }
 
-        if (mostFrequentCount <= 1)
+        return best;
+    }
+
+    // Whether the greedy left-to-right merge of `pair` merges the tokens at `position` and `position + 1`
+    template <typename TokenType>
+    bool IsMergeStart(const std::basic_string<TokenType>& encodedString, size_t position, const std::pair<TokenType, TokenType>& pair)
+    {
+        if (position + 1 >= encodedString.size() || encodedString[position] != pair.first || encodedString[position + 1] != pair.second)
         {
-            break;
+            return false;
+        }
+
+        if (pair.first != pair.second)
+        {
+            return true;
         }
 
-        size_t encodedStringSize{encodedString.size()};
-        encodedStringCopy = encodedString;
-        encodedString.clear();
+        // In a run of identical tokens the merges start at every other position counted from the start of the run
+        size_t runStart{position};
 
-        for (size_t i{0}; i < encodedStringCopy.size(); ++i)
+        while (runStart > 0 && encodedString[runStart - 1] == pair.first)
         {
-            if (i == encodedStringSize - 1)
-            {
-                encodedString.push_back(encodedStringCopy[i]);
-                continue;
-            }
+            --runStart;
+        }
 
-            std::pair<BPE::TOKEN, BPE::TOKEN> pair{encodedStringCopy[i], encodedStringCopy[i + 1]};
+        return (position - runStart) % 2 == 0;
+    }
+
+    /*
+     * Replaces every greedy, non-overlapping occurrence of `pair` by `token`. Each chunk first learns whether its first
+     * token was already consumed by a merge starting in the previous chunk, then the chunks measure their output, and
+     * finally write it to their offset in `output`.
+     */
+    template <typename TokenType>
+    void ApplyMerge(const std::basic_string<TokenType>& encodedString, std::basic_string<TokenType>& output, const std::pair<TokenType, TokenType>& pair, TokenType token, BPE::ThreadPool& threadPool)
+    {
+        size_t chunkCount{BPE::ChunkCount(encodedString.size(), threadPool.ThreadCount(), BPE::MINIMUM_TOKEN_CHUNK_SIZE)};
+
+        std::vector<size_t> chunkStarts(chunkCount);
+        std::vector<size_t> chunkOffsets(chunkCount + 1);
+
+        threadPool.ParallelFor(chunkCount, [&](size_t chunk)
+        {
+            auto [begin, end]{BPE::SplitRange(encodedString.size(), chunkCount, chunk)};
+            size_t i{begin > 0 && IsMergeStart(encodedString, begin - 1, pair) ? begin + 1 : begin};
+            size_t outputLength{0};
+
+            chunkStarts[chunk] = i;
 
-            if (pair == mostFrequentPair)
+            while (i < end)
             {
-                encodedString.push_back(nextEncodedToken);
-                ++i;
+                i += i + 1 < encodedString.size() && encodedString[i] == pair.first && encodedString[i + 1] == pair.second ? 2 : 1;
+                ++outputLength;
             }
-            else
+
+            chunkOffsets[chunk + 1] = outputLength;
+        });
+
+        for (size_t chunk{0}; chunk < chunkCount; ++chunk)
+        {
+            chunkOffsets[chunk + 1] += chunkOffsets[chunk];
+        }
+
+        output.resize(chunkOffsets[chunkCount]);
+
+        threadPool.ParallelFor(chunkCount, [&](size_t chunk)
+        {
+            size_t end{BPE::SplitRange(encodedString.size(), chunkCount, chunk).second};
+            size_t outputIndex{chunkOffsets[chunk]};
+
+            for (size_t i{chunkStarts[chunk]}; i < end; ++i)
             {
-                encodedString.push_back(encodedStringCopy[i]);
+                if (i + 1 < encodedString.size() && encodedString[i] == pair.first && encodedString[i + 1] == pair.second)
+                {
+                    output[outputIndex++] = token;
+                    ++i;
+                }
+                else
+                {
+                    output[outputIndex++] = encodedString[i];
+                }
             }
+        });
+    }
+} //namespace
+
+template std::tuple<std::basic_string<char8_t>, std::basic_string<char8_t>, BPE::BpeEncodingResultInfo> BPE::EncodeText<char8_t>(const std::string& input, const BPE::BpeEncodingOptions& options);
+template std::tuple<std::basic_string<char16_t>, std::basic_string<char16_t>, BPE::BpeEncodingResultInfo> BPE::EncodeText<char16_t>(const std::string& input, const BPE::BpeEncodingOptions& options);
+template std::tuple<std::basic_string<char32_t>, std::basic_string<char32_t>, BPE::BpeEncodingResultInfo> BPE::EncodeText<char32_t>(const std::string& input, const BPE::BpeEncodingOptions& options);
+template <typename TokenType>
+std::tuple<std::basic_string<TokenType>, std::basic_string<TokenType>, BPE::BpeEncodingResultInfo> BPE::EncodeText(const std::string& input, const BPE::BpeEncodingOptions& options)
+{
+    if (options.PreTokenize)
+    {
+        return EncodeTextWords<TokenType>(input, options);
+    }
+
+    // The incremental engine addresses token positions with 32-bit indices
+    if (options.Engine == BPE::EncodingEngine::Legacy || input.size() >= UINT32_MAX - 1)
+    {
+        return EncodeTextLegacy<TokenType>(input, options);
+    }
+
+    return EncodeTextIncremental<TokenType>(input, options);
+}
+
+template std::tuple<std::basic_string<char8_t>, std::basic_string<char8_t>, BPE::BpeEncodingResultInfo> BPE::EncodeTextLegacy<char8_t>(const std::string& input, const BPE::BpeEncodingOptions& options);
+template std::tuple<std::basic_string<char16_t>, std::basic_string<char16_t>, BPE::BpeEncodingResultInfo> BPE::EncodeTextLegacy<char16_t>(const std::string& input, const BPE::BpeEncodingOptions& options);
+template std::tuple<std::basic_string<char32_t>, std::basic_string<char32_t>, BPE::BpeEncodingResultInfo> BPE::EncodeTextLegacy<char32_t>(const std::string& input, const BPE::BpeEncodingOptions& options);
+template <typename TokenType>
+std::tuple<std::basic_string<TokenType>, std::basic_string<TokenType>, BPE::BpeEncodingResultInfo> BPE::EncodeTextLegacy(const std::string& input, const BPE::BpeEncodingOptions& options)
+{
+    std::basic_string<TokenType> encodedString{BPE::ToRawTokens<TokenType>(input)};
+
+    std::basic_string<TokenType> encodedStringCopy{};
+    encodedStringCopy.reserve(input.size());
+
+    BPE::ThreadPool threadPool{options.ThreadCount};
+    std::vector<BPE::PairCountTable<TokenType, int>> localCounts{};
+    std::basic_string<TokenType> bpeTable;
+
+    TokenType nextEncodedToken{FIRST_TOKEN<TokenType>};
+
+    BPE::BpeEncodingResultInfo encodingInfo{};
+    encodingInfo.EncodedStringInitialLength = input.size();
+
+    for (;; encodingInfo.EncodingIterationCount++)
+    {
+        BPE::EnterPhase(options.Monitor, BPE::TrainingPhase::Count);
+
+        auto [mostFrequentPair, mostFrequentCount]{FindMostFrequentPair(encodedString, threadPool, localCounts)};
+
+        if (mostFrequentCount <= 1)
+        {
+            break;
         }
 
-        assert((int)(bpeTable.size()) == (nextEncodedToken - FIRST_TOKEN) * 2);
+        if (bpeTable.size() / 2 >= BPE::MAXIMUM_TABLE_SIZE<TokenType>)
+        {
+            encodingInfo.TableFull = true;
+            break;
+        }
+
+        if (options.MaxMerges > 0 && bpeTable.size() / 2 >= options.MaxMerges)
+        {
+            break;
+        }
+
+        BPE::EnterPhase(options.Monitor, BPE::TrainingPhase::Apply);
+
+        ApplyMerge(encodedString, encodedStringCopy, mostFrequentPair, nextEncodedToken, threadPool);
+        encodedString.swap(encodedStringCopy);
+
+        assert(bpeTable.size() == size_t(nextEncodedToken - FIRST_TOKEN<TokenType>) * 2);
         bpeTable.push_back(mostFrequentPair.first);
         bpeTable.push_back(mostFrequentPair.second);
 
+        if (options.Monitor != nullptr)
+        {
+            options.Monitor->OnMerge({bpeTable.size() / 2, nextEncodedToken, mostFrequentPair.first, mostFrequentPair.second, uint64_t(mostFrequentCount), encodedString.size(), localCounts[0].SparseSize()});
+        }
+
         ++nextEncodedToken;
     }
 
+    BPE::EnterPhase(options.Monitor, BPE::TrainingPhase::Other);
+
     encodingInfo.EncodedStringLength = encodedString.size();
 
     return {bpeTable, encodedString, encodingInfo};
 }
 
-std::tuple<std::string, BPE::BpeDecodingResultInfo> BPE::DecodeString(const std::basic_string<BPE::TOKEN>& input, const std::vector<std::pair<BPE::TOKEN, BPE::TOKEN>>& bpeTable)
+template std::tuple<std::string, BPE::BpeDecodingResultInfo> BPE::DecodeString<char8_t>(std::span<const char8_t> input, std::span<const std::pair<char8_t, char8_t>> bpeTable);
+template std::tuple<std::string, BPE::BpeDecodingResultInfo> BPE::DecodeString<char16_t>(std::span<const char16_t> input, std::span<const std::pair<char16_t, char16_t>> bpeTable);
+template std::tuple<std::string, BPE::BpeDecodingResultInfo> BPE::DecodeString<char32_t>(std::span<const char32_t> input, std::span<const std::pair<char32_t, char32_t>> bpeTable);
+template <typename TokenType>
+std::tuple<std::string, BPE::BpeDecodingResultInfo> BPE::DecodeString(std::span<const TokenType> input, std::span<const std::pair<TokenType, TokenType>> bpeTable)
 {
+    std::expected<BPE::DecodeTable, std::string> decodeTable{TryBuildDecodeTable(bpeTable)};
+
+    if (decodeTable.has_value())
+    {
+        return DecodeString<TokenType>(input, decodeTable.value());
+    }
+
+    // Tables that cannot be flattened are still decoded token by token, so invalid tokens are reported the same way
     std::string result;
     result.reserve(input.size() * 2);
 
-    for (const BPE::TOKEN& token : input)
+    for (const TokenType& token : input)
     {
         DecodeToken(token, result, bpeTable);
     }
@@ -207,33 +447,41 @@ std::tuple<std::string, BPE::BpeDecodingResultInfo> BPE::DecodeString(const std:
     return {result, info};
 }
 
-void BPE::DecodeToken(BPE::TOKEN token, std::string& decodedToken, const std::vector<std::pair<BPE::TOKEN, BPE::TOKEN>>& bpeTable)
+template void BPE::DecodeToken<char8_t>(char8_t token, std::string& decodedToken, std::span<const std::pair<char8_t, char8_t>> bpeTable);
+template void BPE::DecodeToken<char16_t>(char16_t token, std::string& decodedToken, std::span<const std::pair<char16_t, char16_t>> bpeTable);
+template void BPE::DecodeToken<char32_t>(char32_t token, std::string& decodedToken, std::span<const std::pair<char32_t, char32_t>> bpeTable);
+template <typename TokenType>
+void BPE::DecodeToken(TokenType token, std::string& decodedToken, std::span<const std::pair<TokenType, TokenType>> bpeTable)
 {
-    if (token < FIRST_TOKEN)
+    if (token < FIRST_TOKEN<TokenType>)
     {
         decodedToken.push_back(token);
         return;
     }
 
-    BPE::TOKEN tokenPairIndex{BPE::TOKEN(token - FIRST_TOKEN)};
-    std::pair<BPE::TOKEN, BPE::TOKEN> pair{bpeTable.at(tokenPairIndex)};
+    size_t tokenPairIndex{size_t(token - FIRST_TOKEN<TokenType>)};
+    std::pair<TokenType, TokenType> pair{TableEntryAt(bpeTable, tokenPairIndex)};
 
     DecodeToken(pair.first, decodedToken, bpeTable);
     DecodeToken(pair.second, decodedToken, bpeTable);
 }
 
-void BPE::PrintBpeTable(const std::vector<std::pair<BPE::TOKEN, BPE::TOKEN>>& bpeTable)
+template void BPE::PrintBpeTable<char8_t>(std::span<const std::pair<char8_t, char8_t>> bpeTable);
+template void BPE::PrintBpeTable<char16_t>(std::span<const std::pair<char16_t, char16_t>> bpeTable);
+template void BPE::PrintBpeTable<char32_t>(std::span<const std::pair<char32_t, char32_t>> bpeTable);
+template <typename TokenType>
+void BPE::PrintBpeTable(std::span<const std::pair<TokenType, TokenType>> bpeTable)
 {
-    for (BPE::TOKEN token{0}; token < bpeTable.size(); ++token)
+    for (size_t token{0}; token < bpeTable.size(); ++token)
     {
-        std::pair<BPE::TOKEN, BPE::TOKEN> tokenPair{bpeTable.at(token)};
+        std::pair<TokenType, TokenType> tokenPair{TableEntryAt(bpeTable, token)};
 
         std::string decriptedToken;
 
         DecodeToken(tokenPair.first, decriptedToken, bpeTable);
         DecodeToken(tokenPair.second, decriptedToken, bpeTable);
 
-        std::print("{} = |", token + FIRST_TOKEN);
+        std::print("{} = |", token + FIRST_TOKEN<TokenType>);
 
         for (size_t i{0}; i < decriptedToken.size(); ++i)
         {
@@ -250,74 +498,3 @@ void BPE::PrintBpeTable(const std::vector<std::pair<BPE::TOKEN, BPE::TOKEN>>& bp
         std::println("|");
     }
 }
-
-std::basic_string<BPE::TOKEN> BPE::GenerateTokenString(const std::vector<std::pair<BPE::TOKEN, BPE::TOKEN>>& bpeTable, uint tokenCount)
-{
-    srand(time(0));
-    std::basic_string<BPE::TOKEN> result{};
-
-    auto asd = bpeTable;
-
-    BPE::TOKEN currentToken{bpeTable.at(rand() % (int)bpeTable.size()).second};
-    result.push_back(currentToken);
-
-    for (uint i{1}; i < tokenCount; ++i)
-    {
-        std::string decodedString1{};
-        BPE::DecodeToken(currentToken, decodedString1, bpeTable);
-        std::println("TOKEN {}: |{}|", i, decodedString1);
-
-        std::vector<BPE::TOKEN> possibleNextTokens{};
-
-        while (possibleNextTokens.size() == 0)
-        {
-            for (std::pair<BPE::TOKEN, BPE::TOKEN> tokenPair : bpeTable)
-            {
-                if (tokenPair.first == currentToken)
-                {
-                    possibleNextTokens.push_back(tokenPair.second);
-                }
-            }
-
-            if (possibleNextTokens.size() == 0)
-            {
-                if (currentToken < FIRST_TOKEN)
-                {
-                    std::println("GAVE UP: Reached terminal token {}", (char)currentToken);
-                    break;
-                }
-
-                std::string decodedString2{};
-                BPE::DecodeToken(currentToken, decodedString2, bpeTable);
-                std::println("Could not find next token after |{}|", decodedString2);
-                currentToken = bpeTable.at(currentToken - FIRST_TOKEN).second;
-
-                decodedString2 = std::string{};
-                BPE::DecodeToken(currentToken, decodedString2, bpeTable);
-                std::println("Checking token |{}| instead (value {})", decodedString2, (uint16_t)currentToken);
-            }
-        }
-
-        if (possibleNextTokens.size() == 0)
-        {
-            std::string decodedString3{};
-            BPE::DecodeToken(result.at(result.size() - 1), decodedString3, bpeTable);
-            std::println("GAVE UP: Could not find next token after |{}|", decodedString3);
-            return result;
-        }
-
-        std::println("Found {} possible next tokens", possibleNextTokens.size());
-        for (size_t j{0}; j < possibleNextTokens.size(); ++j)
-        {
-            std::string decodedString4{};
-            BPE::DecodeToken(possibleNextTokens.at(j), decodedString4, bpeTable);
-            std::println("|{}| ({})", decodedString4, (uint16_t)possibleNextTokens.at(j));
-        }
-
-        currentToken = possibleNextTokens.at(rand() % possibleNextTokens.size());
-        result.push_back(currentToken);
-        std::println();
-    }
-
-    return result;
-}
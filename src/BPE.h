@@ -1,22 +1,106 @@
+#pragma once
+
+#include <algorithm>
 #include <climits>
 #include <cstdint>
 #include <expected>
 #include <filesystem>
+#include <ostream>
+#include <span>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 namespace BPE
 {
-    typedef char16_t TOKEN;
-    const TOKEN FIRST_TOKEN{CHAR_MAX + 1};
+    /*
+     * Everything that handles tokens is a template over the token type, instantiated for char8_t, char16_t and char32_t.
+     * These stand in for uint8_t, uint16_t and uint32_t, so token sequences can keep using std::basic_string.
+     */
+
+    // Tokens below FIRST_TOKEN are raw bytes. 8-bit tokens only cover 7-bit input, or there would be no room for merges.
+    template <typename TokenType>
+    constexpr TokenType FIRST_TOKEN{sizeof(TokenType) == 1 ? 128 : UCHAR_MAX + 1};
+
+    // Number of merges after which the next token would no longer fit in the token type
+    template <typename TokenType>
+    constexpr uint64_t MAXIMUM_TABLE_SIZE{(uint64_t(1) << (8 * sizeof(TokenType))) - FIRST_TOKEN<TokenType>};
+
+    // Every byte widens to the raw token of the same value, in one pass without growing the string
+    template <typename TokenType>
+    std::basic_string<TokenType> ToRawTokens(std::string_view input)
+    {
+        return std::basic_string<TokenType>(input.begin(), input.end());
+    }
+
+    // Bytes per token, recorded in every BPE table file. Token files use the width of the table they belong to.
+    enum class TokenWidth : uint8_t
+    {
+        Bits8 = 1,
+        Bits16 = 2,
+        Bits32 = 4
+    };
+
+    template <typename TokenType>
+    constexpr TokenWidth TOKEN_WIDTH{TokenWidth(sizeof(TokenType))};
+
+    // BPE table files start with this header, followed by the merges as pairs of tokens of the recorded width. Files
+    // without it were written before the header existed and hold 16-bit pairs.
+    struct BpeTableHeader
+    {
+        char Magic[4];
+        TokenWidth Width;
+        uint8_t Reserved[3];
+    };
+
+    constexpr char BPE_TABLE_MAGIC[4]{'B', 'P', 'E', 'T'};
+
+    class TrainingMonitor;
 
     enum class SubCommand
     {
         NONE = -1,
         Encode,
+        Apply,
         Decode,
         Inspect,
-        Generate
+        Generate,
+        Serve,
+        Compile
+    };
+
+    enum class EncodingEngine
+    {
+        Incremental,
+        Legacy
+    };
+
+    enum class ApplyEngine
+    {
+        Merges,
+        Compiled
+    };
+
+    struct BpeEncodingOptions
+    {
+        EncodingEngine Engine{EncodingEngine::Incremental};
+        // Threads used to count pairs (and to apply merges in the legacy engine), the result does not depend on it
+        unsigned ThreadCount{1};
+        // Memory budget in bytes of TryEncodeFileOutOfCore, the token sequence is spilled to disk while it does not fit
+        uint64_t MemoryLimit{0};
+        // Directory for the spill files, the system's temporary directory when empty
+        std::filesystem::path SpillDirectory{};
+        // Train on the unique words of the input weighted by their counts, merges then never cross a word boundary
+        bool PreTokenize{false};
+        // Receives per-merge telemetry when set, see TrainingMonitor
+        TrainingMonitor* Monitor{nullptr};
+        // Training stops once the table holds this many merges, 0 for no limit
+        uint64_t MaxMerges{0};
+        // The incremental engine saves its state here every CheckpointInterval merges and when it stops, see Checkpoint.h
+        std::filesystem::path CheckpointPath{};
+        uint64_t CheckpointInterval{0};
     };
 
     struct BpeEncodingResultInfo
@@ -24,6 +108,8 @@ namespace BPE
         uint64_t EncodingIterationCount;
         uint64_t EncodedStringInitialLength;
         uint64_t EncodedStringLength;
+        // Training stopped early because the next token would not have fit in the token type
+        bool TableFull;
     };
 
     struct BpeDecodingResultInfo
@@ -32,30 +118,257 @@ namespace BPE
         uint64_t DecodedStringLength;
     };
 
+    // Full byte expansion of every token id (raw bytes included), so decoding a token is a single copy
+    struct DecodeTable
+    {
+        std::string Expansions;
+        // Token t expands to Expansions[Offsets[t], Offsets[t + 1])
+        std::vector<uint64_t> Offsets;
+
+        size_t TokenCount() const
+        {
+            return Offsets.size() - 1;
+        }
+
+        std::string_view Expand(size_t token) const
+        {
+            return {Expansions.data() + Offsets[token], size_t(Offsets[token + 1] - Offsets[token])};
+        }
+    };
+
+    // Every token that follows a given token in the BPE table, stored as one array sliced by the first token (CSR)
+    template <typename TokenType>
+    struct SuccessorIndex
+    {
+        // Successors of token t are Successors[Offsets[t], Offsets[t + 1])
+        std::vector<uint32_t> Offsets;
+        std::vector<TokenType> Successors;
+
+        std::span<const TokenType> SuccessorsOf(TokenType token) const
+        {
+            if (size_t(token) + 1 >= Offsets.size())
+            {
+                return {};
+            }
+
+            return {Successors.data() + Offsets[token], Successors.data() + Offsets[token + 1]};
+        }
+    };
+
+    // Occurrences of every word of some text, the words point into that text
+    typedef std::unordered_map<std::string_view, uint64_t> WordCounts;
+
     template <typename charType>
     std::expected<void, std::string> TryWriteBasicStringToFile(const std::basic_string<charType>& dataToWrite, const std::filesystem::path& outputFilePath);
 
     template <typename ContainerType>
     std::expected<ContainerType, std::string> TryReadFileIntoContainer(const std::filesystem::path& inputFilePath);
 
-    std::expected<void, std::string> TryWriteEncodedTextToFile(const std::basic_string<TOKEN>& encodedString, const std::string& outputFilePath);
-    bool TryReadEncodedTextFromFile(const std::string& inputFilePath, std::basic_string<TOKEN>& encodedString, std::vector<std::pair<TOKEN, TOKEN>>& tokens);
+    template <typename TokenType>
+    std::expected<void, std::string> TryValidateInput(std::string_view input);
+    template <typename TokenType>
+    std::expected<void, std::string> TryWriteBpeTableToFile(const std::basic_string<TokenType>& bpeTable, const std::filesystem::path& outputFilePath);
+    std::expected<TokenWidth, std::string> TryReadTokenWidth(const std::filesystem::path& bpeFilePath);
 
-    std::tuple<std::basic_string<TOKEN>, std::basic_string<TOKEN>, BpeEncodingResultInfo> EncodeText(const std::string& input);
-    std::tuple<std::string, BpeDecodingResultInfo> DecodeString(const std::basic_string<TOKEN>& input, const std::vector<std::pair<TOKEN, TOKEN>>& tokens);
-    void PrintBpeTable(const std::vector<std::pair<TOKEN, TOKEN>>& bpeTable);
-    void DecodeToken(TOKEN token, std::string& decodedToken, const std::vector<std::pair<TOKEN, TOKEN>>& bpeTable);
+    template <typename TokenType>
+    std::tuple<std::basic_string<TokenType>, std::basic_string<TokenType>, BpeEncodingResultInfo> EncodeText(const std::string& input, const BpeEncodingOptions& options = {});
+    template <typename TokenType>
+    std::tuple<std::basic_string<TokenType>, std::basic_string<TokenType>, BpeEncodingResultInfo> EncodeTextLegacy(const std::string& input, const BpeEncodingOptions& options = {});
+    template <typename TokenType>
+    std::tuple<std::basic_string<TokenType>, std::basic_string<TokenType>, BpeEncodingResultInfo> EncodeTextIncremental(const std::string& input, const BpeEncodingOptions& options = {}, std::span<const uint64_t> documentStarts = {});
+    template <typename TokenType>
+    std::tuple<std::basic_string<TokenType>, std::basic_string<TokenType>, BpeEncodingResultInfo> EncodeTextWords(const std::string& input, const BpeEncodingOptions& options = {});
+    // Trains on the words of the documents, given as word counts that together cover every document exactly once
+    template <typename TokenType>
+    std::tuple<std::basic_string<TokenType>, std::basic_string<TokenType>, BpeEncodingResultInfo> EncodeWords(std::span<const std::string_view> documents, std::span<const WordCounts> wordCounts, const BpeEncodingOptions& options = {});
+    void CountWords(std::string_view document, WordCounts& wordCounts);
+    // End of the word that starts at begin, words are split the way CountWords splits them
+    size_t WordEnd(std::string_view text, size_t begin);
+    template <typename TokenType>
+    std::expected<std::tuple<std::basic_string<TokenType>, BpeEncodingResultInfo>, std::string> TryEncodeFileOutOfCore(const std::filesystem::path& inputFilePath, const std::filesystem::path& tokenOutputFilePath, const BpeEncodingOptions& options);
+    template <typename TokenType>
+    void ContinueEncodingIncremental(std::basic_string<TokenType>& encodedString, std::basic_string<TokenType>& bpeTable, BpeEncodingResultInfo& encodingInfo, const BpeEncodingOptions& options = {}, std::span<const uint64_t> documentStarts = {});
+    template <typename TokenType>
+    std::tuple<std::basic_string<TokenType>, BpeEncodingResultInfo> ApplyBpeTable(const std::string& input, std::span<const std::pair<TokenType, TokenType>> bpeTable);
+    template <typename TokenType>
+    std::expected<DecodeTable, std::string> TryBuildDecodeTable(std::span<const std::pair<TokenType, TokenType>> bpeTable);
+    template <typename TokenType>
+    std::tuple<std::string, BpeDecodingResultInfo> DecodeString(std::span<const TokenType> input, std::span<const std::pair<TokenType, TokenType>> bpeTable);
+    template <typename TokenType>
+    std::tuple<std::string, BpeDecodingResultInfo> DecodeString(std::span<const TokenType> input, const DecodeTable& decodeTable);
+    template <typename TokenType>
+    std::tuple<std::string, BpeDecodingResultInfo> DecodeStringParallel(std::span<const TokenType> input, const DecodeTable& decodeTable, unsigned threadCount);
+    template <typename TokenType>
+    std::expected<BpeDecodingResultInfo, std::string> TryDecodeToFileParallel(std::span<const TokenType> input, const DecodeTable& decodeTable, const std::filesystem::path& outputFilePath, unsigned threadCount);
+    template <typename TokenType>
+    void PrintBpeTable(std::span<const std::pair<TokenType, TokenType>> bpeTable);
+    template <typename TokenType>
+    void DecodeToken(TokenType token, std::string& decodedToken, std::span<const std::pair<TokenType, TokenType>> bpeTable);
 
-    std::basic_string<TOKEN> GenerateTokenString(const std::vector<std::pair<TOKEN, TOKEN>>& bpeTable, uint tokenCount);
+    template <typename TokenType>
+    SuccessorIndex<TokenType> BuildSuccessorIndex(std::span<const std::pair<TokenType, TokenType>> bpeTable);
+    template <typename TokenType>
+    std::basic_string<TokenType> GenerateTokenString(std::span<const std::pair<TokenType, TokenType>> bpeTable, uint tokenCount, uint64_t seed);
+    // Generates text like TryGenerateToStream, with the lookup structures built once by the caller
+    template <typename TokenType>
+    std::string GenerateText(std::span<const std::pair<TokenType, TokenType>> bpeTable, const SuccessorIndex<TokenType>& successorIndex, const DecodeTable& decodeTable, uint64_t tokenCount, uint64_t seed);
+    template <typename TokenType>
+    std::expected<uint64_t, std::string> TryGenerateToStream(std::span<const std::pair<TokenType, TokenType>> bpeTable, uint64_t tokenCount, uint64_t seed, std::ostream& output);
+
+    // Finalizer of MurmurHash3, every input bit affects every output bit
+    inline uint64_t MixHash(uint64_t value)
+    {
+        value ^= value >> 33;
+        value *= 0xFF51AFD7ED558CCDull;
+        value ^= value >> 33;
+        value *= 0xC4CEB9FE1A85EC53ull;
+        value ^= value >> 33;
+
+        return value;
+    }
 
     struct PairHash
     {
         template <class T1, class T2>
         std::size_t operator()(const std::pair<T1, T2>& p) const
         {
-            auto h1 = std::hash<T1>{}(p.first);
-            auto h2 = std::hash<T2>{}(p.second);
-            return h1 ^ h2;
+            // Combining the halves in order keeps (a, b) apart from (b, a), and (x, x) from hashing to zero
+            auto h1 = uint64_t(std::hash<T1>{}(p.first));
+            auto h2 = uint64_t(std::hash<T2>{}(p.second));
+            return MixHash((h1 << 32) ^ h2);
         }
     };
+
+    // Rank of a pair that is not in the BPE table
+    constexpr uint32_t NO_PAIR_RANK{UINT32_MAX};
+
+    /*
+     * Rank of every pair of a BPE table, built once to apply the same table to many inputs. Applying a table looks up
+     * every pair it touches, so this is laid out like PairCountTable: pairs of two raw bytes index a dense
+     * FIRST_TOKEN x FIRST_TOKEN array, all other pairs are packed into one integer key and found by linear probing.
+     */
+    template <typename TokenType>
+    class PairRanks
+    {
+        typedef std::conditional_t<sizeof(TokenType) <= 2, uint32_t, uint64_t> KeyType;
+
+    public:
+        PairRanks()
+            : m_Dense(DENSE_SIZE, NO_PAIR_RANK)
+        {
+        }
+
+        // Keeps the rank the pair already has, a pair listed twice can only ever be merged by its first entry
+        void Add(TokenType first, TokenType second, uint32_t rank)
+        {
+            if (first < FIRST_TOKEN<TokenType> && second < FIRST_TOKEN<TokenType>)
+            {
+                uint32_t& denseRank{m_Dense[first * FIRST_TOKEN<TokenType> + second]};
+                denseRank = std::min(denseRank, rank);
+                return;
+            }
+
+            // Keeping the load at or below one half keeps the probe sequences short
+            if ((m_SparseSize + 1) * 2 > m_Slots.size())
+            {
+                Grow();
+            }
+
+            if (Insert(PackPair(first, second), rank))
+            {
+                ++m_SparseSize;
+            }
+        }
+
+        uint32_t Find(TokenType first, TokenType second) const
+        {
+            if (first < FIRST_TOKEN<TokenType> && second < FIRST_TOKEN<TokenType>)
+            {
+                return m_Dense[first * FIRST_TOKEN<TokenType> + second];
+            }
+
+            if (m_Slots.empty())
+            {
+                return NO_PAIR_RANK;
+            }
+
+            KeyType key{PackPair(first, second)};
+            size_t mask{m_Slots.size() - 1};
+
+            for (size_t i{MixHash(key) & mask};; i = (i + 1) & mask)
+            {
+                if (m_Slots[i].Key == key)
+                {
+                    return m_Slots[i].Rank;
+                }
+
+                if (m_Slots[i].Key == EMPTY_KEY)
+                {
+                    return NO_PAIR_RANK;
+                }
+            }
+        }
+
+    private:
+        static constexpr size_t DENSE_SIZE{size_t(FIRST_TOKEN<TokenType>) * FIRST_TOKEN<TokenType>};
+        // Both tokens of the pair (0, 0) are raw bytes, so that key never reaches the sparse table
+        static constexpr KeyType EMPTY_KEY{0};
+        static constexpr size_t MINIMUM_CAPACITY{64};
+        static constexpr size_t TOKEN_BITS{8 * sizeof(TokenType)};
+
+        struct Slot
+        {
+            KeyType Key;
+            uint32_t Rank;
+        };
+
+        static KeyType PackPair(TokenType first, TokenType second)
+        {
+            return (KeyType(first) << TOKEN_BITS) | second;
+        }
+
+        // Returns whether the key was new, an existing key keeps the lowest of its ranks
+        bool Insert(KeyType key, uint32_t rank)
+        {
+            size_t mask{m_Slots.size() - 1};
+
+            for (size_t i{MixHash(key) & mask};; i = (i + 1) & mask)
+            {
+                if (m_Slots[i].Key == key)
+                {
+                    m_Slots[i].Rank = std::min(m_Slots[i].Rank, rank);
+                    return false;
+                }
+
+                if (m_Slots[i].Key == EMPTY_KEY)
+                {
+                    m_Slots[i] = {key, rank};
+                    return true;
+                }
+            }
+        }
+
+        void Grow()
+        {
+            std::vector<Slot> oldSlots(std::max(MINIMUM_CAPACITY, m_Slots.size() * 2), Slot{EMPTY_KEY, NO_PAIR_RANK});
+            oldSlots.swap(m_Slots);
+
+            for (const Slot& slot : oldSlots)
+            {
+                if (slot.Key != EMPTY_KEY)
+                {
+                    Insert(slot.Key, slot.Rank);
+                }
+            }
+        }
+
+        std::vector<uint32_t> m_Dense;
+        std::vector<Slot> m_Slots;
+        size_t m_SparseSize{0};
+    };
+
+    template <typename TokenType>
+    PairRanks<TokenType> BuildPairRanks(std::span<const std::pair<TokenType, TokenType>> bpeTable);
+    template <typename TokenType>
+    std::tuple<std::basic_string<TokenType>, BpeEncodingResultInfo> ApplyBpeTable(std::string_view input, const PairRanks<TokenType>& ranks);
 } //namespace BPE
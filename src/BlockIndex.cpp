@@ -0,0 +1,238 @@
+#include "BlockIndex.h"
+#include "CompactTokens.h"
+#include "Container.h"
+#include "DecodeKernel.h"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+
+template std::expected<BPE::BlockIndex, std::string> BPE::TryBuildBlockIndex<char8_t>(std::span<const char8_t> tokens, const BPE::DecodeTable& decodeTable, size_t stride);
+template std::expected<BPE::BlockIndex, std::string> BPE::TryBuildBlockIndex<char16_t>(std::span<const char16_t> tokens, const BPE::DecodeTable& decodeTable, size_t stride);
+template std::expected<BPE::BlockIndex, std::string> BPE::TryBuildBlockIndex<char32_t>(std::span<const char32_t> tokens, const BPE::DecodeTable& decodeTable, size_t stride);
+template <typename TokenType>
+std::expected<BPE::BlockIndex, std::string> BPE::TryBuildBlockIndex(std::span<const TokenType> tokens, const BPE::DecodeTable& decodeTable, size_t stride)
+{
+    if (stride == 0)
+    {
+        return std::unexpected{"ERROR: The block index stride must be at least 1 token"};
+    }
+
+    BPE::BlockIndex blockIndex{stride, tokens.size(), {}};
+    blockIndex.Offsets.reserve(tokens.size() / stride + 2);
+
+    uint64_t decodedOffset{0};
+
+    for (size_t i{0}; i < tokens.size(); ++i)
+    {
+        if (i % stride == 0)
+        {
+            blockIndex.Offsets.push_back(decodedOffset);
+        }
+
+        if (tokens[i] >= decodeTable.TokenCount())
+        {
+            return std::unexpected{std::format("ERROR: Token {} is not part of the BPE table", size_t(tokens[i]))};
+        }
+
+        decodedOffset += decodeTable.Offsets[tokens[i] + 1] - decodeTable.Offsets[tokens[i]];
+    }
+
+    blockIndex.Offsets.push_back(decodedOffset);
+
+    return blockIndex;
+}
+
+std::string BPE::SerializeBlockIndex(const BPE::BlockIndex& blockIndex)
+{
+    BPE::BlockIndexHeader header{blockIndex.Stride, blockIndex.TokenCount};
+
+    std::string bytes(sizeof(header) + blockIndex.Offsets.size() * sizeof(uint64_t), '\0');
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    std::memcpy(bytes.data() + sizeof(header), blockIndex.Offsets.data(), blockIndex.Offsets.size() * sizeof(uint64_t));
+
+    return bytes;
+}
+
+std::expected<BPE::BlockIndex, std::string> BPE::TryParseBlockIndex(std::span<const std::byte> bytes)
+{
+    const std::string corruptError{"ERROR: Block index is corrupt"};
+
+    if (bytes.size() < sizeof(BPE::BlockIndexHeader))
+    {
+        return std::unexpected{corruptError};
+    }
+
+    BPE::BlockIndexHeader header{};
+    std::memcpy(&header, bytes.data(), sizeof(header));
+
+    if (header.Stride == 0 || (bytes.size() - sizeof(header)) % sizeof(uint64_t) != 0)
+    {
+        return std::unexpected{corruptError};
+    }
+
+    // Every block but the last holds Stride tokens, and one more offset holds the decoded length
+    uint64_t blockCount{(header.TokenCount + header.Stride - 1) / header.Stride};
+
+    if ((bytes.size() - sizeof(header)) / sizeof(uint64_t) != blockCount + 1)
+    {
+        return std::unexpected{corruptError};
+    }
+
+    BPE::BlockIndex blockIndex{header.Stride, header.TokenCount, std::vector<uint64_t>(blockCount + 1)};
+    std::memcpy(blockIndex.Offsets.data(), bytes.data() + sizeof(header), blockIndex.Offsets.size() * sizeof(uint64_t));
+
+    if (blockIndex.Offsets.front() != 0 || !std::is_sorted(blockIndex.Offsets.begin(), blockIndex.Offsets.end()))
+    {
+        return std::unexpected{corruptError};
+    }
+
+    return blockIndex;
+}
+
+std::expected<BPE::BlockRange, std::string> BPE::TryFindBlockRange(const BPE::BlockIndex& blockIndex, uint64_t start, uint64_t length)
+{
+    if (start > blockIndex.DecodedLength() || length > blockIndex.DecodedLength() - start)
+    {
+        return std::unexpected{std::format("ERROR: Range {}:{} lies outside the {} decoded bytes", start, length, blockIndex.DecodedLength())};
+    }
+
+    if (length == 0)
+    {
+        return BPE::BlockRange{0, 0, start};
+    }
+
+    // The first block starting after start is one past the block holding start, the first block starting at or after
+    // the end of the range is one past the last block needed
+    uint64_t firstBlock{uint64_t(std::upper_bound(blockIndex.Offsets.begin(), blockIndex.Offsets.end() - 1, start) - blockIndex.Offsets.begin()) - 1};
+    uint64_t lastBlock{uint64_t(std::lower_bound(blockIndex.Offsets.begin() + firstBlock, blockIndex.Offsets.end() - 1, start + length) - blockIndex.Offsets.begin())};
+
+    return BPE::BlockRange{firstBlock * blockIndex.Stride, std::min(lastBlock * blockIndex.Stride, blockIndex.TokenCount), blockIndex.Offsets[firstBlock]};
+}
+
+template std::expected<std::string, std::string> BPE::TryDecodeRange<char8_t>(std::span<const char8_t> rangeTokens, const BPE::DecodeTable& decodeTable, const BPE::BlockRange& blockRange, uint64_t start, uint64_t length);
+template std::expected<std::string, std::string> BPE::TryDecodeRange<char16_t>(std::span<const char16_t> rangeTokens, const BPE::DecodeTable& decodeTable, const BPE::BlockRange& blockRange, uint64_t start, uint64_t length);
+template std::expected<std::string, std::string> BPE::TryDecodeRange<char32_t>(std::span<const char32_t> rangeTokens, const BPE::DecodeTable& decodeTable, const BPE::BlockRange& blockRange, uint64_t start, uint64_t length);
+template <typename TokenType>
+std::expected<std::string, std::string> BPE::TryDecodeRange(std::span<const TokenType> rangeTokens, const BPE::DecodeTable& decodeTable, const BPE::BlockRange& blockRange, uint64_t start, uint64_t length)
+{
+    // Walks the expansion lengths to skip the tokens that end before the range, then decodes until the range is covered
+    uint64_t end{start + length};
+    uint64_t position{blockRange.DecodedOffset};
+    size_t firstToken{0};
+    uint64_t firstTokenOffset{position};
+    size_t lastToken{0};
+
+    for (; lastToken < rangeTokens.size() && position < end; ++lastToken)
+    {
+        TokenType token{rangeTokens[lastToken]};
+
+        if (token >= decodeTable.TokenCount())
+        {
+            return std::unexpected{std::format("ERROR: Token {} is not part of the BPE table", size_t(token))};
+        }
+
+        uint64_t tokenEnd{position + (decodeTable.Offsets[token + 1] - decodeTable.Offsets[token])};
+
+        if (tokenEnd <= start)
+        {
+            firstToken = lastToken + 1;
+            firstTokenOffset = tokenEnd;
+        }
+
+        position = tokenEnd;
+    }
+
+    if (position < end || firstTokenOffset > start)
+    {
+        return std::unexpected{"ERROR: Block index does not match the tokens"};
+    }
+
+    std::string result{};
+    result.resize_and_overwrite(position - firstTokenOffset + BPE::COPY_BLOCK_SIZE, [&](char* output, size_t size)
+    {
+        BPE::DecodeInto(rangeTokens.subspan(firstToken, lastToken - firstToken), decodeTable, output, output + size);
+        return position - firstTokenOffset;
+    });
+
+    return result.substr(start - firstTokenOffset, length);
+}
+
+template std::expected<std::string, std::string> BPE::TryDecodeContainerRange<char8_t>(std::span<const std::byte> container, const BPE::DecodeTable& decodeTable, uint64_t start, uint64_t length);
+template std::expected<std::string, std::string> BPE::TryDecodeContainerRange<char16_t>(std::span<const std::byte> container, const BPE::DecodeTable& decodeTable, uint64_t start, uint64_t length);
+template std::expected<std::string, std::string> BPE::TryDecodeContainerRange<char32_t>(std::span<const std::byte> container, const BPE::DecodeTable& decodeTable, uint64_t start, uint64_t length);
+template <typename TokenType>
+std::expected<std::string, std::string> BPE::TryDecodeContainerRange(std::span<const std::byte> container, const BPE::DecodeTable& decodeTable, uint64_t start, uint64_t length)
+{
+    std::expected<BPE::ContainerHeader, std::string> header{BPE::TryReadContainerHeader(container)};
+
+    if (!header.has_value())
+    {
+        return std::unexpected{header.error()};
+    }
+
+    if (header.value().Width != BPE::TOKEN_WIDTH<TokenType>)
+    {
+        return std::unexpected{std::format("ERROR: Container holds {}-bit tokens, not {}-bit tokens", 8 * size_t(header.value().Width), 8 * sizeof(TokenType))};
+    }
+
+    std::expected<std::span<const std::byte>, std::string> indexSection{BPE::TryGetContainerSection(container, BPE::SectionType::BlockIndex)};
+
+    if (!indexSection.has_value())
+    {
+        return std::unexpected{indexSection.error()};
+    }
+
+    std::expected<BPE::BlockIndex, std::string> blockIndex{BPE::TryParseBlockIndex(indexSection.value())};
+
+    if (!blockIndex.has_value())
+    {
+        return std::unexpected{blockIndex.error()};
+    }
+
+    if (blockIndex.value().TokenCount != header.value().TokenCount)
+    {
+        return std::unexpected{"ERROR: Block index does not match the tokens"};
+    }
+
+    std::expected<BPE::BlockRange, std::string> blockRange{BPE::TryFindBlockRange(blockIndex.value(), start, length)};
+
+    if (!blockRange.has_value())
+    {
+        return std::unexpected{blockRange.error()};
+    }
+
+    uint64_t tokenCount{blockRange.value().LastToken - blockRange.value().FirstToken};
+    bool compactTokens{BPE::HasContainerSection(container, BPE::SectionType::CompactTokens)};
+
+    // Not checked against its checksum: hashing the whole section would make every lookup cost as much as decoding it all,
+    // instead of the few blocks of the range. Out-of-table tokens and corrupt compact blocks are still rejected below.
+    std::expected<std::span<const std::byte>, std::string> tokenSection{BPE::TryGetContainerSection(container, compactTokens ? BPE::SectionType::CompactTokens : BPE::SectionType::Tokens, false)};
+
+    if (!tokenSection.has_value())
+    {
+        return std::unexpected{tokenSection.error()};
+    }
+
+    if (compactTokens)
+    {
+        std::expected<std::basic_string<TokenType>, std::string> rangeTokens{BPE::TryReadCompactTokenRange<TokenType>(tokenSection.value(), blockRange.value().FirstToken, tokenCount)};
+
+        if (!rangeTokens.has_value())
+        {
+            return std::unexpected{rangeTokens.error()};
+        }
+
+        return BPE::TryDecodeRange<TokenType>(rangeTokens.value(), decodeTable, blockRange.value(), start, length);
+    }
+
+    // Sections are aligned, so raw tokens are used in place
+    std::span<const TokenType> tokens{reinterpret_cast<const TokenType*>(tokenSection.value().data()), tokenSection.value().size() / sizeof(TokenType)};
+
+    if (tokens.size() != header.value().TokenCount)
+    {
+        return std::unexpected{"ERROR: Block index does not match the tokens"};
+    }
+
+    return BPE::TryDecodeRange(tokens.subspan(blockRange.value().FirstToken, tokenCount), decodeTable, blockRange.value(), start, length);
+}
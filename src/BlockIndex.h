@@ -0,0 +1,66 @@
+#pragma once
+
+#include "BPE.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace BPE
+{
+    /*
+     * A block index records where in the decoded text every Stride-th token starts, so a byte range of the decoded text
+     * can be decoded from the few tokens around it instead of from the start of the token stream.
+     *
+     * Layout: BlockIndexHeader, then one uint64_t decoded offset per block of Stride tokens plus the total decoded length.
+     */
+    struct BlockIndexHeader
+    {
+        uint64_t Stride;
+        uint64_t TokenCount;
+    };
+
+    const size_t DEFAULT_BLOCK_INDEX_STRIDE{4096};
+
+    struct BlockIndex
+    {
+        uint64_t Stride;
+        uint64_t TokenCount;
+        // Token i * Stride starts at decoded offset Offsets[i], the last element is the decoded length
+        std::vector<uint64_t> Offsets;
+
+        uint64_t DecodedLength() const
+        {
+            return Offsets.back();
+        }
+    };
+
+    // Tokens [FirstToken, LastToken) decode to the text starting at DecodedOffset, which contains the requested range
+    struct BlockRange
+    {
+        uint64_t FirstToken;
+        uint64_t LastToken;
+        uint64_t DecodedOffset;
+    };
+
+    template <typename TokenType>
+    std::expected<BlockIndex, std::string> TryBuildBlockIndex(std::span<const TokenType> tokens, const DecodeTable& decodeTable, size_t stride);
+
+    std::string SerializeBlockIndex(const BlockIndex& blockIndex);
+    std::expected<BlockIndex, std::string> TryParseBlockIndex(std::span<const std::byte> bytes);
+
+    // Binary searches the blocks that cover decoded bytes [start, start + length)
+    std::expected<BlockRange, std::string> TryFindBlockRange(const BlockIndex& blockIndex, uint64_t start, uint64_t length);
+
+    // Decodes the tokens of a block range and cuts decoded bytes [start, start + length) out of them
+    template <typename TokenType>
+    std::expected<std::string, std::string> TryDecodeRange(std::span<const TokenType> rangeTokens, const DecodeTable& decodeTable, const BlockRange& blockRange, uint64_t start, uint64_t length);
+
+    // Decodes bytes [start, start + length) of the text in a container with a block index, raw or compact tokens. Only the
+    // table and the index are checked against their checksums, the token section is too large to hash per lookup.
+    template <typename TokenType>
+    std::expected<std::string, std::string> TryDecodeContainerRange(std::span<const std::byte> container, const DecodeTable& decodeTable, uint64_t start, uint64_t length);
+} //namespace BPE
@@ -0,0 +1,255 @@
+#include "CApi.h"
+
+#include "BPE.h"
+#include "Core.h"
+#include "DecodeKernel.h"
+#include "MappedFile.h"
+
+#include <exception>
+#include <new>
+#include <optional>
+#include <string>
+#include <variant>
+
+namespace
+{
+    thread_local std::string g_LastError{};
+
+    bpe_status Fail(bpe_status status, std::string message)
+    {
+        g_LastError = std::move(message);
+        return status;
+    }
+
+    template <typename TokenType>
+    struct LoadedTable
+    {
+        BPE::MappedFile<std::pair<TokenType, TokenType>> Merges;
+        BPE::PairRanks<TokenType> Ranks;
+        BPE::DecodeTable Decode;
+    };
+
+    // Exceptions must not cross into C, the only ones expected here are allocation failures
+    template <typename Function>
+    bpe_status Guard(Function&& function)
+    {
+        try
+        {
+            return function();
+        }
+        catch (const std::bad_alloc&)
+        {
+            return Fail(BPE_ERROR_OUT_OF_MEMORY, "ERROR: Out of memory");
+        }
+        catch (const std::exception& ex)
+        {
+            return Fail(BPE_ERROR_INTERNAL, std::string{"ERROR: "} + ex.what());
+        }
+        catch (...)
+        {
+            return Fail(BPE_ERROR_INTERNAL, "ERROR: Unknown failure");
+        }
+    }
+
+    template <typename TokenType>
+    std::expected<LoadedTable<TokenType>, std::string> TryLoadTable(const std::filesystem::path& path)
+    {
+        std::expected<BPE::MappedFile<std::pair<TokenType, TokenType>>, std::string> merges{BPE::TryMapBpeTable<TokenType>(path)};
+        if (!merges.has_value())
+        {
+            return std::unexpected{merges.error()};
+        }
+
+        std::expected<BPE::DecodeTable, std::string> decodeTable{BPE::TryBuildDecodeTable<TokenType>(merges.value().Span())};
+        if (!decodeTable.has_value())
+        {
+            return std::unexpected{decodeTable.error()};
+        }
+
+        BPE::PairRanks<TokenType> ranks{BPE::BuildPairRanks<TokenType>(merges.value().Span())};
+
+        return LoadedTable<TokenType>{std::move(merges.value()), std::move(ranks), std::move(decodeTable.value())};
+    }
+} //namespace
+
+struct bpe_table
+{
+    std::variant<LoadedTable<char8_t>, LoadedTable<char16_t>, LoadedTable<char32_t>> Table;
+};
+
+struct bpe_scratch
+{
+    std::variant<BPE::ApplyScratch<char8_t>, BPE::ApplyScratch<char16_t>, BPE::ApplyScratch<char32_t>> Scratch;
+};
+
+const char* bpe_last_error(void)
+{
+    return g_LastError.c_str();
+}
+
+bpe_status bpe_table_open(const char* path, bpe_table** table)
+{
+    if (path == nullptr || table == nullptr)
+    {
+        return Fail(BPE_ERROR_INVALID_ARGUMENT, "ERROR: Missing path or table");
+    }
+
+    return Guard([&]() -> bpe_status
+    {
+        std::expected<BPE::TokenWidth, std::string> tokenWidth{BPE::TryReadTokenWidth(path)};
+        if (!tokenWidth.has_value())
+        {
+            return Fail(BPE_ERROR_LOAD, tokenWidth.error());
+        }
+
+        auto open{[&]<typename TokenType>() -> bpe_status
+        {
+            std::expected<LoadedTable<TokenType>, std::string> loadedTable{TryLoadTable<TokenType>(path)};
+            if (!loadedTable.has_value())
+            {
+                return Fail(BPE_ERROR_LOAD, loadedTable.error());
+            }
+
+            *table = new bpe_table{std::move(loadedTable.value())};
+            return BPE_OK;
+        }};
+
+        switch (tokenWidth.value())
+        {
+            case BPE::TokenWidth::Bits8:
+                return open.template operator()<char8_t>();
+            case BPE::TokenWidth::Bits16:
+                return open.template operator()<char16_t>();
+            case BPE::TokenWidth::Bits32:
+                return open.template operator()<char32_t>();
+        }
+
+        return Fail(BPE_ERROR_LOAD, "ERROR: Token width not implemented");
+    });
+}
+
+void bpe_table_close(bpe_table* table)
+{
+    delete table;
+}
+
+size_t bpe_table_token_size(const bpe_table* table)
+{
+    return std::visit([]<typename TokenType>(const LoadedTable<TokenType>&) { return sizeof(TokenType); }, table->Table);
+}
+
+size_t bpe_table_merge_count(const bpe_table* table)
+{
+    return std::visit([](const auto& loadedTable) { return loadedTable.Merges.Span().size(); }, table->Table);
+}
+
+bpe_status bpe_scratch_create(const bpe_table* table, bpe_scratch** scratch)
+{
+    if (table == nullptr || scratch == nullptr)
+    {
+        return Fail(BPE_ERROR_INVALID_ARGUMENT, "ERROR: Missing table or scratch");
+    }
+
+    return Guard([&]() -> bpe_status
+    {
+        *scratch = std::visit([]<typename TokenType>(const LoadedTable<TokenType>&) { return new bpe_scratch{BPE::ApplyScratch<TokenType>{}}; }, table->Table);
+        return BPE_OK;
+    });
+}
+
+void bpe_scratch_destroy(bpe_scratch* scratch)
+{
+    delete scratch;
+}
+
+bpe_status bpe_encode(const bpe_table* table, bpe_scratch* scratch, const void* input, size_t input_size, void* tokens, size_t token_capacity, size_t* token_count)
+{
+    if (table == nullptr || scratch == nullptr || token_count == nullptr || (input == nullptr && input_size > 0) || (tokens == nullptr && token_capacity > 0))
+    {
+        return Fail(BPE_ERROR_INVALID_ARGUMENT, "ERROR: Missing table, scratch, input, tokens or token count");
+    }
+
+    if (table->Table.index() != scratch->Scratch.index())
+    {
+        return Fail(BPE_ERROR_INVALID_ARGUMENT, "ERROR: Scratch was created for a table of another token width");
+    }
+
+    if (token_capacity < input_size)
+    {
+        return Fail(BPE_ERROR_BUFFER_TOO_SMALL, "ERROR: Token buffer is smaller than the input");
+    }
+
+    return Guard([&]() -> bpe_status
+    {
+        return std::visit([&]<typename TokenType>(const LoadedTable<TokenType>& loadedTable) -> bpe_status
+        {
+            std::span<const std::byte> inputBytes{static_cast<const std::byte*>(input), input_size};
+            std::span<TokenType> output{static_cast<TokenType*>(tokens), token_capacity};
+
+            std::expected<size_t, std::string> tokenCount{BPE::TryApplyBpeTableInto<TokenType>(inputBytes, loadedTable.Ranks, std::get<BPE::ApplyScratch<TokenType>>(scratch->Scratch), output)};
+            if (!tokenCount.has_value())
+            {
+                return Fail(BPE_ERROR_INVALID_INPUT, tokenCount.error());
+            }
+
+            *token_count = tokenCount.value();
+            return BPE_OK;
+        }, table->Table);
+    });
+}
+
+bpe_status bpe_decoded_size(const bpe_table* table, const void* tokens, size_t token_count, size_t* output_size)
+{
+    if (table == nullptr || output_size == nullptr || (tokens == nullptr && token_count > 0))
+    {
+        return Fail(BPE_ERROR_INVALID_ARGUMENT, "ERROR: Missing table, tokens or output size");
+    }
+
+    return std::visit([&]<typename TokenType>(const LoadedTable<TokenType>& loadedTable) -> bpe_status
+    {
+        std::optional<uint64_t> decodedLength{BPE::DecodedLength(std::span<const TokenType>{static_cast<const TokenType*>(tokens), token_count}, loadedTable.Decode)};
+        if (!decodedLength.has_value())
+        {
+            return Fail(BPE_ERROR_INVALID_INPUT, "ERROR: Tokens contain a token that is not part of the BPE table");
+        }
+
+        *output_size = size_t(decodedLength.value());
+        return BPE_OK;
+    }, table->Table);
+}
+
+bpe_status bpe_decode(const bpe_table* table, const void* tokens, size_t token_count, void* output, size_t output_capacity, size_t* output_size)
+{
+    if (output_size == nullptr)
+    {
+        return Fail(BPE_ERROR_INVALID_ARGUMENT, "ERROR: Missing output size");
+    }
+
+    size_t decodedSize{0};
+
+    bpe_status status{bpe_decoded_size(table, tokens, token_count, &decodedSize)};
+    if (status != BPE_OK)
+    {
+        return status;
+    }
+
+    if (output == nullptr && output_capacity > 0)
+    {
+        return Fail(BPE_ERROR_INVALID_ARGUMENT, "ERROR: Missing output");
+    }
+
+    if (decodedSize > output_capacity)
+    {
+        return Fail(BPE_ERROR_BUFFER_TOO_SMALL, "ERROR: Output buffer is smaller than the decoded tokens");
+    }
+
+    // The tokens were just validated, so they go to the kernel directly
+    std::visit([&]<typename TokenType>(const LoadedTable<TokenType>& loadedTable)
+    {
+        char* outputBegin{static_cast<char*>(output)};
+        BPE::DecodeInto(std::span<const TokenType>{static_cast<const TokenType*>(tokens), token_count}, loadedTable.Decode, outputBegin, outputBegin + output_capacity);
+    }, table->Table);
+
+    *output_size = decodedSize;
+    return BPE_OK;
+}
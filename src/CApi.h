@@ -0,0 +1,56 @@
+#ifndef BPE_C_API_H
+#define BPE_C_API_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * C interface of the bpe_core library: load a BPE table (or container) once, then encode and decode into buffers the
+ * caller owns. Tokens are passed as arrays of the table's token width (see bpe_table_token_size), aligned to it.
+ *
+ * A table can be used from any number of threads at once. A scratch belongs to one table and to one thread at a time,
+ * it is what lets repeated encoding run without allocating. No function throws, failures return a status and leave a
+ * message that bpe_last_error returns on the same thread.
+ */
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct bpe_table bpe_table;
+typedef struct bpe_scratch bpe_scratch;
+
+typedef enum bpe_status
+{
+    BPE_OK = 0,
+    BPE_ERROR_INVALID_ARGUMENT = 1,
+    BPE_ERROR_LOAD = 2,
+    BPE_ERROR_INVALID_INPUT = 3,
+    BPE_ERROR_BUFFER_TOO_SMALL = 4,
+    BPE_ERROR_OUT_OF_MEMORY = 5,
+    BPE_ERROR_INTERNAL = 6
+} bpe_status;
+
+/* Message of the last failure on the calling thread, empty if there was none */
+const char* bpe_last_error(void);
+
+bpe_status bpe_table_open(const char* path, bpe_table** table);
+void bpe_table_close(bpe_table* table);
+/* Bytes per token: 1, 2 or 4 */
+size_t bpe_table_token_size(const bpe_table* table);
+size_t bpe_table_merge_count(const bpe_table* table);
+
+bpe_status bpe_scratch_create(const bpe_table* table, bpe_scratch** scratch);
+void bpe_scratch_destroy(bpe_scratch* scratch);
+
+/* Encodes input_size bytes, tokens needs room for input_size tokens at most (never more than that are written) */
+bpe_status bpe_encode(const bpe_table* table, bpe_scratch* scratch, const void* input, size_t input_size, void* tokens, size_t token_capacity, size_t* token_count);
+/* Exact number of bytes bpe_decode writes for these tokens */
+bpe_status bpe_decoded_size(const bpe_table* table, const void* tokens, size_t token_count, size_t* output_size);
+bpe_status bpe_decode(const bpe_table* table, const void* tokens, size_t token_count, void* output, size_t output_capacity, size_t* output_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,132 @@
+#include "Checkpoint.h"
+#include "Container.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <system_error>
+
+template std::expected<void, std::string> BPE::TryWriteCheckpoint<char8_t>(const std::filesystem::path& checkpointPath, std::span<const char8_t> bpeTable, std::span<const char8_t> encodedString, std::span<const uint64_t> documentStarts, const BPE::BpeEncodingResultInfo& encodingInfo);
+template std::expected<void, std::string> BPE::TryWriteCheckpoint<char16_t>(const std::filesystem::path& checkpointPath, std::span<const char16_t> bpeTable, std::span<const char16_t> encodedString, std::span<const uint64_t> documentStarts, const BPE::BpeEncodingResultInfo& encodingInfo);
+template std::expected<void, std::string> BPE::TryWriteCheckpoint<char32_t>(const std::filesystem::path& checkpointPath, std::span<const char32_t> bpeTable, std::span<const char32_t> encodedString, std::span<const uint64_t> documentStarts, const BPE::BpeEncodingResultInfo& encodingInfo);
+template <typename TokenType>
+std::expected<void, std::string> BPE::TryWriteCheckpoint(const std::filesystem::path& checkpointPath, std::span<const TokenType> bpeTable, std::span<const TokenType> encodedString, std::span<const uint64_t> documentStarts, const BPE::BpeEncodingResultInfo& encodingInfo)
+{
+    BPE::TrainingStateHeader header{encodingInfo.EncodedStringInitialLength, encodingInfo.EncodingIterationCount, documentStarts.size()};
+
+    std::string trainingState(sizeof(header) + documentStarts.size_bytes(), '\0');
+    std::memcpy(trainingState.data(), &header, sizeof(header));
+    std::memcpy(trainingState.data() + sizeof(header), documentStarts.data(), documentStarts.size_bytes());
+
+    std::string metadata{std::format("checkpoint=1\nmerges={}\ninitial_length={}\nlength={}\ndocuments={}\n", bpeTable.size() / 2, header.EncodedStringInitialLength, encodedString.size(), documentStarts.size())};
+
+    const BPE::ContainerSectionSource sources[]{
+        {BPE::SectionType::MergeTable, std::as_bytes(bpeTable)},
+        {BPE::SectionType::Tokens, std::as_bytes(encodedString)},
+        {BPE::SectionType::TrainingState, std::as_bytes(std::span<const char>{trainingState})},
+        {BPE::SectionType::Metadata, std::as_bytes(std::span<const char>{metadata})},
+    };
+
+    std::filesystem::path temporaryPath{checkpointPath};
+    temporaryPath += ".tmp";
+
+    std::expected<void, std::string> writeResult{BPE::TryWriteContainerSections(temporaryPath, BPE::TOKEN_WIDTH<TokenType>, BPE::FIRST_TOKEN<TokenType> + bpeTable.size() / 2, encodedString.size(), sources)};
+
+    if (!writeResult.has_value())
+    {
+        return writeResult;
+    }
+
+    std::error_code error{};
+    std::filesystem::rename(temporaryPath, checkpointPath, error);
+
+    if (error)
+    {
+        return std::unexpected{std::format("ERROR: Unable to move checkpoint to \"{}\": {}", checkpointPath.c_str(), error.message())};
+    }
+
+    return {};
+}
+
+template std::expected<BPE::TrainingCheckpoint<char8_t>, std::string> BPE::TryReadCheckpoint<char8_t>(const std::filesystem::path& checkpointPath);
+template std::expected<BPE::TrainingCheckpoint<char16_t>, std::string> BPE::TryReadCheckpoint<char16_t>(const std::filesystem::path& checkpointPath);
+template std::expected<BPE::TrainingCheckpoint<char32_t>, std::string> BPE::TryReadCheckpoint<char32_t>(const std::filesystem::path& checkpointPath);
+template <typename TokenType>
+std::expected<BPE::TrainingCheckpoint<TokenType>, std::string> BPE::TryReadCheckpoint(const std::filesystem::path& checkpointPath)
+{
+    std::expected<BPE::FileMapping, std::string> mapping{BPE::FileMapping::TryMap(checkpointPath)};
+    if (!mapping.has_value())
+    {
+        return std::unexpected{mapping.error()};
+    }
+
+    std::span<const std::byte> file{mapping.value().Bytes()};
+
+    std::expected<BPE::ContainerHeader, std::string> header{BPE::TryReadContainerHeader(file)};
+    if (!header.has_value())
+    {
+        return std::unexpected{header.error()};
+    }
+
+    if (header.value().Width != BPE::TOKEN_WIDTH<TokenType>)
+    {
+        return std::unexpected{std::format("ERROR: Checkpoint holds {}-bit tokens, not {}-bit tokens", 8 * size_t(header.value().Width), 8 * sizeof(TokenType))};
+    }
+
+    if (!BPE::HasContainerSection(file, BPE::SectionType::TrainingState))
+    {
+        return std::unexpected{std::format("ERROR: Container at path \"{}\" is not a checkpoint", checkpointPath.c_str())};
+    }
+
+    std::expected<std::span<const std::byte>, std::string> mergeTable{BPE::TryGetContainerSection(file, BPE::SectionType::MergeTable)};
+    std::expected<std::span<const std::byte>, std::string> tokens{BPE::TryGetContainerSection(file, BPE::SectionType::Tokens)};
+    std::expected<std::span<const std::byte>, std::string> trainingState{BPE::TryGetContainerSection(file, BPE::SectionType::TrainingState)};
+
+    for (const auto* section : {&mergeTable, &tokens, &trainingState})
+    {
+        if (!section->has_value())
+        {
+            return std::unexpected{section->error()};
+        }
+    }
+
+    BPE::TrainingStateHeader stateHeader{};
+
+    if (trainingState.value().size() < sizeof(stateHeader))
+    {
+        return std::unexpected{"ERROR: Checkpoint training state is corrupt"};
+    }
+
+    std::memcpy(&stateHeader, trainingState.value().data(), sizeof(stateHeader));
+
+    if (mergeTable.value().size() % (2 * sizeof(TokenType)) != 0 || tokens.value().size() % sizeof(TokenType) != 0 || (trainingState.value().size() - sizeof(stateHeader)) / sizeof(uint64_t) != stateHeader.DocumentCount)
+    {
+        return std::unexpected{"ERROR: Checkpoint training state is corrupt"};
+    }
+
+    BPE::TrainingCheckpoint<TokenType> checkpoint{};
+    checkpoint.BpeTable.resize(mergeTable.value().size() / sizeof(TokenType));
+    checkpoint.EncodedString.resize(tokens.value().size() / sizeof(TokenType));
+    checkpoint.DocumentStarts.resize(stateHeader.DocumentCount);
+
+    std::memcpy(checkpoint.BpeTable.data(), mergeTable.value().data(), mergeTable.value().size());
+    std::memcpy(checkpoint.EncodedString.data(), tokens.value().data(), tokens.value().size());
+    std::memcpy(checkpoint.DocumentStarts.data(), trainingState.value().data() + sizeof(stateHeader), stateHeader.DocumentCount * sizeof(uint64_t));
+
+    // The engine trusts its state, so anything it could trip over is rejected here
+    uint64_t vocabularySize{BPE::FIRST_TOKEN<TokenType> + checkpoint.BpeTable.size() / 2};
+
+    if (std::any_of(checkpoint.EncodedString.begin(), checkpoint.EncodedString.end(), [&](TokenType token) { return token >= vocabularySize; })
+        || !std::is_sorted(checkpoint.DocumentStarts.begin(), checkpoint.DocumentStarts.end())
+        || (!checkpoint.DocumentStarts.empty() && checkpoint.DocumentStarts.back() >= checkpoint.EncodedString.size()))
+    {
+        return std::unexpected{"ERROR: Checkpoint training state is corrupt"};
+    }
+
+    checkpoint.EncodingInfo.EncodedStringInitialLength = stateHeader.EncodedStringInitialLength;
+    checkpoint.EncodingInfo.EncodingIterationCount = stateHeader.EncodingIterationCount;
+    checkpoint.EncodingInfo.EncodedStringLength = checkpoint.EncodedString.size();
+
+    return checkpoint;
+}
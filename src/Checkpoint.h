@@ -0,0 +1,47 @@
+#pragma once
+
+#include "BPE.h"
+
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace BPE
+{
+    /*
+     * A checkpoint is a container (see Container.h) holding the merge table so far, the current token sequence and a
+     * training state section. The incremental engine writes one every few merges and when it stops. The pair counts are
+     * not stored: they follow from the token sequence, and recounting them in one pass on resume trains exactly the
+     * merges the uninterrupted run would have trained. A checkpoint is an ordinary container, so it also decodes.
+     *
+     * Training state layout: TrainingStateHeader, then DocumentCount uint64_t token offsets at which the documents start.
+     */
+    struct TrainingStateHeader
+    {
+        uint64_t EncodedStringInitialLength;
+        uint64_t EncodingIterationCount;
+        uint64_t DocumentCount;
+    };
+
+    const uint64_t DEFAULT_CHECKPOINT_INTERVAL{1000};
+
+    template <typename TokenType>
+    struct TrainingCheckpoint
+    {
+        std::basic_string<TokenType> BpeTable;
+        std::basic_string<TokenType> EncodedString;
+        std::vector<uint64_t> DocumentStarts;
+        BpeEncodingResultInfo EncodingInfo;
+    };
+
+    // Writes the checkpoint next to checkpointPath and renames it over the previous one, so a crash while writing never
+    // leaves a broken checkpoint behind
+    template <typename TokenType>
+    std::expected<void, std::string> TryWriteCheckpoint(const std::filesystem::path& checkpointPath, std::span<const TokenType> bpeTable, std::span<const TokenType> encodedString, std::span<const uint64_t> documentStarts, const BpeEncodingResultInfo& encodingInfo);
+
+    template <typename TokenType>
+    std::expected<TrainingCheckpoint<TokenType>, std::string> TryReadCheckpoint(const std::filesystem::path& checkpointPath);
+} //namespace BPE
@@ -0,0 +1,615 @@
+#include "CompactTokens.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <format>
+#include <functional>
+#include <queue>
+#include <vector>
+
+namespace
+{
+    // Symbols of the code, including the escape symbol, so that even a flat code fits in the maximum code length
+    const size_t MAXIMUM_SYMBOL_COUNT{size_t(1) << BPE::COMPACT_MAXIMUM_CODE_LENGTH};
+    const uint64_t LOOKUP_MASK{MAXIMUM_SYMBOL_COUNT - 1};
+
+    // Blocks decoded in lockstep by one thread, and the blocks one decoding task covers
+    const size_t INTERLEAVED_BLOCK_COUNT{4};
+    const size_t BLOCKS_PER_TASK{8 * INTERLEAVED_BLOCK_COUNT};
+
+    std::vector<uint8_t> BuildHuffmanCodeLengths(const std::vector<uint64_t>& frequencies)
+    {
+        size_t symbolCount{frequencies.size()};
+        std::vector<uint8_t> codeLengths(symbolCount, 1);
+
+        if (symbolCount < 2)
+        {
+            return codeLengths;
+        }
+
+        // The first symbolCount nodes are the leaves, every merge appends a node whose parent is filled in later
+        std::vector<uint64_t> weights{frequencies};
+        std::vector<size_t> parents(2 * symbolCount - 1, 0);
+
+        typedef std::pair<uint64_t, size_t> WeightedNode;
+        std::priority_queue<WeightedNode, std::vector<WeightedNode>, std::greater<WeightedNode>> nodes{};
+
+        for (size_t symbol{0}; symbol < symbolCount; ++symbol)
+        {
+            nodes.push({weights[symbol], symbol});
+        }
+
+        while (nodes.size() > 1)
+        {
+            auto [firstWeight, firstNode]{nodes.top()};
+            nodes.pop();
+            auto [secondWeight, secondNode]{nodes.top()};
+            nodes.pop();
+
+            size_t parent{weights.size()};
+            weights.push_back(firstWeight + secondWeight);
+            parents[firstNode] = parent;
+            parents[secondNode] = parent;
+            nodes.push({weights.back(), parent});
+        }
+
+        // Parents are created after their children, so walking down from the root fills in every depth before it is needed
+        std::vector<uint8_t> depths(weights.size(), 0);
+
+        for (size_t node{weights.size() - 1}; node-- > 0;)
+        {
+            depths[node] = uint8_t(depths[parents[node]] + 1);
+        }
+
+        std::copy_n(depths.begin(), symbolCount, codeLengths.begin());
+
+        return codeLengths;
+    }
+
+    // Flattening the frequencies until the longest code fits keeps the code optimal for the flattened frequencies, and
+    // terminates because equal frequencies give a code of at most COMPACT_MAXIMUM_CODE_LENGTH bits
+    std::vector<uint8_t> BuildLimitedCodeLengths(std::vector<uint64_t> frequencies)
+    {
+        while (true)
+        {
+            std::vector<uint8_t> codeLengths{BuildHuffmanCodeLengths(frequencies)};
+
+            if (*std::max_element(codeLengths.begin(), codeLengths.end()) <= BPE::COMPACT_MAXIMUM_CODE_LENGTH)
+            {
+                return codeLengths;
+            }
+
+            for (uint64_t& frequency : frequencies)
+            {
+                frequency = (frequency + 1) / 2;
+            }
+        }
+    }
+
+    // Canonical codes, bit reversed because the bit stream is written and read starting at the least significant bit
+    std::vector<uint32_t> BuildCanonicalCodes(const std::vector<uint8_t>& codeLengths)
+    {
+        std::vector<uint32_t> lengthCounts(BPE::COMPACT_MAXIMUM_CODE_LENGTH + 1, 0);
+
+        for (uint8_t codeLength : codeLengths)
+        {
+            lengthCounts[codeLength]++;
+        }
+
+        std::vector<uint32_t> nextCodes(BPE::COMPACT_MAXIMUM_CODE_LENGTH + 1, 0);
+
+        for (size_t length{1}; length <= BPE::COMPACT_MAXIMUM_CODE_LENGTH; ++length)
+        {
+            nextCodes[length] = (nextCodes[length - 1] + lengthCounts[length - 1]) << 1;
+        }
+
+        std::vector<uint32_t> codes(codeLengths.size());
+
+        for (size_t symbol{0}; symbol < codeLengths.size(); ++symbol)
+        {
+            uint32_t code{nextCodes[codeLengths[symbol]]++};
+            uint32_t reversedCode{0};
+
+            for (uint8_t bit{0}; bit < codeLengths[symbol]; ++bit)
+            {
+                reversedCode |= ((code >> bit) & 1) << (codeLengths[symbol] - 1 - bit);
+            }
+
+            codes[symbol] = reversedCode;
+        }
+
+        return codes;
+    }
+
+    // Only complete codes are accepted: every lookup then resolves to a symbol and consumes at least one bit
+    bool IsCompleteCode(std::span<const uint8_t> codeLengths)
+    {
+        uint64_t kraftSum{0};
+
+        for (uint8_t codeLength : codeLengths)
+        {
+            if (codeLength == 0 || codeLength > BPE::COMPACT_MAXIMUM_CODE_LENGTH)
+            {
+                return false;
+            }
+
+            kraftSum += uint64_t(1) << (BPE::COMPACT_MAXIMUM_CODE_LENGTH - codeLength);
+        }
+
+        return kraftSum == MAXIMUM_SYMBOL_COUNT;
+    }
+
+    class BitWriter
+    {
+    public:
+        explicit BitWriter(std::string& output)
+            : m_Output{output}
+        {
+        }
+
+        // Appends the low `bitCount` bits of value, at most 32 at a time
+        void Write(uint64_t value, unsigned bitCount)
+        {
+            m_Buffer |= value << m_BufferedBits;
+            m_BufferedBits += bitCount;
+
+            while (m_BufferedBits >= 8)
+            {
+                m_Output.push_back(char(m_Buffer));
+                m_Buffer >>= 8;
+                m_BufferedBits -= 8;
+            }
+        }
+
+        void Flush()
+        {
+            if (m_BufferedBits > 0)
+            {
+                m_Output.push_back(char(m_Buffer));
+                m_Buffer = 0;
+                m_BufferedBits = 0;
+            }
+        }
+
+    private:
+        std::string& m_Output;
+        uint64_t m_Buffer{0};
+        unsigned m_BufferedBits{0};
+    };
+
+    struct DecodingTables
+    {
+        // Indexed by the next COMPACT_MAXIMUM_CODE_LENGTH bits of the stream: symbol << 8 | code length
+        std::vector<uint32_t> Lookup;
+        std::vector<uint32_t> SymbolTokens;
+        uint32_t EscapeSymbol;
+        unsigned EscapeBits;
+    };
+
+    // Decodes the token at bitPosition and moves past it. The unaligned 8-byte load holds at least 56 valid bits, which
+    // covers the longest code plus an escaped token of up to 32 bits.
+    template <typename TokenType>
+    inline TokenType DecodeToken(const std::byte* data, uint64_t& bitPosition, const DecodingTables& tables, uint64_t escapeMask)
+    {
+        uint64_t bits{};
+        std::memcpy(&bits, data + (bitPosition >> 3), sizeof(bits));
+        bits >>= bitPosition & 7;
+
+        uint32_t entry{tables.Lookup[bits & LOOKUP_MASK]};
+        uint32_t codeLength{entry & 0xFF};
+        uint32_t symbol{entry >> 8};
+
+        if (symbol != tables.EscapeSymbol)
+        {
+            bitPosition += codeLength;
+            return TokenType(tables.SymbolTokens[symbol]);
+        }
+
+        bitPosition += codeLength + tables.EscapeBits;
+        return TokenType((bits >> codeLength) & escapeMask);
+    }
+
+    /*
+     * Decodes consecutive blocks into consecutive output. Every token of a block depends on the position after the
+     * previous one, so a single block is a chain of load -> lookup -> load. Full groups of INTERLEAVED_BLOCK_COUNT blocks
+     * are decoded in lockstep instead, which lets the independent chains overlap.
+     */
+    template <typename TokenType>
+    bool DecodeBlocks(const std::byte* data, std::span<const uint64_t> blockOffsets, const DecodingTables& tables, TokenType* output, size_t tokenCount)
+    {
+        size_t blockCount{blockOffsets.size() - 1};
+        uint64_t escapeMask{(uint64_t(1) << tables.EscapeBits) - 1};
+
+        uint64_t bitPositions[INTERLEAVED_BLOCK_COUNT];
+        uint64_t endBits[INTERLEAVED_BLOCK_COUNT];
+        size_t block{0};
+
+        for (; block + INTERLEAVED_BLOCK_COUNT <= blockCount && (block + INTERLEAVED_BLOCK_COUNT) * BPE::COMPACT_BLOCK_TOKEN_COUNT <= tokenCount; block += INTERLEAVED_BLOCK_COUNT)
+        {
+            for (size_t lane{0}; lane < INTERLEAVED_BLOCK_COUNT; ++lane)
+            {
+                bitPositions[lane] = blockOffsets[block + lane] * 8;
+                endBits[lane] = blockOffsets[block + lane + 1] * 8;
+            }
+
+            TokenType* groupOutput{output + block * BPE::COMPACT_BLOCK_TOKEN_COUNT};
+
+            for (size_t i{0}; i < BPE::COMPACT_BLOCK_TOKEN_COUNT; ++i)
+            {
+                bool overrun{false};
+
+                for (size_t lane{0}; lane < INTERLEAVED_BLOCK_COUNT; ++lane)
+                {
+                    groupOutput[lane * BPE::COMPACT_BLOCK_TOKEN_COUNT + i] = DecodeToken<TokenType>(data, bitPositions[lane], tables, escapeMask);
+                    overrun |= bitPositions[lane] > endBits[lane];
+                }
+
+                // A corrupt block must not read past its own bytes, the padding covers the load at the very end
+                if (overrun)
+                {
+                    return false;
+                }
+            }
+        }
+
+        for (; block < blockCount; ++block)
+        {
+            uint64_t bitPosition{blockOffsets[block] * 8};
+            uint64_t endBit{blockOffsets[block + 1] * 8};
+            size_t begin{block * BPE::COMPACT_BLOCK_TOKEN_COUNT};
+            size_t end{std::min(begin + BPE::COMPACT_BLOCK_TOKEN_COUNT, tokenCount)};
+
+            for (size_t i{begin}; i < end; ++i)
+            {
+                output[i] = DecodeToken<TokenType>(data, bitPosition, tables, escapeMask);
+
+                if (bitPosition > endBit)
+                {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    // A compact token file whose header, code and block offsets have been checked, ready to decode blocks from
+    struct CompactTokenReader
+    {
+        uint64_t TokenCount;
+        DecodingTables Tables;
+        std::vector<uint64_t> BlockOffsets;
+        const std::byte* Data;
+
+        size_t BlockCount() const
+        {
+            return BlockOffsets.size() - 1;
+        }
+    };
+
+    std::expected<CompactTokenReader, std::string> TryOpenCompactTokens(std::span<const std::byte> file, BPE::TokenWidth width)
+    {
+        if (!BPE::IsCompactTokenFile(file))
+        {
+            return std::unexpected{"ERROR: Not a compact token file"};
+        }
+
+        BPE::CompactTokenHeader header{};
+        std::memcpy(&header, file.data(), sizeof(header));
+
+        if (header.Width != width)
+        {
+            return std::unexpected{std::format("ERROR: Compact token file holds {}-bit tokens, not {}-bit tokens", 8 * size_t(header.Width), 8 * size_t(width))};
+        }
+
+        const std::string corruptError{"ERROR: Compact token file is corrupt"};
+
+        // Without tokens the code is the escape symbol alone, which is never read
+        bool emptyCode{header.TokenCount == 0 && header.SymbolCount == 1};
+        bool packed{header.Coding == BPE::CompactCoding::Packed};
+
+        if (header.Coding != BPE::CompactCoding::Huffman && !packed)
+        {
+            return std::unexpected{std::format("ERROR: Compact token file uses unknown coding {}", size_t(header.Coding))};
+        }
+
+        if ((header.SymbolCount < 2 && !emptyCode && !packed) || (packed && header.SymbolCount != 1) || header.SymbolCount > MAXIMUM_SYMBOL_COUNT || header.EscapeBits == 0 || header.EscapeBits > 8 * size_t(width))
+        {
+            return std::unexpected{corruptError};
+        }
+
+        uint64_t blockCount{(header.TokenCount + BPE::COMPACT_BLOCK_TOKEN_COUNT - 1) / BPE::COMPACT_BLOCK_TOKEN_COUNT};
+        uint64_t symbolsOffset{sizeof(header)};
+        uint64_t codeLengthsOffset{symbolsOffset + (header.SymbolCount - 1) * sizeof(uint32_t)};
+        uint64_t blockOffsetsOffset{codeLengthsOffset + header.SymbolCount};
+        uint64_t dataOffset{blockOffsetsOffset + (blockCount + 1) * sizeof(uint64_t)};
+
+        if (blockCount > file.size() / sizeof(uint64_t) || dataOffset + BPE::COMPACT_TAIL_PADDING > file.size())
+        {
+            return std::unexpected{corruptError};
+        }
+
+        CompactTokenReader reader{};
+        reader.TokenCount = header.TokenCount;
+        reader.Tables.SymbolTokens.resize(header.SymbolCount, 0);
+        reader.Tables.EscapeSymbol = header.SymbolCount - 1;
+        reader.Tables.EscapeBits = header.EscapeBits;
+        std::memcpy(reader.Tables.SymbolTokens.data(), file.data() + symbolsOffset, (header.SymbolCount - 1) * sizeof(uint32_t));
+
+        std::span<const uint8_t> codeLengths{reinterpret_cast<const uint8_t*>(file.data() + codeLengthsOffset), header.SymbolCount};
+
+        if (packed ? codeLengths[0] != 0 : !emptyCode && !IsCompleteCode(codeLengths))
+        {
+            return std::unexpected{corruptError};
+        }
+
+        std::vector<uint32_t> codes{BuildCanonicalCodes({codeLengths.begin(), codeLengths.end()})};
+        reader.Tables.Lookup.resize(MAXIMUM_SYMBOL_COUNT);
+
+        for (uint32_t symbol{0}; symbol < header.SymbolCount; ++symbol)
+        {
+            for (size_t index{codes[symbol]}; index < MAXIMUM_SYMBOL_COUNT; index += size_t(1) << codeLengths[symbol])
+            {
+                reader.Tables.Lookup[index] = symbol << 8 | codeLengths[symbol];
+            }
+        }
+
+        reader.BlockOffsets.resize(blockCount + 1);
+        std::memcpy(reader.BlockOffsets.data(), file.data() + blockOffsetsOffset, reader.BlockOffsets.size() * sizeof(uint64_t));
+
+        if (reader.BlockOffsets.front() != 0 || !std::is_sorted(reader.BlockOffsets.begin(), reader.BlockOffsets.end()) || dataOffset + reader.BlockOffsets.back() + BPE::COMPACT_TAIL_PADDING != file.size())
+        {
+            return std::unexpected{corruptError};
+        }
+
+        reader.Data = file.data() + dataOffset;
+
+        return reader;
+    }
+} //namespace
+
+bool BPE::IsCompactTokenFile(std::span<const std::byte> file)
+{
+    if (file.size() < sizeof(BPE::CompactTokenHeader) || std::memcmp(file.data(), BPE::COMPACT_TOKEN_MAGIC, sizeof(BPE::COMPACT_TOKEN_MAGIC)) != 0)
+    {
+        return false;
+    }
+
+    BPE::CompactTokenHeader header{};
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    return header.FileSize == file.size();
+}
+
+template std::expected<std::string, std::string> BPE::TryEncodeCompactTokens<char8_t>(std::span<const char8_t> tokens, size_t vocabularySize, unsigned threadCount);
+template std::expected<std::string, std::string> BPE::TryEncodeCompactTokens<char16_t>(std::span<const char16_t> tokens, size_t vocabularySize, unsigned threadCount);
+template std::expected<std::string, std::string> BPE::TryEncodeCompactTokens<char32_t>(std::span<const char32_t> tokens, size_t vocabularySize, unsigned threadCount);
+/*
+ * The code is built from the token frequencies of the data being written. Only the COMPACT_BLOCK_TOKEN_COUNT tokens of
+ * one block are coded per task, so the blocks are coded in parallel and concatenated afterwards. Packed coding reuses
+ * the same writer and decoder with a zero-length escape code.
+ */
+template <typename TokenType>
+std::expected<std::string, std::string> BPE::TryEncodeCompactTokens(std::span<const TokenType> tokens, size_t vocabularySize, unsigned threadCount)
+{
+    std::vector<uint64_t> tokenFrequencies(vocabularySize, 0);
+
+    for (TokenType token : tokens)
+    {
+        if (token >= vocabularySize)
+        {
+            return std::unexpected{std::format("ERROR: Token {} is not part of the BPE table", size_t(token))};
+        }
+
+        tokenFrequencies[token]++;
+    }
+
+    std::vector<uint32_t> codedTokens{};
+
+    for (size_t token{0}; token < vocabularySize; ++token)
+    {
+        if (tokenFrequencies[token] > 0)
+        {
+            codedTokens.push_back(uint32_t(token));
+        }
+    }
+
+    // The most frequent tokens get a code of their own, the rest share the escape symbol
+    std::stable_sort(codedTokens.begin(), codedTokens.end(), [&](uint32_t a, uint32_t b) { return tokenFrequencies[a] > tokenFrequencies[b]; });
+    codedTokens.resize(std::min(codedTokens.size(), MAXIMUM_SYMBOL_COUNT - 1));
+
+    std::vector<uint32_t> symbolOfToken(vocabularySize, uint32_t(codedTokens.size()));
+    std::vector<uint64_t> symbolFrequencies{};
+    uint64_t escapedTokenCount{tokens.size()};
+
+    for (size_t symbol{0}; symbol < codedTokens.size(); ++symbol)
+    {
+        symbolOfToken[codedTokens[symbol]] = uint32_t(symbol);
+        symbolFrequencies.push_back(tokenFrequencies[codedTokens[symbol]]);
+        escapedTokenCount -= tokenFrequencies[codedTokens[symbol]];
+    }
+
+    // The escape symbol is always part of the code, which keeps the code complete for a single distinct token
+    symbolFrequencies.push_back(std::max<uint64_t>(escapedTokenCount, 1));
+
+    std::vector<uint8_t> codeLengths{BuildLimitedCodeLengths(symbolFrequencies)};
+    unsigned escapeBits{std::max(unsigned(std::bit_width(vocabularySize - 1)), 1u)};
+
+    // Both sizes leave out the byte alignment of the blocks, which costs the same for either coding
+    uint64_t huffmanBits{8 * (codedTokens.size() * sizeof(uint32_t) + codeLengths.size()) + escapedTokenCount * escapeBits};
+
+    for (size_t symbol{0}; symbol < codeLengths.size(); ++symbol)
+    {
+        huffmanBits += (symbol < codedTokens.size() ? tokenFrequencies[codedTokens[symbol]] : escapedTokenCount) * codeLengths[symbol];
+    }
+
+    BPE::CompactCoding coding{BPE::CompactCoding::Huffman};
+
+    if (8 + tokens.size() * escapeBits < huffmanBits)
+    {
+        coding = BPE::CompactCoding::Packed;
+        codedTokens.clear();
+        codeLengths.assign(1, 0);
+        std::fill(symbolOfToken.begin(), symbolOfToken.end(), 0);
+    }
+
+    std::vector<uint32_t> codes{BuildCanonicalCodes(codeLengths)};
+    uint32_t escapeSymbol{uint32_t(codedTokens.size())};
+
+    size_t blockCount{(tokens.size() + BPE::COMPACT_BLOCK_TOKEN_COUNT - 1) / BPE::COMPACT_BLOCK_TOKEN_COUNT};
+    std::vector<std::string> blocks(blockCount);
+
+    BPE::ThreadPool threadPool{threadCount};
+    threadPool.ParallelFor(blockCount, [&](size_t block)
+    {
+        std::span<const TokenType> blockTokens{tokens.subspan(block * BPE::COMPACT_BLOCK_TOKEN_COUNT, std::min(BPE::COMPACT_BLOCK_TOKEN_COUNT, tokens.size() - block * BPE::COMPACT_BLOCK_TOKEN_COUNT))};
+        BitWriter writer{blocks[block]};
+
+        for (TokenType token : blockTokens)
+        {
+            uint32_t symbol{symbolOfToken[token]};
+            writer.Write(codes[symbol], codeLengths[symbol]);
+
+            if (symbol == escapeSymbol)
+            {
+                writer.Write(token, escapeBits);
+            }
+        }
+
+        writer.Flush();
+    });
+
+    std::vector<uint64_t> blockOffsets(blockCount + 1, 0);
+
+    for (size_t block{0}; block < blockCount; ++block)
+    {
+        blockOffsets[block + 1] = blockOffsets[block] + blocks[block].size();
+    }
+
+    BPE::CompactTokenHeader header{};
+    std::copy(std::begin(BPE::COMPACT_TOKEN_MAGIC), std::end(BPE::COMPACT_TOKEN_MAGIC), header.Magic);
+    header.Width = BPE::TOKEN_WIDTH<TokenType>;
+    header.EscapeBits = uint8_t(escapeBits);
+    header.Coding = coding;
+    header.SymbolCount = uint32_t(codeLengths.size());
+    header.TokenCount = tokens.size();
+    header.FileSize = sizeof(header) + codedTokens.size() * sizeof(uint32_t) + codeLengths.size() + blockOffsets.size() * sizeof(uint64_t) + blockOffsets.back() + BPE::COMPACT_TAIL_PADDING;
+
+    std::string file{};
+    file.reserve(header.FileSize);
+    file.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.append(reinterpret_cast<const char*>(codedTokens.data()), codedTokens.size() * sizeof(uint32_t));
+    file.append(reinterpret_cast<const char*>(codeLengths.data()), codeLengths.size());
+    file.append(reinterpret_cast<const char*>(blockOffsets.data()), blockOffsets.size() * sizeof(uint64_t));
+
+    for (const std::string& block : blocks)
+    {
+        file.append(block);
+    }
+
+    file.append(BPE::COMPACT_TAIL_PADDING, '\0');
+
+    return file;
+}
+
+template std::expected<void, std::string> BPE::TryWriteCompactTokenFile<char8_t>(std::span<const char8_t> tokens, size_t vocabularySize, const std::filesystem::path& outputFilePath, unsigned threadCount);
+template std::expected<void, std::string> BPE::TryWriteCompactTokenFile<char16_t>(std::span<const char16_t> tokens, size_t vocabularySize, const std::filesystem::path& outputFilePath, unsigned threadCount);
+template std::expected<void, std::string> BPE::TryWriteCompactTokenFile<char32_t>(std::span<const char32_t> tokens, size_t vocabularySize, const std::filesystem::path& outputFilePath, unsigned threadCount);
+template <typename TokenType>
+std::expected<void, std::string> BPE::TryWriteCompactTokenFile(std::span<const TokenType> tokens, size_t vocabularySize, const std::filesystem::path& outputFilePath, unsigned threadCount)
+{
+    std::expected<std::string, std::string> file{BPE::TryEncodeCompactTokens(tokens, vocabularySize, threadCount)};
+
+    if (!file.has_value())
+    {
+        return std::unexpected{file.error()};
+    }
+
+    return BPE::TryWriteBasicStringToFile(file.value(), outputFilePath);
+}
+
+template std::expected<std::basic_string<char8_t>, std::string> BPE::TryReadCompactTokens<char8_t>(std::span<const std::byte> file, unsigned threadCount);
+template std::expected<std::basic_string<char16_t>, std::string> BPE::TryReadCompactTokens<char16_t>(std::span<const std::byte> file, unsigned threadCount);
+template std::expected<std::basic_string<char32_t>, std::string> BPE::TryReadCompactTokens<char32_t>(std::span<const std::byte> file, unsigned threadCount);
+template <typename TokenType>
+std::expected<std::basic_string<TokenType>, std::string> BPE::TryReadCompactTokens(std::span<const std::byte> file, unsigned threadCount)
+{
+    std::expected<CompactTokenReader, std::string> reader{TryOpenCompactTokens(file, BPE::TOKEN_WIDTH<TokenType>)};
+
+    if (!reader.has_value())
+    {
+        return std::unexpected{reader.error()};
+    }
+
+    size_t blockCount{reader.value().BlockCount()};
+    // Tasks decode whole groups of interleaved blocks
+    size_t taskCount{(blockCount + BLOCKS_PER_TASK - 1) / BLOCKS_PER_TASK};
+    std::vector<char> taskValid(taskCount, false);
+
+    std::basic_string<TokenType> tokens{};
+    tokens.resize_and_overwrite(reader.value().TokenCount, [&](TokenType* output, size_t size)
+    {
+        BPE::ThreadPool threadPool{threadCount};
+        threadPool.ParallelFor(taskCount, [&](size_t task)
+        {
+            size_t firstBlock{task * BLOCKS_PER_TASK};
+            size_t lastBlock{std::min<size_t>(firstBlock + BLOCKS_PER_TASK, blockCount)};
+            size_t begin{firstBlock * BPE::COMPACT_BLOCK_TOKEN_COUNT};
+            size_t end{std::min(lastBlock * BPE::COMPACT_BLOCK_TOKEN_COUNT, size)};
+            std::span<const uint64_t> taskBlockOffsets{reader.value().BlockOffsets.data() + firstBlock, lastBlock - firstBlock + 1};
+
+            taskValid[task] = DecodeBlocks(reader.value().Data, taskBlockOffsets, reader.value().Tables, output + begin, end - begin);
+        });
+
+        return size;
+    });
+
+    if (std::find(taskValid.begin(), taskValid.end(), false) != taskValid.end())
+    {
+        return std::unexpected{"ERROR: Compact token file is corrupt"};
+    }
+
+    return tokens;
+}
+
+template std::expected<std::basic_string<char8_t>, std::string> BPE::TryReadCompactTokenRange<char8_t>(std::span<const std::byte> file, uint64_t firstToken, uint64_t tokenCount);
+template std::expected<std::basic_string<char16_t>, std::string> BPE::TryReadCompactTokenRange<char16_t>(std::span<const std::byte> file, uint64_t firstToken, uint64_t tokenCount);
+template std::expected<std::basic_string<char32_t>, std::string> BPE::TryReadCompactTokenRange<char32_t>(std::span<const std::byte> file, uint64_t firstToken, uint64_t tokenCount);
+template <typename TokenType>
+std::expected<std::basic_string<TokenType>, std::string> BPE::TryReadCompactTokenRange(std::span<const std::byte> file, uint64_t firstToken, uint64_t tokenCount)
+{
+    std::expected<CompactTokenReader, std::string> reader{TryOpenCompactTokens(file, BPE::TOKEN_WIDTH<TokenType>)};
+
+    if (!reader.has_value())
+    {
+        return std::unexpected{reader.error()};
+    }
+
+    if (firstToken > reader.value().TokenCount || tokenCount > reader.value().TokenCount - firstToken)
+    {
+        return std::unexpected{std::format("ERROR: Tokens [{}, {}) are outside the {} tokens of the compact token file", firstToken, firstToken + tokenCount, reader.value().TokenCount)};
+    }
+
+    if (tokenCount == 0)
+    {
+        return std::basic_string<TokenType>{};
+    }
+
+    // Only the blocks overlapping the range are decoded, then the tokens before and after it are dropped
+    size_t firstBlock{firstToken / BPE::COMPACT_BLOCK_TOKEN_COUNT};
+    size_t lastBlock{(firstToken + tokenCount + BPE::COMPACT_BLOCK_TOKEN_COUNT - 1) / BPE::COMPACT_BLOCK_TOKEN_COUNT};
+    size_t begin{firstBlock * BPE::COMPACT_BLOCK_TOKEN_COUNT};
+    size_t end{std::min<size_t>(lastBlock * BPE::COMPACT_BLOCK_TOKEN_COUNT, reader.value().TokenCount)};
+    std::span<const uint64_t> blockOffsets{reader.value().BlockOffsets.data() + firstBlock, lastBlock - firstBlock + 1};
+
+    std::basic_string<TokenType> tokens(end - begin, TokenType{0});
+
+    if (!DecodeBlocks(reader.value().Data, blockOffsets, reader.value().Tables, tokens.data(), tokens.size()))
+    {
+        return std::unexpected{"ERROR: Compact token file is corrupt"};
+    }
+
+    return tokens.substr(firstToken - begin, tokenCount);
+}
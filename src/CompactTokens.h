@@ -0,0 +1,67 @@
+#pragma once
+
+#include "BPE.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <span>
+#include <string>
+
+namespace BPE
+{
+    /*
+     * Compact token files store the tokens entropy coded instead of as raw little-endian values. The most frequent
+     * tokens get a canonical Huffman code of at most COMPACT_MAXIMUM_CODE_LENGTH bits, every other token is written as an
+     * escape code followed by the token bit-packed at ceil(log2(vocabulary size)) bits. When that would not be smaller
+     * than bit-packing every token (tokens spread evenly over a large vocabulary), the file is Packed instead: its code
+     * is the escape symbol alone with a code length of 0, so every token is just its EscapeBits bits.
+     *
+     * Layout: CompactTokenHeader, the tokens of the coded symbols (uint32_t each, the escape symbol comes last and has
+     * none), the code length of every symbol (uint8_t each), the byte offset of every block in the coded data plus the
+     * end offset (uint64_t each), the coded data and COMPACT_TAIL_PADDING zero bytes. Every block codes
+     * COMPACT_BLOCK_TOKEN_COUNT tokens (the last one the remainder) and starts at a byte boundary, so blocks decode
+     * independently.
+     */
+    enum class CompactCoding : uint8_t
+    {
+        Huffman = 0,
+        Packed = 1
+    };
+
+    struct CompactTokenHeader
+    {
+        char Magic[8];
+        TokenWidth Width;
+        uint8_t EscapeBits;
+        CompactCoding Coding;
+        uint8_t Reserved;
+        // Coded symbols including the escape symbol
+        uint32_t SymbolCount;
+        uint64_t TokenCount;
+        // Size of the whole file, which tells compact token files apart from raw tokens that happen to start with the magic
+        uint64_t FileSize;
+    };
+
+    constexpr char COMPACT_TOKEN_MAGIC[8]{'B', 'P', 'E', 'C', 'T', 'O', 'K', '1'};
+
+    const size_t COMPACT_BLOCK_TOKEN_COUNT{1 << 14};
+    const unsigned COMPACT_MAXIMUM_CODE_LENGTH{12};
+    // Lets the decoder load 8 bytes at any position of the coded data
+    const size_t COMPACT_TAIL_PADDING{8};
+
+    bool IsCompactTokenFile(std::span<const std::byte> file);
+
+    // The whole compact token file, tokens at or above vocabularySize are rejected as they cannot be part of the BPE table
+    template <typename TokenType>
+    std::expected<std::string, std::string> TryEncodeCompactTokens(std::span<const TokenType> tokens, size_t vocabularySize, unsigned threadCount);
+    template <typename TokenType>
+    std::expected<void, std::string> TryWriteCompactTokenFile(std::span<const TokenType> tokens, size_t vocabularySize, const std::filesystem::path& outputFilePath, unsigned threadCount);
+
+    template <typename TokenType>
+    std::expected<std::basic_string<TokenType>, std::string> TryReadCompactTokens(std::span<const std::byte> file, unsigned threadCount);
+    // Tokens [firstToken, firstToken + tokenCount), decoding only the blocks that overlap them
+    template <typename TokenType>
+    std::expected<std::basic_string<TokenType>, std::string> TryReadCompactTokenRange(std::span<const std::byte> file, uint64_t firstToken, uint64_t tokenCount);
+} //namespace BPE
@@ -0,0 +1,408 @@
+#include "CompiledEncoder.h"
+#include "Container.h"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <unordered_map>
+
+namespace
+{
+    // Byte offsets of the arrays of a serialized encoder
+    struct CompiledLayout
+    {
+        size_t EdgeBegins;
+        size_t EdgeTargets;
+        size_t NodeTokens;
+        size_t TokenLengths;
+        size_t PrefixTokens;
+        size_t EdgeBytes;
+        size_t Size;
+    };
+
+    CompiledLayout LayoutOf(const BPE::CompiledEncoderHeader& header)
+    {
+        CompiledLayout layout{};
+        size_t offset{sizeof(header)};
+
+        layout.EdgeBegins = offset;
+        offset += (size_t(header.NodeCount) + 1) * sizeof(uint32_t);
+        layout.EdgeTargets = offset;
+        offset += size_t(header.EdgeCount) * sizeof(uint32_t);
+        layout.NodeTokens = offset;
+        offset += size_t(header.NodeCount) * sizeof(uint32_t);
+        layout.TokenLengths = offset;
+        offset += size_t(header.VocabularySize) * sizeof(uint32_t);
+        layout.PrefixTokens = offset;
+        offset += size_t(header.VocabularySize) * sizeof(uint32_t);
+        layout.EdgeBytes = offset;
+        offset += header.EdgeCount;
+        layout.Size = offset;
+
+        return layout;
+    }
+
+    template <typename ValueType>
+    std::span<const ValueType> ArrayAt(std::span<const std::byte> bytes, size_t offset, size_t count)
+    {
+        return {reinterpret_cast<const ValueType*>(bytes.data() + offset), count};
+    }
+
+    template <typename ValueType>
+    void WriteArray(std::vector<std::byte>& storage, size_t offset, const std::vector<ValueType>& values)
+    {
+        std::memcpy(storage.data() + offset, values.data(), values.size() * sizeof(ValueType));
+    }
+
+    bool IsSet(const std::vector<uint64_t>& bits, size_t index)
+    {
+        return (bits[index / 64] >> (index % 64)) & 1;
+    }
+
+    void Clear(std::vector<uint64_t>& bits, size_t index)
+    {
+        bits[index / 64] &= ~(uint64_t(1) << (index % 64));
+    }
+} //namespace
+
+/*
+ * A token is left out of the trie when its own expansion does not encode to it (a pair listed twice, or a merge whose
+ * halves never meet in merge order), merge-order encoding can never produce it. Finding out encodes every expansion
+ * once, which is why the result is worth storing.
+ */
+template <typename TokenType>
+std::expected<BPE::CompiledEncoder<TokenType>, std::string> BPE::CompiledEncoder<TokenType>::TryCompile(std::span<const std::pair<TokenType, TokenType>> bpeTable)
+{
+    std::expected<BPE::DecodeTable, std::string> decodeTable{BPE::TryBuildDecodeTable<TokenType>(bpeTable)};
+    if (!decodeTable.has_value())
+    {
+        return std::unexpected{decodeTable.error()};
+    }
+
+    uint64_t vocabularySize{BPE::FIRST_TOKEN<TokenType> + uint64_t(bpeTable.size())};
+
+    if (vocabularySize >= NO_COMPILED_TOKEN)
+    {
+        return std::unexpected{std::format("ERROR: A table of {} tokens is too large to compile", vocabularySize)};
+    }
+
+    BPE::PairRanks<TokenType> ranks{BPE::BuildPairRanks<TokenType>(bpeTable)};
+    BPE::ApplyScratch<TokenType> scratch{};
+    std::vector<TokenType> encoded{};
+
+    std::vector<uint32_t> tokenLengths(vocabularySize, 0);
+    std::vector<uint32_t> tokenNodes(vocabularySize, 0);
+    std::vector<uint32_t> nodeTokens{NO_COMPILED_TOKEN};
+    std::vector<uint32_t> nodeParents{0};
+    std::unordered_map<uint64_t, uint32_t> children{};
+
+    for (uint64_t token{0}; token < vocabularySize; ++token)
+    {
+        std::string_view expansion{decodeTable.value().Expand(token)};
+
+        if (token >= BPE::FIRST_TOKEN<TokenType>)
+        {
+            encoded.resize(expansion.size());
+            std::expected<size_t, std::string> tokenCount{BPE::TryApplyBpeTableInto<TokenType>(std::as_bytes(std::span{expansion}), ranks, scratch, encoded)};
+
+            if (!tokenCount.has_value() || tokenCount.value() != 1 || encoded[0] != token)
+            {
+                continue;
+            }
+        }
+
+        uint32_t node{0};
+
+        for (char byte : expansion)
+        {
+            auto [it, inserted]{children.try_emplace((uint64_t(node) << 8) | uint8_t(byte), uint32_t(nodeTokens.size()))};
+
+            if (inserted)
+            {
+                if (nodeTokens.size() >= NO_COMPILED_TOKEN)
+                {
+                    return std::unexpected{"ERROR: The expansions of the table are too long to compile"};
+                }
+
+                nodeTokens.push_back(NO_COMPILED_TOKEN);
+                nodeParents.push_back(node);
+            }
+
+            node = it->second;
+        }
+
+        nodeTokens[node] = uint32_t(token);
+        tokenNodes[token] = node;
+        tokenLengths[token] = uint32_t(expansion.size());
+    }
+
+    // Parents are created before their children, so one pass in node order finds the nearest token above every node
+    std::vector<uint32_t> nodePrefixes(nodeTokens.size(), NO_COMPILED_TOKEN);
+
+    for (size_t node{1}; node < nodeTokens.size(); ++node)
+    {
+        uint32_t parent{nodeParents[node]};
+        nodePrefixes[node] = nodeTokens[parent] != NO_COMPILED_TOKEN ? nodeTokens[parent] : nodePrefixes[parent];
+    }
+
+    std::vector<uint32_t> prefixTokens(vocabularySize, NO_COMPILED_TOKEN);
+
+    for (uint64_t token{0}; token < vocabularySize; ++token)
+    {
+        if (tokenLengths[token] > 0)
+        {
+            prefixTokens[token] = nodePrefixes[tokenNodes[token]];
+        }
+    }
+
+    std::vector<std::pair<uint64_t, uint32_t>> edges{children.begin(), children.end()};
+    std::sort(edges.begin(), edges.end());
+    children = {};
+
+    std::vector<uint32_t> edgeBegins(nodeTokens.size() + 1, 0);
+    std::vector<uint32_t> edgeTargets(edges.size());
+    std::vector<uint8_t> edgeBytes(edges.size());
+
+    for (size_t i{0}; i < edges.size(); ++i)
+    {
+        ++edgeBegins[(edges[i].first >> 8) + 1];
+        edgeTargets[i] = edges[i].second;
+        edgeBytes[i] = uint8_t(edges[i].first);
+    }
+
+    for (size_t node{0}; node < nodeTokens.size(); ++node)
+    {
+        edgeBegins[node + 1] += edgeBegins[node];
+    }
+
+    BPE::CompiledEncoderHeader header{BPE::Checksum(std::as_bytes(bpeTable)), uint32_t(nodeTokens.size()), uint32_t(edges.size()), uint32_t(vocabularySize), 0};
+    CompiledLayout layout{LayoutOf(header)};
+
+    std::vector<std::byte> storage(layout.Size);
+    std::memcpy(storage.data(), &header, sizeof(header));
+    WriteArray(storage, layout.EdgeBegins, edgeBegins);
+    WriteArray(storage, layout.EdgeTargets, edgeTargets);
+    WriteArray(storage, layout.NodeTokens, nodeTokens);
+    WriteArray(storage, layout.TokenLengths, tokenLengths);
+    WriteArray(storage, layout.PrefixTokens, prefixTokens);
+    WriteArray(storage, layout.EdgeBytes, edgeBytes);
+
+    return CompiledEncoder{bpeTable, std::move(storage), {}};
+}
+
+/*
+ * Besides matching the table, a loaded encoder is checked for everything encoding relies on: a tree whose nodes carry
+ * tokens as long as their depth, every raw byte a token of its own and prefix chains that get shorter. Checking is
+ * linear in the size of the encoder, far cheaper than compiling it.
+ */
+template <typename TokenType>
+std::expected<BPE::CompiledEncoder<TokenType>, std::string> BPE::CompiledEncoder<TokenType>::TryLoad(std::span<const std::pair<TokenType, TokenType>> bpeTable, std::span<const std::byte> bytes)
+{
+    BPE::CompiledEncoderHeader header{};
+
+    if (bytes.size() < sizeof(header) || reinterpret_cast<uintptr_t>(bytes.data()) % alignof(uint32_t) != 0)
+    {
+        return std::unexpected{"ERROR: Compiled encoder is corrupt"};
+    }
+
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    CompiledLayout layout{LayoutOf(header)};
+
+    if (header.VocabularySize != BPE::FIRST_TOKEN<TokenType> + uint64_t(bpeTable.size()) || header.TableChecksum != BPE::Checksum(std::as_bytes(bpeTable)))
+    {
+        return std::unexpected{"ERROR: Compiled encoder was compiled from another BPE table"};
+    }
+
+    if (header.NodeCount == 0 || header.NodeCount >= NO_COMPILED_TOKEN || layout.Size != bytes.size())
+    {
+        return std::unexpected{"ERROR: Compiled encoder is corrupt"};
+    }
+
+    std::span<const uint32_t> edgeBegins{ArrayAt<uint32_t>(bytes, layout.EdgeBegins, size_t(header.NodeCount) + 1)};
+    std::span<const uint32_t> edgeTargets{ArrayAt<uint32_t>(bytes, layout.EdgeTargets, header.EdgeCount)};
+    std::span<const uint32_t> nodeTokens{ArrayAt<uint32_t>(bytes, layout.NodeTokens, header.NodeCount)};
+    std::span<const uint32_t> tokenLengths{ArrayAt<uint32_t>(bytes, layout.TokenLengths, header.VocabularySize)};
+    std::span<const uint32_t> prefixTokens{ArrayAt<uint32_t>(bytes, layout.PrefixTokens, header.VocabularySize)};
+
+    if (edgeBegins.front() != 0 || edgeBegins.back() != header.EdgeCount || !std::is_sorted(edgeBegins.begin(), edgeBegins.end()))
+    {
+        return std::unexpected{"ERROR: Compiled encoder is corrupt"};
+    }
+
+    // Every node but the root has one edge into it, from a node before it
+    std::vector<uint32_t> depths(header.NodeCount, UINT32_MAX);
+    depths[0] = 0;
+
+    for (uint32_t node{0}; node < header.NodeCount; ++node)
+    {
+        if (depths[node] == UINT32_MAX)
+        {
+            return std::unexpected{"ERROR: Compiled encoder is corrupt"};
+        }
+
+        for (uint32_t edge{edgeBegins[node]}; edge < edgeBegins[node + 1]; ++edge)
+        {
+            uint32_t target{edgeTargets[edge]};
+
+            if (target <= node || target >= header.NodeCount || depths[target] != UINT32_MAX)
+            {
+                return std::unexpected{"ERROR: Compiled encoder is corrupt"};
+            }
+
+            depths[target] = depths[node] + 1;
+        }
+
+        uint32_t token{nodeTokens[node]};
+
+        if (token != NO_COMPILED_TOKEN && (token >= header.VocabularySize || tokenLengths[token] != depths[node] || depths[node] == 0))
+        {
+            return std::unexpected{"ERROR: Compiled encoder is corrupt"};
+        }
+    }
+
+    for (uint32_t token{0}; token < header.VocabularySize; ++token)
+    {
+        uint32_t prefix{prefixTokens[token]};
+
+        if ((token < BPE::FIRST_TOKEN<TokenType> && tokenLengths[token] != 1) || (prefix != NO_COMPILED_TOKEN && (prefix >= header.VocabularySize || tokenLengths[prefix] == 0 || tokenLengths[prefix] >= tokenLengths[token])))
+        {
+            return std::unexpected{"ERROR: Compiled encoder is corrupt"};
+        }
+    }
+
+    return CompiledEncoder{bpeTable, {}, bytes};
+}
+
+template <typename TokenType>
+BPE::CompiledEncoder<TokenType>::CompiledEncoder(std::span<const std::pair<TokenType, TokenType>> bpeTable, std::vector<std::byte> storage, std::span<const std::byte> bytes)
+    : m_BpeTable{bpeTable}, m_Ranks{BPE::BuildPairRanks<TokenType>(bpeTable)}, m_Storage{std::move(storage)}, m_Bytes{m_Storage.empty() ? bytes : std::span<const std::byte>{m_Storage}}, m_Header{}
+{
+    std::memcpy(&m_Header, m_Bytes.data(), sizeof(m_Header));
+    CompiledLayout layout{LayoutOf(m_Header)};
+
+    m_EdgeBegins = ArrayAt<uint32_t>(m_Bytes, layout.EdgeBegins, size_t(m_Header.NodeCount) + 1);
+    m_EdgeTargets = ArrayAt<uint32_t>(m_Bytes, layout.EdgeTargets, m_Header.EdgeCount);
+    m_NodeTokens = ArrayAt<uint32_t>(m_Bytes, layout.NodeTokens, m_Header.NodeCount);
+    m_TokenLengths = ArrayAt<uint32_t>(m_Bytes, layout.TokenLengths, m_Header.VocabularySize);
+    m_PrefixTokens = ArrayAt<uint32_t>(m_Bytes, layout.PrefixTokens, m_Header.VocabularySize);
+    m_EdgeBytes = ArrayAt<uint8_t>(m_Bytes, layout.EdgeBytes, m_Header.EdgeCount);
+}
+
+template <typename TokenType>
+std::span<const std::byte> BPE::CompiledEncoder<TokenType>::Bytes() const
+{
+    return m_Bytes;
+}
+
+template <typename TokenType>
+const BPE::CompiledEncoderHeader& BPE::CompiledEncoder<TokenType>::Header() const
+{
+    return m_Header;
+}
+
+template <typename TokenType>
+uint32_t BPE::CompiledEncoder<TokenType>::Child(uint32_t node, uint8_t byte) const
+{
+    auto begin{m_EdgeBytes.begin() + m_EdgeBegins[node]};
+    auto end{m_EdgeBytes.begin() + m_EdgeBegins[node + 1]};
+    auto it{std::lower_bound(begin, end, byte)};
+
+    return it != end && *it == byte ? m_EdgeTargets[it - m_EdgeBytes.begin()] : NO_COMPILED_TOKEN;
+}
+
+template <typename TokenType>
+uint32_t BPE::CompiledEncoder<TokenType>::LongestToken(std::span<const std::byte> input, size_t position) const
+{
+    uint32_t node{0};
+    uint32_t longest{NO_COMPILED_TOKEN};
+
+    for (size_t i{position}; i < input.size(); ++i)
+    {
+        node = Child(node, uint8_t(input[i]));
+
+        if (node == NO_COMPILED_TOKEN)
+        {
+            break;
+        }
+
+        if (m_NodeTokens[node] != NO_COMPILED_TOKEN)
+        {
+            longest = m_NodeTokens[node];
+        }
+    }
+
+    return longest;
+}
+
+/*
+ * A position the pass reaches always has the same token before it: the tokens so far can each follow the one before,
+ * so they are the encoding of the text up to there. A position it had to back out of is therefore never a boundary and
+ * is not tried again, which keeps the stepping back from repeating work.
+ */
+template <typename TokenType>
+std::expected<size_t, std::string> BPE::CompiledEncoder<TokenType>::TryEncodeInto(std::span<const std::byte> input, BPE::CompiledScratch& scratch, std::span<TokenType> output) const
+{
+    if (input.size() > BPE::MAX_APPLY_INPUT_SIZE)
+    {
+        return std::unexpected{std::format("ERROR: Input of {} bytes is larger than the {} bytes that can be encoded at once", input.size(), BPE::MAX_APPLY_INPUT_SIZE)};
+    }
+
+    if (output.size() < input.size())
+    {
+        return std::unexpected{std::format("ERROR: Output of {} tokens is too small for an input of {} bytes", output.size(), input.size())};
+    }
+
+    std::expected<void, std::string> validation{BPE::TryValidateInput<TokenType>({reinterpret_cast<const char*>(input.data()), input.size()})};
+    if (!validation.has_value())
+    {
+        return std::unexpected{validation.error()};
+    }
+
+    // Assigning within the capacity the scratch already has does not allocate
+    scratch.Reachable.assign(input.size() / 64 + 1, ~uint64_t(0));
+
+    size_t tokenCount{0};
+    size_t position{0};
+    uint32_t next{input.empty() ? NO_COMPILED_TOKEN : LongestToken(input, 0)};
+
+    while (position < input.size())
+    {
+        bool placed{false};
+
+        for (uint32_t token{next}; token != NO_COMPILED_TOKEN && !placed; token = m_PrefixTokens[token])
+        {
+            size_t end{position + m_TokenLengths[token]};
+
+            if (IsSet(scratch.Reachable, end) && (tokenCount == 0 || BPE::CanFollow<TokenType>(m_BpeTable, m_Ranks, output[tokenCount - 1], TokenType(token))))
+            {
+                output[tokenCount++] = TokenType(token);
+                position = end;
+                placed = true;
+            }
+        }
+
+        if (placed)
+        {
+            next = position < input.size() ? LongestToken(input, position) : NO_COMPILED_TOKEN;
+            continue;
+        }
+
+        if (tokenCount == 0)
+        {
+            return std::unexpected{"ERROR: Compiled encoder found no encoding, it does not match its table"};
+        }
+
+        Clear(scratch.Reachable, position);
+
+        TokenType last{output[--tokenCount]};
+        position -= m_TokenLengths[last];
+        next = m_PrefixTokens[last];
+    }
+
+    return tokenCount;
+}
+
+// After the member definitions, so the instantiations include them
+template class BPE::CompiledEncoder<char8_t>;
+template class BPE::CompiledEncoder<char16_t>;
+template class BPE::CompiledEncoder<char32_t>;
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "BPE.h"
+#include "Core.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace BPE
+{
+    /*
+     * Serialized layout of a compiled encoder (the CompiledEncoder section of a container): CompiledEncoderHeader, then
+     * the uint32_t arrays EdgeBegins (NodeCount + 1), EdgeTargets (EdgeCount), NodeTokens (NodeCount), TokenLengths and
+     * PrefixTokens (VocabularySize each), then the uint8_t array EdgeBytes (EdgeCount).
+     *
+     * The nodes form a trie over the expansions of every token that is its own encoding, node 0 being the root. The edges
+     * of a node are sorted by byte. NodeTokens holds the token that ends at a node, PrefixTokens the longest token that is
+     * a proper prefix of a token and TokenLengths the length of every token's expansion, 0 for tokens left out.
+     */
+    struct CompiledEncoderHeader
+    {
+        // Checksum of the merge table the encoder was compiled from
+        uint64_t TableChecksum;
+        uint32_t NodeCount;
+        uint32_t EdgeCount;
+        uint32_t VocabularySize;
+        uint32_t Reserved;
+    };
+
+    const uint32_t NO_COMPILED_TOKEN{UINT32_MAX};
+
+    // Working memory of CompiledEncoder::TryEncodeInto, reuse one per thread
+    struct CompiledScratch
+    {
+        // One bit per input position, cleared for positions found not to be a token boundary
+        std::vector<uint64_t> Reachable;
+    };
+
+    /*
+     * Encodes in a single left-to-right pass instead of merge by merge. At every position it takes the longest token
+     * that matches and can follow the previous one, then shorter ones, and when none fits it steps back and retries the
+     * previous token shorter. A run of tokens that can each follow the one before is the merge-order encoding of its
+     * text (see CanFollow), so when the pass reaches the end its tokens are exactly the ones ApplyBpeTable produces.
+     */
+    template <typename TokenType>
+    class CompiledEncoder
+    {
+    public:
+        static std::expected<CompiledEncoder, std::string> TryCompile(std::span<const std::pair<TokenType, TokenType>> bpeTable);
+        // Views a serialized encoder, which has to outlive the result and must have been compiled from this table
+        static std::expected<CompiledEncoder, std::string> TryLoad(std::span<const std::pair<TokenType, TokenType>> bpeTable, std::span<const std::byte> bytes);
+
+        CompiledEncoder(CompiledEncoder&& other) noexcept = default;
+        CompiledEncoder& operator=(CompiledEncoder&& other) noexcept = default;
+
+        CompiledEncoder(const CompiledEncoder&) = delete;
+        CompiledEncoder& operator=(const CompiledEncoder&) = delete;
+
+        // Same contract as TryApplyBpeTableInto
+        std::expected<size_t, std::string> TryEncodeInto(std::span<const std::byte> input, CompiledScratch& scratch, std::span<TokenType> output) const;
+
+        // The serialized encoder, for writing it to a container
+        std::span<const std::byte> Bytes() const;
+        const CompiledEncoderHeader& Header() const;
+
+    private:
+        CompiledEncoder(std::span<const std::pair<TokenType, TokenType>> bpeTable, std::vector<std::byte> storage, std::span<const std::byte> bytes);
+
+        uint32_t Child(uint32_t node, uint8_t byte) const;
+        uint32_t LongestToken(std::span<const std::byte> input, size_t position) const;
+
+        std::span<const std::pair<TokenType, TokenType>> m_BpeTable;
+        PairRanks<TokenType> m_Ranks;
+
+        // Holds the bytes of a compiled encoder, empty for a loaded one
+        std::vector<std::byte> m_Storage;
+        std::span<const std::byte> m_Bytes;
+
+        CompiledEncoderHeader m_Header;
+        std::span<const uint32_t> m_EdgeBegins;
+        std::span<const uint32_t> m_EdgeTargets;
+        std::span<const uint32_t> m_NodeTokens;
+        std::span<const uint32_t> m_TokenLengths;
+        std::span<const uint32_t> m_PrefixTokens;
+        std::span<const uint8_t> m_EdgeBytes;
+    };
+} //namespace BPE
@@ -0,0 +1,395 @@
+#include "Container.h"
+#include "BlockIndex.h"
+#include "CompactTokens.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <print>
+#include <vector>
+
+namespace
+{
+    // As written in the xxHash specification, so they can be compared against it
+    const uint64_t XXH_PRIME1{0x9E3779B185EBCA87ULL};
+    const uint64_t XXH_PRIME2{0xC2B2AE3D27D4EB4FULL};
+    const uint64_t XXH_PRIME3{0x165667B19E3779F9ULL};
+    const uint64_t XXH_PRIME4{0x85EBCA77C2B2AE63ULL};
+    const uint64_t XXH_PRIME5{0x27D4EB2F165667C5ULL};
+
+    uint64_t Read64(const std::byte* data)
+    {
+        uint64_t value{};
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    uint32_t Read32(const std::byte* data)
+    {
+        uint32_t value{};
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    uint64_t XxhRound(uint64_t accumulator, uint64_t input)
+    {
+        accumulator += input * XXH_PRIME2;
+        accumulator = std::rotl(accumulator, 31);
+        return accumulator * XXH_PRIME1;
+    }
+
+    uint64_t XxhMergeRound(uint64_t accumulator, uint64_t value)
+    {
+        accumulator ^= XxhRound(0, value);
+        return accumulator * XXH_PRIME1 + XXH_PRIME4;
+    }
+
+    std::string_view SectionName(BPE::SectionType type)
+    {
+        switch (type)
+        {
+            case BPE::SectionType::MergeTable:
+                return "merge table";
+            case BPE::SectionType::Tokens:
+                return "tokens";
+            case BPE::SectionType::CompactTokens:
+                return "compact tokens";
+            case BPE::SectionType::Metadata:
+                return "metadata";
+            case BPE::SectionType::BlockIndex:
+                return "block index";
+            case BPE::SectionType::TrainingState:
+                return "training state";
+            case BPE::SectionType::CompiledEncoder:
+                return "compiled encoder";
+        }
+
+        return "unknown";
+    }
+
+    uint64_t AlignSectionOffset(uint64_t offset)
+    {
+        return (offset + BPE::CONTAINER_SECTION_ALIGNMENT - 1) / BPE::CONTAINER_SECTION_ALIGNMENT * BPE::CONTAINER_SECTION_ALIGNMENT;
+    }
+
+    uint64_t HeaderChecksum(BPE::ContainerHeader header, std::span<const BPE::ContainerSection> sections)
+    {
+        header.HeaderChecksum = 0;
+
+        std::vector<std::byte> headerBytes(sizeof(header) + sections.size_bytes());
+        std::memcpy(headerBytes.data(), &header, sizeof(header));
+        std::memcpy(headerBytes.data() + sizeof(header), sections.data(), sections.size_bytes());
+
+        return BPE::Checksum(headerBytes);
+    }
+
+    std::vector<BPE::ContainerSection> ReadSectionTable(std::span<const std::byte> file, const BPE::ContainerHeader& header)
+    {
+        std::vector<BPE::ContainerSection> sections(header.SectionCount);
+        std::memcpy(sections.data(), file.data() + sizeof(header), sections.size() * sizeof(BPE::ContainerSection));
+
+        return sections;
+    }
+} //namespace
+
+/*
+ * XXH64 with seed 0, so the checksums can be checked with any xxHash implementation. Four independent accumulators
+ * consume 32 bytes per step, which keeps verifying a section well below the cost of reading it.
+ */
+uint64_t BPE::Checksum(std::span<const std::byte> data)
+{
+    const std::byte* position{data.data()};
+    const std::byte* end{data.data() + data.size()};
+    uint64_t hash{};
+
+    if (data.size() >= 32)
+    {
+        uint64_t accumulators[4]{XXH_PRIME1 + XXH_PRIME2, XXH_PRIME2, 0, 0 - XXH_PRIME1};
+
+        for (; position + 32 <= end; position += 32)
+        {
+            for (size_t lane{0}; lane < 4; ++lane)
+            {
+                accumulators[lane] = XxhRound(accumulators[lane], Read64(position + 8 * lane));
+            }
+        }
+
+        hash = std::rotl(accumulators[0], 1) + std::rotl(accumulators[1], 7) + std::rotl(accumulators[2], 12) + std::rotl(accumulators[3], 18);
+
+        for (uint64_t accumulator : accumulators)
+        {
+            hash = XxhMergeRound(hash, accumulator);
+        }
+    }
+    else
+    {
+        hash = XXH_PRIME5;
+    }
+
+    hash += data.size();
+
+    for (; position + 8 <= end; position += 8)
+    {
+        hash ^= XxhRound(0, Read64(position));
+        hash = std::rotl(hash, 27) * XXH_PRIME1 + XXH_PRIME4;
+    }
+
+    if (position + 4 <= end)
+    {
+        hash ^= uint64_t(Read32(position)) * XXH_PRIME1;
+        hash = std::rotl(hash, 23) * XXH_PRIME2 + XXH_PRIME3;
+        position += 4;
+    }
+
+    for (; position < end; ++position)
+    {
+        hash ^= uint64_t(*position) * XXH_PRIME5;
+        hash = std::rotl(hash, 11) * XXH_PRIME1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+bool BPE::IsContainerFile(std::span<const std::byte> file)
+{
+    return file.size() >= sizeof(BPE::ContainerHeader) && std::memcmp(file.data(), BPE::CONTAINER_MAGIC, sizeof(BPE::CONTAINER_MAGIC)) == 0;
+}
+
+std::expected<BPE::ContainerHeader, std::string> BPE::TryReadContainerHeader(std::span<const std::byte> file)
+{
+    if (!BPE::IsContainerFile(file))
+    {
+        return std::unexpected{"ERROR: Not a container file"};
+    }
+
+    BPE::ContainerHeader header{};
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    if (header.Version == 0 || header.Version > BPE::CONTAINER_VERSION)
+    {
+        return std::unexpected{std::format("ERROR: Container version {} is not supported, the newest supported version is {}", header.Version, BPE::CONTAINER_VERSION)};
+    }
+
+    if (header.FileSize != file.size())
+    {
+        return std::unexpected{std::format("ERROR: Container should be {} bytes but is {} bytes, it was truncated or extended", header.FileSize, file.size())};
+    }
+
+    if (header.SectionCount > (file.size() - sizeof(header)) / sizeof(BPE::ContainerSection))
+    {
+        return std::unexpected{"ERROR: Container section table is corrupt"};
+    }
+
+    std::vector<BPE::ContainerSection> sections{ReadSectionTable(file, header)};
+
+    if (HeaderChecksum(header, sections) != header.HeaderChecksum)
+    {
+        return std::unexpected{"ERROR: Checksum mismatch in the container header"};
+    }
+
+    if (header.Width != BPE::TokenWidth::Bits8 && header.Width != BPE::TokenWidth::Bits16 && header.Width != BPE::TokenWidth::Bits32)
+    {
+        return std::unexpected{std::format("ERROR: Container has an unsupported token width of {} bytes", uint8_t(header.Width))};
+    }
+
+    for (const BPE::ContainerSection& section : sections)
+    {
+        if (section.Offset > file.size() || section.Size > file.size() - section.Offset)
+        {
+            return std::unexpected{std::format("ERROR: Container {} section lies outside the file", SectionName(section.Type))};
+        }
+    }
+
+    return header;
+}
+
+bool BPE::HasContainerSection(std::span<const std::byte> file, BPE::SectionType type)
+{
+    std::expected<BPE::ContainerHeader, std::string> header{BPE::TryReadContainerHeader(file)};
+
+    if (!header.has_value())
+    {
+        return false;
+    }
+
+    std::vector<BPE::ContainerSection> sections{ReadSectionTable(file, header.value())};
+
+    return std::any_of(sections.begin(), sections.end(), [&](const BPE::ContainerSection& section) { return section.Type == type; });
+}
+
+std::expected<std::span<const std::byte>, std::string> BPE::TryGetContainerSection(std::span<const std::byte> file, BPE::SectionType type, bool verifyChecksum)
+{
+    std::expected<BPE::ContainerHeader, std::string> header{BPE::TryReadContainerHeader(file)};
+
+    if (!header.has_value())
+    {
+        return std::unexpected{header.error()};
+    }
+
+    for (const BPE::ContainerSection& section : ReadSectionTable(file, header.value()))
+    {
+        if (section.Type != type)
+        {
+            continue;
+        }
+
+        std::span<const std::byte> bytes{file.subspan(section.Offset, section.Size)};
+
+        if (verifyChecksum && BPE::Checksum(bytes) != section.Checksum)
+        {
+            return std::unexpected{std::format("ERROR: Checksum mismatch in the container {} section", SectionName(type))};
+        }
+
+        return bytes;
+    }
+
+    return std::unexpected{std::format("ERROR: Container has no {} section", SectionName(type))};
+}
+
+std::expected<void, std::string> BPE::TryWriteContainerSections(const std::filesystem::path& outputFilePath, BPE::TokenWidth width, uint64_t vocabularySize, uint64_t tokenCount, std::span<const BPE::ContainerSectionSource> sources)
+{
+    BPE::ContainerHeader header{};
+    std::copy(std::begin(BPE::CONTAINER_MAGIC), std::end(BPE::CONTAINER_MAGIC), header.Magic);
+    header.Version = BPE::CONTAINER_VERSION;
+    header.Width = width;
+    header.SectionCount = uint32_t(sources.size());
+    header.VocabularySize = vocabularySize;
+    header.TokenCount = tokenCount;
+
+    std::vector<BPE::ContainerSection> sections(sources.size());
+    uint64_t offset{sizeof(header) + sections.size() * sizeof(BPE::ContainerSection)};
+
+    for (size_t i{0}; i < sources.size(); ++i)
+    {
+        offset = AlignSectionOffset(offset);
+        sections[i] = {sources[i].Type, 0, offset, sources[i].Bytes.size(), BPE::Checksum(sources[i].Bytes)};
+        offset += sources[i].Bytes.size();
+    }
+
+    header.FileSize = offset;
+    header.HeaderChecksum = HeaderChecksum(header, sections);
+
+    std::ofstream outputFile{outputFilePath, std::ios::binary};
+
+    if (outputFile.is_open() == false)
+    {
+        return std::unexpected(std::format("ERROR: Unable to open or create output file at path \"{}\"", outputFilePath.c_str()));
+    }
+
+    outputFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    outputFile.write(reinterpret_cast<const char*>(sections.data()), sections.size() * sizeof(BPE::ContainerSection));
+
+    const char padding[BPE::CONTAINER_SECTION_ALIGNMENT]{};
+    uint64_t position{sizeof(header) + sections.size() * sizeof(BPE::ContainerSection)};
+
+    for (size_t i{0}; i < sources.size(); ++i)
+    {
+        outputFile.write(padding, std::streamsize(sections[i].Offset - position));
+        outputFile.write(reinterpret_cast<const char*>(sources[i].Bytes.data()), std::streamsize(sources[i].Bytes.size()));
+        position = sections[i].Offset + sections[i].Size;
+    }
+
+    outputFile.close();
+
+    if (!outputFile)
+    {
+        return std::unexpected(std::format("ERROR: Unable to write container to \"{}\"", outputFilePath.c_str()));
+    }
+
+    return {};
+}
+
+template std::expected<void, std::string> BPE::TryWriteContainerFile<char8_t>(const std::filesystem::path& outputFilePath, std::span<const char8_t> bpeTable, std::span<const char8_t> tokens, bool compactTokens, std::string_view metadata, size_t blockIndexStride, unsigned threadCount);
+template std::expected<void, std::string> BPE::TryWriteContainerFile<char16_t>(const std::filesystem::path& outputFilePath, std::span<const char16_t> bpeTable, std::span<const char16_t> tokens, bool compactTokens, std::string_view metadata, size_t blockIndexStride, unsigned threadCount);
+template std::expected<void, std::string> BPE::TryWriteContainerFile<char32_t>(const std::filesystem::path& outputFilePath, std::span<const char32_t> bpeTable, std::span<const char32_t> tokens, bool compactTokens, std::string_view metadata, size_t blockIndexStride, unsigned threadCount);
+template <typename TokenType>
+std::expected<void, std::string> BPE::TryWriteContainerFile(const std::filesystem::path& outputFilePath, std::span<const TokenType> bpeTable, std::span<const TokenType> tokens, bool compactTokens, std::string_view metadata, size_t blockIndexStride, unsigned threadCount)
+{
+    uint64_t vocabularySize{BPE::FIRST_TOKEN<TokenType> + bpeTable.size() / 2};
+
+    std::vector<BPE::ContainerSectionSource> sources{};
+    sources.push_back({BPE::SectionType::MergeTable, std::as_bytes(bpeTable)});
+
+    std::expected<std::string, std::string> compactTokenFile{};
+
+    if (compactTokens)
+    {
+        compactTokenFile = BPE::TryEncodeCompactTokens(tokens, vocabularySize, threadCount);
+
+        if (!compactTokenFile.has_value())
+        {
+            return std::unexpected{compactTokenFile.error()};
+        }
+
+        sources.push_back({BPE::SectionType::CompactTokens, std::as_bytes(std::span<const char>{compactTokenFile.value()})});
+    }
+    else
+    {
+        sources.push_back({BPE::SectionType::Tokens, std::as_bytes(tokens)});
+    }
+
+    if (!metadata.empty())
+    {
+        sources.push_back({BPE::SectionType::Metadata, std::as_bytes(std::span<const char>{metadata})});
+    }
+
+    std::string blockIndex{};
+
+    if (blockIndexStride > 0)
+    {
+        std::span<const std::pair<TokenType, TokenType>> pairs{reinterpret_cast<const std::pair<TokenType, TokenType>*>(bpeTable.data()), bpeTable.size() / 2};
+        std::expected<BPE::DecodeTable, std::string> decodeTable{BPE::TryBuildDecodeTable(pairs)};
+
+        if (!decodeTable.has_value())
+        {
+            return std::unexpected{decodeTable.error()};
+        }
+
+        std::expected<BPE::BlockIndex, std::string> index{BPE::TryBuildBlockIndex(tokens, decodeTable.value(), blockIndexStride)};
+
+        if (!index.has_value())
+        {
+            return std::unexpected{index.error()};
+        }
+
+        blockIndex = BPE::SerializeBlockIndex(index.value());
+        sources.push_back({BPE::SectionType::BlockIndex, std::as_bytes(std::span<const char>{blockIndex})});
+    }
+
+    return BPE::TryWriteContainerSections(outputFilePath, BPE::TOKEN_WIDTH<TokenType>, vocabularySize, tokens.size(), sources);
+}
+
+void BPE::PrintContainerSummary(std::span<const std::byte> file)
+{
+    std::expected<BPE::ContainerHeader, std::string> header{BPE::TryReadContainerHeader(file)};
+
+    if (!header.has_value())
+    {
+        std::println("{}", header.error());
+        return;
+    }
+
+    std::println("Container version {}, {}-bit tokens, vocabulary of {} tokens, {} encoded tokens", header.value().Version, 8 * size_t(header.value().Width), header.value().VocabularySize, header.value().TokenCount);
+
+    for (const BPE::ContainerSection& section : ReadSectionTable(file, header.value()))
+    {
+        bool checksumMatches{BPE::Checksum(file.subspan(section.Offset, section.Size)) == section.Checksum};
+        std::println("Section {:<16} offset {:>12} size {:>12} checksum {:016x} ({})", SectionName(section.Type), section.Offset, section.Size, section.Checksum, checksumMatches ? "ok" : "MISMATCH");
+
+        if (section.Type == BPE::SectionType::Metadata && checksumMatches)
+        {
+            std::span<const std::byte> metadata{file.subspan(section.Offset, section.Size)};
+            std::println("{}", std::string_view{reinterpret_cast<const char*>(metadata.data()), metadata.size()});
+        }
+    }
+
+    std::println();
+}
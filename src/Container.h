@@ -0,0 +1,99 @@
+#pragma once
+
+#include "BPE.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace BPE
+{
+    /*
+     * A container file holds a BPE table together with the tokens encoded with it, and optionally free-form metadata.
+     *
+     * Layout: ContainerHeader, SectionCount ContainerSection entries, then the sections themselves. Every section starts
+     * at a multiple of CONTAINER_SECTION_ALIGNMENT bytes, so a mapped section can be viewed as an array of tokens or pairs
+     * in place. Readers find a section through the section table without looking at any other section.
+     *
+     * The header checksum covers the header (with its checksum field zeroed) and the section table, every section has a
+     * checksum of its own. Checksums are XXH64 with seed 0.
+     */
+    enum class SectionType : uint32_t
+    {
+        // Merges as pairs of tokens, like a BPE table file without its header
+        MergeTable = 1,
+        // Raw tokens of the container's width
+        Tokens = 2,
+        // A complete compact token file, see CompactTokens.h
+        CompactTokens = 3,
+        // Lines of "key=value" text
+        Metadata = 4,
+        // Decoded offsets of every Stride-th token, see BlockIndex.h
+        BlockIndex = 5,
+        // Progress of an interrupted or limited training run and its document starts, see Checkpoint.h
+        TrainingState = 6,
+        // Single-pass encoder compiled from the merge table, see CompiledEncoder.h
+        CompiledEncoder = 7
+    };
+
+    struct ContainerHeader
+    {
+        char Magic[8];
+        uint16_t Version;
+        TokenWidth Width;
+        uint8_t Reserved0;
+        uint32_t SectionCount;
+        // FIRST_TOKEN plus the number of merges
+        uint64_t VocabularySize;
+        uint64_t TokenCount;
+        uint64_t FileSize;
+        uint64_t HeaderChecksum;
+        uint8_t Reserved1[16];
+    };
+
+    struct ContainerSection
+    {
+        SectionType Type;
+        uint32_t Reserved;
+        uint64_t Offset;
+        uint64_t Size;
+        uint64_t Checksum;
+    };
+
+    constexpr char CONTAINER_MAGIC[8]{'B', 'P', 'E', 'P', 'A', 'C', 'K', '\0'};
+    // Readers reject containers of a newer version, new section types alone do not need a new version
+    const uint16_t CONTAINER_VERSION{1};
+    const size_t CONTAINER_SECTION_ALIGNMENT{64};
+
+    uint64_t Checksum(std::span<const std::byte> data);
+
+    bool IsContainerFile(std::span<const std::byte> file);
+
+    // Checks the header, its checksum and that every section lies within the file
+    std::expected<ContainerHeader, std::string> TryReadContainerHeader(std::span<const std::byte> file);
+
+    // The bytes of the first section of the given type, after checking the section's checksum unless verifyChecksum is
+    // false (reading a few tokens should not hash the whole token section)
+    std::expected<std::span<const std::byte>, std::string> TryGetContainerSection(std::span<const std::byte> file, SectionType type, bool verifyChecksum = true);
+    bool HasContainerSection(std::span<const std::byte> file, SectionType type);
+
+    struct ContainerSectionSource
+    {
+        SectionType Type;
+        std::span<const std::byte> Bytes;
+    };
+
+    // Writes a container with the given sections in order, for files that need more than TryWriteContainerFile writes
+    std::expected<void, std::string> TryWriteContainerSections(const std::filesystem::path& outputFilePath, TokenWidth width, uint64_t vocabularySize, uint64_t tokenCount, std::span<const ContainerSectionSource> sources);
+
+    // Writes a container with the merge table, the tokens (compact or raw), the metadata when it is not empty and a block
+    // index of every blockIndexStride-th token when blockIndexStride is not 0
+    template <typename TokenType>
+    std::expected<void, std::string> TryWriteContainerFile(const std::filesystem::path& outputFilePath, std::span<const TokenType> bpeTable, std::span<const TokenType> tokens, bool compactTokens, std::string_view metadata, size_t blockIndexStride, unsigned threadCount);
+
+    void PrintContainerSummary(std::span<const std::byte> file);
+} //namespace BPE
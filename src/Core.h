@@ -0,0 +1,60 @@
+#pragma once
+
+#include "BPE.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+/*
+ * Encoding and decoding into buffers owned by the caller, for embedding the library. The owning functions in BPE.h
+ * allocate their results on every call, these only ever grow the scratch they are given, so once it has seen the
+ * largest input, encoding and decoding allocate nothing. Errors are the exception: their messages are allocated.
+ */
+namespace BPE
+{
+    // Working memory of TryApplyBpeTableInto, reuse one per thread
+    template <typename TokenType>
+    struct ApplyScratch
+    {
+        std::vector<TokenType> Symbols;
+        std::vector<uint32_t> Previous;
+        std::vector<uint32_t> Next;
+        std::vector<uint64_t> Heap;
+    };
+
+    // Largest input TryApplyBpeTableInto takes, token positions are 32-bit indices
+    const size_t MAX_APPLY_INPUT_SIZE{UINT32_MAX - 2};
+
+    // Encodes the input into output and returns the number of tokens written. No input encodes to more tokens than it
+    // has bytes, so an output of input.size() tokens always fits.
+    template <typename TokenType>
+    std::expected<size_t, std::string> TryApplyBpeTableInto(std::span<const std::byte> input, const PairRanks<TokenType>& ranks, ApplyScratch<TokenType>& scratch, std::span<TokenType> output);
+
+    /*
+     * Whether right can directly follow left in an encoding, which is the case unless encoding their two expansions back
+     * to back merges across the boundary between them. Tokens that are each their own encoding form the encoding of
+     * their text exactly when every two neighbours can follow each other.
+     */
+    template <typename TokenType>
+    bool CanFollow(std::span<const std::pair<TokenType, TokenType>> bpeTable, const PairRanks<TokenType>& ranks, TokenType left, TokenType right);
+
+    /*
+     * Marks every two bytes (first * 256 + second) that are next to each other inside some token. No token can cross the
+     * position between two bytes that are not, so every encoding of any text has a token boundary there.
+     */
+    template <typename TokenType>
+    std::expected<std::vector<bool>, std::string> TryFindPairsInsideTokens(std::span<const std::pair<TokenType, TokenType>> bpeTable);
+
+    // Exact number of bytes the tokens decode to, nothing if one of them is not part of the table
+    template <typename TokenType>
+    std::optional<uint64_t> DecodedLength(std::span<const TokenType> input, const DecodeTable& decodeTable);
+
+    // Decodes the tokens into output and returns the number of bytes written, see DecodedLength for the size needed
+    template <typename TokenType>
+    std::expected<size_t, std::string> TryDecodeInto(std::span<const TokenType> input, const DecodeTable& decodeTable, std::span<std::byte> output);
+} //namespace BPE
@@ -0,0 +1,208 @@
+#include "Corpus.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <system_error>
+
+namespace
+{
+    // Reader tasks per reader thread, so one large file does not leave the other readers idle for long
+    const size_t TASKS_PER_READER{4};
+
+    std::expected<void, std::string> TryAppendDirectory(const std::filesystem::path& directory, std::vector<std::filesystem::path>& files)
+    {
+        std::error_code error{};
+        std::vector<std::filesystem::path> directoryFiles{};
+
+        for (std::filesystem::recursive_directory_iterator it{directory, error}, end{}; !error && it != end; it.increment(error))
+        {
+            if (it->is_regular_file())
+            {
+                directoryFiles.push_back(it->path());
+            }
+        }
+
+        if (error)
+        {
+            return std::unexpected{std::format("ERROR: Unable to list directory \"{}\": {}", directory.c_str(), error.message())};
+        }
+
+        std::sort(directoryFiles.begin(), directoryFiles.end());
+        files.insert(files.end(), directoryFiles.begin(), directoryFiles.end());
+
+        return {};
+    }
+} //namespace
+
+std::vector<std::string_view> BPE::Corpus::Documents() const
+{
+    std::vector<std::string_view> documents{};
+    documents.reserve(DocumentStarts.size());
+
+    for (size_t i{0}; i < DocumentStarts.size(); ++i)
+    {
+        uint64_t end{i + 1 < DocumentStarts.size() ? DocumentStarts[i + 1] : Text.size()};
+        documents.push_back(std::string_view{Text}.substr(DocumentStarts[i], end - DocumentStarts[i]));
+    }
+
+    return documents;
+}
+
+std::expected<std::vector<std::filesystem::path>, std::string> BPE::TryCollectInputFiles(std::span<const std::filesystem::path> inputs)
+{
+    std::vector<std::filesystem::path> files{};
+
+    for (const std::filesystem::path& input : inputs)
+    {
+        std::string inputString{input.string()};
+
+        if (inputString.starts_with('@'))
+        {
+            std::filesystem::path listFilePath{inputString.substr(1)};
+            std::ifstream listFile{listFilePath};
+
+            if (listFile.is_open() == false)
+            {
+                return std::unexpected{std::format("ERROR: Unable to open file list at path \"{}\"", listFilePath.c_str())};
+            }
+
+            for (std::string line{}; std::getline(listFile, line);)
+            {
+                if (!line.empty() && line.back() == '\r')
+                {
+                    line.pop_back();
+                }
+
+                if (!line.empty())
+                {
+                    files.emplace_back(line);
+                }
+            }
+        }
+        else if (std::filesystem::is_directory(input))
+        {
+            std::expected<void, std::string> appendResult{TryAppendDirectory(input, files)};
+
+            if (!appendResult.has_value())
+            {
+                return std::unexpected{appendResult.error()};
+            }
+        }
+        else
+        {
+            files.push_back(input);
+        }
+    }
+
+    if (files.empty())
+    {
+        return std::unexpected{"ERROR: The inputs do not contain any file"};
+    }
+
+    return files;
+}
+
+std::expected<void, std::string> BPE::TryReadCorpus(std::span<const std::filesystem::path> files, unsigned readerCount, bool countWords, BPE::Corpus& corpus)
+{
+    // Every file gets its place in the text up front, so the readers never have to wait for each other
+    std::vector<uint64_t> fileOffsets(files.size() + 1, 0);
+
+    for (size_t i{0}; i < files.size(); ++i)
+    {
+        std::error_code error{};
+        uintmax_t fileSize{std::filesystem::file_size(files[i], error)};
+
+        if (error)
+        {
+            return std::unexpected{std::format("ERROR: Unable to open file at path \"{}\"", files[i].c_str())};
+        }
+
+        fileOffsets[i + 1] = fileOffsets[i] + fileSize;
+    }
+
+    corpus.Text.assign(fileOffsets.back(), '\0');
+    corpus.DocumentStarts.clear();
+    corpus.ReaderWordCounts.clear();
+
+    for (size_t i{0}; i < files.size(); ++i)
+    {
+        if (fileOffsets[i + 1] > fileOffsets[i])
+        {
+            corpus.DocumentStarts.push_back(fileOffsets[i]);
+        }
+    }
+
+    BPE::ThreadPool threadPool{readerCount};
+    size_t taskCount{std::min(files.size(), size_t(threadPool.ThreadCount()) * TASKS_PER_READER)};
+    std::vector<std::string> taskErrors(taskCount);
+
+    if (countWords)
+    {
+        corpus.ReaderWordCounts.resize(taskCount);
+    }
+
+    threadPool.ParallelFor(taskCount, [&](size_t task)
+    {
+        auto [begin, end]{BPE::SplitRange(files.size(), taskCount, task)};
+
+        for (size_t i{begin}; i < end; ++i)
+        {
+            std::ifstream file{files[i], std::ios::binary};
+            std::streamsize fileSize{std::streamsize(fileOffsets[i + 1] - fileOffsets[i])};
+            char* destination{corpus.Text.data() + fileOffsets[i]};
+
+            if (file.is_open() == false || !file.read(destination, fileSize) || file.peek() != std::ifstream::traits_type::eof())
+            {
+                taskErrors[task] = std::format("ERROR: Unable to read file at path \"{}\", or it changed while reading", files[i].c_str());
+                return;
+            }
+
+            if (countWords)
+            {
+                BPE::CountWords(std::string_view{destination, size_t(fileSize)}, corpus.ReaderWordCounts[task]);
+            }
+        }
+    });
+
+    for (const std::string& error : taskErrors)
+    {
+        if (!error.empty())
+        {
+            return std::unexpected{error};
+        }
+    }
+
+    return {};
+}
+
+template std::expected<std::tuple<std::basic_string<char8_t>, std::basic_string<char8_t>, BPE::BpeEncodingResultInfo>, std::string> BPE::TryEncodeCorpus<char8_t>(const BPE::Corpus& corpus, const BPE::BpeEncodingOptions& options);
+template std::expected<std::tuple<std::basic_string<char16_t>, std::basic_string<char16_t>, BPE::BpeEncodingResultInfo>, std::string> BPE::TryEncodeCorpus<char16_t>(const BPE::Corpus& corpus, const BPE::BpeEncodingOptions& options);
+template std::expected<std::tuple<std::basic_string<char32_t>, std::basic_string<char32_t>, BPE::BpeEncodingResultInfo>, std::string> BPE::TryEncodeCorpus<char32_t>(const BPE::Corpus& corpus, const BPE::BpeEncodingOptions& options);
+template <typename TokenType>
+std::expected<std::tuple<std::basic_string<TokenType>, std::basic_string<TokenType>, BPE::BpeEncodingResultInfo>, std::string> BPE::TryEncodeCorpus(const BPE::Corpus& corpus, const BPE::BpeEncodingOptions& options)
+{
+    if (options.PreTokenize)
+    {
+        if (corpus.ReaderWordCounts.empty() && !corpus.DocumentStarts.empty())
+        {
+            return std::unexpected{"ERROR: The corpus was read without counting its words"};
+        }
+
+        return BPE::EncodeWords<TokenType>(corpus.Documents(), corpus.ReaderWordCounts, options);
+    }
+
+    // The legacy engine has no notion of documents, and the incremental engine addresses tokens with 32-bit indices
+    if (options.Engine == BPE::EncodingEngine::Legacy)
+    {
+        return std::unexpected{"ERROR: The legacy engine cannot train on several input files"};
+    }
+
+    if (corpus.Text.size() >= UINT32_MAX - 1)
+    {
+        return std::unexpected{"ERROR: The inputs are too large to train on together, use --pre-tokenize"};
+    }
+
+    return BPE::EncodeTextIncremental<TokenType>(corpus.Text, options, corpus.DocumentStarts);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "BPE.h"
+
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace BPE
+{
+    /*
+     * A corpus is the text of many input files (documents) read back to back. Training on a corpus never forms a pair
+     * across two documents, so the BPE table does not depend on the order of the files.
+     */
+    struct Corpus
+    {
+        std::string Text;
+        // Offset in Text at which every document starts, empty files do not form a document
+        std::vector<uint64_t> DocumentStarts;
+        // Filled in by the readers when pre-tokenizing, one table per reader task, covering every document once
+        std::vector<WordCounts> ReaderWordCounts;
+
+        std::vector<std::string_view> Documents() const;
+    };
+
+    // Expands every input into the files it stands for: a file is itself, a directory all regular files below it (in path
+    // order) and a list file (given as @<file>) the paths on its lines, one per line
+    std::expected<std::vector<std::filesystem::path>, std::string> TryCollectInputFiles(std::span<const std::filesystem::path> inputs);
+
+    // Reads the files with readerCount threads straight into their place in the corpus text. With countWords every reader
+    // also counts the words of the files it read, so counting overlaps with the reading of the other files. The corpus is
+    // filled in place, as the word counts point into its text.
+    std::expected<void, std::string> TryReadCorpus(std::span<const std::filesystem::path> files, unsigned readerCount, bool countWords, Corpus& corpus);
+
+    template <typename TokenType>
+    std::expected<std::tuple<std::basic_string<TokenType>, std::basic_string<TokenType>, BpeEncodingResultInfo>, std::string> TryEncodeCorpus(const Corpus& corpus, const BpeEncodingOptions& options);
+} //namespace BPE
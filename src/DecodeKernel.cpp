@@ -0,0 +1,151 @@
+#include "DecodeKernel.h"
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BPE_X86_KERNELS
+#endif
+
+namespace
+{
+    // Vectorized kernels only exist for 16-bit tokens, the other widths always decode through the scalar loop
+    typedef void (*DecodeKernel)(const char16_t* tokens, size_t tokenCount, const BPE::DecodeTable& decodeTable, char* output, char* outputEnd);
+
+    // Copies the expansion of a single token and returns the new output position
+    template <typename TokenType>
+    inline char* DecodeSingleToken(TokenType token, const BPE::DecodeTable& decodeTable, char* output, char* outputEnd)
+    {
+        const char* expansion{decodeTable.Expansions.data() + decodeTable.Offsets[token]};
+        size_t length{size_t(decodeTable.Offsets[token + 1] - decodeTable.Offsets[token])};
+
+        // Most expansions are short: copying a whole block and only advancing by the length avoids a variable sized
+        // copy, as long as the block does not run past the end of the output (or into another thread's slice)
+        if (length <= BPE::COPY_BLOCK_SIZE && size_t(outputEnd - output) >= BPE::COPY_BLOCK_SIZE)
+        {
+            std::memcpy(output, expansion, BPE::COPY_BLOCK_SIZE);
+        }
+        else
+        {
+            std::memcpy(output, expansion, length);
+        }
+
+        return output + length;
+    }
+
+    template <typename TokenType>
+    void DecodeScalar(const TokenType* tokens, size_t tokenCount, const BPE::DecodeTable& decodeTable, char* output, char* outputEnd)
+    {
+        for (size_t i{0}; i < tokenCount; ++i)
+        {
+            output = DecodeSingleToken(tokens[i], decodeTable, output, outputEnd);
+        }
+    }
+
+#ifdef BPE_X86_KERNELS
+    /*
+     * Raw bytes are tokens below FIRST_TOKEN, so a block made up of raw bytes only is decoded by narrowing it with a
+     * saturating pack. Any other block goes through the expansion table token by token: testing whole blocks keeps the
+     * branch predictable, where a test per token would mispredict constantly on text that mixes raw bytes and merges.
+     */
+    void DecodeSse2(const char16_t* tokens, size_t tokenCount, const BPE::DecodeTable& decodeTable, char* output, char* outputEnd)
+    {
+        static_assert(BPE::FIRST_TOKEN<char16_t> <= 256);
+
+        const __m128i lastLiteral{_mm_set1_epi16(short(BPE::FIRST_TOKEN<char16_t> - 1))};
+
+        size_t i{0};
+
+        for (; i + 16 <= tokenCount; i += 16)
+        {
+            __m128i low{_mm_loadu_si128(reinterpret_cast<const __m128i*>(tokens + i))};
+            __m128i high{_mm_loadu_si128(reinterpret_cast<const __m128i*>(tokens + i + 8))};
+
+            // Unsigned token <= FIRST_TOKEN - 1 exactly when the saturating subtraction yields zero
+            __m128i excess{_mm_or_si128(_mm_subs_epu16(low, lastLiteral), _mm_subs_epu16(high, lastLiteral))};
+
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(excess, _mm_setzero_si128())) == 0xFFFF)
+            {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(output), _mm_packus_epi16(low, high));
+                output += 16;
+                continue;
+            }
+
+            for (size_t j{i}; j < i + 16; ++j)
+            {
+                output = DecodeSingleToken(tokens[j], decodeTable, output, outputEnd);
+            }
+        }
+
+        DecodeScalar(tokens + i, tokenCount - i, decodeTable, output, outputEnd);
+    }
+
+    __attribute__((target("avx2"))) void DecodeAvx2(const char16_t* tokens, size_t tokenCount, const BPE::DecodeTable& decodeTable, char* output, char* outputEnd)
+    {
+        const __m256i lastLiteral{_mm256_set1_epi16(short(BPE::FIRST_TOKEN<char16_t> - 1))};
+
+        size_t i{0};
+
+        for (; i + 32 <= tokenCount; i += 32)
+        {
+            __m256i low{_mm256_loadu_si256(reinterpret_cast<const __m256i*>(tokens + i))};
+            __m256i high{_mm256_loadu_si256(reinterpret_cast<const __m256i*>(tokens + i + 16))};
+
+            __m256i excess{_mm256_or_si256(_mm256_subs_epu16(low, lastLiteral), _mm256_subs_epu16(high, lastLiteral))};
+
+            if (_mm256_testz_si256(excess, excess))
+            {
+                // The 256-bit pack works per 128-bit lane, the permute puts the four 64-bit quarters back in token order
+                __m256i packed{_mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), 0b11011000)};
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(output), packed);
+                output += 32;
+                continue;
+            }
+
+            for (size_t j{i}; j < i + 32; ++j)
+            {
+                output = DecodeSingleToken(tokens[j], decodeTable, output, outputEnd);
+            }
+        }
+
+        DecodeSse2(tokens + i, tokenCount - i, decodeTable, output, outputEnd);
+    }
+#endif
+
+    DecodeKernel SelectDecodeKernel()
+    {
+#ifdef BPE_X86_KERNELS
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return DecodeAvx2;
+        }
+
+        if (__builtin_cpu_supports("sse2"))
+        {
+            return DecodeSse2;
+        }
+#endif
+
+        return DecodeScalar<char16_t>;
+    }
+} //namespace
+
+template void BPE::DecodeInto<char8_t>(std::span<const char8_t> input, const BPE::DecodeTable& decodeTable, char* output, char* outputEnd);
+template void BPE::DecodeInto<char16_t>(std::span<const char16_t> input, const BPE::DecodeTable& decodeTable, char* output, char* outputEnd);
+template void BPE::DecodeInto<char32_t>(std::span<const char32_t> input, const BPE::DecodeTable& decodeTable, char* output, char* outputEnd);
+template <typename TokenType>
+void BPE::DecodeInto(std::span<const TokenType> input, const BPE::DecodeTable& decodeTable, char* output, char* outputEnd)
+{
+    if constexpr (std::is_same_v<TokenType, char16_t>)
+    {
+        static const DecodeKernel kernel{SelectDecodeKernel()};
+
+        kernel(input.data(), input.size(), decodeTable, output, outputEnd);
+    }
+    else
+    {
+        DecodeScalar(input.data(), input.size(), decodeTable, output, outputEnd);
+    }
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "BPE.h"
+
+#include <cstddef>
+#include <span>
+
+namespace BPE
+{
+    // Short expansions are copied as one fixed-size block, so expansions and outputs keep this much slack behind them
+    const size_t COPY_BLOCK_SIZE{16};
+
+    // Decodes into [output, outputEnd), which has to be large enough for the expansions. Picks the fastest kernel the CPU supports.
+    template <typename TokenType>
+    void DecodeInto(std::span<const TokenType> input, const DecodeTable& decodeTable, char* output, char* outputEnd);
+} //namespace BPE
@@ -0,0 +1,259 @@
+#include "BPE.h"
+#include "Core.h"
+#include "DecodeKernel.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+    // Expansions of a valid table fit easily, anything above this is a corrupt or hostile table
+    const uint64_t MAXIMUM_EXPANSIONS_SIZE{uint64_t(1) << 32};
+
+    template <typename TokenType>
+    TokenType FindInvalidToken(std::span<const TokenType> input, const BPE::DecodeTable& decodeTable)
+    {
+        return *std::find_if(input.begin(), input.end(), [&](TokenType token) { return token >= decodeTable.TokenCount(); });
+    }
+
+    // Output offset of every chunk the input is split into, the last element is the total decoded length
+    template <typename TokenType>
+    std::optional<std::vector<uint64_t>> ChunkOutputOffsets(std::span<const TokenType> input, const BPE::DecodeTable& decodeTable, BPE::ThreadPool& threadPool)
+    {
+        size_t chunkCount{BPE::ChunkCount(input.size(), threadPool.ThreadCount(), BPE::MINIMUM_TOKEN_CHUNK_SIZE)};
+
+        std::vector<std::optional<uint64_t>> chunkLengths(chunkCount);
+
+        threadPool.ParallelFor(chunkCount, [&](size_t chunk)
+        {
+            auto [begin, end]{BPE::SplitRange(input.size(), chunkCount, chunk)};
+            chunkLengths[chunk] = BPE::DecodedLength(input.subspan(begin, end - begin), decodeTable);
+        });
+
+        std::vector<uint64_t> chunkOffsets(chunkCount + 1);
+
+        for (size_t chunk{0}; chunk < chunkCount; ++chunk)
+        {
+            if (!chunkLengths[chunk].has_value())
+            {
+                return std::nullopt;
+            }
+
+            chunkOffsets[chunk + 1] = chunkOffsets[chunk] + chunkLengths[chunk].value();
+        }
+
+        return chunkOffsets;
+    }
+
+    template <typename TokenType>
+    void DecodeChunksInto(std::span<const TokenType> input, const BPE::DecodeTable& decodeTable, const std::vector<uint64_t>& chunkOffsets, char* output, BPE::ThreadPool& threadPool)
+    {
+        size_t chunkCount{chunkOffsets.size() - 1};
+
+        threadPool.ParallelFor(chunkCount, [&](size_t chunk)
+        {
+            auto [begin, end]{BPE::SplitRange(input.size(), chunkCount, chunk)};
+            BPE::DecodeInto(input.subspan(begin, end - begin), decodeTable, output + chunkOffsets[chunk], output + chunkOffsets[chunk + 1]);
+        });
+    }
+} //namespace
+
+template std::optional<uint64_t> BPE::DecodedLength<char8_t>(std::span<const char8_t> input, const BPE::DecodeTable& decodeTable);
+template std::optional<uint64_t> BPE::DecodedLength<char16_t>(std::span<const char16_t> input, const BPE::DecodeTable& decodeTable);
+template std::optional<uint64_t> BPE::DecodedLength<char32_t>(std::span<const char32_t> input, const BPE::DecodeTable& decodeTable);
+template <typename TokenType>
+std::optional<uint64_t> BPE::DecodedLength(std::span<const TokenType> input, const BPE::DecodeTable& decodeTable)
+{
+    uint64_t decodedLength{0};
+
+    for (TokenType token : input)
+    {
+        if (token >= decodeTable.TokenCount())
+        {
+            return std::nullopt;
+        }
+
+        decodedLength += decodeTable.Offsets[token + 1] - decodeTable.Offsets[token];
+    }
+
+    return decodedLength;
+}
+
+template std::expected<size_t, std::string> BPE::TryDecodeInto<char8_t>(std::span<const char8_t> input, const BPE::DecodeTable& decodeTable, std::span<std::byte> output);
+template std::expected<size_t, std::string> BPE::TryDecodeInto<char16_t>(std::span<const char16_t> input, const BPE::DecodeTable& decodeTable, std::span<std::byte> output);
+template std::expected<size_t, std::string> BPE::TryDecodeInto<char32_t>(std::span<const char32_t> input, const BPE::DecodeTable& decodeTable, std::span<std::byte> output);
+template <typename TokenType>
+std::expected<size_t, std::string> BPE::TryDecodeInto(std::span<const TokenType> input, const BPE::DecodeTable& decodeTable, std::span<std::byte> output)
+{
+    std::optional<uint64_t> decodedLength{BPE::DecodedLength(input, decodeTable)};
+
+    if (!decodedLength.has_value())
+    {
+        return std::unexpected{std::format("ERROR: Token {} is not part of the BPE table", size_t(FindInvalidToken(input, decodeTable)))};
+    }
+
+    if (decodedLength.value() > output.size())
+    {
+        return std::unexpected{std::format("ERROR: Output of {} bytes is too small for {} decoded bytes", output.size(), decodedLength.value())};
+    }
+
+    // The kernel only copies whole blocks where the output has room for them, so an exactly sized output is fine
+    char* outputBegin{reinterpret_cast<char*>(output.data())};
+    BPE::DecodeInto(input, decodeTable, outputBegin, outputBegin + output.size());
+
+    return size_t(decodedLength.value());
+}
+
+template std::expected<BPE::DecodeTable, std::string> BPE::TryBuildDecodeTable<char8_t>(std::span<const std::pair<char8_t, char8_t>> bpeTable);
+template std::expected<BPE::DecodeTable, std::string> BPE::TryBuildDecodeTable<char16_t>(std::span<const std::pair<char16_t, char16_t>> bpeTable);
+template std::expected<BPE::DecodeTable, std::string> BPE::TryBuildDecodeTable<char32_t>(std::span<const std::pair<char32_t, char32_t>> bpeTable);
+/*
+ * Every table entry only references tokens defined before it, so the expansions can be built in token order by
+ * concatenating the two (already built) expansions of the pair.
+ */
+template <typename TokenType>
+std::expected<BPE::DecodeTable, std::string> BPE::TryBuildDecodeTable(std::span<const std::pair<TokenType, TokenType>> bpeTable)
+{
+    size_t tokenCount{BPE::FIRST_TOKEN<TokenType> + bpeTable.size()};
+
+    BPE::DecodeTable decodeTable{};
+    decodeTable.Offsets.reserve(tokenCount + 1);
+    decodeTable.Offsets.push_back(0);
+
+    for (size_t token{0}; token < BPE::FIRST_TOKEN<TokenType>; ++token)
+    {
+        decodeTable.Offsets.push_back(token + 1);
+    }
+
+    for (size_t i{0}; i < bpeTable.size(); ++i)
+    {
+        auto [first, second]{bpeTable[i]};
+
+        if (first >= BPE::FIRST_TOKEN<TokenType> + i || second >= BPE::FIRST_TOKEN<TokenType> + i)
+        {
+            return std::unexpected{std::format("ERROR: BPE table entry for token {} references a token that is not defined before it", BPE::FIRST_TOKEN<TokenType> + i)};
+        }
+
+        uint64_t length{(decodeTable.Offsets[first + 1] - decodeTable.Offsets[first]) + (decodeTable.Offsets[second + 1] - decodeTable.Offsets[second])};
+        decodeTable.Offsets.push_back(decodeTable.Offsets.back() + length);
+
+        if (decodeTable.Offsets.back() > MAXIMUM_EXPANSIONS_SIZE)
+        {
+            return std::unexpected{std::format("ERROR: Expansions of the BPE table exceed {} bytes", MAXIMUM_EXPANSIONS_SIZE)};
+        }
+    }
+
+    decodeTable.Expansions.resize(decodeTable.Offsets.back() + BPE::COPY_BLOCK_SIZE);
+
+    for (size_t token{0}; token < BPE::FIRST_TOKEN<TokenType>; ++token)
+    {
+        decodeTable.Expansions[token] = char(token);
+    }
+
+    for (size_t i{0}; i < bpeTable.size(); ++i)
+    {
+        auto [first, second]{bpeTable[i]};
+
+        std::string_view firstExpansion{decodeTable.Expand(first)};
+        std::string_view secondExpansion{decodeTable.Expand(second)};
+        char* destination{decodeTable.Expansions.data() + decodeTable.Offsets[BPE::FIRST_TOKEN<TokenType> + i]};
+
+        std::memcpy(destination, firstExpansion.data(), firstExpansion.size());
+        std::memcpy(destination + firstExpansion.size(), secondExpansion.data(), secondExpansion.size());
+    }
+
+    return decodeTable;
+}
+
+template std::tuple<std::string, BPE::BpeDecodingResultInfo> BPE::DecodeString<char8_t>(std::span<const char8_t> input, const BPE::DecodeTable& decodeTable);
+template std::tuple<std::string, BPE::BpeDecodingResultInfo> BPE::DecodeString<char16_t>(std::span<const char16_t> input, const BPE::DecodeTable& decodeTable);
+template std::tuple<std::string, BPE::BpeDecodingResultInfo> BPE::DecodeString<char32_t>(std::span<const char32_t> input, const BPE::DecodeTable& decodeTable);
+template <typename TokenType>
+std::tuple<std::string, BPE::BpeDecodingResultInfo> BPE::DecodeString(std::span<const TokenType> input, const BPE::DecodeTable& decodeTable)
+{
+    // The exact output size is known up front, so the result is allocated once and every token is a single copy
+    std::optional<uint64_t> decodedLength{BPE::DecodedLength(input, decodeTable)};
+
+    if (!decodedLength.has_value())
+    {
+        throw std::out_of_range(std::format("Token {} is not part of the BPE table", size_t(FindInvalidToken(input, decodeTable))));
+    }
+
+    std::string result{};
+    result.resize_and_overwrite(decodedLength.value() + BPE::COPY_BLOCK_SIZE, [&](char* output, size_t size)
+    {
+        BPE::DecodeInto(input, decodeTable, output, output + size);
+        return decodedLength.value();
+    });
+
+    BpeDecodingResultInfo info{input.size(), result.size()};
+
+    return {result, info};
+}
+
+template std::tuple<std::string, BPE::BpeDecodingResultInfo> BPE::DecodeStringParallel<char8_t>(std::span<const char8_t> input, const BPE::DecodeTable& decodeTable, unsigned threadCount);
+template std::tuple<std::string, BPE::BpeDecodingResultInfo> BPE::DecodeStringParallel<char16_t>(std::span<const char16_t> input, const BPE::DecodeTable& decodeTable, unsigned threadCount);
+template std::tuple<std::string, BPE::BpeDecodingResultInfo> BPE::DecodeStringParallel<char32_t>(std::span<const char32_t> input, const BPE::DecodeTable& decodeTable, unsigned threadCount);
+/*
+ * Once every token's expansion length is known, a prefix sum over the chunks gives the offset at which each chunk's
+ * output starts, so all chunks can decode at the same time into disjoint slices of one output buffer.
+ */
+template <typename TokenType>
+std::tuple<std::string, BPE::BpeDecodingResultInfo> BPE::DecodeStringParallel(std::span<const TokenType> input, const BPE::DecodeTable& decodeTable, unsigned threadCount)
+{
+    BPE::ThreadPool threadPool{threadCount};
+    std::optional<std::vector<uint64_t>> chunkOffsets{ChunkOutputOffsets(input, decodeTable, threadPool)};
+
+    if (!chunkOffsets.has_value())
+    {
+        throw std::out_of_range(std::format("Token {} is not part of the BPE table", size_t(FindInvalidToken(input, decodeTable))));
+    }
+
+    uint64_t decodedLength{chunkOffsets.value().back()};
+
+    std::string result{};
+    result.resize_and_overwrite(decodedLength, [&](char* output, size_t)
+    {
+        DecodeChunksInto(input, decodeTable, chunkOffsets.value(), output, threadPool);
+        return decodedLength;
+    });
+
+    BpeDecodingResultInfo info{input.size(), result.size()};
+
+    return {result, info};
+}
+
+template std::expected<BPE::BpeDecodingResultInfo, std::string> BPE::TryDecodeToFileParallel<char8_t>(std::span<const char8_t> input, const BPE::DecodeTable& decodeTable, const std::filesystem::path& outputFilePath, unsigned threadCount);
+template std::expected<BPE::BpeDecodingResultInfo, std::string> BPE::TryDecodeToFileParallel<char16_t>(std::span<const char16_t> input, const BPE::DecodeTable& decodeTable, const std::filesystem::path& outputFilePath, unsigned threadCount);
+template std::expected<BPE::BpeDecodingResultInfo, std::string> BPE::TryDecodeToFileParallel<char32_t>(std::span<const char32_t> input, const BPE::DecodeTable& decodeTable, const std::filesystem::path& outputFilePath, unsigned threadCount);
+template <typename TokenType>
+std::expected<BPE::BpeDecodingResultInfo, std::string> BPE::TryDecodeToFileParallel(std::span<const TokenType> input, const BPE::DecodeTable& decodeTable, const std::filesystem::path& outputFilePath, unsigned threadCount)
+{
+    BPE::ThreadPool threadPool{threadCount};
+    std::optional<std::vector<uint64_t>> chunkOffsets{ChunkOutputOffsets(input, decodeTable, threadPool)};
+
+    if (!chunkOffsets.has_value())
+    {
+        return std::unexpected{std::format("ERROR: Token {} is not part of the BPE table", size_t(FindInvalidToken(input, decodeTable)))};
+    }
+
+    uint64_t decodedLength{chunkOffsets.value().back()};
+
+    std::expected<BPE::WritableFileMapping, std::string> mapping{BPE::WritableFileMapping::TryCreate(outputFilePath, decodedLength)};
+
+    if (!mapping.has_value())
+    {
+        return std::unexpected{mapping.error()};
+    }
+
+    DecodeChunksInto(input, decodeTable, chunkOffsets.value(), reinterpret_cast<char*>(mapping.value().Bytes().data()), threadPool);
+
+    return BpeDecodingResultInfo{input.size(), decodedLength};
+}
@@ -0,0 +1,272 @@
+#include "BPE.h"
+
+#include <format>
+#include <optional>
+#include <print>
+#include <random>
+#include <vector>
+
+namespace
+{
+    // Generated text is written in blocks of about this many bytes
+    const size_t OUTPUT_BUFFER_SIZE{1 << 20};
+
+    template <typename TokenType>
+    class TokenGenerator
+    {
+    public:
+        TokenGenerator(std::span<const std::pair<TokenType, TokenType>> bpeTable, uint64_t seed)
+            : m_BpeTable{bpeTable}, m_OwnedSuccessors{BPE::BuildSuccessorIndex<TokenType>(bpeTable)}, m_Successors{m_OwnedSuccessors.value()}, m_Random{seed}
+        {
+        }
+
+        TokenGenerator(std::span<const std::pair<TokenType, TokenType>> bpeTable, const BPE::SuccessorIndex<TokenType>& successors, uint64_t seed)
+            : m_BpeTable{bpeTable}, m_OwnedSuccessors{}, m_Successors{successors}, m_Random{seed}
+        {
+        }
+
+        TokenGenerator(const TokenGenerator&) = delete;
+        TokenGenerator& operator=(const TokenGenerator&) = delete;
+
+        TokenType FirstToken()
+        {
+            return m_BpeTable[Pick(m_BpeTable.size())].second;
+        }
+
+        // Picks a token that followed the given one in the training text. Tokens that never came first in a pair fall
+        // back to the successors of their second half, gives up once a raw byte without successors is reached.
+        std::optional<TokenType> NextToken(TokenType token, bool verbose)
+        {
+            std::span<const TokenType> successors{m_Successors.SuccessorsOf(token)};
+
+            while (successors.empty())
+            {
+                if (token < BPE::FIRST_TOKEN<TokenType>)
+                {
+                    if (verbose)
+                    {
+                        std::println("GAVE UP: Reached terminal token {}", (char)token);
+                    }
+
+                    return std::nullopt;
+                }
+
+                if (verbose)
+                {
+                    std::println("Could not find next token after |{}|", Decode(token));
+                }
+
+                // A valid table only refers back to earlier tokens, which also keeps this walk finite
+                if (size_t(token - BPE::FIRST_TOKEN<TokenType>) >= m_BpeTable.size() || m_BpeTable[token - BPE::FIRST_TOKEN<TokenType>].second >= token)
+                {
+                    return std::nullopt;
+                }
+
+                token = m_BpeTable[token - BPE::FIRST_TOKEN<TokenType>].second;
+                successors = m_Successors.SuccessorsOf(token);
+
+                if (verbose)
+                {
+                    std::println("Checking token |{}| instead (value {})", Decode(token), (uint64_t)token);
+                }
+            }
+
+            if (verbose)
+            {
+                std::println("Found {} possible next tokens", successors.size());
+
+                for (TokenType successor : successors)
+                {
+                    std::println("|{}| ({})", Decode(successor), (uint64_t)successor);
+                }
+            }
+
+            return successors[Pick(successors.size())];
+        }
+
+        std::string Decode(TokenType token) const
+        {
+            std::string decodedToken{};
+            BPE::DecodeToken(token, decodedToken, m_BpeTable);
+
+            return decodedToken;
+        }
+
+    private:
+        size_t Pick(size_t count)
+        {
+            return std::uniform_int_distribution<size_t>{0, count - 1}(m_Random);
+        }
+
+        std::span<const std::pair<TokenType, TokenType>> m_BpeTable;
+        // Set when the generator built its own index, m_Successors refers to it then
+        std::optional<BPE::SuccessorIndex<TokenType>> m_OwnedSuccessors;
+        const BPE::SuccessorIndex<TokenType>& m_Successors;
+        std::mt19937_64 m_Random;
+    };
+} //namespace
+
+template BPE::SuccessorIndex<char8_t> BPE::BuildSuccessorIndex<char8_t>(std::span<const std::pair<char8_t, char8_t>> bpeTable);
+template BPE::SuccessorIndex<char16_t> BPE::BuildSuccessorIndex<char16_t>(std::span<const std::pair<char16_t, char16_t>> bpeTable);
+template BPE::SuccessorIndex<char32_t> BPE::BuildSuccessorIndex<char32_t>(std::span<const std::pair<char32_t, char32_t>> bpeTable);
+template <typename TokenType>
+BPE::SuccessorIndex<TokenType> BPE::BuildSuccessorIndex(std::span<const std::pair<TokenType, TokenType>> bpeTable)
+{
+    BPE::SuccessorIndex<TokenType> successorIndex{};
+    successorIndex.Offsets.assign(FIRST_TOKEN<TokenType> + bpeTable.size() + 1, 0);
+
+    // Count the successors of every token, then turn the counts into start offsets and scatter the table into place
+    for (const std::pair<TokenType, TokenType>& pair : bpeTable)
+    {
+        if (size_t(pair.first) + 1 < successorIndex.Offsets.size())
+        {
+            successorIndex.Offsets[pair.first + 1]++;
+        }
+    }
+
+    for (size_t token{1}; token < successorIndex.Offsets.size(); ++token)
+    {
+        successorIndex.Offsets[token] += successorIndex.Offsets[token - 1];
+    }
+
+    std::vector<uint32_t> fill{successorIndex.Offsets.begin(), successorIndex.Offsets.end() - 1};
+    successorIndex.Successors.resize(successorIndex.Offsets.back());
+
+    // Successors keep their table order, so the same seed always generates the same text
+    for (const std::pair<TokenType, TokenType>& pair : bpeTable)
+    {
+        if (size_t(pair.first) + 1 < successorIndex.Offsets.size())
+        {
+            successorIndex.Successors[fill[pair.first]++] = pair.second;
+        }
+    }
+
+    return successorIndex;
+}
+
+template std::basic_string<char8_t> BPE::GenerateTokenString<char8_t>(std::span<const std::pair<char8_t, char8_t>> bpeTable, uint tokenCount, uint64_t seed);
+template std::basic_string<char16_t> BPE::GenerateTokenString<char16_t>(std::span<const std::pair<char16_t, char16_t>> bpeTable, uint tokenCount, uint64_t seed);
+template std::basic_string<char32_t> BPE::GenerateTokenString<char32_t>(std::span<const std::pair<char32_t, char32_t>> bpeTable, uint tokenCount, uint64_t seed);
+template <typename TokenType>
+std::basic_string<TokenType> BPE::GenerateTokenString(std::span<const std::pair<TokenType, TokenType>> bpeTable, uint tokenCount, uint64_t seed)
+{
+    std::basic_string<TokenType> result{};
+
+    if (bpeTable.empty() || tokenCount == 0)
+    {
+        return result;
+    }
+
+    TokenGenerator<TokenType> generator{bpeTable, seed};
+
+    TokenType currentToken{generator.FirstToken()};
+    result.push_back(currentToken);
+
+    for (uint i{1}; i < tokenCount; ++i)
+    {
+        std::println("TOKEN {}: |{}|", i, generator.Decode(currentToken));
+
+        std::optional<TokenType> nextToken{generator.NextToken(currentToken, true)};
+
+        if (nextToken.has_value() == false)
+        {
+            std::println("GAVE UP: Could not find next token after |{}|", generator.Decode(currentToken));
+            return result;
+        }
+
+        currentToken = nextToken.value();
+        result.push_back(currentToken);
+        std::println();
+    }
+
+    return result;
+}
+
+template std::string BPE::GenerateText<char8_t>(std::span<const std::pair<char8_t, char8_t>> bpeTable, const BPE::SuccessorIndex<char8_t>& successorIndex, const BPE::DecodeTable& decodeTable, uint64_t tokenCount, uint64_t seed);
+template std::string BPE::GenerateText<char16_t>(std::span<const std::pair<char16_t, char16_t>> bpeTable, const BPE::SuccessorIndex<char16_t>& successorIndex, const BPE::DecodeTable& decodeTable, uint64_t tokenCount, uint64_t seed);
+template std::string BPE::GenerateText<char32_t>(std::span<const std::pair<char32_t, char32_t>> bpeTable, const BPE::SuccessorIndex<char32_t>& successorIndex, const BPE::DecodeTable& decodeTable, uint64_t tokenCount, uint64_t seed);
+template <typename TokenType>
+std::string BPE::GenerateText(std::span<const std::pair<TokenType, TokenType>> bpeTable, const BPE::SuccessorIndex<TokenType>& successorIndex, const BPE::DecodeTable& decodeTable, uint64_t tokenCount, uint64_t seed)
+{
+    std::string result{};
+
+    if (bpeTable.empty() || tokenCount == 0)
+    {
+        return result;
+    }
+
+    TokenGenerator<TokenType> generator{bpeTable, successorIndex, seed};
+
+    uint64_t generatedTokenCount{0};
+    std::optional<TokenType> currentToken{generator.FirstToken()};
+
+    while (currentToken.has_value() && generatedTokenCount < tokenCount)
+    {
+        result.append(decodeTable.Expand(currentToken.value()));
+        ++generatedTokenCount;
+
+        if (generatedTokenCount < tokenCount)
+        {
+            currentToken = generator.NextToken(currentToken.value(), false);
+        }
+    }
+
+    return result;
+}
+
+template std::expected<uint64_t, std::string> BPE::TryGenerateToStream<char8_t>(std::span<const std::pair<char8_t, char8_t>> bpeTable, uint64_t tokenCount, uint64_t seed, std::ostream& output);
+template std::expected<uint64_t, std::string> BPE::TryGenerateToStream<char16_t>(std::span<const std::pair<char16_t, char16_t>> bpeTable, uint64_t tokenCount, uint64_t seed, std::ostream& output);
+template std::expected<uint64_t, std::string> BPE::TryGenerateToStream<char32_t>(std::span<const std::pair<char32_t, char32_t>> bpeTable, uint64_t tokenCount, uint64_t seed, std::ostream& output);
+/*
+ * Same walk as GenerateTokenString without any tracing: every token is expanded through a DecodeTable and written out
+ * in large blocks, so generating costs a lookup in the successor index and a short copy per token.
+ */
+template <typename TokenType>
+std::expected<uint64_t, std::string> BPE::TryGenerateToStream(std::span<const std::pair<TokenType, TokenType>> bpeTable, uint64_t tokenCount, uint64_t seed, std::ostream& output)
+{
+    if (bpeTable.empty())
+    {
+        return std::unexpected("ERROR: Cannot generate text from an empty BPE table");
+    }
+
+    std::expected<BPE::DecodeTable, std::string> decodeTable{BPE::TryBuildDecodeTable<TokenType>(bpeTable)};
+    if (!decodeTable.has_value())
+    {
+        return std::unexpected(decodeTable.error());
+    }
+
+    TokenGenerator<TokenType> generator{bpeTable, seed};
+
+    std::string buffer{};
+    buffer.reserve(OUTPUT_BUFFER_SIZE);
+
+    uint64_t generatedTokenCount{0};
+    std::optional<TokenType> currentToken{generator.FirstToken()};
+
+    while (currentToken.has_value() && generatedTokenCount < tokenCount)
+    {
+        buffer.append(decodeTable.value().Expand(currentToken.value()));
+        ++generatedTokenCount;
+
+        if (buffer.size() >= OUTPUT_BUFFER_SIZE)
+        {
+            output.write(buffer.data(), buffer.size());
+            buffer.clear();
+        }
+
+        if (generatedTokenCount < tokenCount)
+        {
+            currentToken = generator.NextToken(currentToken.value(), false);
+        }
+    }
+
+    output.write(buffer.data(), buffer.size());
+    output.flush();
+
+    if (!output)
+    {
+        return std::unexpected("ERROR: Unable to write the generated text");
+    }
+
+    return generatedTokenCount;
+}
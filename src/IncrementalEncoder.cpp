@@ -0,0 +1,390 @@
+#include "BPE.h"
+#include "Checkpoint.h"
+#include "ThreadPool.h"
+#include "TrainingMonitor.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <print>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    // Marks the end of the token sequence in the linked list
+    const uint32_t END_INDEX{UINT32_MAX};
+    // Marks a node that was merged into its left neighbour
+    const uint32_t REMOVED_INDEX{UINT32_MAX - 1};
+
+    struct PairOccurrences
+    {
+        int Count;
+        // Node indices at which the pair starts, may contain stale or duplicate entries
+        std::vector<uint32_t> Positions;
+    };
+
+    template <typename TokenType>
+    struct HeapEntry
+    {
+        int Count;
+        std::pair<TokenType, TokenType> Pair;
+    };
+
+    struct HeapEntryCompare
+    {
+        // The top of the heap is the most frequent pair, ties go to the smallest pair (same as the legacy engine)
+        template <typename TokenType>
+        bool operator()(const HeapEntry<TokenType>& a, const HeapEntry<TokenType>& b) const
+        {
+            if (a.Count != b.Count)
+            {
+                return a.Count < b.Count;
+            }
+
+            return a.Pair > b.Pair;
+        }
+    };
+
+    template <typename TokenType>
+    using PairOccurrenceMap = std::unordered_map<std::pair<TokenType, TokenType>, PairOccurrences, BPE::PairHash>;
+    template <typename TokenType>
+    using PairHeap = std::priority_queue<HeapEntry<TokenType>, std::vector<HeapEntry<TokenType>>, HeapEntryCompare>;
+
+    template <typename TokenType>
+    void RebuildHeap(PairHeap<TokenType>& heap, const PairOccurrenceMap<TokenType>& pairs)
+    {
+        std::vector<HeapEntry<TokenType>> entries{};
+        entries.reserve(pairs.size());
+
+        for (const auto& [pair, occurrences] : pairs)
+        {
+            entries.push_back({occurrences.Count, pair});
+        }
+
+        heap = PairHeap<TokenType>{HeapEntryCompare{}, std::move(entries)};
+    }
+} //namespace
+
+template std::tuple<std::basic_string<char8_t>, std::basic_string<char8_t>, BPE::BpeEncodingResultInfo> BPE::EncodeTextIncremental<char8_t>(const std::string& input, const BPE::BpeEncodingOptions& options, std::span<const uint64_t> documentStarts);
+template std::tuple<std::basic_string<char16_t>, std::basic_string<char16_t>, BPE::BpeEncodingResultInfo> BPE::EncodeTextIncremental<char16_t>(const std::string& input, const BPE::BpeEncodingOptions& options, std::span<const uint64_t> documentStarts);
+template std::tuple<std::basic_string<char32_t>, std::basic_string<char32_t>, BPE::BpeEncodingResultInfo> BPE::EncodeTextIncremental<char32_t>(const std::string& input, const BPE::BpeEncodingOptions& options, std::span<const uint64_t> documentStarts);
+template <typename TokenType>
+std::tuple<std::basic_string<TokenType>, std::basic_string<TokenType>, BPE::BpeEncodingResultInfo> BPE::EncodeTextIncremental(const std::string& input, const BPE::BpeEncodingOptions& options, std::span<const uint64_t> documentStarts)
+{
+    std::basic_string<TokenType> encodedString{BPE::ToRawTokens<TokenType>(input)};
+
+    std::basic_string<TokenType> bpeTable{};
+
+    BPE::BpeEncodingResultInfo encodingInfo{};
+    encodingInfo.EncodedStringInitialLength = input.size();
+
+    ContinueEncodingIncremental<TokenType>(encodedString, bpeTable, encodingInfo, options, documentStarts);
+
+    return {bpeTable, encodedString, encodingInfo};
+}
+
+/*
+ * Trains the same table as EncodeTextLegacy, but counts the pairs only once. The token sequence is kept as a linked list
+ * over an array so merging never moves memory, and every pair remembers where it occurs so a merge only touches those
+ * positions and their direct neighbours. The best pair is taken from a max-heap with lazy invalidation: an entry is only
+ * valid while its count still matches the current count of its pair.
+ *
+ * Training picks up from the given table and token sequence, so callers can hand over a partially trained state.
+ *
+ * The token sequence can hold several documents, starting at the (sorted) documentStarts. Every document is a list of
+ * its own, so no pair spans two documents. Without documentStarts the whole sequence is one document.
+ *
+ * With a checkpoint path in the options the state is written out every CheckpointInterval merges and once more when
+ * training stops, see Checkpoint.h.
+ */
+template void BPE::ContinueEncodingIncremental<char8_t>(std::basic_string<char8_t>& encodedString, std::basic_string<char8_t>& bpeTable, BPE::BpeEncodingResultInfo& encodingInfo, const BPE::BpeEncodingOptions& options, std::span<const uint64_t> documentStarts);
+template void BPE::ContinueEncodingIncremental<char16_t>(std::basic_string<char16_t>& encodedString, std::basic_string<char16_t>& bpeTable, BPE::BpeEncodingResultInfo& encodingInfo, const BPE::BpeEncodingOptions& options, std::span<const uint64_t> documentStarts);
+template void BPE::ContinueEncodingIncremental<char32_t>(std::basic_string<char32_t>& encodedString, std::basic_string<char32_t>& bpeTable, BPE::BpeEncodingResultInfo& encodingInfo, const BPE::BpeEncodingOptions& options, std::span<const uint64_t> documentStarts);
+template <typename TokenType>
+void BPE::ContinueEncodingIncremental(std::basic_string<TokenType>& encodedString, std::basic_string<TokenType>& bpeTable, BPE::BpeEncodingResultInfo& encodingInfo, const BPE::BpeEncodingOptions& options, std::span<const uint64_t> documentStarts)
+{
+    assert(encodedString.size() < REMOVED_INDEX);
+
+    uint32_t tokenCount{uint32_t(encodedString.size())};
+
+    std::basic_string<TokenType> symbols{std::move(encodedString)};
+    std::vector<uint32_t> previous{};
+    std::vector<uint32_t> next{};
+    previous.reserve(tokenCount);
+    next.reserve(tokenCount);
+
+    // The first node of a document is never merged away, so every document keeps starting at the same index
+    std::vector<uint32_t> starts{};
+
+    for (uint64_t start : documentStarts)
+    {
+        if (start < tokenCount && (starts.empty() || start > starts.back()))
+        {
+            starts.push_back(uint32_t(start));
+        }
+    }
+
+    if (tokenCount > 0 && (starts.empty() || starts.front() != 0))
+    {
+        starts.insert(starts.begin(), 0);
+    }
+
+    for (uint32_t i{0}, document{0}; i < tokenCount; ++i)
+    {
+        bool isDocumentStart{document < starts.size() && starts[document] == i};
+        bool isDocumentEnd{i + 1 == tokenCount || (document + 1 < starts.size() && starts[document + 1] == i + 1)};
+
+        previous.push_back(isDocumentStart ? END_INDEX : i - 1);
+        next.push_back(isDocumentEnd ? END_INDEX : i + 1);
+
+        if (isDocumentEnd)
+        {
+            ++document;
+        }
+    }
+
+    BPE::EnterPhase(options.Monitor, BPE::TrainingPhase::Count);
+
+    // Chunks count their pairs in parallel, merging them in chunk order keeps every position list sorted
+    size_t chunkCount{BPE::ChunkCount(tokenCount, options.ThreadCount, BPE::MINIMUM_TOKEN_CHUNK_SIZE)};
+    std::vector<PairOccurrenceMap<TokenType>> chunkPairs(chunkCount);
+
+    BPE::ThreadPool{unsigned(chunkCount)}.ParallelFor(chunkCount, [&](size_t chunk)
+    {
+        auto [begin, end]{BPE::SplitRange(tokenCount, chunkCount, chunk)};
+
+        for (size_t i{begin}; i < end; ++i)
+        {
+            if (next[i] == END_INDEX)
+            {
+                continue;
+            }
+
+            PairOccurrences& occurrences{chunkPairs[chunk][{symbols[i], symbols[i + 1]}]};
+            occurrences.Count += 1;
+            occurrences.Positions.push_back(uint32_t(i));
+        }
+    });
+
+    PairOccurrenceMap<TokenType> pairs{std::move(chunkPairs[0])};
+
+    for (size_t chunk{1}; chunk < chunkCount; ++chunk)
+    {
+        for (auto& [pair, chunkOccurrences] : chunkPairs[chunk])
+        {
+            PairOccurrences& occurrences{pairs[pair]};
+            occurrences.Count += chunkOccurrences.Count;
+            occurrences.Positions.insert(occurrences.Positions.end(), chunkOccurrences.Positions.begin(), chunkOccurrences.Positions.end());
+        }
+
+        chunkPairs[chunk] = PairOccurrenceMap<TokenType>{};
+    }
+
+    PairHeap<TokenType> heap{};
+    RebuildHeap(heap, pairs);
+
+    std::vector<std::pair<TokenType, TokenType>> touchedPairs{};
+    std::vector<uint32_t> positions{};
+
+    TokenType nextEncodedToken{TokenType(BPE::FIRST_TOKEN<TokenType> + bpeTable.size() / 2)};
+    uint64_t encodedStringLength{tokenCount};
+
+    auto decrement = [&](std::pair<TokenType, TokenType> pair)
+    {
+        auto it{pairs.find(pair)};
+        assert(it != pairs.end() && it->second.Count > 0);
+
+        if (--it->second.Count == 0)
+        {
+            pairs.erase(it);
+        }
+
+        touchedPairs.push_back(pair);
+    };
+
+    auto increment = [&](std::pair<TokenType, TokenType> pair, uint32_t position)
+    {
+        PairOccurrences& occurrences{pairs[pair]};
+        occurrences.Count += 1;
+        occurrences.Positions.push_back(position);
+
+        touchedPairs.push_back(pair);
+    };
+
+    // Walks the documents in order into `tokens`, recording where every document starts
+    auto collectTokens = [&](std::basic_string<TokenType>& tokens, std::vector<uint64_t>& tokenStarts)
+    {
+        tokens.clear();
+        tokens.reserve(encodedStringLength);
+        tokenStarts.clear();
+
+        for (uint32_t start : starts)
+        {
+            tokenStarts.push_back(tokens.size());
+
+            for (uint32_t i{start}; i != END_INDEX; i = next[i])
+            {
+                tokens.push_back(symbols[i]);
+            }
+        }
+    };
+
+    auto writeCheckpoint = [&](const std::basic_string<TokenType>& tokens, const std::vector<uint64_t>& tokenStarts)
+    {
+        std::expected<void, std::string> checkpointResult{BPE::TryWriteCheckpoint<TokenType>(options.CheckpointPath, bpeTable, tokens, tokenStarts, encodingInfo)};
+
+        // Losing one checkpoint is better than losing the whole run
+        if (!checkpointResult.has_value())
+        {
+            std::println(stderr, "{} (training continues)", checkpointResult.error());
+        }
+    };
+
+    std::basic_string<TokenType> checkpointTokens{};
+    std::vector<uint64_t> tokenStarts{};
+    uint64_t checkpointedMerges{bpeTable.size() / 2};
+
+    for (;; encodingInfo.EncodingIterationCount++)
+    {
+        uint64_t mergeCount{bpeTable.size() / 2};
+
+        if (!options.CheckpointPath.empty() && options.CheckpointInterval > 0 && mergeCount % options.CheckpointInterval == 0 && mergeCount != checkpointedMerges)
+        {
+            BPE::EnterPhase(options.Monitor, BPE::TrainingPhase::Other);
+
+            collectTokens(checkpointTokens, tokenStarts);
+            writeCheckpoint(checkpointTokens, tokenStarts);
+            checkpointedMerges = mergeCount;
+        }
+
+        BPE::EnterPhase(options.Monitor, BPE::TrainingPhase::Select);
+
+        while (heap.empty() == false)
+        {
+            const HeapEntry<TokenType>& top{heap.top()};
+            auto it{pairs.find(top.Pair)};
+
+            if (it != pairs.end() && it->second.Count == top.Count)
+            {
+                break;
+            }
+
+            heap.pop();
+        }
+
+        if (heap.empty() || heap.top().Count <= 1)
+        {
+            break;
+        }
+
+        if (bpeTable.size() / 2 >= BPE::MAXIMUM_TABLE_SIZE<TokenType>)
+        {
+            encodingInfo.TableFull = true;
+            break;
+        }
+
+        if (options.MaxMerges > 0 && mergeCount >= options.MaxMerges)
+        {
+            break;
+        }
+
+        std::pair<TokenType, TokenType> mostFrequentPair{heap.top().Pair};
+        int mostFrequentCount{heap.top().Count};
+        heap.pop();
+
+        BPE::EnterPhase(options.Monitor, BPE::TrainingPhase::Apply);
+
+        // Merging left to right in position order reproduces the greedy, non-overlapping merge of the legacy engine
+        positions.swap(pairs.at(mostFrequentPair).Positions);
+        std::sort(positions.begin(), positions.end());
+        positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
+
+        touchedPairs.clear();
+
+        for (uint32_t position : positions)
+        {
+            if (next[position] == REMOVED_INDEX || symbols[position] != mostFrequentPair.first)
+            {
+                continue;
+            }
+
+            uint32_t right{next[position]};
+
+            if (right == END_INDEX || symbols[right] != mostFrequentPair.second)
+            {
+                continue;
+            }
+
+            uint32_t left{previous[position]};
+            uint32_t afterRight{next[right]};
+
+            if (left != END_INDEX)
+            {
+                decrement({symbols[left], mostFrequentPair.first});
+                increment({symbols[left], nextEncodedToken}, left);
+            }
+
+            if (afterRight != END_INDEX)
+            {
+                decrement({mostFrequentPair.second, symbols[afterRight]});
+                increment({nextEncodedToken, symbols[afterRight]}, position);
+                previous[afterRight] = position;
+            }
+
+            decrement(mostFrequentPair);
+
+            symbols[position] = nextEncodedToken;
+            next[position] = afterRight;
+            next[right] = REMOVED_INDEX;
+            --encodedStringLength;
+        }
+
+        positions.clear();
+        assert(pairs.contains(mostFrequentPair) == false);
+
+        std::sort(touchedPairs.begin(), touchedPairs.end());
+        touchedPairs.erase(std::unique(touchedPairs.begin(), touchedPairs.end()), touchedPairs.end());
+
+        for (const std::pair<TokenType, TokenType>& pair : touchedPairs)
+        {
+            auto it{pairs.find(pair)};
+
+            if (it != pairs.end())
+            {
+                heap.push({it->second.Count, pair});
+            }
+        }
+
+        // Stale entries pile up over time, drop them once they clearly outnumber the live pairs
+        if (heap.size() > pairs.size() * 4 + 1024)
+        {
+            RebuildHeap(heap, pairs);
+        }
+
+        assert(bpeTable.size() == size_t(nextEncodedToken - BPE::FIRST_TOKEN<TokenType>) * 2);
+        bpeTable.push_back(mostFrequentPair.first);
+        bpeTable.push_back(mostFrequentPair.second);
+
+        if (options.Monitor != nullptr)
+        {
+            options.Monitor->OnMerge({bpeTable.size() / 2, nextEncodedToken, mostFrequentPair.first, mostFrequentPair.second, uint64_t(mostFrequentCount), encodedStringLength, pairs.size()});
+        }
+
+        ++nextEncodedToken;
+    }
+
+    BPE::EnterPhase(options.Monitor, BPE::TrainingPhase::Other);
+
+    checkpointTokens = std::basic_string<TokenType>{};
+    collectTokens(encodedString, tokenStarts);
+
+    encodingInfo.EncodedStringLength = encodedString.size();
+
+    // The last checkpoint holds the finished state, so training can be extended with more merges later
+    if (!options.CheckpointPath.empty())
+    {
+        writeCheckpoint(encodedString, tokenStarts);
+    }
+}
@@ -0,0 +1,249 @@
+#include "MappedFile.h"
+#include "BPE.h"
+#include "Container.h"
+
+#include <fcntl.h>
+#include <format>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <utility>
+
+template std::expected<BPE::MappedFile<char8_t>, std::string> BPE::TryMapFile(const std::filesystem::path& inputFilePath);
+template std::expected<BPE::MappedFile<char16_t>, std::string> BPE::TryMapFile(const std::filesystem::path& inputFilePath);
+template std::expected<BPE::MappedFile<char32_t>, std::string> BPE::TryMapFile(const std::filesystem::path& inputFilePath);
+template <typename ValueType>
+std::expected<BPE::MappedFile<ValueType>, std::string> BPE::TryMapFile(const std::filesystem::path& inputFilePath)
+{
+    std::expected<FileMapping, std::string> mapping{FileMapping::TryMap(inputFilePath)};
+
+    if (!mapping.has_value())
+    {
+        return std::unexpected{mapping.error()};
+    }
+
+    size_t fileSize{mapping.value().Bytes().size()};
+
+    if (fileSize % sizeof(ValueType) != 0)
+    {
+        return std::unexpected{std::format("ERROR: Input file size (\"{}\" with size {}) was not divisible by the templated data type with size {}", inputFilePath.c_str(), fileSize, sizeof(ValueType))};
+    }
+
+    return MappedFile<ValueType>{std::move(mapping.value())};
+}
+
+template std::expected<BPE::MappedFile<std::pair<char8_t, char8_t>>, std::string> BPE::TryMapBpeTable(const std::filesystem::path& bpeFilePath);
+template std::expected<BPE::MappedFile<std::pair<char16_t, char16_t>>, std::string> BPE::TryMapBpeTable(const std::filesystem::path& bpeFilePath);
+template std::expected<BPE::MappedFile<std::pair<char32_t, char32_t>>, std::string> BPE::TryMapBpeTable(const std::filesystem::path& bpeFilePath);
+template <typename TokenType>
+std::expected<BPE::MappedFile<std::pair<TokenType, TokenType>>, std::string> BPE::TryMapBpeTable(const std::filesystem::path& bpeFilePath)
+{
+    std::expected<FileMapping, std::string> mapping{FileMapping::TryMap(bpeFilePath)};
+
+    if (!mapping.has_value())
+    {
+        return std::unexpected{mapping.error()};
+    }
+
+    std::span<const std::byte> bytes{mapping.value().Bytes()};
+    size_t headerSize{0};
+    size_t tableSize{bytes.size()};
+    BPE::TokenWidth width{BPE::TokenWidth::Bits16};
+
+    if (BPE::IsContainerFile(bytes))
+    {
+        std::expected<BPE::ContainerHeader, std::string> header{BPE::TryReadContainerHeader(bytes)};
+        if (!header.has_value())
+        {
+            return std::unexpected{header.error()};
+        }
+
+        std::expected<std::span<const std::byte>, std::string> section{BPE::TryGetContainerSection(bytes, BPE::SectionType::MergeTable)};
+        if (!section.has_value())
+        {
+            return std::unexpected{section.error()};
+        }
+
+        headerSize = size_t(section.value().data() - bytes.data());
+        tableSize = headerSize + section.value().size();
+        width = header.value().Width;
+    }
+    else if (bytes.size() >= sizeof(BPE::BpeTableHeader) && std::memcmp(bytes.data(), BPE::BPE_TABLE_MAGIC, sizeof(BPE::BPE_TABLE_MAGIC)) == 0)
+    {
+        BPE::BpeTableHeader header{};
+        std::memcpy(&header, bytes.data(), sizeof(header));
+
+        headerSize = sizeof(header);
+        width = header.Width;
+    }
+
+    if (width != BPE::TOKEN_WIDTH<TokenType>)
+    {
+        return std::unexpected{std::format("ERROR: BPE table \"{}\" holds {}-bit tokens, not {}-bit tokens", bpeFilePath.c_str(), uint8_t(width) * 8, sizeof(TokenType) * 8)};
+    }
+
+    if ((tableSize - headerSize) % sizeof(std::pair<TokenType, TokenType>) != 0)
+    {
+        return std::unexpected{std::format("ERROR: Input file size (\"{}\" with size {}) was not divisible by the templated data type with size {}", bpeFilePath.c_str(), tableSize - headerSize, sizeof(std::pair<TokenType, TokenType>))};
+    }
+
+    return MappedFile<std::pair<TokenType, TokenType>>{std::move(mapping.value()), headerSize, tableSize - headerSize};
+}
+
+std::expected<BPE::FileMapping, std::string> BPE::FileMapping::TryMap(const std::filesystem::path& inputFilePath)
+{
+    int fileDescriptor{open(inputFilePath.c_str(), O_RDONLY)};
+
+    if (fileDescriptor < 0)
+    {
+        return std::unexpected{std::format("ERROR: Unable to open file at path \"{}\"", inputFilePath.c_str())};
+    }
+
+    struct stat fileStatus{};
+
+    if (fstat(fileDescriptor, &fileStatus) != 0)
+    {
+        close(fileDescriptor);
+        return std::unexpected{std::format("ERROR: Unable to read the size of file at path \"{}\"", inputFilePath.c_str())};
+    }
+
+    size_t fileSize{size_t(fileStatus.st_size)};
+
+    // Mapping zero bytes is an error, an empty file is simply an empty view
+    if (fileSize == 0)
+    {
+        close(fileDescriptor);
+        return FileMapping{nullptr, 0};
+    }
+
+    void* data{mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fileDescriptor, 0)};
+    close(fileDescriptor);
+
+    if (data == MAP_FAILED)
+    {
+        return std::unexpected{std::format("ERROR: Unable to map file at path \"{}\" into memory", inputFilePath.c_str())};
+    }
+
+    return FileMapping{data, fileSize};
+}
+
+BPE::FileMapping::FileMapping(void* data, size_t size)
+    : m_Data{data}, m_Size{size}
+{
+}
+
+BPE::FileMapping::FileMapping(FileMapping&& other) noexcept
+    : m_Data{std::exchange(other.m_Data, nullptr)}, m_Size{std::exchange(other.m_Size, 0)}
+{
+}
+
+BPE::FileMapping& BPE::FileMapping::operator=(FileMapping&& other) noexcept
+{
+    if (this != &other)
+    {
+        if (m_Data != nullptr)
+        {
+            munmap(m_Data, m_Size);
+        }
+
+        m_Data = std::exchange(other.m_Data, nullptr);
+        m_Size = std::exchange(other.m_Size, 0);
+    }
+
+    return *this;
+}
+
+BPE::FileMapping::~FileMapping()
+{
+    if (m_Data != nullptr)
+    {
+        munmap(m_Data, m_Size);
+    }
+}
+
+std::span<const std::byte> BPE::FileMapping::Bytes() const
+{
+    return {static_cast<const std::byte*>(m_Data), m_Size};
+}
+
+std::expected<BPE::WritableFileMapping, std::string> BPE::WritableFileMapping::TryCreate(const std::filesystem::path& outputFilePath, size_t size)
+{
+    int fileDescriptor{open(outputFilePath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644)};
+
+    if (fileDescriptor < 0)
+    {
+        return std::unexpected{std::format("ERROR: Unable to open or create output file at path \"{}\"", outputFilePath.c_str())};
+    }
+
+    if (size == 0)
+    {
+        close(fileDescriptor);
+        return WritableFileMapping{nullptr, 0};
+    }
+
+    // Reserving the blocks up front turns a full disk into an error here instead of a SIGBUS while writing the mapping
+    int allocateResult{posix_fallocate(fileDescriptor, 0, off_t(size))};
+
+    if (allocateResult != 0 && (allocateResult != EOPNOTSUPP && allocateResult != EINVAL))
+    {
+        close(fileDescriptor);
+        return std::unexpected{std::format("ERROR: Unable to reserve {} bytes for output file at path \"{}\"", size, outputFilePath.c_str())};
+    }
+
+    if (allocateResult != 0 && ftruncate(fileDescriptor, off_t(size)) != 0)
+    {
+        close(fileDescriptor);
+        return std::unexpected{std::format("ERROR: Unable to resize output file at path \"{}\"", outputFilePath.c_str())};
+    }
+
+    void* data{mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0)};
+    close(fileDescriptor);
+
+    if (data == MAP_FAILED)
+    {
+        return std::unexpected{std::format("ERROR: Unable to map output file at path \"{}\" into memory", outputFilePath.c_str())};
+    }
+
+    return WritableFileMapping{data, size};
+}
+
+BPE::WritableFileMapping::WritableFileMapping(void* data, size_t size)
+    : m_Data{data}, m_Size{size}
+{
+}
+
+BPE::WritableFileMapping::WritableFileMapping(WritableFileMapping&& other) noexcept
+    : m_Data{std::exchange(other.m_Data, nullptr)}, m_Size{std::exchange(other.m_Size, 0)}
+{
+}
+
+BPE::WritableFileMapping& BPE::WritableFileMapping::operator=(WritableFileMapping&& other) noexcept
+{
+    if (this != &other)
+    {
+        if (m_Data != nullptr)
+        {
+            munmap(m_Data, m_Size);
+        }
+
+        m_Data = std::exchange(other.m_Data, nullptr);
+        m_Size = std::exchange(other.m_Size, 0);
+    }
+
+    return *this;
+}
+
+BPE::WritableFileMapping::~WritableFileMapping()
+{
+    if (m_Data != nullptr)
+    {
+        munmap(m_Data, m_Size);
+    }
+}
+
+std::span<std::byte> BPE::WritableFileMapping::Bytes() const
+{
+    return {static_cast<std::byte*>(m_Data), m_Size};
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <utility>
+
+namespace BPE
+{
+    // Read-only memory mapping of a whole file, unmapped again when destroyed
+    class FileMapping
+    {
+    public:
+        static std::expected<FileMapping, std::string> TryMap(const std::filesystem::path& inputFilePath);
+
+        FileMapping(FileMapping&& other) noexcept;
+        FileMapping& operator=(FileMapping&& other) noexcept;
+        ~FileMapping();
+
+        FileMapping(const FileMapping&) = delete;
+        FileMapping& operator=(const FileMapping&) = delete;
+
+        std::span<const std::byte> Bytes() const;
+
+    private:
+        FileMapping(void* data, size_t size);
+
+        void* m_Data;
+        size_t m_Size;
+    };
+
+    // Shared, writable mapping of a newly created (or truncated) file of a fixed size
+    class WritableFileMapping
+    {
+    public:
+        static std::expected<WritableFileMapping, std::string> TryCreate(const std::filesystem::path& outputFilePath, size_t size);
+
+        WritableFileMapping(WritableFileMapping&& other) noexcept;
+        WritableFileMapping& operator=(WritableFileMapping&& other) noexcept;
+        ~WritableFileMapping();
+
+        WritableFileMapping(const WritableFileMapping&) = delete;
+        WritableFileMapping& operator=(const WritableFileMapping&) = delete;
+
+        std::span<std::byte> Bytes() const;
+
+    private:
+        WritableFileMapping(void* data, size_t size);
+
+        void* m_Data;
+        size_t m_Size;
+    };
+
+    // A file mapped into memory and viewed as an array of ValueType (the `size` bytes at `offset`), without copying it
+    template <typename ValueType>
+    class MappedFile
+    {
+    public:
+        explicit MappedFile(FileMapping mapping, size_t offset = 0, size_t size = SIZE_MAX)
+            : m_Mapping{std::move(mapping)}, m_Offset{offset}, m_Size{size}
+        {
+        }
+
+        std::span<const ValueType> Span() const
+        {
+            std::span<const std::byte> bytes{m_Mapping.Bytes().subspan(m_Offset)};
+            bytes = bytes.first(std::min(bytes.size(), m_Size));
+            return {reinterpret_cast<const ValueType*>(bytes.data()), bytes.size() / sizeof(ValueType)};
+        }
+
+    private:
+        FileMapping m_Mapping;
+        size_t m_Offset;
+        size_t m_Size;
+    };
+
+    template <typename ValueType>
+    std::expected<MappedFile<ValueType>, std::string> TryMapFile(const std::filesystem::path& inputFilePath);
+
+    // Maps the merges of a BPE table file or container, which fails if the file holds tokens of another width
+    template <typename TokenType>
+    std::expected<MappedFile<std::pair<TokenType, TokenType>>, std::string> TryMapBpeTable(const std::filesystem::path& bpeFilePath);
+} //namespace BPE
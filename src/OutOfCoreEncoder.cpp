@@ -0,0 +1,453 @@
+#include "BPE.h"
+#include "PairCountTable.h"
+#include "TrainingMonitor.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <optional>
+#include <random>
+#include <vector>
+
+namespace
+{
+    // Rough peak memory of the incremental engine per token: symbol, list links, position lists and the final copy
+    const uint64_t INCREMENTAL_BYTES_PER_TOKEN{32};
+    const size_t MINIMUM_WINDOW_SIZE{1 << 12};
+
+    template <typename TokenType>
+    using PairCounts = BPE::PairCountTable<TokenType, uint64_t>;
+
+    // Temporary file holding an intermediate token sequence, removed again when it goes out of scope
+    class SpillFile
+    {
+    public:
+        explicit SpillFile(const std::filesystem::path& directory)
+        {
+            std::random_device randomDevice{};
+            m_Path = directory / std::format("bpe-spill-{:08x}{:08x}.tmp", randomDevice(), randomDevice());
+        }
+
+        ~SpillFile()
+        {
+            std::error_code error{};
+            std::filesystem::remove(m_Path, error);
+        }
+
+        SpillFile(const SpillFile&) = delete;
+        SpillFile& operator=(const SpillFile&) = delete;
+
+        const std::filesystem::path& Path() const
+        {
+            return m_Path;
+        }
+
+    private:
+        std::filesystem::path m_Path;
+    };
+
+    // Calls `callback` for every value in the file while holding at most `windowSize` values in memory
+    template <typename ValueType, typename Callback>
+    std::expected<void, std::string> TryStreamFile(const std::filesystem::path& inputFilePath, size_t windowSize, Callback&& callback)
+    {
+        std::ifstream file{inputFilePath, std::ios::binary};
+
+        if (file.is_open() == false)
+        {
+            return std::unexpected{std::format("ERROR: Unable to open file at path \"{}\"", inputFilePath.c_str())};
+        }
+
+        std::vector<ValueType> window(windowSize);
+
+        while (file)
+        {
+            file.read(reinterpret_cast<char*>(window.data()), windowSize * sizeof(ValueType));
+            size_t valueCount{size_t(file.gcount()) / sizeof(ValueType)};
+
+            for (size_t i{0}; i < valueCount; ++i)
+            {
+                callback(window[i]);
+            }
+        }
+
+        if (file.bad())
+        {
+            return std::unexpected{std::format("ERROR: Unable to read file at path \"{}\"", inputFilePath.c_str())};
+        }
+
+        return {};
+    }
+
+    // Buffers tokens into a file window by window and (optionally) counts the pairs of everything it writes
+    template <typename TokenType>
+    class TokenWriter
+    {
+    public:
+        TokenWriter(const std::filesystem::path& outputFilePath, size_t windowSize, PairCounts<TokenType>* pairCounts)
+            : m_File{outputFilePath, std::ios::binary}, m_WindowSize{windowSize}, m_PairCounts{pairCounts}, m_LastToken{}, m_TokenCount{0}
+        {
+            m_Window.reserve(windowSize);
+        }
+
+        bool IsOpen() const
+        {
+            return m_File.is_open();
+        }
+
+        void Push(TokenType token)
+        {
+            if (m_PairCounts != nullptr && m_TokenCount > 0)
+            {
+                m_PairCounts->Add(m_LastToken, token);
+            }
+
+            m_LastToken = token;
+            ++m_TokenCount;
+
+            m_Window.push_back(token);
+
+            if (m_Window.size() == m_WindowSize)
+            {
+                Flush();
+            }
+        }
+
+        bool Close()
+        {
+            Flush();
+            m_File.close();
+
+            return m_File.good();
+        }
+
+        uint64_t TokenCount() const
+        {
+            return m_TokenCount;
+        }
+
+    private:
+        void Flush()
+        {
+            m_File.write(reinterpret_cast<const char*>(m_Window.data()), m_Window.size() * sizeof(TokenType));
+            m_Window.clear();
+        }
+
+        std::ofstream m_File;
+        std::vector<TokenType> m_Window;
+        size_t m_WindowSize;
+        PairCounts<TokenType>* m_PairCounts;
+        TokenType m_LastToken;
+        uint64_t m_TokenCount;
+    };
+
+    // Same greedy left-to-right merge as the in-memory engines, one token at a time so it can run over a stream
+    template <typename TokenType>
+    class StreamingMerge
+    {
+    public:
+        StreamingMerge(std::pair<TokenType, TokenType> pair, TokenType mergedToken, TokenWriter<TokenType>& writer)
+            : m_Pair{pair}, m_MergedToken{mergedToken}, m_Writer{writer}, m_HasPendingToken{false}, m_PendingToken{}
+        {
+        }
+
+        void Push(TokenType token)
+        {
+            if (m_HasPendingToken == false)
+            {
+                m_PendingToken = token;
+                m_HasPendingToken = true;
+                return;
+            }
+
+            if (m_PendingToken == m_Pair.first && token == m_Pair.second)
+            {
+                m_Writer.Push(m_MergedToken);
+                m_HasPendingToken = false;
+                return;
+            }
+
+            m_Writer.Push(m_PendingToken);
+            m_PendingToken = token;
+        }
+
+        void Finish()
+        {
+            if (m_HasPendingToken)
+            {
+                m_Writer.Push(m_PendingToken);
+                m_HasPendingToken = false;
+            }
+        }
+
+    private:
+        std::pair<TokenType, TokenType> m_Pair;
+        TokenType m_MergedToken;
+        TokenWriter<TokenType>& m_Writer;
+        bool m_HasPendingToken;
+        TokenType m_PendingToken;
+    };
+
+    template <typename TokenType>
+    std::pair<std::pair<TokenType, TokenType>, uint64_t> FindMostFrequentPair(const PairCounts<TokenType>& pairCounts)
+    {
+        std::pair<TokenType, TokenType> mostFrequentPair{};
+        uint64_t mostFrequentCount{0};
+
+        pairCounts.ForEach([&](const std::pair<TokenType, TokenType>& pair, uint64_t count)
+        {
+            // Same tie-break as the in-memory engines, so all of them train the same table
+            if (count > mostFrequentCount || (count == mostFrequentCount && pair < mostFrequentPair))
+            {
+                mostFrequentPair = pair;
+                mostFrequentCount = count;
+            }
+        });
+
+        return {mostFrequentPair, mostFrequentCount};
+    }
+} //namespace
+
+template std::expected<std::tuple<std::basic_string<char8_t>, BPE::BpeEncodingResultInfo>, std::string> BPE::TryEncodeFileOutOfCore<char8_t>(const std::filesystem::path& inputFilePath, const std::filesystem::path& tokenOutputFilePath, const BPE::BpeEncodingOptions& options);
+template std::expected<std::tuple<std::basic_string<char16_t>, BPE::BpeEncodingResultInfo>, std::string> BPE::TryEncodeFileOutOfCore<char16_t>(const std::filesystem::path& inputFilePath, const std::filesystem::path& tokenOutputFilePath, const BPE::BpeEncodingOptions& options);
+template std::expected<std::tuple<std::basic_string<char32_t>, BPE::BpeEncodingResultInfo>, std::string> BPE::TryEncodeFileOutOfCore<char32_t>(const std::filesystem::path& inputFilePath, const std::filesystem::path& tokenOutputFilePath, const BPE::BpeEncodingOptions& options);
+/*
+ * Trains on a file without ever holding it in memory. While the token sequence is larger than the memory limit allows,
+ * every merge streams the current sequence (first the input file itself, later a spill file) through a fixed-size window
+ * into the next spill file, counting the pairs of the output on the way for the next merge. As soon as the shrinking
+ * sequence fits into the limit it is loaded and the incremental engine finishes the job, so the table is the same as
+ * the one in-memory training produces. Only the pair counts are not bounded by the window size.
+ */
+template <typename TokenType>
+std::expected<std::tuple<std::basic_string<TokenType>, BPE::BpeEncodingResultInfo>, std::string> BPE::TryEncodeFileOutOfCore(const std::filesystem::path& inputFilePath, const std::filesystem::path& tokenOutputFilePath, const BPE::BpeEncodingOptions& options)
+{
+    std::error_code error{};
+    uint64_t fileSize{std::filesystem::file_size(inputFilePath, error)};
+
+    if (error)
+    {
+        return std::unexpected{std::format("ERROR: Unable to open file at path \"{}\"", inputFilePath.c_str())};
+    }
+
+    std::filesystem::path spillDirectory{options.SpillDirectory.empty() ? std::filesystem::temp_directory_path() : options.SpillDirectory};
+    size_t windowSize{std::max<size_t>(options.MemoryLimit / 4 / sizeof(TokenType), MINIMUM_WINDOW_SIZE)};
+
+    SpillFile spillFiles[2]{SpillFile{spillDirectory}, SpillFile{spillDirectory}};
+    int currentSpillFile{-1};
+
+    std::basic_string<TokenType> bpeTable{};
+    TokenType nextEncodedToken{BPE::FIRST_TOKEN<TokenType>};
+
+    BPE::BpeEncodingResultInfo encodingInfo{};
+    encodingInfo.EncodedStringInitialLength = fileSize;
+
+    uint64_t encodedStringLength{fileSize};
+    bool finishedTraining{false};
+
+    // The incremental engine also needs the sequence to be addressable with 32-bit indices
+    auto fitsInMemory = [&](uint64_t length)
+    {
+        return length * INCREMENTAL_BYTES_PER_TOKEN <= options.MemoryLimit && length < UINT32_MAX - 1;
+    };
+
+    if constexpr (BPE::FIRST_TOKEN<TokenType> <= UCHAR_MAX)
+    {
+        // Narrow tokens do not cover every byte, which is checked up front so the passes below never have to
+        uint64_t offset{0};
+        std::optional<uint64_t> invalidOffset{};
+        char invalidByte{};
+
+        std::expected<void, std::string> checkResult{TryStreamFile<char>(inputFilePath, windowSize, [&](char i)
+        {
+            if (size_t(i) >= BPE::FIRST_TOKEN<TokenType> && invalidOffset.has_value() == false)
+            {
+                invalidOffset = offset;
+                invalidByte = i;
+            }
+
+            ++offset;
+        })};
+
+        if (!checkResult.has_value())
+        {
+            return std::unexpected{checkResult.error()};
+        }
+
+        if (invalidOffset.has_value())
+        {
+            return std::unexpected{std::format("ERROR: Byte 0x{:02X} at offset {} does not fit in {}-bit tokens, use wider tokens for this input", size_t(invalidByte), invalidOffset.value(), sizeof(TokenType) * 8)};
+        }
+    }
+
+    PairCounts<TokenType> pairCounts{};
+
+    BPE::EnterPhase(options.Monitor, BPE::TrainingPhase::Count);
+
+    if (fitsInMemory(encodedStringLength) == false)
+    {
+        bool hasLastToken{false};
+        TokenType lastToken{};
+
+        std::expected<void, std::string> countResult{TryStreamFile<char>(inputFilePath, windowSize, [&](char i)
+        {
+            if (hasLastToken)
+            {
+                pairCounts.Add(lastToken, TokenType(i));
+            }
+
+            lastToken = TokenType(i);
+            hasLastToken = true;
+        })};
+
+        if (!countResult.has_value())
+        {
+            return std::unexpected{countResult.error()};
+        }
+    }
+
+    for (; fitsInMemory(encodedStringLength) == false; encodingInfo.EncodingIterationCount++)
+    {
+        BPE::EnterPhase(options.Monitor, BPE::TrainingPhase::Select);
+
+        auto [mostFrequentPair, mostFrequentCount]{FindMostFrequentPair(pairCounts)};
+
+        if (mostFrequentCount <= 1)
+        {
+            finishedTraining = true;
+            break;
+        }
+
+        if (bpeTable.size() / 2 >= BPE::MAXIMUM_TABLE_SIZE<TokenType>)
+        {
+            encodingInfo.TableFull = true;
+            finishedTraining = true;
+            break;
+        }
+
+        if (options.MaxMerges > 0 && bpeTable.size() / 2 >= options.MaxMerges)
+        {
+            finishedTraining = true;
+            break;
+        }
+
+        BPE::EnterPhase(options.Monitor, BPE::TrainingPhase::Apply);
+
+        int nextSpillFile{currentSpillFile == 0 ? 1 : 0};
+
+        pairCounts.Clear();
+        TokenWriter<TokenType> writer{spillFiles[nextSpillFile].Path(), windowSize, &pairCounts};
+
+        if (writer.IsOpen() == false)
+        {
+            return std::unexpected{std::format("ERROR: Unable to open or create spill file at path \"{}\"", spillFiles[nextSpillFile].Path().c_str())};
+        }
+
+        StreamingMerge<TokenType> merge{mostFrequentPair, nextEncodedToken, writer};
+
+        std::expected<void, std::string> mergeResult{currentSpillFile < 0
+            ? TryStreamFile<char>(inputFilePath, windowSize, [&](char i) { merge.Push(TokenType(i)); })
+            : TryStreamFile<TokenType>(spillFiles[currentSpillFile].Path(), windowSize, [&](TokenType token) { merge.Push(token); })};
+
+        if (!mergeResult.has_value())
+        {
+            return std::unexpected{mergeResult.error()};
+        }
+
+        merge.Finish();
+
+        if (writer.Close() == false)
+        {
+            return std::unexpected{std::format("ERROR: Unable to write spill file at path \"{}\"", spillFiles[nextSpillFile].Path().c_str())};
+        }
+
+        currentSpillFile = nextSpillFile;
+        encodedStringLength = writer.TokenCount();
+
+        bpeTable.push_back(mostFrequentPair.first);
+        bpeTable.push_back(mostFrequentPair.second);
+
+        if (options.Monitor != nullptr)
+        {
+            options.Monitor->OnMerge({bpeTable.size() / 2, nextEncodedToken, mostFrequentPair.first, mostFrequentPair.second, mostFrequentCount, encodedStringLength, pairCounts.SparseSize()});
+        }
+
+        ++nextEncodedToken;
+    }
+
+    BPE::EnterPhase(options.Monitor, BPE::TrainingPhase::Other);
+    pairCounts = PairCounts<TokenType>{};
+
+    if (finishedTraining && tokenOutputFilePath.empty())
+    {
+        encodingInfo.EncodedStringLength = encodedStringLength;
+        return std::tuple{bpeTable, encodingInfo};
+    }
+
+    if (finishedTraining && currentSpillFile >= 0)
+    {
+        if (std::filesystem::copy_file(spillFiles[currentSpillFile].Path(), tokenOutputFilePath, std::filesystem::copy_options::overwrite_existing, error) == false)
+        {
+            return std::unexpected{std::format("ERROR: Unable to open or create output file at path \"{}\"", tokenOutputFilePath.c_str())};
+        }
+
+        encodingInfo.EncodedStringLength = encodedStringLength;
+        return std::tuple{bpeTable, encodingInfo};
+    }
+
+    if (finishedTraining)
+    {
+        // Nothing was merged, so the tokens are just the widened input
+        TokenWriter<TokenType> writer{tokenOutputFilePath, windowSize, nullptr};
+
+        if (writer.IsOpen() == false)
+        {
+            return std::unexpected{std::format("ERROR: Unable to open or create output file at path \"{}\"", tokenOutputFilePath.c_str())};
+        }
+
+        std::expected<void, std::string> copyResult{TryStreamFile<char>(inputFilePath, windowSize, [&](char i) { writer.Push(TokenType(i)); })};
+
+        if (!copyResult.has_value())
+        {
+            return std::unexpected{copyResult.error()};
+        }
+
+        if (writer.Close() == false)
+        {
+            return std::unexpected{std::format("ERROR: Unable to write output file at path \"{}\"", tokenOutputFilePath.c_str())};
+        }
+
+        encodingInfo.EncodedStringLength = encodedStringLength;
+        return std::tuple{bpeTable, encodingInfo};
+    }
+
+    // The sequence fits into memory now
+    std::basic_string<TokenType> encodedString{};
+    encodedString.reserve(encodedStringLength);
+
+    std::expected<void, std::string> loadResult{currentSpillFile < 0
+        ? TryStreamFile<char>(inputFilePath, windowSize, [&](char i) { encodedString.push_back(TokenType(i)); })
+        : TryStreamFile<TokenType>(spillFiles[currentSpillFile].Path(), windowSize, [&](TokenType token) { encodedString.push_back(token); })};
+
+    if (!loadResult.has_value())
+    {
+        return std::unexpected{loadResult.error()};
+    }
+
+    ContinueEncodingIncremental<TokenType>(encodedString, bpeTable, encodingInfo, options);
+
+    encodingInfo.EncodedStringLength = encodedString.size();
+
+    if (!tokenOutputFilePath.empty())
+    {
+        std::expected<void, std::string> writeTokensResult{TryWriteBasicStringToFile(encodedString, tokenOutputFilePath)};
+
+        if (!writeTokensResult.has_value())
+        {
+            return std::unexpected{writeTokensResult.error()};
+        }
+    }
+
+    return std::tuple{bpeTable, encodingInfo};
+}
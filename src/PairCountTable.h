@@ -0,0 +1,256 @@
+#pragma once
+
+#include "BPE.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace BPE
+{
+    /*
+     * Counts token pairs without a node allocation per pair. While both tokens are raw bytes (which is most of the
+     * pairs early in training) the count lives in a dense FIRST_TOKEN x FIRST_TOKEN array. All other pairs are packed
+     * into one integer key (32 bits up to 16-bit tokens) and stored in open-addressing tables with linear probing.
+     *
+     * The sparse pairs are split over a fixed number of partitions by their hash, and every partition also owns a slice
+     * of the dense array. Tables counted on different threads can then be reduced one partition per thread.
+     */
+    template <typename TokenType, typename CountType>
+    class PairCountTable
+    {
+        typedef std::conditional_t<sizeof(TokenType) <= 2, uint32_t, uint64_t> KeyType;
+
+    public:
+        explicit PairCountTable(size_t partitionCount = 1)
+            : m_Dense(DENSE_SIZE, 0), m_Partitions(partitionCount)
+        {
+        }
+
+        size_t PartitionCount() const
+        {
+            return m_Partitions.size();
+        }
+
+        void Add(TokenType first, TokenType second, CountType count = 1)
+        {
+            if (first < FIRST_TOKEN<TokenType> && second < FIRST_TOKEN<TokenType>)
+            {
+                m_Dense[first * FIRST_TOKEN<TokenType> + second] += count;
+                return;
+            }
+
+            KeyType key{PackPair(first, second)};
+            uint64_t hash{MixHash(key)};
+            m_Partitions[PartitionOf(hash)].Add(key, hash, count);
+        }
+
+        // Pairs held in the sparse tables, pairs of two raw bytes live in the dense array and are not included
+        size_t SparseSize() const
+        {
+            size_t size{0};
+
+            for (const Partition& partition : m_Partitions)
+            {
+                size += partition.Size;
+            }
+
+            return size;
+        }
+
+        CountType Get(TokenType first, TokenType second) const
+        {
+            if (first < FIRST_TOKEN<TokenType> && second < FIRST_TOKEN<TokenType>)
+            {
+                return m_Dense[first * FIRST_TOKEN<TokenType> + second];
+            }
+
+            KeyType key{PackPair(first, second)};
+            uint64_t hash{MixHash(key)};
+            return m_Partitions[PartitionOf(hash)].Get(key, hash);
+        }
+
+        // Resets every count but keeps the allocated capacity for the next pass
+        void Clear()
+        {
+            std::fill(m_Dense.begin(), m_Dense.end(), CountType{0});
+
+            for (Partition& partition : m_Partitions)
+            {
+                partition.Clear();
+            }
+        }
+
+        // Adds the counts of one partition of another table (with the same partition count) to this table
+        void AddPartition(const PairCountTable& other, size_t partition)
+        {
+            auto [begin, end]{DenseRange(partition)};
+
+            for (size_t i{begin}; i < end; ++i)
+            {
+                m_Dense[i] += other.m_Dense[i];
+            }
+
+            for (const Slot& slot : other.m_Partitions[partition].Slots)
+            {
+                if (slot.Key != EMPTY_KEY)
+                {
+                    m_Partitions[partition].Add(slot.Key, MixHash(slot.Key), slot.Count);
+                }
+            }
+        }
+
+        // Calls function(pair, count) for every pair of the partition with a non-zero count
+        template <typename Function>
+        void ForEachInPartition(size_t partition, Function&& function) const
+        {
+            auto [begin, end]{DenseRange(partition)};
+
+            for (size_t i{begin}; i < end; ++i)
+            {
+                if (m_Dense[i] != 0)
+                {
+                    function(std::pair<TokenType, TokenType>{TokenType(i / FIRST_TOKEN<TokenType>), TokenType(i % FIRST_TOKEN<TokenType>)}, m_Dense[i]);
+                }
+            }
+
+            for (const Slot& slot : m_Partitions[partition].Slots)
+            {
+                if (slot.Key != EMPTY_KEY && slot.Count != 0)
+                {
+                    function(UnpackPair(slot.Key), slot.Count);
+                }
+            }
+        }
+
+        template <typename Function>
+        void ForEach(Function&& function) const
+        {
+            for (size_t partition{0}; partition < m_Partitions.size(); ++partition)
+            {
+                ForEachInPartition(partition, function);
+            }
+        }
+
+    private:
+        static constexpr size_t DENSE_SIZE{size_t(FIRST_TOKEN<TokenType>) * FIRST_TOKEN<TokenType>};
+        // Both tokens of the pair (0, 0) are raw bytes, so that key never reaches the sparse tables
+        static constexpr KeyType EMPTY_KEY{0};
+        static constexpr size_t MINIMUM_CAPACITY{64};
+
+        struct Slot
+        {
+            KeyType Key;
+            CountType Count;
+        };
+
+        struct Partition
+        {
+            std::vector<Slot> Slots;
+            size_t Size{0};
+
+            void Add(KeyType key, uint64_t hash, CountType count)
+            {
+                // Keeping the load at or below one half keeps the probe sequences short
+                if ((Size + 1) * 2 > Slots.size())
+                {
+                    Grow();
+                }
+
+                size_t mask{Slots.size() - 1};
+
+                for (size_t i{hash & mask};; i = (i + 1) & mask)
+                {
+                    if (Slots[i].Key == key)
+                    {
+                        Slots[i].Count += count;
+                        return;
+                    }
+
+                    if (Slots[i].Key == EMPTY_KEY)
+                    {
+                        Slots[i] = {key, count};
+                        ++Size;
+                        return;
+                    }
+                }
+            }
+
+            CountType Get(KeyType key, uint64_t hash) const
+            {
+                if (Slots.empty())
+                {
+                    return 0;
+                }
+
+                size_t mask{Slots.size() - 1};
+
+                for (size_t i{hash & mask};; i = (i + 1) & mask)
+                {
+                    if (Slots[i].Key == key)
+                    {
+                        return Slots[i].Count;
+                    }
+
+                    if (Slots[i].Key == EMPTY_KEY)
+                    {
+                        return 0;
+                    }
+                }
+            }
+
+            void Clear()
+            {
+                if (Size > 0)
+                {
+                    std::fill(Slots.begin(), Slots.end(), Slot{EMPTY_KEY, 0});
+                    Size = 0;
+                }
+            }
+
+            void Grow()
+            {
+                std::vector<Slot> oldSlots(std::max(MINIMUM_CAPACITY, Slots.size() * 2), Slot{EMPTY_KEY, 0});
+                oldSlots.swap(Slots);
+                Size = 0;
+
+                for (const Slot& slot : oldSlots)
+                {
+                    if (slot.Key != EMPTY_KEY)
+                    {
+                        Add(slot.Key, MixHash(slot.Key), slot.Count);
+                    }
+                }
+            }
+        };
+
+        static constexpr size_t TOKEN_BITS{8 * sizeof(TokenType)};
+
+        static KeyType PackPair(TokenType first, TokenType second)
+        {
+            return (KeyType(first) << TOKEN_BITS) | second;
+        }
+
+        static std::pair<TokenType, TokenType> UnpackPair(KeyType key)
+        {
+            return {TokenType(key >> TOKEN_BITS), TokenType(key)};
+        }
+
+        // The slot index uses the low bits of the hash, the partition is picked with the high bits
+        size_t PartitionOf(uint64_t hash) const
+        {
+            return size_t(((hash >> 32) * m_Partitions.size()) >> 32);
+        }
+
+        std::pair<size_t, size_t> DenseRange(size_t partition) const
+        {
+            return {DENSE_SIZE * partition / m_Partitions.size(), DENSE_SIZE * (partition + 1) / m_Partitions.size()};
+        }
+
+        std::vector<CountType> m_Dense;
+        std::vector<Partition> m_Partitions;
+    };
+} //namespace BPE
@@ -0,0 +1,158 @@
+#include "ParallelApply.h"
+#include "Core.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <format>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // Chunks per thread, so finished chunks reach the writer early and one slow chunk does not leave the others idle
+    const unsigned CHUNKS_PER_THREAD{4};
+} //namespace
+
+template std::expected<BPE::BpeEncodingResultInfo, std::string> BPE::TryApplyBpeTableParallel<char8_t>(std::span<const std::pair<char8_t, char8_t>> bpeTable, std::string_view input, bool splitAtWords, const BPE::ChunkEncoder<char8_t>& encodeChunk, const BPE::ChunkWriter<char8_t>& write, unsigned threadCount);
+template std::expected<BPE::BpeEncodingResultInfo, std::string> BPE::TryApplyBpeTableParallel<char16_t>(std::span<const std::pair<char16_t, char16_t>> bpeTable, std::string_view input, bool splitAtWords, const BPE::ChunkEncoder<char16_t>& encodeChunk, const BPE::ChunkWriter<char16_t>& write, unsigned threadCount);
+template std::expected<BPE::BpeEncodingResultInfo, std::string> BPE::TryApplyBpeTableParallel<char32_t>(std::span<const std::pair<char32_t, char32_t>> bpeTable, std::string_view input, bool splitAtWords, const BPE::ChunkEncoder<char32_t>& encodeChunk, const BPE::ChunkWriter<char32_t>& write, unsigned threadCount);
+template <typename TokenType>
+std::expected<BPE::BpeEncodingResultInfo, std::string> BPE::TryApplyBpeTableParallel(std::span<const std::pair<TokenType, TokenType>> bpeTable, std::string_view input, bool splitAtWords, const BPE::ChunkEncoder<TokenType>& encodeChunk, const BPE::ChunkWriter<TokenType>& write, unsigned threadCount)
+{
+    std::expected<std::vector<bool>, std::string> pairsInsideTokens{BPE::TryFindPairsInsideTokens<TokenType>(bpeTable)};
+    if (!pairsInsideTokens.has_value())
+    {
+        return std::unexpected{pairsInsideTokens.error()};
+    }
+
+    // Every chunk but the first starts at the first split at or after its share of the input, if its share has one
+    size_t shareCount{BPE::ChunkCount(input.size(), threadCount * CHUNKS_PER_THREAD, BPE::MINIMUM_APPLY_CHUNK_SIZE)};
+    std::vector<size_t> chunkStarts{0};
+
+    for (size_t share{1}; share < shareCount; ++share)
+    {
+        auto [begin, end]{BPE::SplitRange(input.size(), shareCount, share)};
+        size_t split{begin};
+
+        if (splitAtWords)
+        {
+            split = BPE::WordEnd(input, begin - 1);
+        }
+        else
+        {
+            while (split < end && pairsInsideTokens.value()[uint8_t(input[split - 1]) * 256 + uint8_t(input[split])])
+            {
+                ++split;
+            }
+        }
+
+        if (split < end)
+        {
+            chunkStarts.push_back(split);
+        }
+    }
+
+    chunkStarts.push_back(input.size());
+
+    size_t chunkCount{chunkStarts.size() - 1};
+    std::vector<std::vector<TokenType>> chunkTokens(chunkCount);
+    std::vector<std::expected<size_t, std::string>> chunkResults(chunkCount, 0);
+    std::vector<bool> chunkFinished(chunkCount, false);
+    std::mutex mutex{};
+    std::condition_variable finished{};
+    std::atomic<bool> failed{false};
+
+    BPE::BpeEncodingResultInfo encodingInfo{};
+    encodingInfo.EncodedStringInitialLength = input.size();
+    std::expected<void, std::string> result{};
+
+    // Writes the chunks in order as they finish, and frees them once written
+    std::thread writer{[&]()
+    {
+        for (size_t chunk{0}; chunk < chunkCount; ++chunk)
+        {
+            {
+                std::unique_lock lock{mutex};
+                finished.wait(lock, [&]() { return chunkFinished[chunk]; });
+            }
+
+            if (!chunkResults[chunk].has_value())
+            {
+                result = std::unexpected{chunkResults[chunk].error()};
+            }
+            else
+            {
+                result = write(std::span<const TokenType>{chunkTokens[chunk]}.first(chunkResults[chunk].value()));
+                encodingInfo.EncodedStringLength += chunkResults[chunk].value();
+            }
+
+            if (!result.has_value())
+            {
+                failed = true;
+                return;
+            }
+
+            chunkTokens[chunk] = {};
+        }
+    }};
+
+    BPE::ThreadPool pool{threadCount};
+
+    // At most threadCount chunks are encoded at once, each takes a free worker slot for its duration
+    std::vector<unsigned> freeWorkers(pool.ThreadCount());
+    std::mutex workersMutex{};
+
+    for (unsigned worker{0}; worker < freeWorkers.size(); ++worker)
+    {
+        freeWorkers[worker] = unsigned(freeWorkers.size()) - 1 - worker;
+    }
+
+    pool.ParallelFor(chunkCount, [&](size_t chunk)
+    {
+        std::vector<TokenType> tokens{};
+        std::expected<size_t, std::string> tokenCount{0};
+
+        // After a failure the remaining chunks are only marked finished
+        if (!failed)
+        {
+            unsigned worker{};
+
+            {
+                std::lock_guard lock{workersMutex};
+                worker = freeWorkers.back();
+                freeWorkers.pop_back();
+            }
+
+            std::string_view text{input.substr(chunkStarts[chunk], chunkStarts[chunk + 1] - chunkStarts[chunk])};
+            tokens.resize(text.size());
+            tokenCount = encodeChunk(std::as_bytes(std::span{text}), tokens, worker);
+
+            std::lock_guard lock{workersMutex};
+            freeWorkers.push_back(worker);
+        }
+
+        {
+            std::lock_guard lock{mutex};
+            chunkTokens[chunk] = std::move(tokens);
+            chunkResults[chunk] = std::move(tokenCount);
+            chunkFinished[chunk] = true;
+        }
+
+        finished.notify_all();
+    });
+
+    writer.join();
+
+    if (!result.has_value())
+    {
+        return std::unexpected{result.error()};
+    }
+
+    encodingInfo.EncodingIterationCount = encodingInfo.EncodedStringInitialLength - encodingInfo.EncodedStringLength;
+
+    return encodingInfo;
+}
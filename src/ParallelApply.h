@@ -0,0 +1,36 @@
+#pragma once
+
+#include "BPE.h"
+
+#include <cstddef>
+#include <expected>
+#include <functional>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace BPE
+{
+    // Smallest part of the input encoded as one task
+    const size_t MINIMUM_APPLY_CHUNK_SIZE{1 << 20};
+
+    // Encodes one chunk into output, which has room for chunk.size() tokens, and returns the number of tokens written.
+    // Called from several threads at once, but never twice at the same time with the same worker (below threadCount),
+    // so scratch and caches kept per worker need no lock and stay warm from one chunk to the next.
+    template <typename TokenType>
+    using ChunkEncoder = std::function<std::expected<size_t, std::string>(std::span<const std::byte> chunk, std::span<TokenType> output, unsigned worker)>;
+
+    // Receives the tokens of every chunk in input order, on one thread
+    template <typename TokenType>
+    using ChunkWriter = std::function<std::expected<void, std::string>(std::span<const TokenType> tokens)>;
+
+    /*
+     * Splits the input at positions every encoding has a token boundary at, encodes the chunks on threadCount threads
+     * and hands their tokens to write in order while later chunks are still being encoded. A position splits when no
+     * token of the table holds the two bytes around it next to each other, so no token can cross it, or with splitAtWords
+     * when a word starts there. The tokens are therefore exactly those of encoding the whole input at once. A table
+     * whose tokens hold every byte pair of the input leaves nowhere to split, the input is then one chunk.
+     */
+    template <typename TokenType>
+    std::expected<BpeEncodingResultInfo, std::string> TryApplyBpeTableParallel(std::span<const std::pair<TokenType, TokenType>> bpeTable, std::string_view input, bool splitAtWords, const ChunkEncoder<TokenType>& encodeChunk, const ChunkWriter<TokenType>& write, unsigned threadCount);
+} //namespace BPE
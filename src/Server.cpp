@@ -0,0 +1,676 @@
+#include "Server.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <print>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    // Requests taken off the queue at once, the pool answers all of them before it takes the next batch
+    const size_t MAX_BATCH_SIZE{256};
+    // Operation codes index the latency histograms directly, code 0 collects unknown operations
+    const size_t OPERATION_COUNT{size_t(BPE::ServeOperation::Shutdown) + 1};
+    // Histogram buckets per doubling of the latency, so a reported percentile is at most 9% above the true one
+    const size_t BUCKETS_PER_DOUBLING{8};
+    // Up to 2^40 us (about 12 days), longer latencies are counted in the last bucket
+    const size_t LATENCY_BUCKET_COUNT{40 * BUCKETS_PER_DOUBLING};
+    // Wait before accepting again when the process or system ran out of file descriptors
+    const std::chrono::milliseconds ACCEPT_RETRY_DELAY{100};
+
+    std::string_view OperationName(size_t code)
+    {
+        switch (BPE::ServeOperation(code))
+        {
+            case BPE::ServeOperation::Encode: return "encode";
+            case BPE::ServeOperation::Decode: return "decode";
+            case BPE::ServeOperation::Generate: return "generate";
+            case BPE::ServeOperation::Stats: return "stats";
+            case BPE::ServeOperation::Shutdown: return "shutdown";
+        }
+
+        return "unknown";
+    }
+
+    // Returns false once the other side closed the file before all bytes were read
+    bool ReadFully(int fd, void* data, size_t size)
+    {
+        char* position{static_cast<char*>(data)};
+
+        while (size > 0)
+        {
+            ssize_t readSize{::read(fd, position, size)};
+
+            if (readSize < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            if (readSize <= 0)
+            {
+                return false;
+            }
+
+            position += readSize;
+            size -= size_t(readSize);
+        }
+
+        return true;
+    }
+
+    bool WriteFully(int fd, const void* data, size_t size)
+    {
+        const char* position{static_cast<const char*>(data)};
+
+        while (size > 0)
+        {
+            ssize_t writtenSize{::write(fd, position, size)};
+
+            if (writtenSize < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            if (writtenSize <= 0)
+            {
+                return false;
+            }
+
+            position += writtenSize;
+            size -= size_t(writtenSize);
+        }
+
+        return true;
+    }
+
+    // One client, either stdin and stdout or an accepted socket that is closed with the connection
+    class Connection
+    {
+    public:
+        Connection(int readFd, int writeFd, bool ownsFds)
+            : m_ReadFd{readFd}, m_WriteFd{writeFd}, m_OwnsFds{ownsFds}, m_Broken{false}
+        {
+        }
+
+        ~Connection()
+        {
+            if (m_OwnsFds)
+            {
+                ::close(m_ReadFd);
+            }
+        }
+
+        Connection(const Connection&) = delete;
+        Connection& operator=(const Connection&) = delete;
+
+        bool Read(void* data, size_t size)
+        {
+            return ReadFully(m_ReadFd, data, size);
+        }
+
+        // Responses of one batch are written from several threads, the lock keeps their frames from interleaving.
+        // Once a write failed the client is gone and the remaining responses are dropped.
+        void Respond(uint32_t id, BPE::ServeStatus status, std::string_view payload)
+        {
+            BPE::ServeFrameHeader header{uint32_t(payload.size()), id, uint8_t(status), {}};
+
+            std::lock_guard lock{m_WriteMutex};
+
+            if (m_Broken)
+            {
+                return;
+            }
+
+            m_Broken = !WriteFully(m_WriteFd, &header, sizeof(header)) || !WriteFully(m_WriteFd, payload.data(), payload.size());
+        }
+
+        // Wakes up the thread blocked reading from a socket, stdin cannot be woken up this way
+        void Shutdown()
+        {
+            if (m_OwnsFds)
+            {
+                ::shutdown(m_ReadFd, SHUT_RDWR);
+            }
+        }
+
+    private:
+        int m_ReadFd;
+        int m_WriteFd;
+        bool m_OwnsFds;
+
+        std::mutex m_WriteMutex;
+        bool m_Broken;
+    };
+
+    struct Request
+    {
+        std::shared_ptr<Connection> Client;
+        BPE::ServeFrameHeader Header;
+        std::string Payload;
+        Clock::time_point Received;
+    };
+
+    /*
+     * Time from reading a request to having written its response, per operation. Latencies are counted in log-spaced
+     * buckets, so memory and the cost of a report stay the same however long the server runs.
+     */
+    class LatencyRecorder
+    {
+    public:
+        LatencyRecorder()
+            : m_Histograms{}
+        {
+        }
+
+        void Add(uint8_t code, double microseconds)
+        {
+            Histogram& histogram{m_Histograms[code < OPERATION_COUNT ? code : 0]};
+
+            ++histogram.Buckets[Bucket(microseconds)];
+            ++histogram.Count;
+            histogram.Max = std::max(histogram.Max, microseconds);
+        }
+
+        std::string Report() const
+        {
+            std::string report{};
+
+            for (size_t code{0}; code < OPERATION_COUNT; ++code)
+            {
+                const Histogram& histogram{m_Histograms[code]};
+
+                if (histogram.Count == 0)
+                {
+                    continue;
+                }
+
+                report += std::format("{}: {} requests, p50 {:.1f} us, p90 {:.1f} us, p99 {:.1f} us, max {:.1f} us\n", OperationName(code), histogram.Count,
+                    Percentile(histogram, 0.50), Percentile(histogram, 0.90), Percentile(histogram, 0.99), histogram.Max);
+            }
+
+            return report.empty() ? "No requests answered\n" : report;
+        }
+
+    private:
+        struct Histogram
+        {
+            uint64_t Buckets[LATENCY_BUCKET_COUNT];
+            uint64_t Count;
+            double Max;
+        };
+
+        // Bucket b holds latencies below 2^((b + 1) / BUCKETS_PER_DOUBLING) us, bucket 0 everything below 1 us as well
+        static size_t Bucket(double microseconds)
+        {
+            double position{microseconds > 1.0 ? std::log2(microseconds) * double(BUCKETS_PER_DOUBLING) : 0.0};
+            return std::min(size_t(position), LATENCY_BUCKET_COUNT - 1);
+        }
+
+        // Upper bound of the bucket holding the nearest rank, never above the largest latency seen
+        static double Percentile(const Histogram& histogram, double fraction)
+        {
+            uint64_t rank{std::clamp<uint64_t>(uint64_t(fraction * double(histogram.Count) + 0.999999), 1, histogram.Count)};
+            uint64_t seen{0};
+            size_t bucket{0};
+
+            while (seen + histogram.Buckets[bucket] < rank)
+            {
+                seen += histogram.Buckets[bucket++];
+            }
+
+            return std::min(std::exp2(double(bucket + 1) / double(BUCKETS_PER_DOUBLING)), histogram.Max);
+        }
+
+        Histogram m_Histograms[OPERATION_COUNT];
+    };
+
+    /*
+     * Every client has a reader thread that queues its requests and forgets the client once it disconnects, its socket
+     * is closed when the last of its responses was written. The serving thread takes all queued requests as one
+     * batch, answers them in parallel on the pool and only records the latencies once the batch is done, so answering a
+     * Stats request never races with recording.
+     */
+    template <typename TokenType>
+    class Server
+    {
+    public:
+        Server(std::span<const std::pair<TokenType, TokenType>> bpeTable, BPE::DecodeTable decodeTable, unsigned threadCount)
+            : m_BpeTable{bpeTable}, m_Ranks{BPE::BuildPairRanks<TokenType>(bpeTable)}, m_DecodeTable{std::move(decodeTable)},
+              m_Successors{BPE::BuildSuccessorIndex<TokenType>(bpeTable)}, m_Pool{threadCount}, m_ListenFd{-1}, m_OpenSources{0}, m_Stopping{false}, m_NextClient{0}
+        {
+        }
+
+        // A source is a reader or the thread accepting connections, the server stops once none is left
+        void AddSource()
+        {
+            std::lock_guard lock{m_QueueMutex};
+            ++m_OpenSources;
+        }
+
+        void SetListenSocket(int listenFd)
+        {
+            m_ListenFd = listenFd;
+        }
+
+        void ReadRequests(const std::shared_ptr<Connection>& client)
+        {
+            while (true)
+            {
+                Request request{client, {}, {}, {}};
+
+                if (!client->Read(&request.Header, sizeof(request.Header)) || request.Header.Size > BPE::MAX_SERVE_REQUEST_SIZE)
+                {
+                    break;
+                }
+
+                request.Payload.resize(request.Header.Size);
+
+                if (!client->Read(request.Payload.data(), request.Payload.size()))
+                {
+                    break;
+                }
+
+                request.Received = Clock::now();
+                bool shutdown{request.Header.Code == uint8_t(BPE::ServeOperation::Shutdown)};
+
+                {
+                    std::lock_guard lock{m_QueueMutex};
+                    m_Queue.push_back(std::move(request));
+                    m_Stopping = m_Stopping || shutdown;
+                }
+
+                m_QueueChanged.notify_one();
+
+                if (shutdown)
+                {
+                    if (m_ListenFd >= 0)
+                    {
+                        ::shutdown(m_ListenFd, SHUT_RDWR);
+                    }
+
+                    break;
+                }
+            }
+
+            RemoveSource();
+        }
+
+        /*
+         * Accepts clients until the listening socket is shut down for a Shutdown request. Running out of file descriptors
+         * is waited out, any other failure stops the server with the error AcceptError returns.
+         */
+        void AcceptConnections()
+        {
+            bool waitingForDescriptors{false};
+
+            while (true)
+            {
+                int clientFd{::accept(m_ListenFd, nullptr, nullptr)};
+
+                if (clientFd < 0 && (errno == EINTR || errno == ECONNABORTED))
+                {
+                    continue;
+                }
+
+                if (clientFd < 0 && IsStopping())
+                {
+                    break;
+                }
+
+                if (clientFd < 0 && (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM))
+                {
+                    if (!waitingForDescriptors)
+                    {
+                        std::println(stderr, "Unable to accept a connection: {}, retrying until one closes", std::strerror(errno));
+                        waitingForDescriptors = true;
+                    }
+
+                    std::this_thread::sleep_for(ACCEPT_RETRY_DELAY);
+                    continue;
+                }
+
+                if (clientFd < 0)
+                {
+                    std::string error{std::format("ERROR: Unable to accept a connection: {}", std::strerror(errno))};
+
+                    {
+                        std::lock_guard lock{m_QueueMutex};
+                        m_AcceptError = std::move(error);
+                        m_Stopping = true;
+                    }
+
+                    break;
+                }
+
+                waitingForDescriptors = false;
+
+                std::shared_ptr<Connection> client{std::make_shared<Connection>(clientFd, clientFd, true)};
+
+                AddSource();
+
+                std::lock_guard lock{m_ClientsMutex};
+                uint64_t clientId{m_NextClient++};
+                m_Clients.emplace(clientId, client);
+
+                std::thread{[this, clientId, client]()
+                {
+                    ReadRequests(client);
+                    ForgetClient(clientId);
+                }}.detach();
+            }
+
+            RemoveSource();
+        }
+
+        // Answers batches of requests until the server is stopping (or every source is closed) and the queue is empty
+        void Serve()
+        {
+            while (true)
+            {
+                std::vector<Request> batch{};
+
+                {
+                    std::unique_lock lock{m_QueueMutex};
+                    m_QueueChanged.wait(lock, [&]() { return !m_Queue.empty() || m_Stopping || m_OpenSources == 0; });
+
+                    if (m_Queue.empty())
+                    {
+                        break;
+                    }
+
+                    size_t batchSize{std::min(m_Queue.size(), MAX_BATCH_SIZE)};
+                    batch.assign(std::make_move_iterator(m_Queue.begin()), std::make_move_iterator(m_Queue.begin() + batchSize));
+                    m_Queue.erase(m_Queue.begin(), m_Queue.begin() + batchSize);
+                }
+
+                std::vector<double> latencies(batch.size());
+
+                m_Pool.ParallelFor(batch.size(), [&](size_t i)
+                {
+                    Request& request{batch[i]};
+
+                    BPE::ServeStatus status{BPE::ServeStatus::Ok};
+                    std::string response{Answer(request, status)};
+
+                    request.Client->Respond(request.Header.Id, status, response);
+                    latencies[i] = std::chrono::duration<double, std::micro>(Clock::now() - request.Received).count();
+                });
+
+                for (size_t i{0}; i < batch.size(); ++i)
+                {
+                    m_Latencies.Add(batch[i].Header.Code, latencies[i]);
+                }
+            }
+        }
+
+        // Disconnects the remaining socket clients and waits until their readers forgot them
+        void Close()
+        {
+            std::unique_lock lock{m_ClientsMutex};
+
+            for (const auto& [clientId, client] : m_Clients)
+            {
+                client->Shutdown();
+            }
+
+            m_ClientsChanged.wait(lock, [&]() { return m_Clients.empty(); });
+        }
+
+        std::string LatencyReport() const
+        {
+            return m_Latencies.Report();
+        }
+
+        // Why accepting connections stopped, empty when it stopped for a Shutdown request
+        std::string AcceptError()
+        {
+            std::lock_guard lock{m_QueueMutex};
+            return m_AcceptError;
+        }
+
+    private:
+        bool IsStopping()
+        {
+            std::lock_guard lock{m_QueueMutex};
+            return m_Stopping;
+        }
+
+        // Notified under the lock, Close may destroy the server as soon as it is released
+        void ForgetClient(uint64_t clientId)
+        {
+            std::lock_guard lock{m_ClientsMutex};
+            m_Clients.erase(clientId);
+            m_ClientsChanged.notify_all();
+        }
+
+        void RemoveSource()
+        {
+            {
+                std::lock_guard lock{m_QueueMutex};
+                --m_OpenSources;
+            }
+
+            m_QueueChanged.notify_one();
+        }
+
+        std::string Answer(const Request& request, BPE::ServeStatus& status) const
+        {
+            std::expected<std::string, std::string> response{TryAnswer(request)};
+
+            if (!response.has_value())
+            {
+                status = BPE::ServeStatus::Error;
+                return response.error();
+            }
+
+            return std::move(response.value());
+        }
+
+        std::expected<std::string, std::string> TryAnswer(const Request& request) const
+        {
+            switch (BPE::ServeOperation(request.Header.Code))
+            {
+                case BPE::ServeOperation::Encode:
+                {
+                    std::expected<void, std::string> validation{BPE::TryValidateInput<TokenType>(request.Payload)};
+                    if (!validation.has_value())
+                    {
+                        return std::unexpected{validation.error()};
+                    }
+
+                    auto [tokens, _]{BPE::ApplyBpeTable<TokenType>(request.Payload, m_Ranks)};
+
+                    return std::string{reinterpret_cast<const char*>(tokens.data()), tokens.size() * sizeof(TokenType)};
+                }
+                case BPE::ServeOperation::Decode:
+                {
+                    if (request.Payload.size() % sizeof(TokenType) != 0)
+                    {
+                        return std::unexpected{std::format("ERROR: Decode request of {} bytes does not hold whole {}-bit tokens", request.Payload.size(), 8 * sizeof(TokenType))};
+                    }
+
+                    std::basic_string<TokenType> tokens(request.Payload.size() / sizeof(TokenType), TokenType{0});
+                    std::memcpy(tokens.data(), request.Payload.data(), request.Payload.size());
+
+                    try
+                    {
+                        auto [text, _]{BPE::DecodeString(std::span<const TokenType>{tokens}, m_DecodeTable)};
+                        return text;
+                    }
+                    catch (const std::out_of_range& ex)
+                    {
+                        return std::unexpected{std::format("ERROR: {}", ex.what())};
+                    }
+                }
+                case BPE::ServeOperation::Generate:
+                {
+                    BPE::ServeGenerateRequest generateRequest{};
+
+                    if (request.Payload.size() != sizeof(generateRequest))
+                    {
+                        return std::unexpected{std::format("ERROR: Generate request should be {} bytes, not {}", sizeof(generateRequest), request.Payload.size())};
+                    }
+
+                    std::memcpy(&generateRequest, request.Payload.data(), sizeof(generateRequest));
+
+                    if (generateRequest.TokenCount > BPE::MAX_SERVE_GENERATE_TOKENS)
+                    {
+                        return std::unexpected{std::format("ERROR: Cannot generate more than {} tokens per request", BPE::MAX_SERVE_GENERATE_TOKENS)};
+                    }
+
+                    if (m_BpeTable.empty())
+                    {
+                        return std::unexpected{"ERROR: Cannot generate text from an empty BPE table"};
+                    }
+
+                    return BPE::GenerateText(m_BpeTable, m_Successors, m_DecodeTable, generateRequest.TokenCount, generateRequest.Seed);
+                }
+                case BPE::ServeOperation::Stats:
+                    return m_Latencies.Report();
+                case BPE::ServeOperation::Shutdown:
+                    return std::string{};
+            }
+
+            return std::unexpected{std::format("ERROR: Unknown operation {}", size_t(request.Header.Code))};
+        }
+
+        std::span<const std::pair<TokenType, TokenType>> m_BpeTable;
+        BPE::PairRanks<TokenType> m_Ranks;
+        BPE::DecodeTable m_DecodeTable;
+        BPE::SuccessorIndex<TokenType> m_Successors;
+
+        BPE::ThreadPool m_Pool;
+        LatencyRecorder m_Latencies;
+        int m_ListenFd;
+
+        std::mutex m_QueueMutex;
+        std::condition_variable m_QueueChanged;
+        std::deque<Request> m_Queue;
+        size_t m_OpenSources;
+        bool m_Stopping;
+        std::string m_AcceptError;
+
+        std::mutex m_ClientsMutex;
+        std::condition_variable m_ClientsChanged;
+        std::unordered_map<uint64_t, std::shared_ptr<Connection>> m_Clients;
+        uint64_t m_NextClient;
+    };
+
+    std::expected<int, std::string> TryListen(const std::filesystem::path& socketPath)
+    {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+
+        if (socketPath.native().size() >= sizeof(address.sun_path))
+        {
+            return std::unexpected{std::format("ERROR: Socket path \"{}\" is too long", socketPath.c_str())};
+        }
+
+        std::memcpy(address.sun_path, socketPath.c_str(), socketPath.native().size());
+
+        // A socket left behind by a server that did not stop cleanly would make bind fail, anything else is kept
+        struct stat status{};
+        if (::stat(socketPath.c_str(), &status) == 0 && S_ISSOCK(status.st_mode))
+        {
+            ::unlink(socketPath.c_str());
+        }
+
+        int listenFd{::socket(AF_UNIX, SOCK_STREAM, 0)};
+
+        if (listenFd < 0)
+        {
+            return std::unexpected{std::format("ERROR: Unable to create a socket: {}", std::strerror(errno))};
+        }
+
+        if (::bind(listenFd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listenFd, SOMAXCONN) != 0)
+        {
+            std::string error{std::strerror(errno)};
+            ::close(listenFd);
+
+            return std::unexpected{std::format("ERROR: Unable to listen on \"{}\": {}", socketPath.c_str(), error)};
+        }
+
+        return listenFd;
+    }
+} //namespace
+
+template std::expected<void, std::string> BPE::TryServe<char8_t>(std::span<const std::pair<char8_t, char8_t>> bpeTable, const BPE::ServeOptions& options);
+template std::expected<void, std::string> BPE::TryServe<char16_t>(std::span<const std::pair<char16_t, char16_t>> bpeTable, const BPE::ServeOptions& options);
+template std::expected<void, std::string> BPE::TryServe<char32_t>(std::span<const std::pair<char32_t, char32_t>> bpeTable, const BPE::ServeOptions& options);
+template <typename TokenType>
+std::expected<void, std::string> BPE::TryServe(std::span<const std::pair<TokenType, TokenType>> bpeTable, const BPE::ServeOptions& options)
+{
+    std::expected<BPE::DecodeTable, std::string> decodeTable{BPE::TryBuildDecodeTable<TokenType>(bpeTable)};
+    if (!decodeTable.has_value())
+    {
+        return std::unexpected{decodeTable.error()};
+    }
+
+    // A client that disconnects before reading its responses must not take the server down
+    std::signal(SIGPIPE, SIG_IGN);
+
+    Server<TokenType> server{bpeTable, std::move(decodeTable.value()), std::max(options.ThreadCount, 1u)};
+
+    if (options.SocketPath.empty())
+    {
+        std::shared_ptr<Connection> client{std::make_shared<Connection>(STDIN_FILENO, STDOUT_FILENO, false)};
+
+        server.AddSource();
+        std::thread reader{[&]() { server.ReadRequests(client); }};
+
+        server.Serve();
+        reader.join();
+    }
+    else
+    {
+        std::expected<int, std::string> listenFd{TryListen(options.SocketPath)};
+        if (!listenFd.has_value())
+        {
+            return std::unexpected{listenFd.error()};
+        }
+
+        std::println(stderr, "Listening on \"{}\"", options.SocketPath.c_str());
+
+        server.SetListenSocket(listenFd.value());
+        server.AddSource();
+        std::thread acceptor{[&]() { server.AcceptConnections(); }};
+
+        server.Serve();
+
+        ::shutdown(listenFd.value(), SHUT_RDWR);
+        acceptor.join();
+        server.Close();
+
+        ::close(listenFd.value());
+        ::unlink(options.SocketPath.c_str());
+
+        if (std::string error{server.AcceptError()}; !error.empty())
+        {
+            std::print(stderr, "{}", server.LatencyReport());
+            return std::unexpected{std::move(error)};
+        }
+    }
+
+    std::print(stderr, "{}", server.LatencyReport());
+
+    return {};
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "BPE.h"
+
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <span>
+#include <string>
+
+namespace BPE
+{
+    /*
+     * Protocol of `bpe serve`. Requests and responses are frames: a ServeFrameHeader followed by Size payload bytes, all
+     * integers in host byte order. A response carries the id of its request, and since requests are worked on in
+     * parallel responses can arrive in a different order than their requests were sent.
+     *
+     * Payloads per operation:
+     *   Encode    request: the text                       response: its tokens, in the table's token width
+     *   Decode    request: tokens in the table's width    response: the text
+     *   Generate  request: ServeGenerateRequest           response: the generated text
+     *   Stats     request: empty                          response: latency percentiles per operation, as text
+     *   Shutdown  request: empty                          response: empty, the server stops once it answered everything
+     *
+     * A failed request is answered with ServeStatus::Error and the error message as payload.
+     */
+    enum class ServeOperation : uint8_t
+    {
+        Encode = 1,
+        Decode = 2,
+        Generate = 3,
+        Stats = 4,
+        Shutdown = 5
+    };
+
+    enum class ServeStatus : uint8_t
+    {
+        Ok = 0,
+        Error = 1
+    };
+
+    struct ServeFrameHeader
+    {
+        uint32_t Size;
+        uint32_t Id;
+        // A ServeOperation in requests and a ServeStatus in responses
+        uint8_t Code;
+        uint8_t Reserved[7];
+    };
+
+    struct ServeGenerateRequest
+    {
+        uint64_t TokenCount;
+        uint64_t Seed;
+    };
+
+    // A connection sending a larger request is closed, there is no way to skip it without reading it
+    const uint32_t MAX_SERVE_REQUEST_SIZE{1u << 30};
+    const uint64_t MAX_SERVE_GENERATE_TOKENS{1u << 24};
+
+    struct ServeOptions
+    {
+        // Listen on this Unix domain socket, stdin and stdout are used when empty
+        std::filesystem::path SocketPath{};
+        // Threads working on a batch of requests
+        unsigned ThreadCount{1};
+    };
+
+    // Answers requests until stdin is closed or a Shutdown request was answered, then prints the latencies to stderr
+    template <typename TokenType>
+    std::expected<void, std::string> TryServe(std::span<const std::pair<TokenType, TokenType>> bpeTable, const ServeOptions& options);
+} //namespace BPE
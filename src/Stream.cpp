@@ -0,0 +1,360 @@
+#include "Stream.h"
+#include "CompactTokens.h"
+#include "Container.h"
+#include "Core.h"
+#include "DecodeKernel.h"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <vector>
+
+namespace
+{
+    // Token boundaries tried as cut, from the last candidate backwards, before waiting for more input instead
+    const size_t MAX_CUT_ATTEMPTS{8};
+    // Boundaries of the window's encoding tried per prefix, from the last one before the prefix end backwards. A prefix
+    // whose encoding goes through none of them counts as not sharing the cut, which only delays the cut.
+    const size_t MAX_SHARED_CANDIDATES{4};
+
+    /*
+     * Decides which tokens of the text read so far no later input can change. The encoding of a longer input keeps,
+     * from its end, stepping back one token at a time: every token is at most the longest expansion long, so it steps
+     * onto one of the positions q less than that before the current end, and from there on it is the encoding of the
+     * prefix ending at q (the last token of any prefix's encoding is decided by that prefix alone). A token boundary
+     * that the encodings of all these prefixes share is therefore final.
+     *
+     * Whether a prefix's encoding goes through a boundary of the window's encoding is checked without encoding the whole
+     * prefix: two valid encodings joined at a boundary are the encoding of the joined text exactly when the token after
+     * the boundary can follow the one before it (see CanFollow). So the part after the boundary is encoded on its own and
+     * only the pair at the boundary is checked.
+     *
+     * When none of the boundaries tried is shared, the cut falls back to the last position between two bytes that are
+     * next to each other inside no token: no token crosses it in any encoding, so everything before it is final. Only a
+     * table whose tokens contain every byte pair of the input leaves the window growing.
+     */
+    template <typename TokenType>
+    class StreamEncoder
+    {
+    public:
+        StreamEncoder(std::span<const std::pair<TokenType, TokenType>> bpeTable, const BPE::DecodeTable& decodeTable, std::vector<bool> pairsInsideTokens, uint64_t longestExpansion)
+            : m_BpeTable{bpeTable}, m_DecodeTable{decodeTable}, m_Ranks{BPE::BuildPairRanks<TokenType>(bpeTable)}, m_PairsInsideTokens{std::move(pairsInsideTokens)},
+              m_LongestExpansion{longestExpansion}, m_UnsplittableSize{0}
+        {
+        }
+
+        std::expected<void, std::string> TryEncode(std::string_view window)
+        {
+            m_Tokens.resize(window.size());
+
+            std::expected<size_t, std::string> tokenCount{BPE::TryApplyBpeTableInto<TokenType>(std::as_bytes(std::span{window}), m_Ranks, m_Scratch, m_Tokens)};
+            if (!tokenCount.has_value())
+            {
+                return std::unexpected{tokenCount.error()};
+            }
+
+            m_Tokens.resize(tokenCount.value());
+            m_Offsets.resize(m_Tokens.size() + 1);
+            m_Offsets[0] = 0;
+
+            for (size_t i{0}; i < m_Tokens.size(); ++i)
+            {
+                m_Offsets[i + 1] = m_Offsets[i] + m_DecodeTable.Expand(m_Tokens[i]).size();
+            }
+
+            return {};
+        }
+
+        // Tokens of the window encoded last, and the window offset at which every token starts
+        std::span<const TokenType> Tokens() const
+        {
+            return m_Tokens;
+        }
+
+        std::span<const uint64_t> Offsets() const
+        {
+            return m_Offsets;
+        }
+
+        // Number of leading tokens of the encoded window that are final, 0 until enough text follows them
+        size_t FinalTokenCount(std::string_view window)
+        {
+            if (window.size() <= m_LongestExpansion)
+            {
+                return 0;
+            }
+
+            // The latest boundary that leaves the longest expansion behind it
+            uint64_t lastCut{window.size() - m_LongestExpansion};
+            size_t boundary{size_t(std::upper_bound(m_Offsets.begin(), m_Offsets.end(), lastCut) - m_Offsets.begin()) - 1};
+
+            for (size_t attempt{0}; attempt < MAX_CUT_ATTEMPTS && boundary > 0; ++attempt, --boundary)
+            {
+                if (IsFinalBoundary(window, boundary))
+                {
+                    m_UnsplittableSize = 0;
+                    return boundary;
+                }
+            }
+
+            return SplitTokenCount(window);
+        }
+
+    private:
+        // Tokens before the last position no token can cross, only scanning the bytes read since the previous call
+        size_t SplitTokenCount(std::string_view window)
+        {
+            for (size_t split{window.size() - 1}; split >= std::max<size_t>(m_UnsplittableSize, 1); --split)
+            {
+                if (!m_PairsInsideTokens[uint8_t(window[split - 1]) * 256 + uint8_t(window[split])])
+                {
+                    m_UnsplittableSize = 0;
+                    return size_t(std::lower_bound(m_Offsets.begin(), m_Offsets.end(), split) - m_Offsets.begin());
+                }
+            }
+
+            m_UnsplittableSize = window.size();
+            return 0;
+        }
+
+        // Every prefix check encodes a tail of up to about two token expansions, and there are MAX_SHARED_CANDIDATES of
+        // them for each of the longest expansion's prefix ends
+        bool IsFinalBoundary(std::string_view window, size_t boundary)
+        {
+            // The token before the boundary is checked against the first token after it
+            if (boundary == 0)
+            {
+                return false;
+            }
+
+            uint64_t end{window.size()};
+            size_t start{m_Tokens.size()};
+
+            for (uint64_t prefixEnd{end - 1}; prefixEnd > end - m_LongestExpansion; --prefixEnd)
+            {
+                // The last boundary of the window's encoding before the prefix end is the most likely one to be shared
+                while (m_Offsets[start] >= prefixEnd)
+                {
+                    --start;
+                }
+
+                bool shared{false};
+
+                for (size_t candidate{start}; candidate >= boundary && candidate + MAX_SHARED_CANDIDATES > start && !shared; --candidate)
+                {
+                    std::string_view rest{window.substr(m_Offsets[candidate], prefixEnd - m_Offsets[candidate])};
+
+                    m_RestTokens.resize(rest.size());
+                    std::expected<size_t, std::string> restTokenCount{BPE::TryApplyBpeTableInto<TokenType>(std::as_bytes(std::span{rest}), m_Ranks, m_RestScratch, m_RestTokens)};
+
+                    shared = restTokenCount.has_value() && BPE::CanFollow<TokenType>(m_BpeTable, m_Ranks, m_Tokens[candidate - 1], m_RestTokens[0]);
+                }
+
+                if (!shared)
+                {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        std::span<const std::pair<TokenType, TokenType>> m_BpeTable;
+        const BPE::DecodeTable& m_DecodeTable;
+        BPE::PairRanks<TokenType> m_Ranks;
+        std::vector<bool> m_PairsInsideTokens;
+        uint64_t m_LongestExpansion;
+        // Leading bytes of the window already scanned without finding a split between them
+        size_t m_UnsplittableSize;
+
+        BPE::ApplyScratch<TokenType> m_Scratch;
+        std::vector<TokenType> m_Tokens;
+        std::vector<uint64_t> m_Offsets;
+
+        BPE::ApplyScratch<TokenType> m_RestScratch;
+        std::vector<TokenType> m_RestTokens;
+    };
+} //namespace
+
+template std::expected<BPE::BpeEncodingResultInfo, std::string> BPE::TryApplyBpeTableStream<char8_t>(std::span<const std::pair<char8_t, char8_t>> bpeTable, std::istream& input, std::ostream& output, size_t chunkSize);
+template std::expected<BPE::BpeEncodingResultInfo, std::string> BPE::TryApplyBpeTableStream<char16_t>(std::span<const std::pair<char16_t, char16_t>> bpeTable, std::istream& input, std::ostream& output, size_t chunkSize);
+template std::expected<BPE::BpeEncodingResultInfo, std::string> BPE::TryApplyBpeTableStream<char32_t>(std::span<const std::pair<char32_t, char32_t>> bpeTable, std::istream& input, std::ostream& output, size_t chunkSize);
+template <typename TokenType>
+std::expected<BPE::BpeEncodingResultInfo, std::string> BPE::TryApplyBpeTableStream(std::span<const std::pair<TokenType, TokenType>> bpeTable, std::istream& input, std::ostream& output, size_t chunkSize)
+{
+    std::expected<BPE::DecodeTable, std::string> decodeTable{BPE::TryBuildDecodeTable<TokenType>(bpeTable)};
+    if (!decodeTable.has_value())
+    {
+        return std::unexpected{decodeTable.error()};
+    }
+
+    uint64_t longestExpansion{1};
+
+    for (size_t token{0}; token < decodeTable.value().TokenCount(); ++token)
+    {
+        longestExpansion = std::max<uint64_t>(longestExpansion, decodeTable.value().Expand(token).size());
+    }
+
+    std::expected<std::vector<bool>, std::string> pairsInsideTokens{BPE::TryFindPairsInsideTokens<TokenType>(bpeTable)};
+    if (!pairsInsideTokens.has_value())
+    {
+        return std::unexpected{pairsInsideTokens.error()};
+    }
+
+    StreamEncoder<TokenType> encoder{bpeTable, decodeTable.value(), std::move(pairsInsideTokens.value()), longestExpansion};
+
+    // A cut leaves the longest expansion behind, reading less than that at a time would encode it over and over
+    size_t readSize{size_t(std::max<uint64_t>(std::max<size_t>(chunkSize, 1), longestExpansion))};
+
+    std::string window{};
+    BPE::BpeEncodingResultInfo encodingInfo{};
+    bool endOfInput{false};
+
+    while (!endOfInput)
+    {
+        size_t windowSize{window.size()};
+        window.resize(windowSize + readSize);
+        input.read(window.data() + windowSize, std::streamsize(readSize));
+        window.resize(windowSize + size_t(input.gcount()));
+
+        if (input.bad())
+        {
+            return std::unexpected{"ERROR: Unable to read the input"};
+        }
+
+        endOfInput = input.eof();
+        encodingInfo.EncodedStringInitialLength += window.size() - windowSize;
+
+        if (window.size() > BPE::MAX_APPLY_INPUT_SIZE - readSize)
+        {
+            return std::unexpected{std::format("ERROR: No token became final in the last {} bytes of the input", window.size())};
+        }
+
+        std::expected<void, std::string> encodeResult{encoder.TryEncode(window)};
+        if (!encodeResult.has_value())
+        {
+            return std::unexpected{encodeResult.error()};
+        }
+
+        size_t finalTokenCount{endOfInput ? encoder.Tokens().size() : encoder.FinalTokenCount(window)};
+        std::span<const TokenType> finalTokens{encoder.Tokens().first(finalTokenCount)};
+
+        output.write(reinterpret_cast<const char*>(finalTokens.data()), std::streamsize(finalTokens.size_bytes()));
+
+        if (!output)
+        {
+            return std::unexpected{"ERROR: Unable to write the encoded tokens"};
+        }
+
+        encodingInfo.EncodedStringLength += finalTokenCount;
+        window.erase(0, encoder.Offsets()[finalTokenCount]);
+    }
+
+    output.flush();
+
+    encodingInfo.EncodingIterationCount = encodingInfo.EncodedStringInitialLength - encodingInfo.EncodedStringLength;
+
+    return encodingInfo;
+}
+
+template std::expected<BPE::BpeDecodingResultInfo, std::string> BPE::TryDecodeStream<char8_t>(const BPE::DecodeTable& decodeTable, std::istream& input, std::ostream& output, size_t chunkSize);
+template std::expected<BPE::BpeDecodingResultInfo, std::string> BPE::TryDecodeStream<char16_t>(const BPE::DecodeTable& decodeTable, std::istream& input, std::ostream& output, size_t chunkSize);
+template std::expected<BPE::BpeDecodingResultInfo, std::string> BPE::TryDecodeStream<char32_t>(const BPE::DecodeTable& decodeTable, std::istream& input, std::ostream& output, size_t chunkSize);
+template <typename TokenType>
+std::expected<BPE::BpeDecodingResultInfo, std::string> BPE::TryDecodeStream(const BPE::DecodeTable& decodeTable, std::istream& input, std::ostream& output, size_t chunkSize)
+{
+    size_t bufferSize{std::max<size_t>(chunkSize, BPE::COPY_BLOCK_SIZE)};
+
+    std::vector<TokenType> tokens(std::max<size_t>(chunkSize / sizeof(TokenType), 1));
+    std::string text(bufferSize, '\0');
+
+    BPE::BpeDecodingResultInfo decodingInfo{};
+    size_t pendingBytes{0};
+    bool endOfInput{false};
+
+    while (!endOfInput)
+    {
+        char* tokenBytes{reinterpret_cast<char*>(tokens.data())};
+        input.read(tokenBytes + pendingBytes, std::streamsize(tokens.size() * sizeof(TokenType) - pendingBytes));
+
+        if (input.bad())
+        {
+            return std::unexpected{"ERROR: Unable to read the tokens"};
+        }
+
+        endOfInput = input.eof();
+        size_t readBytes{pendingBytes + size_t(input.gcount())};
+
+        // Token files that need the whole file to be decoded cannot be streamed
+        if (decodingInfo.EncodedStringLength == 0 && pendingBytes == 0)
+        {
+            std::span<const std::byte> head{std::as_bytes(std::span{tokenBytes, readBytes})};
+
+            if (BPE::IsCompactTokenFile(head) || BPE::IsContainerFile(head))
+            {
+                return std::unexpected{"ERROR: Only raw tokens can be decoded from a stream, not compact tokens or containers"};
+            }
+        }
+
+        std::span<const TokenType> chunk{tokens.data(), readBytes / sizeof(TokenType)};
+        pendingBytes = readBytes % sizeof(TokenType);
+
+        if (endOfInput && pendingBytes != 0)
+        {
+            return std::unexpected{std::format("ERROR: Input ends in the middle of a {}-bit token", 8 * sizeof(TokenType))};
+        }
+
+        // Runs of tokens that fit the buffer go through the decode kernel, longer expansions are written directly
+        size_t position{0};
+
+        while (position < chunk.size())
+        {
+            size_t runEnd{position};
+            uint64_t runLength{0};
+
+            while (runEnd < chunk.size())
+            {
+                if (chunk[runEnd] >= decodeTable.TokenCount())
+                {
+                    return std::unexpected{std::format("ERROR: Token {} is not part of the BPE table", size_t(chunk[runEnd]))};
+                }
+
+                uint64_t length{decodeTable.Expand(chunk[runEnd]).size()};
+
+                if (runLength + length > bufferSize)
+                {
+                    break;
+                }
+
+                runLength += length;
+                ++runEnd;
+            }
+
+            if (runEnd == position)
+            {
+                std::string_view expansion{decodeTable.Expand(chunk[position])};
+                output.write(expansion.data(), std::streamsize(expansion.size()));
+                decodingInfo.DecodedStringLength += expansion.size();
+                ++position;
+                continue;
+            }
+
+            BPE::DecodeInto(chunk.subspan(position, runEnd - position), decodeTable, text.data(), text.data() + text.size());
+            output.write(text.data(), std::streamsize(runLength));
+            decodingInfo.DecodedStringLength += runLength;
+            position = runEnd;
+        }
+
+        if (!output)
+        {
+            return std::unexpected{"ERROR: Unable to write the decoded text"};
+        }
+
+        decodingInfo.EncodedStringLength += chunk.size();
+        std::memmove(tokenBytes, tokenBytes + chunk.size_bytes(), pendingBytes);
+    }
+
+    output.flush();
+
+    return decodingInfo;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "BPE.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <istream>
+#include <ostream>
+#include <span>
+#include <string>
+
+namespace BPE
+{
+    // Bytes (or token bytes) read from the input at a time
+    const size_t DEFAULT_STREAM_CHUNK_SIZE{1 << 20};
+
+    /*
+     * Applies a BPE table to the input as it arrives and writes every token as soon as it is final, with the exact
+     * tokens ApplyBpeTable would produce for the whole input. Only the text after the last final token is kept, which
+     * is about one chunk plus the longest token expansion of the table, or back to the last two bytes that are next to
+     * each other inside no token. Text without such a pair (for a table whose tokens contain every pair it has) is
+     * kept, and encoded again on every read, until one arrives or the input ends.
+     */
+    template <typename TokenType>
+    std::expected<BpeEncodingResultInfo, std::string> TryApplyBpeTableStream(std::span<const std::pair<TokenType, TokenType>> bpeTable, std::istream& input, std::ostream& output, size_t chunkSize = DEFAULT_STREAM_CHUNK_SIZE);
+
+    // Decodes raw tokens as they arrive, in output blocks of at most chunkSize bytes (tokens expanding to more are
+    // written on their own)
+    template <typename TokenType>
+    std::expected<BpeDecodingResultInfo, std::string> TryDecodeStream(const DecodeTable& decodeTable, std::istream& input, std::ostream& output, size_t chunkSize = DEFAULT_STREAM_CHUNK_SIZE);
+} //namespace BPE
@@ -0,0 +1,143 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+BPE::ThreadPool::ThreadPool(unsigned threadCount)
+    : m_Task{nullptr}, m_TaskCount{0}, m_NextTask{0}, m_UnfinishedTasks{0}, m_Generation{0}, m_Stopping{false}
+{
+    // The calling thread of ParallelFor is the first "worker"
+    for (unsigned i{1}; i < threadCount; ++i)
+    {
+        m_Workers.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+}
+
+BPE::ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock{m_Mutex};
+        m_Stopping = true;
+    }
+
+    m_WorkAvailable.notify_all();
+
+    for (std::thread& worker : m_Workers)
+    {
+        worker.join();
+    }
+}
+
+unsigned BPE::ThreadPool::ThreadCount() const
+{
+    return unsigned(m_Workers.size()) + 1;
+}
+
+void BPE::ThreadPool::ParallelFor(size_t taskCount, const std::function<void(size_t)>& task)
+{
+    if (taskCount == 0)
+    {
+        return;
+    }
+
+    if (m_Workers.empty() || taskCount == 1)
+    {
+        for (size_t i{0}; i < taskCount; ++i)
+        {
+            task(i);
+        }
+
+        return;
+    }
+
+    {
+        std::lock_guard lock{m_Mutex};
+        m_Task = &task;
+        m_TaskCount = taskCount;
+        m_NextTask = 0;
+        m_UnfinishedTasks = taskCount;
+        ++m_Generation;
+    }
+
+    m_WorkAvailable.notify_all();
+
+    RunTasks();
+
+    std::unique_lock lock{m_Mutex};
+    m_WorkDone.wait(lock, [this] { return m_UnfinishedTasks == 0; });
+    m_Task = nullptr;
+}
+
+void BPE::ThreadPool::WorkerLoop()
+{
+    uint64_t seenGeneration{0};
+
+    for (;;)
+    {
+        {
+            std::unique_lock lock{m_Mutex};
+            m_WorkAvailable.wait(lock, [&] { return m_Stopping || m_Generation != seenGeneration; });
+
+            if (m_Stopping)
+            {
+                return;
+            }
+
+            seenGeneration = m_Generation;
+        }
+
+        RunTasks();
+    }
+}
+
+void BPE::ThreadPool::RunTasks()
+{
+    for (;;)
+    {
+        size_t taskIndex{};
+        const std::function<void(size_t)>* task{};
+
+        {
+            std::lock_guard lock{m_Mutex};
+
+            if (m_Task == nullptr || m_NextTask >= m_TaskCount)
+            {
+                return;
+            }
+
+            taskIndex = m_NextTask++;
+            task = m_Task;
+        }
+
+        (*task)(taskIndex);
+
+        bool finished{};
+
+        {
+            std::lock_guard lock{m_Mutex};
+            finished = --m_UnfinishedTasks == 0;
+        }
+
+        if (finished)
+        {
+            m_WorkDone.notify_all();
+        }
+    }
+}
+
+std::pair<size_t, size_t> BPE::SplitRange(size_t size, size_t parts, size_t index)
+{
+    size_t baseSize{size / parts};
+    size_t remainder{size % parts};
+
+    size_t begin{index * baseSize + std::min(index, remainder)};
+    size_t end{begin + baseSize + (index < remainder ? 1 : 0)};
+
+    return {begin, end};
+}
+
+size_t BPE::ChunkCount(size_t size, unsigned threadCount, size_t minimumChunkSize)
+{
+    size_t chunkCount{size / std::max<size_t>(minimumChunkSize, 1)};
+
+    return std::clamp<size_t>(chunkCount, 1, std::max(threadCount, 1u));
+}
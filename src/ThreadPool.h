@@ -0,0 +1,54 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace BPE
+{
+    // Fixed set of worker threads that run the tasks of one ParallelFor call at a time
+    class ThreadPool
+    {
+    public:
+        explicit ThreadPool(unsigned threadCount);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        unsigned ThreadCount() const;
+
+        // Runs task(i) for every i in [0, taskCount) and returns once all of them finished. The calling thread helps out.
+        void ParallelFor(size_t taskCount, const std::function<void(size_t)>& task);
+
+    private:
+        void WorkerLoop();
+        void RunTasks();
+
+        std::vector<std::thread> m_Workers;
+        std::mutex m_Mutex;
+        std::condition_variable m_WorkAvailable;
+        std::condition_variable m_WorkDone;
+
+        const std::function<void(size_t)>* m_Task;
+        size_t m_TaskCount;
+        size_t m_NextTask;
+        size_t m_UnfinishedTasks;
+        uint64_t m_Generation;
+        bool m_Stopping;
+    };
+
+    // Splits [0, size) into `parts` contiguous ranges of (almost) equal size and returns the range with the given index
+    std::pair<size_t, size_t> SplitRange(size_t size, size_t parts, size_t index);
+
+    // Number of chunks worth splitting `size` elements into, at most one per thread and never below `minimumChunkSize` each
+    size_t ChunkCount(size_t size, unsigned threadCount, size_t minimumChunkSize);
+
+    // Below this many tokens per chunk, starting a thread costs more than it saves
+    const size_t MINIMUM_TOKEN_CHUNK_SIZE{1 << 16};
+} //namespace BPE
@@ -0,0 +1,167 @@
+#include "TokenCache.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <format>
+#include <functional>
+
+namespace
+{
+    // Entries per set, scanned together on every lookup
+    const size_t SET_SIZE{8};
+} //namespace
+
+template <typename TokenType>
+BPE::TokenCache<TokenType>::TokenCache(size_t capacity)
+    : m_Stats{}
+{
+    size_t setCount{std::bit_ceil(std::max<size_t>((capacity + SET_SIZE - 1) / SET_SIZE, 1))};
+
+    m_SetMask = setCount - 1;
+    m_Entries.resize(setCount * SET_SIZE, Entry{0, 0, 0, false});
+    m_Words.resize(m_Entries.size() * BPE::MAX_CACHED_WORD_SIZE);
+    m_Tokens.resize(m_Entries.size() * BPE::MAX_CACHED_WORD_SIZE);
+    m_Hands.resize(setCount, 0);
+}
+
+template <typename TokenType>
+size_t BPE::TokenCache<TokenType>::SetOf(uint64_t hash) const
+{
+    // The low bits pick the set, the full hash tells the entries of a set apart
+    return (hash & m_SetMask) * SET_SIZE;
+}
+
+template <typename TokenType>
+std::optional<std::span<const TokenType>> BPE::TokenCache<TokenType>::Find(std::string_view word)
+{
+    uint64_t hash{std::hash<std::string_view>{}(word)};
+    size_t set{SetOf(hash)};
+
+    for (size_t i{set}; i < set + SET_SIZE; ++i)
+    {
+        Entry& entry{m_Entries[i]};
+
+        if (entry.Hash == hash && entry.WordSize == word.size() && word.size() > 0 && std::memcmp(m_Words.data() + i * BPE::MAX_CACHED_WORD_SIZE, word.data(), word.size()) == 0)
+        {
+            entry.Referenced = true;
+            ++m_Stats.Hits;
+            return std::span<const TokenType>{m_Tokens.data() + i * BPE::MAX_CACHED_WORD_SIZE, entry.TokenCount};
+        }
+    }
+
+    ++m_Stats.Misses;
+    return std::nullopt;
+}
+
+template <typename TokenType>
+void BPE::TokenCache<TokenType>::Insert(std::string_view word, std::span<const TokenType> tokens)
+{
+    if (word.empty() || word.size() > BPE::MAX_CACHED_WORD_SIZE)
+    {
+        return;
+    }
+
+    uint64_t hash{std::hash<std::string_view>{}(word)};
+    size_t set{SetOf(hash)};
+    auto empty{std::find_if(m_Entries.begin() + set, m_Entries.begin() + set + SET_SIZE, [](const Entry& entry) { return entry.WordSize == 0; })};
+    size_t index{size_t(empty - m_Entries.begin())};
+
+    if (empty == m_Entries.begin() + set + SET_SIZE)
+    {
+        uint8_t& hand{m_Hands[set / SET_SIZE]};
+
+        while (m_Entries[set + hand].Referenced)
+        {
+            m_Entries[set + hand].Referenced = false;
+            hand = uint8_t((hand + 1) % SET_SIZE);
+        }
+
+        index = set + hand;
+        hand = uint8_t((hand + 1) % SET_SIZE);
+        ++m_Stats.Evictions;
+    }
+
+    // A word never encodes to more tokens than it has bytes
+    m_Entries[index] = Entry{hash, uint8_t(word.size()), uint8_t(tokens.size()), false};
+    std::memcpy(m_Words.data() + index * BPE::MAX_CACHED_WORD_SIZE, word.data(), word.size());
+    std::copy(tokens.begin(), tokens.end(), m_Tokens.begin() + index * BPE::MAX_CACHED_WORD_SIZE);
+}
+
+template <typename TokenType>
+void BPE::TokenCache<TokenType>::CountUncached()
+{
+    ++m_Stats.Uncached;
+}
+
+template <typename TokenType>
+size_t BPE::TokenCache<TokenType>::Capacity() const
+{
+    return m_Entries.size();
+}
+
+template <typename TokenType>
+const BPE::TokenCacheStats& BPE::TokenCache<TokenType>::Stats() const
+{
+    return m_Stats;
+}
+
+// After the member definitions, so the instantiations include them
+template class BPE::TokenCache<char8_t>;
+template class BPE::TokenCache<char16_t>;
+template class BPE::TokenCache<char32_t>;
+
+template std::expected<size_t, std::string> BPE::TryApplyBpeTableWordsInto<char8_t>(std::span<const std::byte> input, const BPE::PairRanks<char8_t>& ranks, BPE::ApplyScratch<char8_t>& scratch, BPE::TokenCache<char8_t>& cache, std::span<char8_t> output);
+template std::expected<size_t, std::string> BPE::TryApplyBpeTableWordsInto<char16_t>(std::span<const std::byte> input, const BPE::PairRanks<char16_t>& ranks, BPE::ApplyScratch<char16_t>& scratch, BPE::TokenCache<char16_t>& cache, std::span<char16_t> output);
+template std::expected<size_t, std::string> BPE::TryApplyBpeTableWordsInto<char32_t>(std::span<const std::byte> input, const BPE::PairRanks<char32_t>& ranks, BPE::ApplyScratch<char32_t>& scratch, BPE::TokenCache<char32_t>& cache, std::span<char32_t> output);
+template <typename TokenType>
+std::expected<size_t, std::string> BPE::TryApplyBpeTableWordsInto(std::span<const std::byte> input, const BPE::PairRanks<TokenType>& ranks, BPE::ApplyScratch<TokenType>& scratch, BPE::TokenCache<TokenType>& cache, std::span<TokenType> output)
+{
+    if (output.size() < input.size())
+    {
+        return std::unexpected{std::format("ERROR: Output of {} tokens is too small for an input of {} bytes", output.size(), input.size())};
+    }
+
+    std::string_view text{reinterpret_cast<const char*>(input.data()), input.size()};
+
+    // Cached words skip the validation TryApplyBpeTableInto does, so the whole input is validated up front
+    std::expected<void, std::string> validation{BPE::TryValidateInput<TokenType>(text)};
+    if (!validation.has_value())
+    {
+        return std::unexpected{validation.error()};
+    }
+
+    size_t outputSize{0};
+
+    for (size_t begin{0}; begin < text.size();)
+    {
+        size_t end{BPE::WordEnd(text, begin)};
+        std::string_view word{text.substr(begin, end - begin)};
+        begin = end;
+
+        if (word.size() > BPE::MAX_CACHED_WORD_SIZE)
+        {
+            cache.CountUncached();
+        }
+        else if (std::optional<std::span<const TokenType>> cached{cache.Find(word)}; cached.has_value())
+        {
+            std::copy(cached.value().begin(), cached.value().end(), output.begin() + outputSize);
+            outputSize += cached.value().size();
+            continue;
+        }
+
+        // Every word written so far took at most as many tokens as it had bytes, so the rest of the word fits
+        std::span<TokenType> wordOutput{output.subspan(outputSize, word.size())};
+
+        std::expected<size_t, std::string> tokenCount{BPE::TryApplyBpeTableInto<TokenType>(std::as_bytes(std::span{word}), ranks, scratch, wordOutput)};
+        if (!tokenCount.has_value())
+        {
+            return std::unexpected{tokenCount.error()};
+        }
+
+        cache.Insert(word, wordOutput.first(tokenCount.value()));
+        outputSize += tokenCount.value();
+    }
+
+    return outputSize;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "BPE.h"
+#include "Core.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace BPE
+{
+    // Longer words are rare enough to always be encoded, this keeps every cache entry the same size
+    const size_t MAX_CACHED_WORD_SIZE{32};
+    const size_t DEFAULT_TOKEN_CACHE_SIZE{1 << 16};
+
+    struct TokenCacheStats
+    {
+        uint64_t Hits;
+        uint64_t Misses;
+        uint64_t Evictions;
+        // Words too long to be cached, these are not counted as lookups
+        uint64_t Uncached;
+    };
+
+    /*
+     * Remembers the tokens of recently encoded words. Entries are grouped in small sets by the hash of their word, and
+     * a set is scanned as a whole, so a lookup touches one or two cache lines. A full set evicts with CLOCK: entries that
+     * were hit since the hand last passed them get a second chance.
+     */
+    template <typename TokenType>
+    class TokenCache
+    {
+    public:
+        // The capacity is rounded up to whole sets, a power of two of them
+        explicit TokenCache(size_t capacity = DEFAULT_TOKEN_CACHE_SIZE);
+
+        // Tokens of the word if they are cached, valid until the next Insert
+        std::optional<std::span<const TokenType>> Find(std::string_view word);
+        void Insert(std::string_view word, std::span<const TokenType> tokens);
+        void CountUncached();
+
+        size_t Capacity() const;
+        const TokenCacheStats& Stats() const;
+
+    private:
+        struct Entry
+        {
+            uint64_t Hash;
+            // Empty entries have no word
+            uint8_t WordSize;
+            uint8_t TokenCount;
+            bool Referenced;
+        };
+
+        size_t SetOf(uint64_t hash) const;
+
+        size_t m_SetMask;
+        std::vector<Entry> m_Entries;
+        std::vector<char> m_Words;
+        std::vector<TokenType> m_Tokens;
+        std::vector<uint8_t> m_Hands;
+        TokenCacheStats m_Stats;
+    };
+
+    /*
+     * Encodes the input one word at a time, with words split the way training with pre-tokenization splits them. For a
+     * table trained that way this gives the tokens training produced, which whole-text encoding does not (it can merge
+     * across words). Words are looked up in the cache first. Like TryApplyBpeTableInto it returns the number of tokens
+     * written and needs an output of input.size() tokens.
+     */
+    template <typename TokenType>
+    std::expected<size_t, std::string> TryApplyBpeTableWordsInto(std::span<const std::byte> input, const PairRanks<TokenType>& ranks, ApplyScratch<TokenType>& scratch, TokenCache<TokenType>& cache, std::span<TokenType> output);
+} //namespace BPE
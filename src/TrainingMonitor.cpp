@@ -0,0 +1,112 @@
+#include "TrainingMonitor.h"
+
+#include <cstdio>
+#include <format>
+#include <print>
+#include <unistd.h>
+
+namespace
+{
+    const std::chrono::seconds PROGRESS_INTERVAL{1};
+
+    // Resident set size of the process, which is what the engines' data structures and the input really occupy
+    uint64_t ResidentBytes()
+    {
+        FILE* statm{std::fopen("/proc/self/statm", "r")};
+
+        if (statm == nullptr)
+        {
+            return 0;
+        }
+
+        unsigned long long totalPages{0};
+        unsigned long long residentPages{0};
+        int fieldCount{std::fscanf(statm, "%llu %llu", &totalPages, &residentPages)};
+        std::fclose(statm);
+
+        return fieldCount == 2 ? residentPages * uint64_t(sysconf(_SC_PAGESIZE)) : 0;
+    }
+} //namespace
+
+BPE::TrainingMonitor::TrainingMonitor(std::ostream* statsOutput, uint64_t statsInterval, bool progress)
+    : m_StatsOutput{statsOutput}, m_StatsInterval{std::max<uint64_t>(statsInterval, 1)}, m_Progress{progress},
+      m_Start{Clock::now()}, m_PhaseStart{m_Start}, m_LastProgress{m_Start}, m_Phase{TrainingPhase::Other}, m_PhaseSeconds{},
+      m_LastMerge{}, m_LastMergeWritten{true}
+{
+}
+
+void BPE::TrainingMonitor::EnterPhase(TrainingPhase phase)
+{
+    Clock::time_point now{Clock::now()};
+
+    m_PhaseSeconds[size_t(m_Phase)] += std::chrono::duration<double>(now - m_PhaseStart).count();
+    m_PhaseStart = now;
+    m_Phase = phase;
+}
+
+void BPE::TrainingMonitor::OnMerge(const MergeStats& stats)
+{
+    // Bring the running phase up to date, so the line includes the merge it reports
+    EnterPhase(m_Phase);
+
+    m_LastMerge = stats;
+    m_LastMergeWritten = false;
+
+    if (stats.Merge % m_StatsInterval == 0)
+    {
+        WriteStats(stats);
+    }
+
+    if (m_Progress && m_PhaseStart - m_LastProgress >= PROGRESS_INTERVAL)
+    {
+        PrintProgress(stats);
+        m_LastProgress = m_PhaseStart;
+    }
+}
+
+void BPE::TrainingMonitor::Finish(const BpeEncodingResultInfo& encodingInfo)
+{
+    EnterPhase(TrainingPhase::Other);
+
+    if (!m_LastMergeWritten)
+    {
+        WriteStats(m_LastMerge);
+    }
+
+    if (m_StatsOutput != nullptr)
+    {
+        m_StatsOutput->flush();
+    }
+
+    if (m_Progress)
+    {
+        MergeStats finalStats{m_LastMerge};
+        finalStats.Merge = encodingInfo.EncodingIterationCount;
+        finalStats.SequenceLength = encodingInfo.EncodedStringLength;
+
+        PrintProgress(finalStats);
+    }
+}
+
+void BPE::TrainingMonitor::WriteStats(const MergeStats& stats)
+{
+    m_LastMergeWritten = true;
+
+    if (m_StatsOutput == nullptr)
+    {
+        return;
+    }
+
+    double elapsedSeconds{std::chrono::duration<double>(m_PhaseStart - m_Start).count()};
+
+    *m_StatsOutput << std::format("{{\"merge\":{},\"token\":{},\"pair\":[{},{}],\"frequency\":{},\"length\":{},\"pair_table_size\":{},\"memory_bytes\":{},\"count_s\":{:.6f},\"select_s\":{:.6f},\"apply_s\":{:.6f},\"elapsed_s\":{:.6f}}}\n",
+        stats.Merge, stats.Token, stats.First, stats.Second, stats.Frequency, stats.SequenceLength, stats.PairTableSize, ResidentBytes(),
+        m_PhaseSeconds[size_t(TrainingPhase::Count)], m_PhaseSeconds[size_t(TrainingPhase::Select)], m_PhaseSeconds[size_t(TrainingPhase::Apply)], elapsedSeconds);
+}
+
+void BPE::TrainingMonitor::PrintProgress(const MergeStats& stats)
+{
+    double elapsedSeconds{std::chrono::duration<double>(m_PhaseStart - m_Start).count()};
+
+    std::println(stderr, "[{:8.1f}s] {} merges, {} tokens, {} pairs, {:.1f} MiB resident", elapsedSeconds, stats.Merge, stats.SequenceLength, stats.PairTableSize, double(ResidentBytes()) / (1024 * 1024));
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "BPE.h"
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+namespace BPE
+{
+    // Phases a training engine moves through, Other is everything that is not reported on its own (setup and output)
+    enum class TrainingPhase
+    {
+        Count,
+        Select,
+        Apply,
+        Other
+    };
+
+    // State of a training run right after a merge
+    struct MergeStats
+    {
+        // Number of merges done, including this one
+        uint64_t Merge;
+        uint64_t Token;
+        uint64_t First;
+        uint64_t Second;
+        uint64_t Frequency;
+        uint64_t SequenceLength;
+        // Entries in the engine's pair table, the dense raw byte pairs of the streaming engines are not included
+        uint64_t PairTableSize;
+    };
+
+    /*
+     * Per-merge telemetry of a training run. The engines take a pointer to a monitor that is null when nothing is
+     * observed, so without one the cost is a branch per phase. Phase times add up over the whole run, every stats line
+     * holds the totals so far and the difference between two lines is the time spent in between.
+     *
+     * The legacy engine counts and selects in one pass, which it reports as counting. The out-of-core engine recounts
+     * while it streams a merge, which it reports as applying.
+     *
+     * Stats are written as JSON lines every statsInterval merges, the progress line goes to stderr about once a second.
+     */
+    class TrainingMonitor
+    {
+    public:
+        TrainingMonitor(std::ostream* statsOutput, uint64_t statsInterval, bool progress);
+
+        TrainingMonitor(const TrainingMonitor&) = delete;
+        TrainingMonitor& operator=(const TrainingMonitor&) = delete;
+
+        // Ends the current phase and starts timing the given one
+        void EnterPhase(TrainingPhase phase);
+        void OnMerge(const MergeStats& stats);
+        // Writes the last merge if its line was not written yet, and the final progress line
+        void Finish(const BpeEncodingResultInfo& encodingInfo);
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        void WriteStats(const MergeStats& stats);
+        void PrintProgress(const MergeStats& stats);
+
+        std::ostream* m_StatsOutput;
+        uint64_t m_StatsInterval;
+        bool m_Progress;
+
+        Clock::time_point m_Start;
+        Clock::time_point m_PhaseStart;
+        Clock::time_point m_LastProgress;
+        TrainingPhase m_Phase;
+        double m_PhaseSeconds[4];
+
+        MergeStats m_LastMerge;
+        bool m_LastMergeWritten;
+    };
+
+    inline void EnterPhase(TrainingMonitor* monitor, TrainingPhase phase)
+    {
+        if (monitor != nullptr)
+        {
+            monitor->EnterPhase(phase);
+        }
+    }
+} //namespace BPE
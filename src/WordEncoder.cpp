@@ -0,0 +1,420 @@
+#include "BPE.h"
+#include "ThreadPool.h"
+#include "TrainingMonitor.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <queue>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    const size_t MINIMUM_CHUNK_SIZE{1 << 20};
+
+    enum class CharacterClass
+    {
+        Word,
+        Space,
+        Punctuation
+    };
+
+    // Bytes of multi-byte UTF-8 sequences count as word characters, so non-ASCII letters stay inside their word
+    CharacterClass ClassOf(char character)
+    {
+        unsigned char byte{static_cast<unsigned char>(character)};
+
+        if (byte >= 0x80 || (byte >= '0' && byte <= '9') || (byte >= 'a' && byte <= 'z') || (byte >= 'A' && byte <= 'Z'))
+        {
+            return CharacterClass::Word;
+        }
+
+        if (byte == ' ' || byte == '\t' || byte == '\n' || byte == '\r' || byte == '\v' || byte == '\f')
+        {
+            return CharacterClass::Space;
+        }
+
+        return CharacterClass::Punctuation;
+    }
+
+    /*
+     * Words are maximal runs of one character class, except that a single space in front of a word or punctuation run
+     * belongs to that run (" the", " ("), like most BPE pre-tokenizers do. Whether a word starts at a position only
+     * depends on its direct neighbours, so chunks of the input can be split independently.
+     */
+    bool IsWordStart(std::string_view input, size_t i)
+    {
+        if (i == 0)
+        {
+            return true;
+        }
+
+        CharacterClass current{ClassOf(input[i])};
+
+        if (input[i] == ' ' && i + 1 < input.size() && ClassOf(input[i + 1]) != CharacterClass::Space)
+        {
+            return true;
+        }
+
+        if (input[i - 1] == ' ' && current != CharacterClass::Space)
+        {
+            return false;
+        }
+
+        return current != ClassOf(input[i - 1]);
+    }
+
+    // Calls function(word) for every word in [begin, end), where begin is a word start
+    template <typename Function>
+    void ForEachWord(std::string_view input, size_t begin, size_t end, Function&& function)
+    {
+        size_t wordBegin{begin};
+
+        for (size_t i{begin + 1}; i < end; ++i)
+        {
+            if (IsWordStart(input, i))
+            {
+                function(input.substr(wordBegin, i - wordBegin));
+                wordBegin = i;
+            }
+        }
+
+        if (wordBegin < end)
+        {
+            function(input.substr(wordBegin, end - wordBegin));
+        }
+    }
+
+    struct WordPairOccurrences
+    {
+        uint64_t Count;
+        // Words in which the pair occurs, may contain stale or duplicate entries
+        std::vector<uint32_t> Words;
+    };
+
+    template <typename TokenType>
+    struct WordHeapEntry
+    {
+        uint64_t Count;
+        std::pair<TokenType, TokenType> Pair;
+    };
+
+    struct WordHeapEntryCompare
+    {
+        // Same order as the incremental engine: the most frequent pair first, ties go to the smallest pair
+        template <typename TokenType>
+        bool operator()(const WordHeapEntry<TokenType>& a, const WordHeapEntry<TokenType>& b) const
+        {
+            if (a.Count != b.Count)
+            {
+                return a.Count < b.Count;
+            }
+
+            return a.Pair > b.Pair;
+        }
+    };
+
+    template <typename TokenType>
+    using WordPairMap = std::unordered_map<std::pair<TokenType, TokenType>, WordPairOccurrences, BPE::PairHash>;
+    template <typename TokenType>
+    using WordPairHeap = std::priority_queue<WordHeapEntry<TokenType>, std::vector<WordHeapEntry<TokenType>>, WordHeapEntryCompare>;
+
+    template <typename TokenType>
+    void RebuildWordHeap(WordPairHeap<TokenType>& heap, const WordPairMap<TokenType>& pairs)
+    {
+        std::vector<WordHeapEntry<TokenType>> entries{};
+        entries.reserve(pairs.size());
+
+        for (const auto& [pair, occurrences] : pairs)
+        {
+            entries.push_back({occurrences.Count, pair});
+        }
+
+        heap = WordPairHeap<TokenType>{WordHeapEntryCompare{}, std::move(entries)};
+    }
+} //namespace
+
+void BPE::CountWords(std::string_view document, BPE::WordCounts& wordCounts)
+{
+    ForEachWord(document, 0, document.size(), [&](std::string_view word) { ++wordCounts[word]; });
+}
+
+size_t BPE::WordEnd(std::string_view text, size_t begin)
+{
+    size_t end{begin + 1};
+
+    while (end < text.size() && !IsWordStart(text, end))
+    {
+        ++end;
+    }
+
+    return end;
+}
+
+template std::tuple<std::basic_string<char8_t>, std::basic_string<char8_t>, BPE::BpeEncodingResultInfo> BPE::EncodeTextWords<char8_t>(const std::string& input, const BPE::BpeEncodingOptions& options);
+template std::tuple<std::basic_string<char16_t>, std::basic_string<char16_t>, BPE::BpeEncodingResultInfo> BPE::EncodeTextWords<char16_t>(const std::string& input, const BPE::BpeEncodingOptions& options);
+template std::tuple<std::basic_string<char32_t>, std::basic_string<char32_t>, BPE::BpeEncodingResultInfo> BPE::EncodeTextWords<char32_t>(const std::string& input, const BPE::BpeEncodingOptions& options);
+template <typename TokenType>
+std::tuple<std::basic_string<TokenType>, std::basic_string<TokenType>, BPE::BpeEncodingResultInfo> BPE::EncodeTextWords(const std::string& input, const BPE::BpeEncodingOptions& options)
+{
+    std::string_view text{input};
+
+    // Chunks start at the first word start at or after their even split point, so they split the text into the same
+    // words as a single pass would
+    BPE::ThreadPool threadPool{options.ThreadCount};
+    size_t chunkCount{BPE::ChunkCount(text.size(), threadPool.ThreadCount(), MINIMUM_CHUNK_SIZE)};
+    std::vector<size_t> chunkBegins(chunkCount + 1, text.size());
+
+    for (size_t chunk{0}; chunk < chunkCount; ++chunk)
+    {
+        size_t begin{BPE::SplitRange(text.size(), chunkCount, chunk).first};
+
+        while (begin < text.size() && !IsWordStart(text, begin))
+        {
+            ++begin;
+        }
+
+        chunkBegins[chunk] = std::max(begin, chunk == 0 ? size_t{0} : chunkBegins[chunk - 1]);
+    }
+
+    std::vector<BPE::WordCounts> chunkWordCounts(chunkCount);
+
+    threadPool.ParallelFor(chunkCount, [&](size_t chunk)
+    {
+        ForEachWord(text, chunkBegins[chunk], chunkBegins[chunk + 1], [&](std::string_view word) { ++chunkWordCounts[chunk][word]; });
+    });
+
+    return BPE::EncodeWords<TokenType>(std::span<const std::string_view>{&text, 1}, chunkWordCounts, options);
+}
+
+template std::tuple<std::basic_string<char8_t>, std::basic_string<char8_t>, BPE::BpeEncodingResultInfo> BPE::EncodeWords<char8_t>(std::span<const std::string_view> documents, std::span<const BPE::WordCounts> wordCounts, const BPE::BpeEncodingOptions& options);
+template std::tuple<std::basic_string<char16_t>, std::basic_string<char16_t>, BPE::BpeEncodingResultInfo> BPE::EncodeWords<char16_t>(std::span<const std::string_view> documents, std::span<const BPE::WordCounts> wordCounts, const BPE::BpeEncodingOptions& options);
+template std::tuple<std::basic_string<char32_t>, std::basic_string<char32_t>, BPE::BpeEncodingResultInfo> BPE::EncodeWords<char32_t>(std::span<const std::string_view> documents, std::span<const BPE::WordCounts> wordCounts, const BPE::BpeEncodingOptions& options);
+/*
+ * Trains on the dictionary of unique words instead of on the text. Every word is a token sequence weighted by how often
+ * it occurs, so a merge rewrites each distinct word once instead of every occurrence, and no merge crosses a word
+ * boundary. The merge loop mirrors ContinueEncodingIncremental: pairs remember the words they occur in and the best
+ * pair comes from a max-heap with lazy invalidation. The merges only depend on the counts, not on the order in which the
+ * words are numbered.
+ *
+ * The tokens of the text are the tokens of its words, so the returned token sequence can differ from what ApplyBpeTable
+ * produces for the whole text where a merge could also match across a word boundary. Both decode to the input.
+ */
+template <typename TokenType>
+std::tuple<std::basic_string<TokenType>, std::basic_string<TokenType>, BPE::BpeEncodingResultInfo> BPE::EncodeWords(std::span<const std::string_view> documents, std::span<const BPE::WordCounts> wordCounts, const BPE::BpeEncodingOptions& options)
+{
+    std::unordered_map<std::string_view, uint32_t> wordIds{};
+    std::vector<std::basic_string<TokenType>> words{};
+    std::vector<uint64_t> wordFrequencies{};
+
+    for (const BPE::WordCounts& counts : wordCounts)
+    {
+        for (const auto& [word, count] : counts)
+        {
+            auto [it, inserted]{wordIds.try_emplace(word, uint32_t(words.size()))};
+
+            if (inserted)
+            {
+                words.emplace_back(word.begin(), word.end());
+                wordFrequencies.push_back(0);
+            }
+
+            wordFrequencies[it->second] += count;
+        }
+    }
+
+    BPE::EnterPhase(options.Monitor, BPE::TrainingPhase::Count);
+
+    WordPairMap<TokenType> pairs{};
+
+    for (uint32_t word{0}; word < words.size(); ++word)
+    {
+        for (size_t i{0}; i + 1 < words[word].size(); ++i)
+        {
+            WordPairOccurrences& occurrences{pairs[{words[word][i], words[word][i + 1]}]};
+            occurrences.Count += wordFrequencies[word];
+            occurrences.Words.push_back(word);
+        }
+    }
+
+    WordPairHeap<TokenType> heap{};
+    RebuildWordHeap(heap, pairs);
+
+    std::basic_string<TokenType> bpeTable{};
+    TokenType nextEncodedToken{BPE::FIRST_TOKEN<TokenType>};
+
+    BPE::BpeEncodingResultInfo encodingInfo{};
+
+    for (std::string_view document : documents)
+    {
+        encodingInfo.EncodedStringInitialLength += document.size();
+    }
+
+    // Length of the text in tokens, kept up to date by the merges
+    uint64_t encodedStringLength{0};
+
+    for (uint32_t word{0}; word < words.size(); ++word)
+    {
+        encodedStringLength += words[word].size() * wordFrequencies[word];
+    }
+
+    std::vector<std::pair<TokenType, TokenType>> touchedPairs{};
+    std::vector<uint32_t> wordsToMerge{};
+    std::basic_string<TokenType> mergedWord{};
+
+    auto decrement = [&](std::pair<TokenType, TokenType> pair, uint64_t count)
+    {
+        auto it{pairs.find(pair)};
+        assert(it != pairs.end() && it->second.Count >= count);
+
+        it->second.Count -= count;
+
+        if (it->second.Count == 0)
+        {
+            pairs.erase(it);
+        }
+
+        touchedPairs.push_back(pair);
+    };
+
+    auto increment = [&](std::pair<TokenType, TokenType> pair, uint64_t count, uint32_t word)
+    {
+        WordPairOccurrences& occurrences{pairs[pair]};
+        occurrences.Count += count;
+        occurrences.Words.push_back(word);
+
+        touchedPairs.push_back(pair);
+    };
+
+    for (;; encodingInfo.EncodingIterationCount++)
+    {
+        BPE::EnterPhase(options.Monitor, BPE::TrainingPhase::Select);
+
+        while (heap.empty() == false)
+        {
+            const WordHeapEntry<TokenType>& top{heap.top()};
+            auto it{pairs.find(top.Pair)};
+
+            if (it != pairs.end() && it->second.Count == top.Count)
+            {
+                break;
+            }
+
+            heap.pop();
+        }
+
+        if (heap.empty() || heap.top().Count <= 1)
+        {
+            break;
+        }
+
+        if (bpeTable.size() / 2 >= BPE::MAXIMUM_TABLE_SIZE<TokenType>)
+        {
+            encodingInfo.TableFull = true;
+            break;
+        }
+
+        if (options.MaxMerges > 0 && bpeTable.size() / 2 >= options.MaxMerges)
+        {
+            break;
+        }
+
+        auto [first, second]{heap.top().Pair};
+        uint64_t mostFrequentCount{heap.top().Count};
+        heap.pop();
+
+        BPE::EnterPhase(options.Monitor, BPE::TrainingPhase::Apply);
+
+        wordsToMerge.swap(pairs.at({first, second}).Words);
+        std::sort(wordsToMerge.begin(), wordsToMerge.end());
+        wordsToMerge.erase(std::unique(wordsToMerge.begin(), wordsToMerge.end()), wordsToMerge.end());
+
+        touchedPairs.clear();
+
+        // Merges left to right within every word, updating the neighbouring pairs the same way the incremental engine does
+        for (uint32_t word : wordsToMerge)
+        {
+            const std::basic_string<TokenType>& tokens{words[word]};
+            uint64_t count{wordFrequencies[word]};
+            mergedWord.clear();
+
+            for (size_t i{0}; i < tokens.size(); ++i)
+            {
+                if (i + 1 == tokens.size() || tokens[i] != first || tokens[i + 1] != second)
+                {
+                    mergedWord.push_back(tokens[i]);
+                    continue;
+                }
+
+                if (!mergedWord.empty())
+                {
+                    decrement({mergedWord.back(), first}, count);
+                    increment({mergedWord.back(), nextEncodedToken}, count, word);
+                }
+
+                if (i + 2 < tokens.size())
+                {
+                    decrement({second, tokens[i + 2]}, count);
+                    increment({nextEncodedToken, tokens[i + 2]}, count, word);
+                }
+
+                decrement({first, second}, count);
+
+                mergedWord.push_back(nextEncodedToken);
+                encodedStringLength -= count;
+                ++i;
+            }
+
+            words[word] = mergedWord;
+        }
+
+        wordsToMerge.clear();
+        assert(pairs.contains({first, second}) == false);
+
+        std::sort(touchedPairs.begin(), touchedPairs.end());
+        touchedPairs.erase(std::unique(touchedPairs.begin(), touchedPairs.end()), touchedPairs.end());
+
+        for (const std::pair<TokenType, TokenType>& pair : touchedPairs)
+        {
+            auto it{pairs.find(pair)};
+
+            if (it != pairs.end())
+            {
+                heap.push({it->second.Count, pair});
+            }
+        }
+
+        // Stale entries pile up over time, drop them once they clearly outnumber the live pairs
+        if (heap.size() > pairs.size() * 4 + 1024)
+        {
+            RebuildWordHeap(heap, pairs);
+        }
+
+        assert(bpeTable.size() == size_t(nextEncodedToken - BPE::FIRST_TOKEN<TokenType>) * 2);
+        bpeTable.push_back(first);
+        bpeTable.push_back(second);
+
+        if (options.Monitor != nullptr)
+        {
+            options.Monitor->OnMerge({bpeTable.size() / 2, nextEncodedToken, first, second, mostFrequentCount, encodedStringLength, pairs.size()});
+        }
+
+        ++nextEncodedToken;
+    }
+
+    BPE::EnterPhase(options.Monitor, BPE::TrainingPhase::Other);
+
+    std::basic_string<TokenType> encodedString{};
+    encodedString.reserve(encodedStringLength);
+
+    for (std::string_view document : documents)
+    {
+        ForEachWord(document, 0, document.size(), [&](std::string_view word) { encodedString += words[wordIds.at(word)]; });
+    }
+
+    encodingInfo.EncodedStringLength = encodedString.size();
+
+    return {bpeTable, encodedString, encodingInfo};
+}
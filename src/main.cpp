@@ -1,13 +1,36 @@
+#include <algorithm>
 #include <cassert>
+#include <climits>
+#include <cstdint>
 #include <filesystem>
 #include <format>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <optional>
 #include <print>
 #include <queue>
+#include <random>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <tuple>
+#include <vector>
 
 #include "BPE.h"
+#include "BlockIndex.h"
+#include "Checkpoint.h"
+#include "CompiledEncoder.h"
+#include "CompactTokens.h"
+#include "Container.h"
+#include "Corpus.h"
+#include "MappedFile.h"
+#include "ParallelApply.h"
+#include "Server.h"
+#include "Stream.h"
+#include "TokenCache.h"
+#include "TrainingMonitor.h"
 
 void PrintUsage(std::string_view programName, BPE::SubCommand subCommand = BPE::SubCommand::NONE)
 {
@@ -18,9 +41,12 @@ void PrintUsage(std::string_view programName, BPE::SubCommand subCommand = BPE::
         std::println();
         std::println("Commands:");
         std::println("\tencode\t Encode the input file using byte pair encoding");
+        std::println("\tapply\t Encode the input file using an existing BPE table");
         std::println("\tdecode\t Decode an encoded file using a BPE table");
         std::println("\tinspect\t Inpsect a BPE table");
         std::println("\tgenerate\t Generate new text (gibberish) based on an BPE table");
+        std::println("\tserve\t Load a BPE table once and answer encode, decode and generate requests");
+        std::println("\tcompile\t Compile a BPE table into a single-pass encoder stored next to it in a container");
         std::println();
         std::println("Options:");
     }
@@ -30,23 +56,66 @@ void PrintUsage(std::string_view programName, BPE::SubCommand subCommand = BPE::
         {
             case BPE::SubCommand::Encode:
                 std::println();
-                std::println("Usage: {} encode -i <input> -b <bpe-output> [-t <token-output>]", programName);
+                std::println("Usage: {} encode -i <input> [-i <input> ...] -b <bpe-output> [-t <token-output>] [-c <container-output>] [--engine <engine>] [-j <threads>] [--memory-limit <MiB>] [--pre-tokenize] [--token-width <bits>] [--compact] [--block-index <tokens>] [--stats <file>] [--stats-interval <merges>] [--progress] [--max-merges <count>] [--checkpoint <file>] [--checkpoint-interval <merges>]", programName);
+                std::println("       {} encode --resume <checkpoint> -b <bpe-output> [options]", programName);
                 std::println();
                 std::println("Options:");
-                std::println("\t-i <file>\t Input file to encode (REQUIRED)");
-                std::println("\t-b <file>\t Output file containing the BPE table (REQUIRED)");
+                std::println("\t-i <input>\t Input file, directory or @<file-list> to encode, repeat for several inputs (REQUIRED)");
+                std::println("\t-b <file>\t Output file containing the BPE table (REQUIRED unless -c is given)");
                 std::println("\t-t <file>\t Output file containing the encoded tokens (optional)");
+                std::println("\t-c <file>\t Output container holding the BPE table and the encoded tokens, replaces or adds to -b (optional)");
+                std::println("\t--engine <name>\t Training engine, 'incremental' or 'legacy' (optional, default: incremental)");
+                std::println("\t-j <value>\t Number of threads used for counting pairs (optional, default: all cores)");
+                std::println("\t--memory-limit <MiB>\t Train without loading the input, spilling to disk above this limit (optional)");
+                std::println("\t--spill-dir <dir>\t Directory for spill files of --memory-limit (optional, default: temp directory)");
+                std::println("\t--pre-tokenize\t Train on the unique words of the input, so merges never cross word boundaries (optional)");
+                std::println("\t--token-width <bits>\t Width of the tokens, 8 (7-bit input only), 16 or 32 (optional, default: 16)");
+                std::println("\t--compact\t Write the tokens entropy coded instead of raw, decode detects this (optional)");
+                std::println("\t--block-index <tokens>\t Add an index of every n-th token to the container for 'decode --range' (optional, e.g. {})", BPE::DEFAULT_BLOCK_INDEX_STRIDE);
+                std::println("\t--stats <file>\t Write phase times, the merged pair, sequence length and memory per merge as JSON lines (optional)");
+                std::println("\t--stats-interval <merges>\t Write a stats line every n merges (optional, default: 1)");
+                std::println("\t--progress\t Print a progress line to stderr about once a second while training (optional)");
+                std::println("\t--max-merges <count>\t Stop training once the table holds this many merges (optional)");
+                std::println("\t--checkpoint <file>\t Save the training state to this file periodically and at the end (optional)");
+                std::println("\t--checkpoint-interval <merges>\t Merges between two checkpoints (optional, default: {})", BPE::DEFAULT_CHECKPOINT_INTERVAL);
+                std::println("\t--resume <file>\t Continue training from a checkpoint instead of from -i, uses the checkpoint's token width (optional)");
+                std::println();
+                break;
+
+            case BPE::SubCommand::Apply:
+                std::println();
+                std::println("Usage: {} apply -b <bpe-input> -i <input> -t <token-output> [-c <container-output>] [--compact] [--block-index <tokens>] [--stream] [--chunk-size <KiB>] [--pre-tokenize] [--cache-size <entries>] [--engine <engine>] [--verify] [-j <threads>]", programName);
+                std::println();
+                std::println("Options:");
+                std::println("\t-b <file>\t Input file containing the BPE table or a container (REQUIRED)");
+                std::println("\t-i <file>\t Input file to encode, '-' streams from stdin (REQUIRED)");
+                std::println("\t-t <file>\t Output file containing the encoded tokens, '-' streams to stdout (REQUIRED unless -c is given)");
+                std::println("\t-c <file>\t Output container holding the BPE table and the encoded tokens (optional)");
+                std::println("\t--compact\t Write the tokens entropy coded instead of raw, decode detects this (optional)");
+                std::println("\t--block-index <tokens>\t Add an index of every n-th token to the container for 'decode --range' (optional, e.g. {})", BPE::DEFAULT_BLOCK_INDEX_STRIDE);
+                std::println("\t--stream\t Encode in chunks, writing raw tokens as they become final. Memory is bounded by the table, except for text in which every byte pair occurs inside some token (optional)");
+                std::println("\t--chunk-size <KiB>\t Bytes read at a time when streaming (optional, default: {})", BPE::DEFAULT_STREAM_CHUNK_SIZE / 1024);
+                std::println("\t--pre-tokenize\t Encode word by word, for tables trained with 'encode --pre-tokenize' (optional)");
+                std::println("\t--cache-size <entries>\t Words whose tokens are remembered when pre-tokenizing (optional, default: {})", BPE::DEFAULT_TOKEN_CACHE_SIZE);
+                std::println("\t--engine <engine>\t Encoder to use: merges or compiled, which uses the encoder stored by 'compile' or compiles one (optional, default: merges)");
+                std::println("\t--verify\t Also apply the merges and fail if the compiled encoder's tokens differ (optional)");
+                std::println("\t-j <value>\t Number of threads encoding chunks of the input, split where no token can cross (optional, default: all cores)");
                 std::println();
                 break;
 
             case BPE::SubCommand::Decode:
                 std::println();
-                std::println("Usage: {} decode -b <bpe-input> -t <token-input> -o <output-file>", programName);
+                std::println("Usage: {} decode (-b <bpe-input> -t <token-input> | -c <container-input>) -o <output-file> [-j <threads>] [--range <start>:<length>] [--stream] [--chunk-size <KiB>]", programName);
                 std::println();
                 std::println("Options:");
-                std::println("\t-b <file>\t Input file containing the BPE table (REQUIRED)");
-                std::println("\t-t <file>\t Input file containing the encoded tokens (REQUIRED)");
-                std::println("\t-o <file>\t Output file containing the decoded text (REQUIRED)");
+                std::println("\t-b <file>\t Input file containing the BPE table (REQUIRED unless -c is given)");
+                std::println("\t-t <file>\t Input file containing the encoded tokens, raw or compact, '-' streams raw tokens from stdin (REQUIRED unless -c is given)");
+                std::println("\t-c <file>\t Input container holding both the BPE table and the encoded tokens");
+                std::println("\t-o <file>\t Output file containing the decoded text, '-' streams to stdout (REQUIRED)");
+                std::println("\t-j <value>\t Number of threads decoding into the output file (optional, default: all cores)");
+                std::println("\t--range <start>:<length>\t Decode only these bytes of the text, using the block index of a container. The token section's checksum is not verified, that would read every token (optional)");
+                std::println("\t--stream\t Decode raw tokens in chunks with constant memory, writing the text as it is decoded (optional)");
+                std::println("\t--chunk-size <KiB>\t Token bytes read at a time when streaming (optional, default: {})", BPE::DEFAULT_STREAM_CHUNK_SIZE / 1024);
                 std::println();
                 break;
 
@@ -55,99 +124,1465 @@ void PrintUsage(std::string_view programName, BPE::SubCommand subCommand = BPE::
                 std::println("Usage: {} inspect -b <bpe-input>", programName);
                 std::println();
                 std::println("Options:");
-                std::println("\t-b <file>\t Input file containing the BPE table (REQUIRED)");
+                std::println("\t-b <file>\t Input file containing the BPE table, or a container whose sections are listed too (REQUIRED)");
                 std::println();
                 break;
 
             case BPE::SubCommand::Generate:
                 std::println();
-                std::println("Usage: {} generate -b <bpe-input> -o <output-file> -l <token-length>", programName);
+                std::println("Usage: {} generate -b <bpe-input> [-o <output-file>] [-c <token-count>] [-s <seed>] [-q]", programName);
                 std::println();
                 std::println("Options:");
-                std::println("\t-b <file>\t Input file containing the BPE table (REQUIRED)");
+                std::println("\t-b <file>\t Input file containing the BPE table or a container (REQUIRED)");
                 std::println("\t-o <file>\t Output file to write the generate text to (optional)");
                 std::println("\t-c <value>\t Number of tokens to generate (optional, default: 10)");
+                std::println("\t-s <value>\t Seed for the random generator, the same seed generates the same text (optional, default: random)");
+                std::println("\t-q\t\t Quiet mode: skip the per-token trace and stream the text to the output (or stdout)");
+                std::println();
+                break;
+
+            case BPE::SubCommand::Serve:
+                std::println();
+                std::println("Usage: {} serve -b <bpe-input> [--socket <path>] [-j <threads>]", programName);
+                std::println();
+                std::println("Requests and responses are length-prefixed binary frames, see src/Server.h for the protocol.");
+                std::println("Latency percentiles per operation are printed to stderr when the server stops.");
+                std::println();
+                std::println("Options:");
+                std::println("\t-b <file>\t Input file containing the BPE table or a container (REQUIRED)");
+                std::println("\t--socket <path>\t Listen on this Unix domain socket instead of reading stdin and writing stdout (optional)");
+                std::println("\t-j <value>\t Number of threads answering a batch of requests (optional, default: all cores)");
+                std::println();
+                break;
+
+            case BPE::SubCommand::Compile:
                 std::println();
+                std::println("Usage: {} compile -b <bpe-input> -o <container-output>", programName);
+                std::println();
+                std::println("Options:");
+                std::println("\t-b <file>\t Input file containing the BPE table or a container (REQUIRED)");
+                std::println("\t-o <file>\t Output container holding the BPE table and its compiled encoder, for 'apply --engine compiled' (REQUIRED)");
+                std::println();
+                break;
+
+            default:
+                throw std::runtime_error("Subcommand not implemented");
                 break;
+        }
+    }
+
+    std::println("\t-h, --help\t Print this help message");
+    std::println();
+}
+
+// Calls function.template operator()<TokenType>() with the token type of the given width
+template <typename Function>
+int WithTokenType(BPE::TokenWidth tokenWidth, Function&& function)
+{
+    switch (tokenWidth)
+    {
+        case BPE::TokenWidth::Bits8:
+            return function.template operator()<char8_t>();
+        case BPE::TokenWidth::Bits16:
+            return function.template operator()<char16_t>();
+        case BPE::TokenWidth::Bits32:
+            return function.template operator()<char32_t>();
+    }
+
+    throw std::runtime_error("Token width not implemented");
+}
+
+// Raw tokens are written as they are, compact tokens are entropy coded with a code built from their frequencies
+template <typename TokenType>
+std::expected<void, std::string> TryWriteTokens(std::span<const TokenType> tokens, size_t vocabularySize, bool compact, const std::filesystem::path& tokenFilePath, unsigned threadCount)
+{
+    if (compact)
+    {
+        return BPE::TryWriteCompactTokenFile(tokens, vocabularySize, tokenFilePath, threadCount);
+    }
+
+    std::ofstream outputFile{tokenFilePath, std::ios::binary};
+
+    if (outputFile.is_open() == false)
+    {
+        return std::unexpected(std::format("ERROR: Unable to open or create output file at path \"{}\"", tokenFilePath.c_str()));
+    }
+
+    outputFile.write(reinterpret_cast<const char*>(tokens.data()), std::streamsize(tokens.size_bytes()));
+    outputFile.close();
+
+    return {};
+}
+
+std::optional<unsigned> ParseThreadCount(std::string_view arg)
+{
+    try
+    {
+        int threadCount{std::stoi(arg.data(), nullptr, 0)};
+
+        if (threadCount <= 0)
+        {
+            std::println("ERROR: Thread count should be greater than zero.");
+            return std::nullopt;
+        }
+
+        return unsigned(threadCount);
+    }
+    catch (std::invalid_argument const& ex)
+    {
+        std::println("ERROR: Unable to parse {} to int", arg);
+        return std::nullopt;
+    }
+    catch (std::out_of_range const& ex)
+    {
+        std::println("ERROR: Thread count was out of range");
+        return std::nullopt;
+    }
+}
+
+std::optional<size_t> ParseBlockIndexStride(std::string_view arg)
+{
+    try
+    {
+        long long stride{std::stoll(arg.data(), nullptr, 0)};
+
+        if (stride <= 0)
+        {
+            std::println("ERROR: Block index stride should be greater than zero.");
+            return std::nullopt;
+        }
+
+        return size_t(stride);
+    }
+    catch (std::invalid_argument const& ex)
+    {
+        std::println("ERROR: Unable to parse {} to int", arg);
+        return std::nullopt;
+    }
+    catch (std::out_of_range const& ex)
+    {
+        std::println("ERROR: Block index stride was out of range");
+        return std::nullopt;
+    }
+}
+
+// Parses a count of merges, `name` is what the count stands for in error messages
+std::optional<uint64_t> ParseMergeCount(std::string_view arg, std::string_view name)
+{
+    try
+    {
+        long long count{std::stoll(arg.data(), nullptr, 0)};
+
+        if (count <= 0)
+        {
+            std::println("ERROR: {} should be greater than zero.", name);
+            return std::nullopt;
+        }
+
+        return uint64_t(count);
+    }
+    catch (std::invalid_argument const& ex)
+    {
+        std::println("ERROR: Unable to parse {} to int", arg);
+        return std::nullopt;
+    }
+    catch (std::out_of_range const& ex)
+    {
+        std::println("ERROR: {} was out of range", name);
+        return std::nullopt;
+    }
+}
+
+// Parses "<start>:<length>" into the byte offset and the byte count of a range
+std::optional<std::pair<uint64_t, uint64_t>> ParseRange(std::string_view arg)
+{
+    size_t separator{arg.find(':')};
+
+    if (separator == std::string_view::npos)
+    {
+        std::println("ERROR: Range '{}' should look like <start>:<length>", arg);
+        return std::nullopt;
+    }
+
+    try
+    {
+        std::string start{arg.substr(0, separator)};
+        std::string length{arg.substr(separator + 1)};
+
+        if (start.empty() || length.empty() || start.front() == '-' || length.front() == '-')
+        {
+            std::println("ERROR: Range '{}' should look like <start>:<length>", arg);
+            return std::nullopt;
+        }
+
+        return std::pair<uint64_t, uint64_t>{std::stoull(start, nullptr, 0), std::stoull(length, nullptr, 0)};
+    }
+    catch (std::invalid_argument const& ex)
+    {
+        std::println("ERROR: Unable to parse {} to a range", arg);
+        return std::nullopt;
+    }
+    catch (std::out_of_range const& ex)
+    {
+        std::println("ERROR: Range was out of range");
+        return std::nullopt;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    BPE::SubCommand subCommand{BPE::SubCommand::NONE};
+
+    std::string_view programName{argv[0]};
+
+    std::queue<std::string_view> args{argv + 1, argv + argc};
+
+    if (args.size() <= 0)
+    {
+        std::println(stderr, "ERROR: Missing command");
+        PrintUsage(programName);
+        return 1;
+    }
+
+    std::string_view subCommandArg{args.front()};
+    args.pop();
+
+    if (subCommandArg == "encode") subCommand = BPE::SubCommand::Encode;
+    else if (subCommandArg == "apply") subCommand = BPE::SubCommand::Apply;
+    else if (subCommandArg == "decode") subCommand = BPE::SubCommand::Decode;
+    else if (subCommandArg == "inspect") subCommand = BPE::SubCommand::Inspect;
+    else if (subCommandArg == "generate") subCommand = BPE::SubCommand::Generate;
+    else if (subCommandArg == "serve") subCommand = BPE::SubCommand::Serve;
+    else if (subCommandArg == "compile") subCommand = BPE::SubCommand::Compile;
+    else if (subCommandArg == "-h" || subCommandArg == "--help")
+    {
+        PrintUsage(programName);
+        return 0;
+    }
+    else
+    {
+        std::println(stderr, "ERROR: Unknown command {}", subCommandArg);
+        PrintUsage(programName);
+        return 1;
+    }
+
+    if (args.size() > 0 && (args.front() == "-h" || args.front() == "--help"))
+    {
+        PrintUsage(programName, subCommand);
+        return 0;
+    }
+
+    switch (subCommand)
+    {
+        case BPE::SubCommand::Encode:
+        {
+            std::vector<std::filesystem::path> inputPaths{};
+            std::filesystem::path bpeFilePath{};
+            std::filesystem::path tokenFilePath{};
+            std::filesystem::path containerFilePath{};
+            BPE::TokenWidth tokenWidth{BPE::TokenWidth::Bits16};
+            bool compactTokens{false};
+            size_t blockIndexStride{0};
+            std::filesystem::path statsFilePath{};
+            uint64_t statsInterval{1};
+            bool progress{false};
+            std::filesystem::path resumeFilePath{};
+            bool tokenWidthGiven{false};
+            BPE::BpeEncodingOptions encodingOptions{};
+            encodingOptions.ThreadCount = std::max(std::thread::hardware_concurrency(), 1u);
+            encodingOptions.CheckpointInterval = BPE::DEFAULT_CHECKPOINT_INTERVAL;
+
+            while (args.size() > 0)
+            {
+                std::string_view arg{args.front()};
+                args.pop();
+
+                if (arg == "-i")
+                {
+                    inputPaths.emplace_back(args.front());
+                    args.pop();
+                }
+                else if (arg == "-b")
+                {
+                    bpeFilePath = args.front();
+                    args.pop();
+                }
+                else if (arg == "-t")
+                {
+                    tokenFilePath = args.front();
+                    args.pop();
+                }
+                else if (arg == "-c")
+                {
+                    containerFilePath = args.front();
+                    args.pop();
+                }
+                else if (arg == "--engine")
+                {
+                    if (args.front() == "incremental") encodingOptions.Engine = BPE::EncodingEngine::Incremental;
+                    else if (args.front() == "legacy") encodingOptions.Engine = BPE::EncodingEngine::Legacy;
+                    else
+                    {
+                        std::println(stderr, "ERROR: Unknown engine '{}'", args.front());
+                        PrintUsage(programName, subCommand);
+                        return 1;
+                    }
+
+                    args.pop();
+                }
+                else if (arg == "-j")
+                {
+                    std::optional<unsigned> threadCount{ParseThreadCount(args.front())};
+                    if (!threadCount.has_value())
+                    {
+                        return 1;
+                    }
+
+                    encodingOptions.ThreadCount = threadCount.value();
+                    args.pop();
+                }
+                else if (arg == "--memory-limit")
+                {
+                    try
+                    {
+                        long long memoryLimit{std::stoll(args.front().data(), nullptr, 0)};
+
+                        if (memoryLimit <= 0)
+                        {
+                            std::println("ERROR: Memory limit should be greater than zero.");
+                            return 1;
+                        }
+
+                        encodingOptions.MemoryLimit = uint64_t(memoryLimit) * 1024 * 1024;
+                    }
+                    catch (std::invalid_argument const& ex)
+                    {
+                        std::println("ERROR: Unable to parse {} to int", args.front());
+                        return 1;
+                    }
+                    catch (std::out_of_range const& ex)
+                    {
+                        std::println("ERROR: Memory limit was out of range");
+                        return 1;
+                    }
+
+                    args.pop();
+                }
+                else if (arg == "--spill-dir")
+                {
+                    encodingOptions.SpillDirectory = args.front();
+                    args.pop();
+                }
+                else if (arg == "--pre-tokenize")
+                {
+                    encodingOptions.PreTokenize = true;
+                }
+                else if (arg == "--compact")
+                {
+                    compactTokens = true;
+                }
+                else if (arg == "--block-index")
+                {
+                    std::optional<size_t> stride{ParseBlockIndexStride(args.front())};
+                    if (!stride.has_value())
+                    {
+                        return 1;
+                    }
+
+                    blockIndexStride = stride.value();
+                    args.pop();
+                }
+                else if (arg == "--stats")
+                {
+                    statsFilePath = args.front();
+                    args.pop();
+                }
+                else if (arg == "--stats-interval")
+                {
+                    std::optional<uint64_t> interval{ParseMergeCount(args.front(), "Stats interval")};
+                    if (!interval.has_value())
+                    {
+                        return 1;
+                    }
+
+                    statsInterval = interval.value();
+                    args.pop();
+                }
+                else if (arg == "--progress")
+                {
+                    progress = true;
+                }
+                else if (arg == "--max-merges" || arg == "--checkpoint-interval")
+                {
+                    std::optional<uint64_t> count{ParseMergeCount(args.front(), arg == "--max-merges" ? "Maximum merge count" : "Checkpoint interval")};
+                    if (!count.has_value())
+                    {
+                        return 1;
+                    }
+
+                    (arg == "--max-merges" ? encodingOptions.MaxMerges : encodingOptions.CheckpointInterval) = count.value();
+                    args.pop();
+                }
+                else if (arg == "--checkpoint")
+                {
+                    encodingOptions.CheckpointPath = args.front();
+                    args.pop();
+                }
+                else if (arg == "--resume")
+                {
+                    resumeFilePath = args.front();
+                    args.pop();
+                }
+                else if (arg == "--token-width")
+                {
+                    if (args.front() == "8") tokenWidth = BPE::TokenWidth::Bits8;
+                    else if (args.front() == "16") tokenWidth = BPE::TokenWidth::Bits16;
+                    else if (args.front() == "32") tokenWidth = BPE::TokenWidth::Bits32;
+                    else
+                    {
+                        std::println(stderr, "ERROR: Token width should be 8, 16 or 32, not '{}'", args.front());
+                        PrintUsage(programName, subCommand);
+                        return 1;
+                    }
+
+                    tokenWidthGiven = true;
+                    args.pop();
+                }
+                else
+                {
+                    std::println("ERROR: Unknown option '{}'", arg);
+                    PrintUsage(programName, subCommand);
+                    return 1;
+                }
+            }
+
+            if (inputPaths.empty() && resumeFilePath.empty())
+            {
+                std::println(stderr, "ERROR: Missing option '-i <file>'");
+                PrintUsage(programName, subCommand);
+                return 1;
+            }
+
+            if (!inputPaths.empty() && !resumeFilePath.empty())
+            {
+                std::println(stderr, "ERROR: Option '--resume' continues from the checkpoint's tokens and cannot be combined with '-i'");
+                PrintUsage(programName, subCommand);
+                return 1;
+            }
+
+            // A resumed run takes its tokens from the checkpoint, not from input files
+            std::vector<std::filesystem::path> inputFiles{};
+
+            if (!inputPaths.empty())
+            {
+                std::expected<std::vector<std::filesystem::path>, std::string> collectResult{BPE::TryCollectInputFiles(inputPaths)};
+                if (!collectResult.has_value())
+                {
+                    std::println(stderr, "{}", collectResult.error());
+                    return 1;
+                }
+
+                inputFiles = std::move(collectResult.value());
+            }
+
+            // A single input file keeps the single-text engines, several files are read as a corpus of documents
+            std::filesystem::path inputFilePath{inputFiles.empty() ? resumeFilePath : inputFiles.front()};
+            bool corpusInput{inputFiles.size() > 1};
+
+            if (corpusInput && (encodingOptions.MemoryLimit > 0 || encodingOptions.Engine == BPE::EncodingEngine::Legacy))
+            {
+                std::println(stderr, "ERROR: Several input files cannot be combined with '--memory-limit' or '--engine legacy'");
+                PrintUsage(programName, subCommand);
+                return 1;
+            }
+
+            if (bpeFilePath.empty() && containerFilePath.empty())
+            {
+                std::println(stderr, "ERROR: Missing option '-b <file>' or '-c <file>'");
+                PrintUsage(programName, subCommand);
+                return 1;
+            }
+
+            if (blockIndexStride > 0 && containerFilePath.empty())
+            {
+                std::println(stderr, "ERROR: Option '--block-index' needs a container output '-c <file>'");
+                PrintUsage(programName, subCommand);
+                return 1;
+            }
+
+            if (encodingOptions.PreTokenize && (encodingOptions.MemoryLimit > 0 || encodingOptions.Engine == BPE::EncodingEngine::Legacy))
+            {
+                std::println(stderr, "ERROR: Option '--pre-tokenize' cannot be combined with '--memory-limit' or '--engine legacy'");
+                PrintUsage(programName, subCommand);
+                return 1;
+            }
+
+            // Only the incremental engine keeps the token sequence a checkpoint is made of
+            if ((!encodingOptions.CheckpointPath.empty() || !resumeFilePath.empty()) && (encodingOptions.MemoryLimit > 0 || encodingOptions.PreTokenize || encodingOptions.Engine == BPE::EncodingEngine::Legacy))
+            {
+                std::println(stderr, "ERROR: Options '--checkpoint' and '--resume' cannot be combined with '--memory-limit', '--pre-tokenize' or '--engine legacy'");
+                PrintUsage(programName, subCommand);
+                return 1;
+            }
+
+            if (!resumeFilePath.empty())
+            {
+                std::expected<BPE::TokenWidth, std::string> checkpointWidth{BPE::TryReadTokenWidth(resumeFilePath)};
+                if (!checkpointWidth.has_value())
+                {
+                    std::println(stderr, "{}", checkpointWidth.error());
+                    return 1;
+                }
+
+                if (tokenWidthGiven && checkpointWidth.value() != tokenWidth)
+                {
+                    std::println(stderr, "ERROR: The checkpoint holds {}-bit tokens, which '--token-width' cannot change", 8 * size_t(checkpointWidth.value()));
+                    return 1;
+                }
+
+                tokenWidth = checkpointWidth.value();
+            }
+
+            std::ofstream statsFile{};
+            std::optional<BPE::TrainingMonitor> monitor{};
+
+            if (!statsFilePath.empty())
+            {
+                statsFile.open(statsFilePath);
+
+                if (statsFile.is_open() == false)
+                {
+                    std::println(stderr, "ERROR: Unable to open or create stats file at path \"{}\"", statsFilePath.c_str());
+                    return 1;
+                }
+            }
+
+            if (!statsFilePath.empty() || progress)
+            {
+                monitor.emplace(statsFilePath.empty() ? nullptr : &statsFile, statsInterval, progress);
+                encodingOptions.Monitor = &monitor.value();
+            }
+
+            int result{WithTokenType(tokenWidth, [&]<typename TokenType>() -> int
+            {
+                std::basic_string<TokenType> bpeTable{};
+                BPE::BpeEncodingResultInfo info{};
+
+                // The tokens that end up in the token file and/or the container
+                std::basic_string<TokenType> encodedString{};
+                std::optional<BPE::MappedFile<TokenType>> rawTokens{};
+                std::span<const TokenType> tokens{};
+                bool tokenFileWritten{false};
+
+                if (!resumeFilePath.empty())
+                {
+                    std::expected<BPE::TrainingCheckpoint<TokenType>, std::string> checkpoint{BPE::TryReadCheckpoint<TokenType>(resumeFilePath)};
+                    if (!checkpoint.has_value())
+                    {
+                        std::println(stderr, "{}", checkpoint.error());
+                        return 1;
+                    }
+
+                    BPE::TrainingCheckpoint<TokenType>& state{checkpoint.value()};
+                    BPE::ContinueEncodingIncremental<TokenType>(state.EncodedString, state.BpeTable, state.EncodingInfo, encodingOptions, state.DocumentStarts);
+
+                    bpeTable = std::move(state.BpeTable);
+                    encodedString = std::move(state.EncodedString);
+                    info = state.EncodingInfo;
+                    tokens = encodedString;
+                }
+                else if (encodingOptions.MemoryLimit > 0)
+                {
+                    // Writes the tokens itself, they may not fit into memory. Compact tokens and containers are written
+                    // from a raw copy afterwards.
+                    std::filesystem::path rawTokenFilePath{tokenFilePath};
+                    if (compactTokens || !containerFilePath.empty())
+                    {
+                        rawTokenFilePath = (tokenFilePath.empty() ? containerFilePath : tokenFilePath);
+                        rawTokenFilePath += ".raw";
+                    }
+
+                    auto encodeResult{BPE::TryEncodeFileOutOfCore<TokenType>(inputFilePath, rawTokenFilePath, encodingOptions)};
+                    if (!encodeResult.has_value())
+                    {
+                        std::println(stderr, "{}", encodeResult.error());
+                        return 1;
+                    }
+
+                    std::tie(bpeTable, info) = std::move(encodeResult.value());
+                    tokenFileWritten = rawTokenFilePath == tokenFilePath;
+
+                    if (!rawTokenFilePath.empty() && !tokenFileWritten)
+                    {
+                        std::expected<BPE::MappedFile<TokenType>, std::string> mapResult{BPE::TryMapFile<TokenType>(rawTokenFilePath)};
+                        std::filesystem::remove(rawTokenFilePath);
+
+                        if (!mapResult.has_value())
+                        {
+                            std::println(stderr, "{}", mapResult.error());
+                            return 1;
+                        }
+
+                        rawTokens.emplace(std::move(mapResult.value()));
+                        tokens = rawTokens.value().Span();
+                    }
+                }
+                else if (corpusInput)
+                {
+                    BPE::Corpus corpus{};
+
+                    std::expected<void, std::string> readResult{BPE::TryReadCorpus(inputFiles, encodingOptions.ThreadCount, encodingOptions.PreTokenize, corpus)};
+                    if (!readResult.has_value())
+                    {
+                        std::println(stderr, "{}", readResult.error());
+                        return 1;
+                    }
+
+                    std::expected<void, std::string> validationResult{BPE::TryValidateInput<TokenType>(corpus.Text)};
+                    if (!validationResult.has_value())
+                    {
+                        std::println(stderr, "{}", validationResult.error());
+                        return 1;
+                    }
+
+                    auto encodeResult{BPE::TryEncodeCorpus<TokenType>(corpus, encodingOptions)};
+                    if (!encodeResult.has_value())
+                    {
+                        std::println(stderr, "{}", encodeResult.error());
+                        return 1;
+                    }
+
+                    std::tie(bpeTable, encodedString, info) = std::move(encodeResult.value());
+                    tokens = encodedString;
+                }
+                else
+                {
+                    std::expected<std::string, std::string> inputData{BPE::TryReadFileIntoContainer<std::string>(inputFilePath)};
+                    if (!inputData.has_value())
+                    {
+                        std::println(stderr, "{}", inputData.error());
+                        return 1;
+                    }
+
+                    std::expected<void, std::string> validationResult{BPE::TryValidateInput<TokenType>(inputData.value())};
+                    if (!validationResult.has_value())
+                    {
+                        std::println(stderr, "{}", validationResult.error());
+                        return 1;
+                    }
+
+                    std::tie(bpeTable, encodedString, info) = BPE::EncodeText<TokenType>(inputData.value(), encodingOptions);
+                    tokens = encodedString;
+                }
+
+                if (monitor.has_value())
+                {
+                    monitor.value().Finish(info);
+                }
+
+                if (!tokenFilePath.empty() && !tokenFileWritten)
+                {
+                    std::expected<void, std::string> writeTokensResult{TryWriteTokens(tokens, BPE::FIRST_TOKEN<TokenType> + bpeTable.size() / 2, compactTokens, tokenFilePath, encodingOptions.ThreadCount)};
+                    if (!writeTokensResult.has_value())
+                    {
+                        std::println(stderr, "{}", writeTokensResult.error());
+                        return 1;
+                    }
+                }
+
+                if (!containerFilePath.empty())
+                {
+                    std::string metadata{std::format("source={}\nfiles={}\nmerges={}\n", inputFilePath.c_str(), inputFiles.size(), bpeTable.size() / 2)};
+
+                    std::expected<void, std::string> writeContainerResult{BPE::TryWriteContainerFile<TokenType>(containerFilePath, bpeTable, tokens, compactTokens, metadata, blockIndexStride, encodingOptions.ThreadCount)};
+                    if (!writeContainerResult.has_value())
+                    {
+                        std::println(stderr, "{}", writeContainerResult.error());
+                        return 1;
+                    }
+                }
+
+                if (!bpeFilePath.empty())
+                {
+                    std::expected<void, std::string> writeBpeTableResult = BPE::TryWriteBpeTableToFile(bpeTable, bpeFilePath);
+                    if (!writeBpeTableResult.has_value())
+                    {
+                        std::println(stderr, "{}", writeBpeTableResult.error());
+                        return 1;
+                    }
+                }
+
+                if (info.TableFull)
+                {
+                    std::println(stderr, "WARNING: Stopped after {} merges, {}-bit tokens cannot hold more. Use a wider --token-width to keep merging.", info.EncodingIterationCount, 8 * sizeof(TokenType));
+                }
+
+                if (tokenFilePath.empty() && containerFilePath.empty())
+                {
+                    std::println("Successfully encoded in {} iterations.", info.EncodingIterationCount);
+                }
+                else
+                {
+                    std::println("Succesfully encoded {} tokens to {} tokens in {} iterations.", info.EncodedStringInitialLength, info.EncodedStringLength, info.EncodingIterationCount);
+                }
+
+                return 0;
+            })};
+
+            if (result != 0)
+            {
+                return result;
+            }
+
+            break;
+        }
+        case BPE::SubCommand::Apply:
+        {
+            std::filesystem::path bpeFilePath{};
+            std::filesystem::path inputFilePath{};
+            std::filesystem::path tokenFilePath{};
+            std::filesystem::path containerFilePath{};
+            bool compactTokens{false};
+            size_t blockIndexStride{0};
+            bool stream{false};
+            size_t chunkSize{BPE::DEFAULT_STREAM_CHUNK_SIZE};
+            bool preTokenize{false};
+            size_t cacheSize{BPE::DEFAULT_TOKEN_CACHE_SIZE};
+            BPE::ApplyEngine applyEngine{BPE::ApplyEngine::Merges};
+            bool verify{false};
+            unsigned threadCount{std::max(std::thread::hardware_concurrency(), 1u)};
+
+            while (args.size() > 0)
+            {
+                std::string_view arg{args.front()};
+                args.pop();
+
+                if (arg == "-b")
+                {
+                    bpeFilePath = args.front();
+                    args.pop();
+                }
+                else if (arg == "-i")
+                {
+                    inputFilePath = args.front();
+                    args.pop();
+                }
+                else if (arg == "-t")
+                {
+                    tokenFilePath = args.front();
+                    args.pop();
+                }
+                else if (arg == "-c")
+                {
+                    containerFilePath = args.front();
+                    args.pop();
+                }
+                else if (arg == "--compact")
+                {
+                    compactTokens = true;
+                }
+                else if (arg == "--block-index")
+                {
+                    std::optional<size_t> stride{ParseBlockIndexStride(args.front())};
+                    if (!stride.has_value())
+                    {
+                        return 1;
+                    }
+
+                    blockIndexStride = stride.value();
+                    args.pop();
+                }
+                else if (arg == "--stream")
+                {
+                    stream = true;
+                }
+                else if (arg == "--chunk-size")
+                {
+                    std::optional<uint64_t> chunkKib{ParseMergeCount(args.front(), "Chunk size")};
+                    if (!chunkKib.has_value())
+                    {
+                        return 1;
+                    }
+
+                    chunkSize = size_t(chunkKib.value()) * 1024;
+                    args.pop();
+                }
+                else if (arg == "--pre-tokenize")
+                {
+                    preTokenize = true;
+                }
+                else if (arg == "--cache-size")
+                {
+                    std::optional<uint64_t> entries{ParseMergeCount(args.front(), "Cache size")};
+                    if (!entries.has_value())
+                    {
+                        return 1;
+                    }
+
+                    cacheSize = size_t(entries.value());
+                    args.pop();
+                }
+                else if (arg == "--engine")
+                {
+                    if (args.front() == "merges") applyEngine = BPE::ApplyEngine::Merges;
+                    else if (args.front() == "compiled") applyEngine = BPE::ApplyEngine::Compiled;
+                    else
+                    {
+                        std::println(stderr, "ERROR: Unknown engine '{}'", args.front());
+                        PrintUsage(programName, subCommand);
+                        return 1;
+                    }
+
+                    args.pop();
+                }
+                else if (arg == "--verify")
+                {
+                    verify = true;
+                }
+                else if (arg == "-j")
+                {
+                    std::optional<unsigned> threads{ParseThreadCount(args.front())};
+                    if (!threads.has_value())
+                    {
+                        return 1;
+                    }
+
+                    threadCount = threads.value();
+                    args.pop();
+                }
+                else
+                {
+                    std::println("ERROR: Unknown option '{}'", arg);
+                    PrintUsage(programName, subCommand);
+                    return 1;
+                }
+            }
+
+            if (bpeFilePath.empty())
+            {
+                std::println(stderr, "ERROR: Missing option '-b <file>'");
+                PrintUsage(programName, subCommand);
+                return 1;
+            }
+
+            stream = stream || inputFilePath == "-" || tokenFilePath == "-";
+
+            if (stream && (!containerFilePath.empty() || compactTokens || blockIndexStride > 0))
+            {
+                std::println(stderr, "ERROR: Streaming writes raw tokens only, it cannot be combined with '-c', '--compact' or '--block-index'");
+                PrintUsage(programName, subCommand);
+                return 1;
+            }
+
+            if (stream && preTokenize)
+            {
+                std::println(stderr, "ERROR: Option '--pre-tokenize' cannot be combined with streaming");
+                PrintUsage(programName, subCommand);
+                return 1;
+            }
+
+            if (applyEngine == BPE::ApplyEngine::Compiled && (stream || preTokenize))
+            {
+                std::println(stderr, "ERROR: Option '--engine compiled' cannot be combined with streaming or '--pre-tokenize'");
+                PrintUsage(programName, subCommand);
+                return 1;
+            }
+
+            if (verify && applyEngine != BPE::ApplyEngine::Compiled)
+            {
+                std::println(stderr, "ERROR: Option '--verify' checks the compiled encoder, it needs '--engine compiled'");
+                PrintUsage(programName, subCommand);
+                return 1;
+            }
+
+            if (inputFilePath.empty())
+            {
+                std::println(stderr, "ERROR: Missing option '-i <file>'");
+                PrintUsage(programName, subCommand);
+                return 1;
+            }
+
+            if (tokenFilePath.empty() && containerFilePath.empty())
+            {
+                std::println(stderr, "ERROR: Missing option '-t <file>' or '-c <file>'");
+                PrintUsage(programName, subCommand);
+                return 1;
+            }
+
+            if (blockIndexStride > 0 && containerFilePath.empty())
+            {
+                std::println(stderr, "ERROR: Option '--block-index' needs a container output '-c <file>'");
+                PrintUsage(programName, subCommand);
+                return 1;
+            }
+
+            std::expected<BPE::TokenWidth, std::string> tokenWidth{BPE::TryReadTokenWidth(bpeFilePath)};
+            if (!tokenWidth.has_value())
+            {
+                std::println(stderr, "{}", tokenWidth.error());
+                return 1;
+            }
+
+            int result{WithTokenType(tokenWidth.value(), [&]<typename TokenType>() -> int
+            {
+                std::expected<BPE::MappedFile<std::pair<TokenType, TokenType>>, std::string> bpeTable{BPE::TryMapBpeTable<TokenType>(bpeFilePath)};
+                if (!bpeTable.has_value())
+                {
+                    std::println(stderr, "{}", bpeTable.error());
+                    return 1;
+                }
+
+                if (stream)
+                {
+                    std::ifstream inputFile{};
+                    std::ofstream outputFile{};
+
+                    if (inputFilePath != "-")
+                    {
+                        inputFile.open(inputFilePath, std::ios::binary);
+
+                        if (inputFile.is_open() == false)
+                        {
+                            std::println(stderr, "ERROR: Unable to open input file at path \"{}\"", inputFilePath.c_str());
+                            return 1;
+                        }
+                    }
+
+                    if (tokenFilePath != "-")
+                    {
+                        outputFile.open(tokenFilePath, std::ios::binary);
+
+                        if (outputFile.is_open() == false)
+                        {
+                            std::println(stderr, "ERROR: Unable to open or create output file at path \"{}\"", tokenFilePath.c_str());
+                            return 1;
+                        }
+                    }
+
+                    std::expected<BPE::BpeEncodingResultInfo, std::string> streamResult{BPE::TryApplyBpeTableStream<TokenType>(bpeTable.value().Span(), inputFilePath == "-" ? std::cin : inputFile, tokenFilePath == "-" ? std::cout : outputFile, chunkSize)};
+                    if (!streamResult.has_value())
+                    {
+                        std::println(stderr, "{}", streamResult.error());
+                        return 1;
+                    }
+
+                    // The tokens may be going to stdout
+                    BPE::BpeEncodingResultInfo info{streamResult.value()};
+                    std::println(stderr, "Successfully encoded {} tokens to {} tokens using {} merges.", info.EncodedStringInitialLength, info.EncodedStringLength, info.EncodingIterationCount);
+
+                    return 0;
+                }
+
+                std::expected<std::string, std::string> inputData{BPE::TryReadFileIntoContainer<std::string>(inputFilePath)};
+                if (!inputData.has_value())
+                {
+                    std::println(stderr, "{}", inputData.error());
+                    return 1;
+                }
+
+                std::expected<void, std::string> validationResult{BPE::TryValidateInput<TokenType>(inputData.value())};
+                if (!validationResult.has_value())
+                {
+                    std::println(stderr, "{}", validationResult.error());
+                    return 1;
+                }
+
+                std::span<const std::pair<TokenType, TokenType>> merges{bpeTable.value().Span()};
+                BPE::PairRanks<TokenType> ranks{};
+                std::optional<BPE::CompiledEncoder<TokenType>> compiledEncoder{};
+                BPE::ChunkEncoder<TokenType> encodeChunk{};
+
+                // Mapped again for its compiled encoder section, which has to stay mapped while encoding
+                std::optional<BPE::FileMapping> tableFile{};
+
+                // Per worker of TryApplyBpeTableParallel, created by the first chunk the worker encodes
+                std::vector<std::optional<BPE::TokenCache<TokenType>>> caches(threadCount);
+                std::vector<BPE::ApplyScratch<TokenType>> scratches(threadCount);
+                std::vector<BPE::CompiledScratch> compiledScratches(threadCount);
+
+                if (applyEngine == BPE::ApplyEngine::Compiled)
+                {
+                    std::expected<BPE::FileMapping, std::string> mapping{BPE::FileMapping::TryMap(bpeFilePath)};
+                    if (!mapping.has_value())
+                    {
+                        std::println(stderr, "{}", mapping.error());
+                        return 1;
+                    }
+
+                    tableFile.emplace(std::move(mapping.value()));
+
+                    std::span<const std::byte> tableBytes{tableFile.value().Bytes()};
+                    std::expected<BPE::CompiledEncoder<TokenType>, std::string> encoder{std::unexpected{""}};
+
+                    if (BPE::IsContainerFile(tableBytes) && BPE::HasContainerSection(tableBytes, BPE::SectionType::CompiledEncoder))
+                    {
+                        std::expected<std::span<const std::byte>, std::string> section{BPE::TryGetContainerSection(tableBytes, BPE::SectionType::CompiledEncoder)};
+                        encoder = section.has_value() ? BPE::CompiledEncoder<TokenType>::TryLoad(merges, section.value()) : std::unexpected{section.error()};
+                    }
+                    else
+                    {
+                        std::println("No compiled encoder stored with the table, compiling one (store it with 'compile').");
+                        encoder = BPE::CompiledEncoder<TokenType>::TryCompile(merges);
+                    }
+
+                    if (!encoder.has_value())
+                    {
+                        std::println(stderr, "{}", encoder.error());
+                        return 1;
+                    }
+
+                    compiledEncoder.emplace(std::move(encoder.value()));
+
+                    encodeChunk = [&](std::span<const std::byte> chunk, std::span<TokenType> output, unsigned worker)
+                    {
+                        return compiledEncoder.value().TryEncodeInto(chunk, compiledScratches[worker], output);
+                    };
+                }
+                else if (preTokenize)
+                {
+                    ranks = BPE::BuildPairRanks<TokenType>(merges);
+
+                    encodeChunk = [&](std::span<const std::byte> chunk, std::span<TokenType> output, unsigned worker)
+                    {
+                        if (!caches[worker].has_value())
+                        {
+                            caches[worker].emplace(cacheSize);
+                        }
+
+                        return BPE::TryApplyBpeTableWordsInto<TokenType>(chunk, ranks, scratches[worker], caches[worker].value(), output);
+                    };
+                }
+                else
+                {
+                    ranks = BPE::BuildPairRanks<TokenType>(merges);
+
+                    encodeChunk = [&](std::span<const std::byte> chunk, std::span<TokenType> output, unsigned worker)
+                    {
+                        return BPE::TryApplyBpeTableInto<TokenType>(chunk, ranks, scratches[worker], output);
+                    };
+                }
+
+                // Raw tokens are written while later chunks are still being encoded, everything else needs all of them
+                bool writeTokenFile{!tokenFilePath.empty() && !compactTokens && !verify};
+                std::basic_string<TokenType> encodedString{};
+                std::ofstream tokenFile{};
+
+                if (writeTokenFile)
+                {
+                    tokenFile.open(tokenFilePath, std::ios::binary);
+
+                    if (tokenFile.is_open() == false)
+                    {
+                        std::println(stderr, "ERROR: Unable to open or create output file at path \"{}\"", tokenFilePath.c_str());
+                        return 1;
+                    }
+                }
+
+                BPE::ChunkWriter<TokenType> writeChunk{[&](std::span<const TokenType> chunkTokens) -> std::expected<void, std::string>
+                {
+                    if (writeTokenFile && !tokenFile.write(reinterpret_cast<const char*>(chunkTokens.data()), std::streamsize(chunkTokens.size_bytes())))
+                    {
+                        return std::unexpected{std::format("ERROR: Unable to write to output file at path \"{}\"", tokenFilePath.c_str())};
+                    }
+
+                    if (!writeTokenFile || !containerFilePath.empty())
+                    {
+                        encodedString.append(chunkTokens.begin(), chunkTokens.end());
+                    }
+
+                    return {};
+                }};
+
+                std::expected<BPE::BpeEncodingResultInfo, std::string> applyResult{BPE::TryApplyBpeTableParallel<TokenType>(merges, inputData.value(), preTokenize, encodeChunk, writeChunk, threadCount)};
+                if (!applyResult.has_value())
+                {
+                    std::println(stderr, "{}", applyResult.error());
+                    return 1;
+                }
+
+                BPE::BpeEncodingResultInfo info{applyResult.value()};
+
+                if (verify)
+                {
+                    auto [mergedString, mergedInfo]{BPE::ApplyBpeTable(inputData.value(), merges)};
+                    auto mismatch{std::mismatch(encodedString.begin(), encodedString.end(), mergedString.begin(), mergedString.end())};
+
+                    if (mismatch.first != encodedString.end() || mismatch.second != mergedString.end())
+                    {
+                        std::println(stderr, "ERROR: Compiled encoder differs from applying the merges at token {}", mismatch.first - encodedString.begin());
+                        return 1;
+                    }
+
+                    std::println("Verified the {} tokens against applying the merges.", encodedString.size());
+                }
+
+                if (!tokenFilePath.empty() && !writeTokenFile)
+                {
+                    std::expected<void, std::string> writeTokensResult{TryWriteTokens<TokenType>(encodedString, BPE::FIRST_TOKEN<TokenType> + merges.size(), compactTokens, tokenFilePath, threadCount)};
+                    if (!writeTokensResult.has_value())
+                    {
+                        std::println(stderr, "{}", writeTokensResult.error());
+                        return 1;
+                    }
+                }
+
+                if (!containerFilePath.empty())
+                {
+                    // The merges as one flat run of tokens, the layout they have in table files
+                    std::span<const TokenType> flatTable{reinterpret_cast<const TokenType*>(merges.data()), 2 * merges.size()};
+                    std::string metadata{std::format("source={}\ntable={}\n", inputFilePath.c_str(), bpeFilePath.c_str())};
+
+                    std::expected<void, std::string> writeContainerResult{BPE::TryWriteContainerFile<TokenType>(containerFilePath, flatTable, encodedString, compactTokens, metadata, blockIndexStride, threadCount)};
+                    if (!writeContainerResult.has_value())
+                    {
+                        std::println(stderr, "{}", writeContainerResult.error());
+                        return 1;
+                    }
+                }
+
+                std::println("Successfully encoded {} tokens to {} tokens using {} merges.", info.EncodedStringInitialLength, info.EncodedStringLength, info.EncodingIterationCount);
+
+                if (preTokenize)
+                {
+                    BPE::TokenCacheStats cacheStats{};
+
+                    for (const std::optional<BPE::TokenCache<TokenType>>& cache : caches)
+                    {
+                        if (cache.has_value())
+                        {
+                            cacheStats.Hits += cache->Stats().Hits;
+                            cacheStats.Misses += cache->Stats().Misses;
+                            cacheStats.Evictions += cache->Stats().Evictions;
+                            cacheStats.Uncached += cache->Stats().Uncached;
+                        }
+                    }
+
+                    uint64_t lookups{cacheStats.Hits + cacheStats.Misses};
+                    std::println("Token cache: {} hits, {} misses ({:.1f}% hit rate), {} evictions, {} words too long to cache.", cacheStats.Hits, cacheStats.Misses, lookups == 0 ? 0.0 : 100.0 * double(cacheStats.Hits) / double(lookups), cacheStats.Evictions, cacheStats.Uncached);
+                }
+
+                return 0;
+            })};
+
+            if (result != 0)
+            {
+                return result;
+            }
+
+            break;
+        }
+        case BPE::SubCommand::Decode:
+        {
+            std::filesystem::path bpeFilePath{};
+            std::filesystem::path tokenFilePath{};
+            std::filesystem::path outputFilePath{};
+            unsigned threadCount{std::max(std::thread::hardware_concurrency(), 1u)};
+            std::optional<std::pair<uint64_t, uint64_t>> range{};
+            bool stream{false};
+            size_t chunkSize{BPE::DEFAULT_STREAM_CHUNK_SIZE};
+
+            while (args.size() > 0)
+            {
+                std::string_view arg{args.front()};
+                args.pop();
+
+                if (arg == "-o")
+                {
+                    outputFilePath = args.front();
+                    args.pop();
+                }
+                else if (arg == "-b")
+                {
+                    bpeFilePath = args.front();
+                    args.pop();
+                }
+                else if (arg == "-t")
+                {
+                    tokenFilePath = args.front();
+                    args.pop();
+                }
+                else if (arg == "-c")
+                {
+                    // A container holds both the table and the tokens
+                    bpeFilePath = args.front();
+                    tokenFilePath = args.front();
+                    args.pop();
+                }
+                else if (arg == "-j")
+                {
+                    std::optional<unsigned> parsedThreadCount{ParseThreadCount(args.front())};
+                    if (!parsedThreadCount.has_value())
+                    {
+                        return 1;
+                    }
+
+                    threadCount = parsedThreadCount.value();
+                    args.pop();
+                }
+                else if (arg == "--range")
+                {
+                    range = ParseRange(args.front());
+                    if (!range.has_value())
+                    {
+                        return 1;
+                    }
+
+                    args.pop();
+                }
+                else if (arg == "--stream")
+                {
+                    stream = true;
+                }
+                else if (arg == "--chunk-size")
+                {
+                    std::optional<uint64_t> chunkKib{ParseMergeCount(args.front(), "Chunk size")};
+                    if (!chunkKib.has_value())
+                    {
+                        return 1;
+                    }
+
+                    chunkSize = size_t(chunkKib.value()) * 1024;
+                    args.pop();
+                }
+                else
+                {
+                    std::println("ERROR: Unknown option '{}'", arg);
+                    PrintUsage(programName, subCommand);
+                    return 1;
+                }
+            }
+
+            if (bpeFilePath.empty())
+            {
+                std::println(stderr, "ERROR: Missing option '-b <file>' or '-c <file>'");
+                PrintUsage(programName, subCommand);
+                return 1;
+            }
+
+            if (tokenFilePath.empty())
+            {
+                std::println(stderr, "ERROR: Missing option '-t <file>' or '-c <file>'");
+                PrintUsage(programName, subCommand);
+                return 1;
+            }
+
+            if (outputFilePath.empty())
+            {
+                std::println(stderr, "ERROR: Missing option '-o <file>'");
+                PrintUsage(programName, subCommand);
+                return 1;
+            }
+
+            stream = stream || tokenFilePath == "-" || outputFilePath == "-";
+
+            if (stream && range.has_value())
+            {
+                std::println(stderr, "ERROR: Option '--range' needs a container, it cannot be combined with streaming");
+                PrintUsage(programName, subCommand);
+                return 1;
+            }
+
+            std::expected<BPE::TokenWidth, std::string> tokenWidth{BPE::TryReadTokenWidth(bpeFilePath)};
+            if (!tokenWidth.has_value())
+            {
+                std::println(stderr, "{}", tokenWidth.error());
+                return 1;
+            }
+
+            int result{WithTokenType(tokenWidth.value(), [&]<typename TokenType>() -> int
+            {
+                std::expected<BPE::MappedFile<std::pair<TokenType, TokenType>>, std::string> bpeTable{BPE::TryMapBpeTable<TokenType>(bpeFilePath)};
+                if (!bpeTable.has_value())
+                {
+                    std::println(stderr, "{}", bpeTable.error());
+                    return 1;
+                }
+
+                std::expected<BPE::DecodeTable, std::string> decodeTable{BPE::TryBuildDecodeTable(bpeTable.value().Span())};
+                if (!decodeTable.has_value())
+                {
+                    std::println(stderr, "{}", decodeTable.error());
+                    return 1;
+                }
+
+                if (stream)
+                {
+                    std::ifstream tokenFile{};
+                    std::ofstream outputFile{};
+
+                    if (tokenFilePath != "-")
+                    {
+                        tokenFile.open(tokenFilePath, std::ios::binary);
+
+                        if (tokenFile.is_open() == false)
+                        {
+                            std::println(stderr, "ERROR: Unable to open token file at path \"{}\"", tokenFilePath.c_str());
+                            return 1;
+                        }
+                    }
+
+                    if (outputFilePath != "-")
+                    {
+                        outputFile.open(outputFilePath, std::ios::binary);
+
+                        if (outputFile.is_open() == false)
+                        {
+                            std::println(stderr, "ERROR: Unable to open or create output file at path \"{}\"", outputFilePath.c_str());
+                            return 1;
+                        }
+                    }
+
+                    std::expected<BPE::BpeDecodingResultInfo, std::string> streamResult{BPE::TryDecodeStream<TokenType>(decodeTable.value(), tokenFilePath == "-" ? std::cin : tokenFile, outputFilePath == "-" ? std::cout : outputFile, chunkSize)};
+                    if (!streamResult.has_value())
+                    {
+                        std::println(stderr, "{}", streamResult.error());
+                        return 1;
+                    }
+
+                    // The text may be going to stdout
+                    BPE::BpeDecodingResultInfo info{streamResult.value()};
+                    std::println(stderr, "Successfully decoded {} tokens to {} bytes.", info.EncodedStringLength, info.DecodedStringLength);
+
+                    return 0;
+                }
+
+                std::expected<BPE::FileMapping, std::string> tokenFile{BPE::FileMapping::TryMap(tokenFilePath)};
+                if (!tokenFile.has_value())
+                {
+                    std::println(stderr, "{}", tokenFile.error());
+                    return 1;
+                }
+
+                // A range only decodes the blocks of the container's block index that overlap it
+                if (range.has_value())
+                {
+                    auto [start, length]{range.value()};
+
+                    std::expected<std::string, std::string> text{BPE::TryDecodeContainerRange<TokenType>(tokenFile.value().Bytes(), decodeTable.value(), start, length)};
+                    if (!text.has_value())
+                    {
+                        std::println(stderr, "{}", text.error());
+                        return 1;
+                    }
+
+                    std::expected<void, std::string> writeResult{BPE::TryWriteBasicStringToFile(text.value(), outputFilePath)};
+                    if (!writeResult.has_value())
+                    {
+                        std::println(stderr, "{}", writeResult.error());
+                        return 1;
+                    }
+
+                    std::println("Successfully decoded bytes {} to {} of the text.", start, start + length);
+
+                    return 0;
+                }
+
+                // Compact tokens are decompressed into memory first, raw tokens are decoded straight from the mapping
+                std::basic_string<TokenType> decompressedTokens{};
+                std::optional<BPE::MappedFile<TokenType>> rawTokens{};
+                std::span<const TokenType> tokens{};
+                std::span<const std::byte> tokenBytes{tokenFile.value().Bytes()};
+                bool containerTokens{false};
+
+                if (BPE::IsContainerFile(tokenBytes))
+                {
+                    std::expected<BPE::ContainerHeader, std::string> header{BPE::TryReadContainerHeader(tokenBytes)};
+                    if (!header.has_value())
+                    {
+                        std::println(stderr, "{}", header.error());
+                        return 1;
+                    }
+
+                    if (header.value().Width != BPE::TOKEN_WIDTH<TokenType>)
+                    {
+                        std::println(stderr, "ERROR: Container \"{}\" holds {}-bit tokens, not {}-bit tokens", tokenFilePath.c_str(), 8 * size_t(header.value().Width), 8 * sizeof(TokenType));
+                        return 1;
+                    }
+
+                    bool compactSection{BPE::HasContainerSection(tokenBytes, BPE::SectionType::CompactTokens)};
 
-            default:
-                throw std::runtime_error("Subcommand not implemented");
-                break;
-        }
-    }
+                    std::expected<std::span<const std::byte>, std::string> section{BPE::TryGetContainerSection(tokenBytes, compactSection ? BPE::SectionType::CompactTokens : BPE::SectionType::Tokens)};
+                    if (!section.has_value())
+                    {
+                        std::println(stderr, "{}", section.error());
+                        return 1;
+                    }
 
-    std::println("\t-h, --help\t Print this help message");
-    std::println();
-}
+                    tokenBytes = section.value();
 
-int main(int argc, char* argv[])
-{
-    BPE::SubCommand subCommand{BPE::SubCommand::NONE};
+                    // Sections are aligned, so raw tokens are used in place
+                    if (!compactSection)
+                    {
+                        tokens = {reinterpret_cast<const TokenType*>(tokenBytes.data()), tokenBytes.size() / sizeof(TokenType)};
+                        containerTokens = true;
+                    }
+                }
 
-    std::string_view programName{argv[0]};
+                // Raw container tokens already point into the container's mapping
+                if (!containerTokens)
+                {
+                    if (BPE::IsCompactTokenFile(tokenBytes))
+                    {
+                        std::expected<std::basic_string<TokenType>, std::string> readResult{BPE::TryReadCompactTokens<TokenType>(tokenBytes, threadCount)};
+                        if (!readResult.has_value())
+                        {
+                            std::println(stderr, "{}", readResult.error());
+                            return 1;
+                        }
 
-    std::queue<std::string_view> args{argv + 1, argv + argc};
+                        decompressedTokens = std::move(readResult.value());
+                        tokens = decompressedTokens;
+                    }
+                    else
+                    {
+                        std::expected<BPE::MappedFile<TokenType>, std::string> mapResult{BPE::TryMapFile<TokenType>(tokenFilePath)};
+                        if (!mapResult.has_value())
+                        {
+                            std::println(stderr, "{}", mapResult.error());
+                            return 1;
+                        }
 
-    if (args.size() <= 0)
-    {
-        std::println(stderr, "ERROR: Missing command");
-        PrintUsage(programName);
-        return 1;
-    }
+                        rawTokens.emplace(std::move(mapResult.value()));
+                        tokens = rawTokens.value().Span();
+                    }
+                }
 
-    std::string_view subCommandArg{args.front()};
-    args.pop();
+                // Decodes straight into the mapped output file, without holding the decoded text in memory
+                std::expected<BPE::BpeDecodingResultInfo, std::string> decodeResult{BPE::TryDecodeToFileParallel(tokens, decodeTable.value(), outputFilePath, threadCount)};
+                if (!decodeResult.has_value())
+                {
+                    std::println(stderr, "{}", decodeResult.error());
+                    return 1;
+                }
 
-    if (subCommandArg == "encode") subCommand = BPE::SubCommand::Encode;
-    else if (subCommandArg == "decode") subCommand = BPE::SubCommand::Decode;
-    else if (subCommandArg == "inspect") subCommand = BPE::SubCommand::Inspect;
-    else if (subCommandArg == "generate") subCommand = BPE::SubCommand::Generate;
-    else if (subCommandArg == "-h" || subCommandArg == "--help")
-    {
-        PrintUsage(programName);
-        return 0;
-    }
-    else
-    {
-        std::println(stderr, "ERROR: Unknown command {}", subCommandArg);
-        PrintUsage(programName);
-        return 1;
-    }
+                BPE::BpeDecodingResultInfo info{decodeResult.value()};
 
-    if (args.size() > 0 && (args.front() == "-h" || args.front() == "--help"))
-    {
-        PrintUsage(programName, subCommand);
-        return 0;
-    }
+                std::println("Successfully decoded {} tokens to {} tokens.", info.EncodedStringLength, info.DecodedStringLength);
 
-    switch (subCommand)
-    {
-        case BPE::SubCommand::Encode:
+                return 0;
+            })};
+
+            if (result != 0)
+            {
+                return result;
+            }
+
+            break;
+        }
+        case BPE::SubCommand::Inspect:
         {
-            std::filesystem::path inputFilePath{};
             std::filesystem::path bpeFilePath{};
-            std::filesystem::path tokenFilePath{};
 
             while (args.size() > 0)
             {
                 std::string_view arg{args.front()};
                 args.pop();
 
-                if (arg == "-i")
-                {
-                    inputFilePath = args.front();
-                    args.pop();
-                }
-                else if (arg == "-b")
+                if (arg == "-b")
                 {
                     bpeFilePath = args.front();
                     args.pop();
                 }
-                else if (arg == "-t")
-                {
-                    tokenFilePath = args.front();
-                    args.pop();
-                }
                 else
                 {
                     std::println("ERROR: Unknown option '{}'", arg);
@@ -156,13 +1591,6 @@ int main(int argc, char* argv[])
                 }
             }
 
-            if (inputFilePath.empty())
-            {
-                std::println(stderr, "ERROR: Missing option '-i <file>'");
-                PrintUsage(programName, subCommand);
-                return 1;
-            }
-
             if (bpeFilePath.empty())
             {
                 std::println(stderr, "ERROR: Missing option '-b <file>'");
@@ -170,48 +1598,47 @@ int main(int argc, char* argv[])
                 return 1;
             }
 
-            std::expected<std::string, std::string> inputData{BPE::TryReadFileIntoContainer<std::string>(inputFilePath)};
-            if (!inputData.has_value())
-            {
-                std::println(stderr, "{}", inputData.error());
-                return 1;
-            }
-
-            auto [bpeTable, encodedString, info]{BPE::EncodeText(inputData.value())};
-
-            std::expected<void, std::string> writeBpeTableResult = BPE::TryWriteBasicStringToFile(bpeTable, bpeFilePath);
-            if (!writeBpeTableResult.has_value())
+            std::expected<BPE::TokenWidth, std::string> tokenWidth{BPE::TryReadTokenWidth(bpeFilePath)};
+            if (!tokenWidth.has_value())
             {
-                std::println(stderr, "{}", writeBpeTableResult.error());
+                std::println(stderr, "{}", tokenWidth.error());
                 return 1;
             }
 
-            if (!tokenFilePath.empty())
+            int result{WithTokenType(tokenWidth.value(), [&]<typename TokenType>() -> int
             {
-                std::expected<void, std::string> writeTokensResult = BPE::TryWriteBasicStringToFile(encodedString, tokenFilePath);
-                if (!writeTokensResult.has_value())
+                std::expected<BPE::MappedFile<std::pair<TokenType, TokenType>>, std::string> bpeTable{BPE::TryMapBpeTable<TokenType>(bpeFilePath)};
+                if (!bpeTable.has_value())
                 {
-                    std::println(stderr, "{}", writeTokensResult.error());
+                    std::println(stderr, "{}", bpeTable.error());
                     return 1;
                 }
-            }
 
-            if (tokenFilePath.empty())
-            {
-                std::println("Successfully encoded in {} iterations.", info.EncodingIterationCount);
-            }
-            else
+                std::expected<BPE::FileMapping, std::string> bpeFile{BPE::FileMapping::TryMap(bpeFilePath)};
+                if (bpeFile.has_value() && BPE::IsContainerFile(bpeFile.value().Bytes()))
+                {
+                    BPE::PrintContainerSummary(bpeFile.value().Bytes());
+                }
+
+                BPE::PrintBpeTable(bpeTable.value().Span());
+
+                return 0;
+            })};
+
+            if (result != 0)
             {
-                std::println("Succesfully encoded {} tokens to {} tokens in {} iterations.", info.EncodedStringInitialLength, info.EncodedStringLength, info.EncodingIterationCount);
+                return result;
             }
 
             break;
         }
-        case BPE::SubCommand::Decode:
+        case BPE::SubCommand::Generate:
         {
             std::filesystem::path bpeFilePath{};
-            std::filesystem::path tokenFilePath{};
             std::filesystem::path outputFilePath{};
+            long long tokenCount{10};
+            uint64_t seed{std::random_device{}()};
+            bool quiet{false};
 
             while (args.size() > 0)
             {
@@ -228,11 +1655,48 @@ int main(int argc, char* argv[])
                     bpeFilePath = args.front();
                     args.pop();
                 }
-                else if (arg == "-t")
+                else if (arg == "-c")
                 {
-                    tokenFilePath = args.front();
+                    try
+                    {
+                        tokenCount = std::stoll(args.front().data(), nullptr, 0);
+                    }
+                    catch (std::invalid_argument const& ex)
+                    {
+                        std::println("ERROR: Unable to parse {} to int", args.front());
+                        return 1;
+                    }
+                    catch (std::out_of_range const& ex)
+                    {
+                        std::println("ERROR: Token count was out of range");
+                        return 1;
+                    }
+
+                    args.pop();
+                }
+                else if (arg == "-s")
+                {
+                    try
+                    {
+                        seed = std::stoull(args.front().data(), nullptr, 0);
+                    }
+                    catch (std::invalid_argument const& ex)
+                    {
+                        std::println("ERROR: Unable to parse {} to int", args.front());
+                        return 1;
+                    }
+                    catch (std::out_of_range const& ex)
+                    {
+                        std::println("ERROR: Seed was out of range");
+                        return 1;
+                    }
+
                     args.pop();
                 }
+                else if (arg == "-q")
+                {
+                    quiet = true;
+                }
                 else
                 {
                     std::println("ERROR: Unknown option '{}'", arg);
@@ -241,57 +1705,94 @@ int main(int argc, char* argv[])
                 }
             }
 
-            if (bpeFilePath.empty())
+            if (tokenCount <= 0)
             {
-                std::println(stderr, "ERROR: Missing option '-b <file>'");
-                PrintUsage(programName, subCommand);
+                std::println("ERROR: Token count should be greater than zero.");
                 return 1;
             }
 
-            if (tokenFilePath.empty())
+            if (bpeFilePath.empty())
             {
-                std::println(stderr, "ERROR: Missing option '-t <file>'");
+                std::println(stderr, "ERROR: Missing option '-b <file>'");
                 PrintUsage(programName, subCommand);
                 return 1;
             }
 
-            if (outputFilePath.empty())
+            std::expected<BPE::TokenWidth, std::string> tokenWidth{BPE::TryReadTokenWidth(bpeFilePath)};
+            if (!tokenWidth.has_value())
             {
-                std::println(stderr, "ERROR: Missing option '-o <file>'");
-                PrintUsage(programName, subCommand);
+                std::println(stderr, "{}", tokenWidth.error());
                 return 1;
             }
 
-            std::expected<std::vector<std::pair<BPE::TOKEN, BPE::TOKEN>>, std::string> bpeTable{BPE::TryReadFileIntoContainer<std::vector<std::pair<BPE::TOKEN, BPE::TOKEN>>>(bpeFilePath)};
-            if (!bpeTable.has_value())
+            int result{WithTokenType(tokenWidth.value(), [&]<typename TokenType>() -> int
             {
-                std::println(stderr, "{}", bpeTable.error());
-                return 1;
-            }
+                std::expected<BPE::MappedFile<std::pair<TokenType, TokenType>>, std::string> bpeTable{BPE::TryMapBpeTable<TokenType>(bpeFilePath)};
+                if (!bpeTable.has_value())
+                {
+                    std::println(stderr, "{}", bpeTable.error());
+                    return 1;
+                }
 
-            std::expected<std::basic_string<BPE::TOKEN>, std::string> tokens{BPE::TryReadFileIntoContainer<std::basic_string<BPE::TOKEN>>(tokenFilePath)};
-            if (!tokens.has_value())
-            {
-                std::println(stderr, "{}", tokens.error());
-                return 1;
-            }
+                if (quiet)
+                {
+                    std::ofstream outputFile{};
+
+                    if (outputFilePath.empty() == false)
+                    {
+                        outputFile.open(outputFilePath, std::ios::binary);
+
+                        if (outputFile.is_open() == false)
+                        {
+                            std::println(stderr, "ERROR: Unable to open or create output file at path \"{}\"", outputFilePath.c_str());
+                            return 1;
+                        }
+                    }
+
+                    std::expected<uint64_t, std::string> generatedTokenCount{BPE::TryGenerateToStream(bpeTable.value().Span(), uint64_t(tokenCount), seed, outputFilePath.empty() ? std::cout : outputFile)};
+                    if (!generatedTokenCount.has_value())
+                    {
+                        std::println(stderr, "{}", generatedTokenCount.error());
+                        return 1;
+                    }
+
+                    return 0;
+                }
+
+                std::println("Seed: {}", seed);
+
+                std::basic_string<TokenType> generatedTokenString{BPE::GenerateTokenString(bpeTable.value().Span(), uint(std::min<long long>(tokenCount, UINT_MAX)), seed)};
+
+                auto [decodedString, _]{BPE::DecodeString<TokenType>(generatedTokenString, bpeTable.value().Span())};
+
+                if (outputFilePath.empty())
+                {
+                    std::println("{}", decodedString);
+                    return 0;
+                }
+
+                std::expected<void, std::string> writeResult{BPE::TryWriteBasicStringToFile(decodedString, outputFilePath)};
+                if (!writeResult.has_value())
+                {
+                    std::println(stderr, "{}", writeResult.error());
+                    return 1;
+                }
 
-            auto [decodedString, info]{BPE::DecodeString(tokens.value(), bpeTable.value())};
+                return 0;
+            })};
 
-            std::expected<void, std::string> writeStringResult{BPE::TryWriteBasicStringToFile(decodedString, outputFilePath)};
-            if (!writeStringResult.has_value())
+            if (result != 0)
             {
-                std::println(stderr, "{}", writeStringResult.error());
-                return 1;
+                return result;
             }
 
-            std::println("Successfully decoded {} tokens to {} tokens.", info.EncodedStringLength, info.DecodedStringLength);
-
             break;
         }
-        case BPE::SubCommand::Inspect:
+        case BPE::SubCommand::Serve:
         {
             std::filesystem::path bpeFilePath{};
+            BPE::ServeOptions serveOptions{};
+            serveOptions.ThreadCount = std::max(std::thread::hardware_concurrency(), 1u);
 
             while (args.size() > 0)
             {
@@ -303,9 +1804,25 @@ int main(int argc, char* argv[])
                     bpeFilePath = args.front();
                     args.pop();
                 }
+                else if (arg == "--socket")
+                {
+                    serveOptions.SocketPath = args.front();
+                    args.pop();
+                }
+                else if (arg == "-j")
+                {
+                    std::optional<unsigned> threadCount{ParseThreadCount(args.front())};
+                    if (!threadCount.has_value())
+                    {
+                        return 1;
+                    }
+
+                    serveOptions.ThreadCount = threadCount.value();
+                    args.pop();
+                }
                 else
                 {
-                    std::println("ERROR: Unknown option '{}'", arg);
+                    std::println(stderr, "ERROR: Unknown option '{}'", arg);
                     PrintUsage(programName, subCommand);
                     return 1;
                 }
@@ -318,90 +1835,130 @@ int main(int argc, char* argv[])
                 return 1;
             }
 
-            std::expected<std::vector<std::pair<BPE::TOKEN, BPE::TOKEN>>, std::string> bpeTable{BPE::TryReadFileIntoContainer<std::vector<std::pair<BPE::TOKEN, BPE::TOKEN>>>(bpeFilePath)};
-            if (!bpeTable.has_value())
+            std::expected<BPE::TokenWidth, std::string> tokenWidth{BPE::TryReadTokenWidth(bpeFilePath)};
+            if (!tokenWidth.has_value())
             {
-                std::println(stderr, "{}", bpeTable.error());
+                std::println(stderr, "{}", tokenWidth.error());
                 return 1;
             }
 
-            BPE::PrintBpeTable(bpeTable.value());
+            int result{WithTokenType(tokenWidth.value(), [&]<typename TokenType>() -> int
+            {
+                std::expected<BPE::MappedFile<std::pair<TokenType, TokenType>>, std::string> bpeTable{BPE::TryMapBpeTable<TokenType>(bpeFilePath)};
+                if (!bpeTable.has_value())
+                {
+                    std::println(stderr, "{}", bpeTable.error());
+                    return 1;
+                }
+
+                std::expected<void, std::string> serveResult{BPE::TryServe<TokenType>(bpeTable.value().Span(), serveOptions)};
+                if (!serveResult.has_value())
+                {
+                    std::println(stderr, "{}", serveResult.error());
+                    return 1;
+                }
+
+                return 0;
+            })};
+
+            if (result != 0)
+            {
+                return result;
+            }
 
             break;
         }
-        case BPE::SubCommand::Generate:
+        case BPE::SubCommand::Compile:
         {
             std::filesystem::path bpeFilePath{};
             std::filesystem::path outputFilePath{};
-            int tokenCount{10};
 
             while (args.size() > 0)
             {
                 std::string_view arg{args.front()};
                 args.pop();
 
-                if (arg == "-o")
-                {
-                    outputFilePath = args.front();
-                    args.pop();
-                }
-                else if (arg == "-b")
+                if (arg == "-b")
                 {
                     bpeFilePath = args.front();
                     args.pop();
                 }
-                else if (arg == "-c")
+                else if (arg == "-o")
                 {
-                    try
-                    {
-                        tokenCount = std::stoi(args.front().data(), nullptr, 0);
-                    }
-                    catch (std::invalid_argument const& ex)
-                    {
-                        std::println("ERROR: Unable to parse {} to int", args.front());
-                        return 1;
-                    }
-                    catch (std::out_of_range const& ex)
-                    {
-                        std::println("ERROR: Token count was out of range");
-                        return 1;
-                    }
-
+                    outputFilePath = args.front();
                     args.pop();
                 }
                 else
                 {
-                    std::println("ERROR: Unknown option '{}'", arg);
+                    std::println(stderr, "ERROR: Unknown option '{}'", arg);
                     PrintUsage(programName, subCommand);
                     return 1;
                 }
             }
 
-            if (tokenCount <= 0)
+            if (bpeFilePath.empty())
             {
-                std::println("ERROR: Token count should be greater than zero.");
+                std::println(stderr, "ERROR: Missing option '-b <file>'");
+                PrintUsage(programName, subCommand);
                 return 1;
             }
 
-            if (bpeFilePath.empty())
+            if (outputFilePath.empty())
             {
-                std::println(stderr, "ERROR: Missing option '-b <file>'");
+                std::println(stderr, "ERROR: Missing option '-o <file>'");
                 PrintUsage(programName, subCommand);
                 return 1;
             }
 
-            std::expected<std::vector<std::pair<BPE::TOKEN, BPE::TOKEN>>, std::string> bpeTable{BPE::TryReadFileIntoContainer<std::vector<std::pair<BPE::TOKEN, BPE::TOKEN>>>(bpeFilePath)};
-            if (!bpeTable.has_value())
+            std::expected<BPE::TokenWidth, std::string> tokenWidth{BPE::TryReadTokenWidth(bpeFilePath)};
+            if (!tokenWidth.has_value())
             {
-                std::println(stderr, "{}", bpeTable.error());
+                std::println(stderr, "{}", tokenWidth.error());
                 return 1;
             }
 
-            std::basic_string<BPE::TOKEN> generatedTokenString{BPE::GenerateTokenString(bpeTable.value(), tokenCount)};
+            int result{WithTokenType(tokenWidth.value(), [&]<typename TokenType>() -> int
+            {
+                std::expected<BPE::MappedFile<std::pair<TokenType, TokenType>>, std::string> bpeTable{BPE::TryMapBpeTable<TokenType>(bpeFilePath)};
+                if (!bpeTable.has_value())
+                {
+                    std::println(stderr, "{}", bpeTable.error());
+                    return 1;
+                }
+
+                std::expected<BPE::CompiledEncoder<TokenType>, std::string> encoder{BPE::CompiledEncoder<TokenType>::TryCompile(bpeTable.value().Span())};
+                if (!encoder.has_value())
+                {
+                    std::println(stderr, "{}", encoder.error());
+                    return 1;
+                }
+
+                std::span<const std::pair<TokenType, TokenType>> merges{bpeTable.value().Span()};
+                const BPE::CompiledEncoderHeader& header{encoder.value().Header()};
+                std::string metadata{std::format("table={}\nnodes={}\nedges={}\n", bpeFilePath.c_str(), header.NodeCount, header.EdgeCount)};
 
-            auto [decodedString, _]{BPE::DecodeString(generatedTokenString, bpeTable.value())};
+                const BPE::ContainerSectionSource sources[]{
+                    {BPE::SectionType::MergeTable, std::as_bytes(merges)},
+                    {BPE::SectionType::CompiledEncoder, encoder.value().Bytes()},
+                    {BPE::SectionType::Metadata, std::as_bytes(std::span<const char>{metadata})},
+                };
 
-            std::println("{}", decodedString);
+                std::expected<void, std::string> writeResult{BPE::TryWriteContainerSections(outputFilePath, BPE::TOKEN_WIDTH<TokenType>, BPE::FIRST_TOKEN<TokenType> + merges.size(), 0, sources)};
+                if (!writeResult.has_value())
+                {
+                    std::println(stderr, "{}", writeResult.error());
+                    return 1;
+                }
+
+                std::println("Successfully compiled {} merges into an encoder of {} nodes ({} bytes).", merges.size(), header.NodeCount, encoder.value().Bytes().size());
+
+                return 0;
+            })};
+
+            if (result != 0)
+            {
+                return result;
+            }
 
             break;
         }
@@ -0,0 +1,43 @@
+#include "Container.h"
+#include "Test.h"
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace
+{
+    uint64_t ChecksumOf(std::string_view text)
+    {
+        return BPE::Checksum(std::as_bytes(std::span{text}));
+    }
+} //namespace
+
+// Published XXH64 values for seed 0, covering the tail-only path (below 32 bytes) and the four-lane path
+BPE_TEST(ChecksumMatchesXxh64Vectors)
+{
+    CHECK(ChecksumOf("") == 0xEF46DB3751D8E999ull);
+    CHECK(ChecksumOf("a") == 0xD24EC4F1A98C6E5Bull);
+    CHECK(ChecksumOf("abc") == 0x44BC2CF5AD770999ull);
+    CHECK(ChecksumOf("xxhash") == 0x32DD38952C4BC720ull);
+    CHECK(ChecksumOf("Nobody inspects the spammish repetition") == 0xFBCEA83C8A378BF1ull);
+}
+
+// Every byte value four times and a 3-byte tail, against the reference implementation
+BPE_TEST(ChecksumMatchesXxh64OnLongInput)
+{
+    std::string text{};
+
+    for (size_t repetition{0}; repetition < 4; ++repetition)
+    {
+        for (size_t byte{0}; byte < 256; ++byte)
+        {
+            text.push_back(char(byte));
+        }
+    }
+
+    text += "xyz";
+
+    CHECK(ChecksumOf(text) == 0xE146CB31B65BC21Aull);
+}
@@ -0,0 +1,112 @@
+#include "CompactTokens.h"
+#include "Test.h"
+#include "TestData.h"
+
+#include <cstddef>
+#include <cstring>
+#include <span>
+#include <string>
+
+namespace
+{
+    template <typename TokenType>
+    bool RoundTrips(const std::basic_string<TokenType>& tokens, size_t vocabularySize)
+    {
+        std::expected<std::string, std::string> file{BPE::TryEncodeCompactTokens<TokenType>(tokens, vocabularySize, 2)};
+        if (!file.has_value())
+        {
+            return false;
+        }
+
+        std::span<const std::byte> bytes{std::as_bytes(std::span<const char>{file.value()})};
+        std::expected<std::basic_string<TokenType>, std::string> decoded{BPE::TryReadCompactTokens<TokenType>(bytes, 2)};
+
+        return BPE::IsCompactTokenFile(bytes) && decoded.has_value() && decoded.value() == tokens;
+    }
+
+    template <typename TokenType>
+    void CheckEncodedTextRoundTrips()
+    {
+        auto [bpeTable, tokens, info]{BPE::EncodeText<TokenType>(BPE::Test::SampleText(100000), {.MaxMerges = 100})};
+
+        CHECK(RoundTrips<TokenType>(tokens, BPE::FIRST_TOKEN<TokenType> + bpeTable.size() / 2));
+        CHECK(RoundTrips<TokenType>({}, BPE::FIRST_TOKEN<TokenType> + bpeTable.size() / 2));
+        CHECK(RoundTrips<TokenType>(tokens.substr(0, 1), BPE::FIRST_TOKEN<TokenType> + bpeTable.size() / 2));
+    }
+} //namespace
+
+BPE_TEST(CompactTokensRoundTripEveryWidth)
+{
+    CheckEncodedTextRoundTrips<char8_t>();
+    CheckEncodedTextRoundTrips<char16_t>();
+    CheckEncodedTextRoundTrips<char32_t>();
+}
+
+// More distinct tokens than the code has symbols, so most of them are escaped
+BPE_TEST(CompactTokensRoundTripEscapedTokens)
+{
+    std::u16string tokens{};
+
+    for (size_t i{0}; i < 50000; ++i)
+    {
+        tokens.push_back(char16_t(i * 7919 % 40000));
+    }
+
+    CHECK(RoundTrips<char16_t>(tokens, 40000));
+}
+
+BPE_TEST(CompactTokensRejectTokensOutsideTheTable)
+{
+    std::u16string tokens{u"À"};
+
+    CHECK(!BPE::TryEncodeCompactTokens<char16_t>(tokens, 0x300, 1).has_value());
+}
+
+BPE_TEST(CompactTokensWriteEmptyInputToFile)
+{
+    BPE::Test::TemporaryFile file{"empty.tok"};
+
+    REQUIRE(BPE::TryWriteCompactTokenFile<char16_t>({}, 256, file.Path(), 1).has_value());
+
+    std::expected<std::string, std::string> bytes{BPE::TryReadFileIntoContainer<std::string>(file.Path())};
+    REQUIRE(bytes.has_value());
+
+    std::expected<std::u16string, std::string> decoded{BPE::TryReadCompactTokens<char16_t>(std::as_bytes(std::span<const char>{bytes.value()}), 1)};
+    CHECK(decoded.has_value() && decoded.value().empty());
+}
+
+// Tokens spread evenly over a large vocabulary, where the Huffman code plus escapes would be larger than raw tokens
+BPE_TEST(CompactTokensFallBackToPackedCoding)
+{
+    std::u16string tokens{};
+
+    for (size_t i{0}; i < 100000; ++i)
+    {
+        tokens.push_back(char16_t(i * 7919 % 8800));
+    }
+
+    std::expected<std::string, std::string> file{BPE::TryEncodeCompactTokens<char16_t>(tokens, 8800, 2)};
+    REQUIRE(file.has_value());
+
+    BPE::CompactTokenHeader header{};
+    std::memcpy(&header, file.value().data(), sizeof(header));
+
+    CHECK(header.Coding == BPE::CompactCoding::Packed);
+    CHECK(file.value().size() < tokens.size() * sizeof(char16_t));
+    CHECK(RoundTrips<char16_t>(tokens, 8800));
+}
+
+// Skewed token frequencies keep the Huffman code
+BPE_TEST(CompactTokensKeepHuffmanCodingForSkewedTokens)
+{
+    auto [bpeTable, tokens, info]{BPE::EncodeText<char16_t>(BPE::Test::SampleText(100000), {.MaxMerges = 100})};
+
+    std::expected<std::string, std::string> file{BPE::TryEncodeCompactTokens<char16_t>(tokens, BPE::FIRST_TOKEN<char16_t> + bpeTable.size() / 2, 1)};
+    REQUIRE(file.has_value());
+
+    BPE::CompactTokenHeader header{};
+    std::memcpy(&header, file.value().data(), sizeof(header));
+
+    CHECK(header.Coding == BPE::CompactCoding::Huffman);
+    CHECK(file.value().size() < tokens.size() * sizeof(char16_t) / 2);
+}
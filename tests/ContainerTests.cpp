@@ -0,0 +1,104 @@
+#include "BlockIndex.h"
+#include "CompactTokens.h"
+#include "Container.h"
+#include "MappedFile.h"
+#include "Test.h"
+#include "TestData.h"
+
+#include <cstring>
+#include <span>
+#include <string>
+
+namespace
+{
+    // Writes the text's encoding to a container, then decodes it back whole and in ranges the way `decode -c` does
+    template <typename TokenType>
+    void CheckContainerRoundTrips(const std::string& text, bool compactTokens)
+    {
+        auto [bpeTable, tokens, info]{BPE::EncodeText<TokenType>(text, {.MaxMerges = 200})};
+        std::span<const std::pair<TokenType, TokenType>> merges{BPE::Test::Merges(bpeTable)};
+
+        BPE::Test::TemporaryFile file{std::format("container_{}_{}_{}.bpec", sizeof(TokenType), compactTokens, text.size())};
+        REQUIRE(BPE::TryWriteContainerFile<TokenType>(file.Path(), bpeTable, tokens, compactTokens, "metadata", 64, 2).has_value());
+
+        std::expected<BPE::FileMapping, std::string> mapping{BPE::FileMapping::TryMap(file.Path())};
+        REQUIRE(mapping.has_value());
+        std::span<const std::byte> container{mapping.value().Bytes()};
+        REQUIRE(BPE::TryReadContainerHeader(container).has_value());
+
+        std::expected<std::span<const std::byte>, std::string> tableSection{BPE::TryGetContainerSection(container, BPE::SectionType::MergeTable)};
+        REQUIRE(tableSection.has_value());
+        CHECK(tableSection.value().size() == bpeTable.size() * sizeof(TokenType));
+        CHECK(std::memcmp(tableSection.value().data(), bpeTable.data(), tableSection.value().size()) == 0);
+
+        std::expected<std::span<const std::byte>, std::string> tokenSection{BPE::TryGetContainerSection(container, compactTokens ? BPE::SectionType::CompactTokens : BPE::SectionType::Tokens)};
+        REQUIRE(tokenSection.has_value());
+
+        std::basic_string<TokenType> storedTokens{};
+
+        if (compactTokens)
+        {
+            std::expected<std::basic_string<TokenType>, std::string> readResult{BPE::TryReadCompactTokens<TokenType>(tokenSection.value(), 2)};
+            REQUIRE(readResult.has_value());
+            storedTokens = readResult.value();
+        }
+        else
+        {
+            storedTokens.resize(tokenSection.value().size() / sizeof(TokenType));
+            std::memcpy(storedTokens.data(), tokenSection.value().data(), tokenSection.value().size());
+        }
+
+        CHECK(storedTokens == tokens);
+
+        std::expected<BPE::DecodeTable, std::string> decodeTable{BPE::TryBuildDecodeTable<TokenType>(merges)};
+        REQUIRE(decodeTable.has_value());
+        CHECK(std::get<0>(BPE::DecodeString<TokenType>(storedTokens, decodeTable.value())) == text);
+
+        // Empty ranges, single bytes and ranges crossing blocks, at both ends of the text
+        for (uint64_t start : {uint64_t(0), uint64_t(text.size() / 3), uint64_t(text.size())})
+        {
+            for (uint64_t length : {uint64_t(0), uint64_t(1), uint64_t(1000)})
+            {
+                length = std::min<uint64_t>(length, text.size() - start);
+
+                std::expected<std::string, std::string> range{BPE::TryDecodeContainerRange<TokenType>(container, decodeTable.value(), start, length)};
+                CHECK(range.has_value() && range.value() == text.substr(start, length));
+            }
+        }
+
+        CHECK(!BPE::TryDecodeContainerRange<TokenType>(container, decodeTable.value(), text.size(), 1).has_value());
+    }
+
+    template <typename TokenType>
+    void CheckEveryTokenStorage()
+    {
+        for (bool compactTokens : {false, true})
+        {
+            CheckContainerRoundTrips<TokenType>(BPE::Test::SampleText(20000), compactTokens);
+            CheckContainerRoundTrips<TokenType>("", compactTokens);
+        }
+    }
+} //namespace
+
+BPE_TEST(ContainerRoundTripEveryWidth)
+{
+    CheckEveryTokenStorage<char8_t>();
+    CheckEveryTokenStorage<char16_t>();
+    CheckEveryTokenStorage<char32_t>();
+}
+
+BPE_TEST(ContainerRejectsCorruptSection)
+{
+    std::string text{BPE::Test::SampleText(5000)};
+    auto [bpeTable, tokens, info]{BPE::EncodeText<char16_t>(text, {.MaxMerges = 50})};
+
+    BPE::Test::TemporaryFile file{"corrupt.bpec"};
+    REQUIRE(BPE::TryWriteContainerFile<char16_t>(file.Path(), bpeTable, tokens, false, "", 0, 1).has_value());
+
+    std::expected<std::string, std::string> bytes{BPE::TryReadFileIntoContainer<std::string>(file.Path())};
+    REQUIRE(bytes.has_value());
+    bytes.value()[bytes.value().size() - 1] ^= 1;
+
+    std::span<const std::byte> container{std::as_bytes(std::span<const char>{bytes.value()})};
+    CHECK(!BPE::TryGetContainerSection(container, BPE::SectionType::Tokens).has_value());
+}
@@ -0,0 +1,169 @@
+#include "CompiledEncoder.h"
+#include "Core.h"
+#include "ParallelApply.h"
+#include "Test.h"
+#include "TestData.h"
+#include "TokenCache.h"
+
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // Applies the table to the text through every encoder and compares with the tokens training produced
+    template <typename TokenType>
+    void CheckApplyMatchesTraining(const std::string& text, const std::basic_string<TokenType>& bpeTable, const std::basic_string<TokenType>& trainedTokens)
+    {
+        std::span<const std::pair<TokenType, TokenType>> merges{BPE::Test::Merges(bpeTable)};
+
+        auto [appliedTokens, info]{BPE::ApplyBpeTable<TokenType>(text, merges)};
+        CHECK(appliedTokens == trainedTokens);
+
+        std::expected<BPE::CompiledEncoder<TokenType>, std::string> compiled{BPE::CompiledEncoder<TokenType>::TryCompile(merges)};
+        REQUIRE(compiled.has_value());
+
+        BPE::CompiledScratch scratch{};
+        std::basic_string<TokenType> compiledTokens(text.size(), TokenType{0});
+        std::expected<size_t, std::string> tokenCount{compiled.value().TryEncodeInto(std::as_bytes(std::span{text}), scratch, compiledTokens)};
+        REQUIRE(tokenCount.has_value());
+        compiledTokens.resize(tokenCount.value());
+        CHECK(compiledTokens == trainedTokens);
+
+        std::expected<BPE::DecodeTable, std::string> decodeTable{BPE::TryBuildDecodeTable<TokenType>(merges)};
+        REQUIRE(decodeTable.has_value());
+        CHECK(std::get<0>(BPE::DecodeString<TokenType>(trainedTokens, decodeTable.value())) == text);
+    }
+
+    // Trains with every engine and thread count, in memory and out of core, and expects the same table and tokens
+    template <typename TokenType>
+    void CheckEnginesTrainTheSameTable(const std::string& text, uint64_t maxMerges)
+    {
+        auto [bpeTable, tokens, info]{BPE::EncodeTextIncremental<TokenType>(text, {.MaxMerges = maxMerges})};
+        CHECK(!bpeTable.empty());
+
+        for (unsigned threadCount : {1u, 4u})
+        {
+            auto [legacyTable, legacyTokens, legacyInfo]{BPE::EncodeTextLegacy<TokenType>(text, {.ThreadCount = threadCount, .MaxMerges = maxMerges})};
+            CHECK(legacyTable == bpeTable);
+            CHECK(legacyTokens == tokens);
+            CHECK(legacyInfo.TableFull == info.TableFull);
+
+            auto [incrementalTable, incrementalTokens, incrementalInfo]{BPE::EncodeTextIncremental<TokenType>(text, {.ThreadCount = threadCount, .MaxMerges = maxMerges})};
+            CHECK(incrementalTable == bpeTable);
+            CHECK(incrementalTokens == tokens);
+        }
+
+        BPE::Test::TemporaryFile input{std::format("differential_{}_{}.txt", sizeof(TokenType), text.size())};
+        BPE::Test::TemporaryFile tokenOutput{std::format("differential_{}_{}.tok", sizeof(TokenType), text.size())};
+        std::ofstream{input.Path(), std::ios::binary} << text;
+
+        // A limit of one byte spills every merge, the larger one hands over to the incremental engine part way
+        for (uint64_t memoryLimit : {uint64_t(1), uint64_t(text.size() * 8)})
+        {
+            auto result{BPE::TryEncodeFileOutOfCore<TokenType>(input.Path(), tokenOutput.Path(), {.MemoryLimit = memoryLimit, .MaxMerges = maxMerges})};
+            REQUIRE(result.has_value());
+            CHECK(std::get<0>(result.value()) == bpeTable);
+
+            std::expected<std::basic_string<TokenType>, std::string> outOfCoreTokens{BPE::TryReadFileIntoContainer<std::basic_string<TokenType>>(tokenOutput.Path())};
+            CHECK(outOfCoreTokens.has_value() && outOfCoreTokens.value() == tokens);
+        }
+
+        CheckApplyMatchesTraining<TokenType>(text, bpeTable, tokens);
+    }
+
+    // Pre-tokenized training never merges across words, so only word by word application gives its tokens back
+    template <typename TokenType>
+    void CheckWordsApplyLikeTraining(const std::string& text)
+    {
+        auto [bpeTable, tokens, info]{BPE::EncodeTextWords<TokenType>(text, {.PreTokenize = true, .MaxMerges = 200})};
+        BPE::PairRanks<TokenType> ranks{BPE::BuildPairRanks<TokenType>(BPE::Test::Merges(bpeTable))};
+
+        // A cache too small to hold every word also exercises eviction
+        for (size_t cacheSize : {size_t(8), BPE::DEFAULT_TOKEN_CACHE_SIZE})
+        {
+            BPE::ApplyScratch<TokenType> scratch{};
+            BPE::TokenCache<TokenType> cache{cacheSize};
+            std::basic_string<TokenType> appliedTokens(text.size(), TokenType{0});
+
+            std::expected<size_t, std::string> tokenCount{BPE::TryApplyBpeTableWordsInto<TokenType>(std::as_bytes(std::span{text}), ranks, scratch, cache, appliedTokens)};
+            REQUIRE(tokenCount.has_value());
+            appliedTokens.resize(tokenCount.value());
+            CHECK(appliedTokens == tokens);
+        }
+    }
+
+    // Encodes the text split over threadCount threads and returns the tokens in the order they were written
+    template <typename TokenType>
+    std::optional<std::basic_string<TokenType>> ApplyParallel(std::span<const std::pair<TokenType, TokenType>> merges, const BPE::CompiledEncoder<TokenType>& encoder, const std::string& text, unsigned threadCount)
+    {
+        std::vector<BPE::CompiledScratch> scratches(threadCount);
+        std::basic_string<TokenType> tokens{};
+
+        auto encodeChunk{[&](std::span<const std::byte> chunk, std::span<TokenType> output, unsigned worker)
+        {
+            return encoder.TryEncodeInto(chunk, scratches[worker], output);
+        }};
+
+        auto write{[&](std::span<const TokenType> chunkTokens) -> std::expected<void, std::string>
+        {
+            tokens.append(chunkTokens.begin(), chunkTokens.end());
+            return {};
+        }};
+
+        if (!BPE::TryApplyBpeTableParallel<TokenType>(merges, text, false, encodeChunk, write, threadCount).has_value())
+        {
+            return std::nullopt;
+        }
+
+        return tokens;
+    }
+} //namespace
+
+BPE_TEST(DifferentialEnginesTrainTheSameTable)
+{
+    CheckEnginesTrainTheSameTable<char16_t>(BPE::Test::SampleText(200000), 150);
+    CheckEnginesTrainTheSameTable<char32_t>(BPE::Test::SampleText(200000, 2), 150);
+}
+
+// Narrow tokens run out of room after 128 merges, every engine has to stop at the same point
+BPE_TEST(DifferentialEnginesFillTheNarrowTable)
+{
+    CheckEnginesTrainTheSameTable<char8_t>(BPE::Test::SampleText(200000, 3), 0);
+}
+
+BPE_TEST(DifferentialWordsApplyLikeTraining)
+{
+    CheckWordsApplyLikeTraining<char8_t>(BPE::Test::SampleText(50000));
+    CheckWordsApplyLikeTraining<char16_t>(BPE::Test::SampleText(50000));
+    CheckWordsApplyLikeTraining<char32_t>(BPE::Test::SampleText(50000));
+}
+
+// The input is large enough to be split into several chunks, which have to encode like the whole text
+BPE_TEST(DifferentialThreadCountsApplyAndDecodeTheSame)
+{
+    std::string text{BPE::Test::SampleText(3 * BPE::MINIMUM_APPLY_CHUNK_SIZE + 12345)};
+    auto [bpeTable, tokens, info]{BPE::EncodeText<char16_t>(BPE::Test::SampleText(100000), {.MaxMerges = 300})};
+    std::span<const std::pair<char16_t, char16_t>> merges{BPE::Test::Merges(bpeTable)};
+
+    std::expected<BPE::CompiledEncoder<char16_t>, std::string> compiled{BPE::CompiledEncoder<char16_t>::TryCompile(merges)};
+    REQUIRE(compiled.has_value());
+
+    auto [wholeTokens, wholeInfo]{BPE::ApplyBpeTable<char16_t>(text, merges)};
+
+    for (unsigned threadCount : {1u, 4u})
+    {
+        std::optional<std::basic_string<char16_t>> parallelTokens{ApplyParallel<char16_t>(merges, compiled.value(), text, threadCount)};
+        CHECK(parallelTokens.has_value() && parallelTokens.value() == wholeTokens);
+    }
+
+    std::expected<BPE::DecodeTable, std::string> decodeTable{BPE::TryBuildDecodeTable<char16_t>(merges)};
+    REQUIRE(decodeTable.has_value());
+
+    for (unsigned threadCount : {1u, 4u})
+    {
+        CHECK(std::get<0>(BPE::DecodeStringParallel<char16_t>(wholeTokens, decodeTable.value(), threadCount)) == text);
+    }
+}
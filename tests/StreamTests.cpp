@@ -0,0 +1,78 @@
+#include "Stream.h"
+#include "Test.h"
+#include "TestData.h"
+
+#include <sstream>
+#include <string>
+
+namespace
+{
+    // Streams the text through the table in chunks of chunkSize bytes and compares with applying it to the whole text
+    template <typename TokenType>
+    bool StreamsLikeWholeText(const std::basic_string<TokenType>& bpeTable, const std::string& text, size_t chunkSize)
+    {
+        auto [wholeTokens, wholeInfo]{BPE::ApplyBpeTable<TokenType>(text, BPE::Test::Merges(bpeTable))};
+
+        std::istringstream input{text};
+        std::ostringstream output{};
+
+        if (!BPE::TryApplyBpeTableStream<TokenType>(BPE::Test::Merges(bpeTable), input, output, chunkSize).has_value())
+        {
+            return false;
+        }
+
+        std::string streamed{output.str()};
+
+        return streamed.size() == wholeTokens.size() * sizeof(TokenType) && streamed.compare(0, streamed.size(), reinterpret_cast<const char*>(wholeTokens.data()), streamed.size()) == 0;
+    }
+
+    // Decodes the raw tokens in chunks and compares with the text
+    template <typename TokenType>
+    bool DecodeStreamsBack(const std::basic_string<TokenType>& bpeTable, const std::string& text, size_t chunkSize)
+    {
+        auto [tokens, info]{BPE::ApplyBpeTable<TokenType>(text, BPE::Test::Merges(bpeTable))};
+        std::expected<BPE::DecodeTable, std::string> decodeTable{BPE::TryBuildDecodeTable<TokenType>(BPE::Test::Merges(bpeTable))};
+
+        std::istringstream input{std::string{reinterpret_cast<const char*>(tokens.data()), tokens.size() * sizeof(TokenType)}};
+        std::ostringstream output{};
+
+        return decodeTable.has_value() && BPE::TryDecodeStream<TokenType>(decodeTable.value(), input, output, chunkSize).has_value() && output.str() == text;
+    }
+
+    template <typename TokenType>
+    void CheckStreamingMatchesWholeText()
+    {
+        std::string text{BPE::Test::SampleText(30000)};
+        auto [bpeTable, tokens, info]{BPE::EncodeText<TokenType>(text, {.MaxMerges = 100})};
+
+        for (size_t chunkSize : {size_t(1), size_t(7), size_t(4096), size_t(1 << 20)})
+        {
+            CHECK(StreamsLikeWholeText<TokenType>(bpeTable, text, chunkSize));
+            CHECK(StreamsLikeWholeText<TokenType>(bpeTable, "", chunkSize));
+            CHECK(DecodeStreamsBack<TokenType>(bpeTable, text, chunkSize));
+        }
+    }
+} //namespace
+
+BPE_TEST(StreamMatchesWholeTextEveryWidth)
+{
+    CheckStreamingMatchesWholeText<char8_t>();
+    CheckStreamingMatchesWholeText<char16_t>();
+    CheckStreamingMatchesWholeText<char32_t>();
+}
+
+// A run of one byte has no position every encoding splits at, only the cut at a line break ends the window
+BPE_TEST(StreamCutsLongRunsOfOneByte)
+{
+    std::string text{};
+
+    for (size_t line{0}; line < 20; ++line)
+    {
+        text += std::string(3000 + line, 'a') + "\n";
+    }
+
+    auto [bpeTable, tokens, info]{BPE::EncodeText<char16_t>(std::string(4096, 'a'), {.MaxMerges = 5})};
+
+    CHECK(StreamsLikeWholeText<char16_t>(bpeTable, text, 64));
+    CHECK(StreamsLikeWholeText<char16_t>(bpeTable, text, 1));
+}
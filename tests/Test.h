@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+/*
+ * A minimal test registry, so the tests need nothing beyond the library. BPE_TEST defines and registers a test, CHECK
+ * records a failed expression and lets the test carry on, REQUIRE also ends the test.
+ */
+namespace BPE::Test
+{
+    struct TestCase
+    {
+        std::string_view Name;
+        void (*Run)();
+    };
+
+    std::vector<TestCase>& Registry();
+
+    struct Registrar
+    {
+        Registrar(std::string_view name, void (*run)())
+        {
+            Registry().push_back({name, run});
+        }
+    };
+
+    // Returns false, so REQUIRE can return from the test
+    bool Fail(std::string_view expression, const char* file, int line);
+} //namespace BPE::Test
+
+#define BPE_TEST(name) \
+    static void name(); \
+    static const BPE::Test::Registrar name##Registrar{#name, name}; \
+    static void name()
+
+#define CHECK(expression) ((expression) ? true : BPE::Test::Fail(#expression, __FILE__, __LINE__))
+#define REQUIRE(expression) \
+    if (!CHECK(expression)) \
+    { \
+        return; \
+    }
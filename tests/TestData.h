@@ -0,0 +1,69 @@
+#pragma once
+
+#include "BPE.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <utility>
+
+// Inputs shared by the tests, deterministic so a failure reproduces
+namespace BPE::Test
+{
+    // 7-bit text of words drawn from a small vocabulary, so it suits every token width and has plenty to merge
+    inline std::string SampleText(size_t size, uint64_t seed = 1)
+    {
+        constexpr std::string_view words[]{"the ", "byte ", "pair ", "encoding ", "of ", "a ", "text ", "merges ", "tokens, ", "and\n", "again. ", "x9 "};
+
+        std::string text{};
+        uint64_t state{seed};
+
+        while (text.size() < size)
+        {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            text += words[(state >> 33) % std::size(words)];
+        }
+
+        text.resize(size);
+
+        return text;
+    }
+
+    // The merges of a flat table as EncodeText returns it
+    template <typename TokenType>
+    std::span<const std::pair<TokenType, TokenType>> Merges(const std::basic_string<TokenType>& bpeTable)
+    {
+        return {reinterpret_cast<const std::pair<TokenType, TokenType>*>(bpeTable.data()), bpeTable.size() / 2};
+    }
+
+    // A path in the temporary directory that no other test process uses, removed when it goes out of scope
+    class TemporaryFile
+    {
+    public:
+        explicit TemporaryFile(std::string_view name)
+            : m_Path{std::filesystem::temp_directory_path() / std::format("bpe_tests_{}_{}", ::getpid(), name)}
+        {
+        }
+
+        ~TemporaryFile()
+        {
+            std::error_code error{};
+            std::filesystem::remove(m_Path, error);
+        }
+
+        TemporaryFile(const TemporaryFile&) = delete;
+        TemporaryFile& operator=(const TemporaryFile&) = delete;
+
+        const std::filesystem::path& Path() const
+        {
+            return m_Path;
+        }
+
+    private:
+        std::filesystem::path m_Path;
+    };
+} //namespace BPE::Test
@@ -0,0 +1,59 @@
+#include "Test.h"
+
+#include <cstdio>
+#include <print>
+#include <string_view>
+
+namespace
+{
+    size_t failureCount{0};
+} //namespace
+
+std::vector<BPE::Test::TestCase>& BPE::Test::Registry()
+{
+    static std::vector<BPE::Test::TestCase> registry{};
+    return registry;
+}
+
+bool BPE::Test::Fail(std::string_view expression, const char* file, int line)
+{
+    std::println(stderr, "{}:{}: CHECK({}) failed", file, line, expression);
+    ++failureCount;
+
+    return false;
+}
+
+// Runs every test whose name contains the first argument, or all of them
+int main(int argc, char** argv)
+{
+    std::string_view filter{argc > 1 ? argv[1] : ""};
+    size_t testCount{0};
+    size_t failedTestCount{0};
+
+    for (const BPE::Test::TestCase& test : BPE::Test::Registry())
+    {
+        if (test.Name.find(filter) == std::string_view::npos)
+        {
+            continue;
+        }
+
+        size_t failuresBefore{failureCount};
+        test.Run();
+        ++testCount;
+
+        bool passed{failureCount == failuresBefore};
+        failedTestCount += passed ? 0 : 1;
+
+        std::println("{} {}", passed ? "PASS" : "FAIL", test.Name);
+    }
+
+    if (testCount == 0)
+    {
+        std::println(stderr, "ERROR: No test matches \"{}\"", filter);
+        return 1;
+    }
+
+    std::println("{} of {} tests passed", testCount - failedTestCount, testCount);
+
+    return failedTestCount == 0 ? 0 : 1;
+}